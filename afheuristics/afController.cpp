@@ -0,0 +1,391 @@
+#include "afController.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Ratio of the lowest to the highest value seen above which a sweep that
+// reached the end of the lens found nothing (see benchmark.py).
+#define FLAT_RATIO 0.8
+
+// Moves to estimated peaks, at most : each value measured at one refines
+// the fit, until the lens is where the fit says.
+#define MAXIMUM_JUMPS 4
+
+HillClimbDecisions::HillClimbDecisions( double dropRatio )
+	: dropRatio( dropRatio )
+{
+}
+
+int
+HillClimbDecisions::firstDirection( double first, double second,
+									double third, double normalizedPosition )
+{
+	return third >= first ? +1 : -1;
+}
+
+AfAction
+HillClimbDecisions::sweepAction( const AfSweep &sweep )
+{
+	int best = 0;
+	for (int i = 1; i < sweep.count; i++)
+		if ( sweep.values[i] > sweep.values[best] )
+			best = i;
+
+	if ( sweep.values[sweep.count - 1] >= dropRatio * sweep.values[best] )
+		return AfContinue;
+
+	// Only downhill from the start : the peak is on the other side, unless
+	// that side was swept already.
+	return best == 0 && !sweep.backtracked ? AfBacktrack : AfTurnPeak;
+}
+
+AfController::AfController( AfDecisions &decisions, int coarseStep,
+							int fineStep )
+	: decisions( decisions ), coarseStep( coarseStep ), fineStep( fineStep ),
+	  peakFit( NoPeakFit ), fitSamples( 3 ), stepCount( 0 ), state( Idle )
+{
+}
+
+void
+AfController::setPeakFit( PeakFit fit, int samples )
+{
+	peakFit = fit;
+	fitSamples = samples;
+}
+
+void
+AfController::start( int position, int stepCount )
+{
+	this->stepCount = stepCount;
+	values.assign( stepCount, 0 );
+	firstVisit.assign( stepCount, -1 );
+	sweepValues.assign( stepCount + 1, 0 );
+	visitedPositions.assign( stepCount, 0 );
+	visitedValues.assign( stepCount, 0 );
+
+	initialPosition = position;
+	lensPosition = position;
+	stepsTaken = 0;
+	recent[0] = recent[1] = recent[2] = -1;
+	measured = false;
+	state = FirstSteps;
+	remaining = 2;
+}
+
+LensCommand
+AfController::onFocusValue( double value )
+{
+	return onFocusValue( value, lensPosition );
+}
+
+LensCommand
+AfController::onFocusValue( double value, int position )
+{
+	if ( state != Idle && state != Done && state != Failure )
+	{
+		lensPosition = position < 0 ? 0 :
+			position >= stepCount ? stepCount - 1 : position;
+		values[lensPosition] = value;
+		if ( firstVisit[lensPosition] < 0 )
+			firstVisit[lensPosition] = stepsTaken;
+		stepsTaken++;
+		recent[2] = recent[1];
+		recent[1] = recent[0];
+		recent[0] = lensPosition;
+		measured = true;
+	}
+	return advance();
+}
+
+LensCommand
+AfController::move( int direction, int size, bool coarse )
+{
+	// Where the lens should end up; the next value may say otherwise.
+	int target = lensPosition + direction * size;
+	lensPosition = target < 0 ? 0 : target >= stepCount ? stepCount - 1 : target;
+
+	LensCommand command = { LensCommand::Move, direction * size, coarse };
+	return command;
+}
+
+bool
+AfController::willHitEdge( int direction ) const
+{
+	return (lensPosition <= 0 && direction < 0) ||
+		   (lensPosition >= stepCount - 1 && direction > 0);
+}
+
+void
+AfController::startSweep( int direction )
+{
+	this->direction = direction;
+	sweepStart = lensPosition;
+	sweepValues[0] = values[lensPosition];
+	sweepCount = 1;
+	measured = false;
+	state = Sweeping;
+}
+
+void
+AfController::endSweep( AfAction action )
+{
+	if ( action == AfTurnPeak )
+		startGoToMax();
+	else if ( !secondSweep )
+	{
+		// Back to the start of the sweep, and sweep the other way.
+		secondSweep = true;
+		direction = -direction;
+		remaining = sweepCount - 1;
+		state = Returning;
+	}
+	else
+		state = Failure;
+}
+
+AfAction
+AfController::edgeAction() const
+{
+	// The sweep reached the end of the lens without a decision. Either
+	// there is a peak near the end, or everything was flat.
+	double lowest = 0, highest = 0;
+	bool first = true;
+	for (int p = 0; p < stepCount; p++)
+		if ( firstVisit[p] >= 0 )
+		{
+			if ( first || values[p] < lowest )
+				lowest = values[p];
+			if ( first || values[p] > highest )
+				highest = values[p];
+			first = false;
+		}
+	return highest > 0 && lowest > FLAT_RATIO * highest ? AfBacktrack : AfTurnPeak;
+}
+
+void
+AfController::startGoToMax()
+{
+	if ( peakFit != NoPeakFit && startJump() )
+		return;
+
+	// Best position visited, the earliest visited of equal ones.
+	int best = -1;
+	for (int p = 0; p < stepCount; p++)
+		if ( firstVisit[p] >= 0 &&
+			 (best < 0 || values[p] > values[best] ||
+			  (values[p] == values[best] && firstVisit[p] < firstVisit[best])) )
+			best = p;
+
+	if ( best < lensPosition )
+		direction = -1;
+	else if ( best > lensPosition )
+		direction = +1;
+	else
+		direction = lensPosition < recent[1] ? -1 : +1;
+
+	// As many coarse steps as fit before the best position, then fine
+	// steps uphill.
+	remaining = abs( lensPosition - best ) / coarseStep;
+	state = GoingToMax;
+}
+
+bool
+AfController::estimateTarget()
+{
+	int count = 0;
+	for (int p = 0; p < stepCount; p++)
+		if ( firstVisit[p] >= 0 )
+		{
+			visitedPositions[count] = p;
+			visitedValues[count] = values[p];
+			count++;
+		}
+	double peak;
+	if ( !estimatePeak( peakFit, &visitedPositions[0], &visitedValues[0],
+						count, fitSamples, peak ) )
+		return false;
+	target = (int)floor( peak + 0.5 );
+	return true;
+}
+
+bool
+AfController::startJump()
+{
+	if ( !estimateTarget() )
+		return false;
+	jumps = MAXIMUM_JUMPS;
+	measured = false;
+	state = Jumping;
+	return true;
+}
+
+void
+AfController::startClimb( int direction )
+{
+	this->direction = direction;
+	climbStart = lensPosition;
+	measured = false;
+	state = Climbing;
+}
+
+void
+AfController::endClimb()
+{
+	// Nothing better that way : try the other way, once.
+	if ( !secondClimb && lensPosition == climbStart )
+	{
+		secondClimb = true;
+		startClimb( -direction );
+	}
+	else
+		state = Done;
+}
+
+LensCommand
+AfController::advance()
+{
+	for (;;)
+	{
+		switch ( state )
+		{
+			case FirstSteps:
+				if ( remaining > 0 )
+				{
+					remaining--;
+					if ( !willHitEdge( +1 ) )
+						return move( +1, fineStep, false );
+					continue;
+				}
+				{
+					// The last three values, oldest first (fewer if the
+					// lens was at its end).
+					int third = recent[0];
+					int second = recent[1] >= 0 ? recent[1] : third;
+					int first = recent[2] >= 0 ? recent[2] : second;
+					double normalized = stepCount > 1 ?
+						(double)initialPosition / (stepCount - 1) : 0;
+					int direction = decisions.firstDirection(
+						values[first], values[second], values[third],
+						normalized ) < 0 ? -1 : +1;
+					secondSweep = false;
+					startSweep( direction );
+				}
+				continue;
+
+			case Sweeping:
+				if ( measured )
+				{
+					measured = false;
+					sweepValues[sweepCount++] = values[lensPosition];
+
+					// Take at least two steps before turning back.
+					if ( sweepCount >= 3 )
+					{
+						AfSweep sweep = { &sweepValues[0], sweepCount,
+										  stepCount, direction, sweepStart,
+										  lensPosition, secondSweep };
+						AfAction action = decisions.sweepAction( sweep );
+						if ( action != AfContinue )
+						{
+							endSweep( action );
+							continue;
+						}
+					}
+				}
+				if ( !willHitEdge( direction ) &&
+					 sweepCount < (int)sweepValues.size() )
+					return move( direction, coarseStep, true );
+				endSweep( edgeAction() );
+				continue;
+
+			case Returning:
+				if ( remaining > 0 )
+				{
+					remaining--;
+					if ( !willHitEdge( direction ) )
+						return move( direction, coarseStep, true );
+					continue;
+				}
+				startSweep( direction );
+				continue;
+
+			case GoingToMax:
+				if ( remaining > 0 )
+				{
+					remaining--;
+					if ( !willHitEdge( direction ) )
+						return move( direction, coarseStep, true );
+					continue;
+				}
+				secondClimb = false;
+				startClimb( direction );
+				continue;
+
+			case Climbing:
+				if ( measured )
+				{
+					measured = false;
+					if ( values[lensPosition] < previous )
+					{
+						state = SteppingBack;
+						remaining = 1;
+						continue;
+					}
+				}
+				if ( !willHitEdge( direction ) )
+				{
+					previous = values[lensPosition];
+					return move( direction, fineStep, false );
+				}
+				endClimb();
+				continue;
+
+			case SteppingBack:
+				if ( remaining > 0 )
+				{
+					remaining--;
+					if ( !willHitEdge( -direction ) )
+						return move( -direction, fineStep, false );
+					continue;
+				}
+				endClimb();
+				continue;
+
+			case Jumping:
+				// The value where the lens landed (maybe not the target,
+				// after a backlash) is one more sample for the fit.
+				if ( measured )
+				{
+					measured = false;
+					if ( !estimateTarget() )
+					{
+						state = Done;
+						continue;
+					}
+				}
+				if ( lensPosition != target && jumps > 0 )
+				{
+					jumps--;
+					// A jump longer than a fine step drives as coarse steps.
+					int offset = target - lensPosition;
+					return move( offset > 0 ? +1 : -1, abs( offset ),
+								 abs( offset ) > fineStep );
+				}
+				state = Done;
+				continue;
+
+			case Done:
+			{
+				LensCommand found = { LensCommand::Found, 0 };
+				return found;
+			}
+
+			case Idle:
+			case Failure:
+			default:
+			{
+				LensCommand failed = { LensCommand::Failed, 0 };
+				return failed;
+			}
+		}
+	}
+}
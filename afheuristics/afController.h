@@ -0,0 +1,240 @@
+#ifndef _AfController_H
+#define _AfController_H
+
+#include <vector>
+
+#include "peakEstimator.h"
+
+/*
+ * Hill-climbing autofocus, as simulated by benchmark.py : two fine steps,
+ * a choice of direction, a sweep in coarse steps until a peak is passed
+ * (or back to the start and a sweep the other way), then fine steps to
+ * the peak. With a peak fit, the steps back to the peak are replaced by
+ * one move to the peak estimated from the values around the best one.
+ *
+ * The controller never waits : it is given each focus value as it is
+ * measured and answers with the next lens move. It allocates nothing
+ * after start(), so it can run in the live view loop, one frame at a time.
+ *
+ * Lens positions are numbered in fine steps from 0 to stepCount - 1, the
+ * way focusraw/ and focusmeasures/ sweep the lens (kEdsEvfDriveLens_Far1
+ * at each step). Moving right is moving towards far focus.
+ */
+
+enum AfAction
+{
+	AfContinue,
+	AfTurnPeak,			// a peak was passed, go back to it
+	AfBacktrack			// no peak this way, look on the other side
+};
+
+/*
+ * A sweep in progress, as given to AfDecisions::sweepAction.
+ */
+struct AfSweep
+{
+	const double *values;	// focus values since the start of the sweep,
+	int count;				// the start of the sweep included
+	int stepCount;			// lens positions of the lens
+	int direction;			// +1 (right) or -1 (left)
+	int startPosition;		// lens position at the start of the sweep
+	int position;			// current lens position
+	bool backtracked;		// the other side was swept already
+};
+
+/*
+ * The two decisions of the heuristic, made by the decision trees in
+ * benchmark.py (left/right and action trees). Both must not allocate.
+ */
+class AfDecisions
+{
+public:
+	virtual ~AfDecisions() {}
+
+	/*
+	 * Direction of the first sweep (+1 right, -1 left), from the values
+	 * at the initial position (first) and the two fine steps to its right.
+	 * normalizedPosition is the initial position over stepCount - 1.
+	 */
+	virtual int firstDirection( double first, double second, double third,
+								double normalizedPosition ) = 0;
+
+	/*
+	 * What to do after a coarse step of a sweep (at least two steps in).
+	 */
+	virtual AfAction sweepAction( const AfSweep &sweep ) = 0;
+};
+
+/*
+ * Decisions without trees : keep going uphill, turn back once the values
+ * fell well below the best one of the sweep, and backtrack if the sweep
+ * only went down from its start.
+ */
+class HillClimbDecisions : public AfDecisions
+{
+public:
+	/*
+	 * dropRatio : a value below dropRatio times the best value of a sweep
+	 * means the peak was passed.
+	 */
+	HillClimbDecisions( double dropRatio = 0.9 );
+
+	virtual int firstDirection( double first, double second, double third,
+								double normalizedPosition );
+	virtual AfAction sweepAction( const AfSweep &sweep );
+
+private:
+	double dropRatio;
+};
+
+/*
+ * A lens move, or the end of the search.
+ */
+struct LensCommand
+{
+	enum Kind
+	{
+		Move,			// move by steps and measure the focus again
+		Found,			// the lens is at the peak
+		Failed			// no peak on either side
+	};
+
+	Kind kind;
+	int steps;			// fine steps, > 0 to the right (Move only)
+	bool coarse;		// a coarse move, which a backlash throws off
+};
+
+/*
+ * A search for the peak of focus, one lens move at a time : start() from
+ * a lens position, then the focus value measured after each move gives
+ * the next move, until the lens is at a peak (or no peak was found).
+ * AfController is the coarse-fine hill climb; afStrategies.h has others.
+ */
+class AfSearch
+{
+public:
+	virtual ~AfSearch() {}
+
+	virtual void start( int position, int stepCount ) = 0;
+
+	/*
+	 * The next lens move, given the focus value measured after the last
+	 * one, at the position where it was measured.
+	 */
+	virtual LensCommand onFocusValue( double value, int position ) = 0;
+
+	/*
+	 * Number of focus values received since start() (the lens positions
+	 * visited), and whether a position was visited.
+	 */
+	virtual int steps() const = 0;
+	virtual bool visited( int position ) const = 0;
+};
+
+class AfController : public AfSearch
+{
+public:
+	/*
+	 * decisions must outlive the controller. coarseStep is the size of a
+	 * coarse step, and fineStep that of the first steps and of the climb
+	 * to the peak, in lens positions.
+	 */
+	AfController( AfDecisions &decisions, int coarseStep = 8,
+				  int fineStep = 1 );
+
+	/*
+	 * Once a peak was passed, move to the peak estimated from samples
+	 * (3 to 5) of the positions visited around the best one, and stop
+	 * there, instead of climbing to it. If the fit fails (e.g. the best
+	 * position is the last visited on a side), climb as usual.
+	 */
+	void setPeakFit( PeakFit fit, int samples = 3 );
+
+	/*
+	 * Start a search from a lens position. The first focus value given to
+	 * onFocusValue is the one at that position.
+	 */
+	virtual void start( int position, int stepCount );
+
+	/*
+	 * The next lens move, given the focus value measured after the last
+	 * one. The lens is assumed to have moved as told (within the ends of
+	 * the lens), unless the caller knows better and gives the position
+	 * where the value was measured (e.g. a simulation of backlash).
+	 */
+	LensCommand onFocusValue( double value );
+	virtual LensCommand onFocusValue( double value, int position );
+
+	/*
+	 * Current lens position, and number of focus values received since
+	 * start() (the lens positions visited).
+	 */
+	int position() const { return lensPosition; }
+	virtual int steps() const { return stepsTaken; }
+
+	/*
+	 * The latest focus value measured at a visited position.
+	 */
+	double value( int position ) const { return values[position]; }
+	virtual bool visited( int position ) const
+		{ return firstVisit[position] >= 0; }
+
+private:
+	enum State
+	{
+		Idle,
+		FirstSteps,		// two fine steps to the right
+		Sweeping,		// coarse steps until a decision
+		Returning,		// coarse steps back to the start of a sweep
+		GoingToMax,		// coarse steps back towards the best value
+		Climbing,		// fine steps while the values increase
+		SteppingBack,	// one fine step back after a decrease
+		Jumping,		// to the estimated peak
+		Done,
+		Failure
+	};
+
+	LensCommand advance();
+	LensCommand move( int direction, int size, bool coarse );
+	bool willHitEdge( int direction ) const;
+	void startSweep( int direction );
+	void endSweep( AfAction action );
+	AfAction edgeAction() const;
+	void startGoToMax();
+	bool estimateTarget();
+	bool startJump();
+	void startClimb( int direction );
+	void endClimb();
+
+	AfDecisions &decisions;
+	int coarseStep;
+	int fineStep;
+	PeakFit peakFit;
+	int fitSamples;
+	int stepCount;
+	State state;
+
+	int initialPosition;
+	int lensPosition;
+	int stepsTaken;
+	int recent[3];				// last three positions visited, latest first
+	std::vector<double> values;	// latest value at each position
+	std::vector<int> firstVisit;// step of the first visit, -1 if none
+
+	int direction;				// of the current sweep or climb
+	int remaining;				// moves left in the current state
+	bool measured;				// a value answered the last move
+	bool secondSweep;
+	std::vector<double> sweepValues;
+	int sweepCount;
+	int sweepStart;
+	bool secondClimb;
+	int climbStart;
+	double previous;			// value before the last fine step
+	std::vector<int> visitedPositions;	// for the peak fit
+	std::vector<double> visitedValues;
+	int target;					// estimated peak
+	int jumps;					// moves left to reach it
+};
+
+#endif
@@ -0,0 +1,464 @@
+#include "afFeatures.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Parameters of the ratio features, chosen to be symmetrical (0.75 and
+// 1.333 are, 0.75 and 1.25 are not).
+static const int RatioCount = 15;
+static const double Ratios[RatioCount] = {
+	1.64, 1.32, 1.16, 1.08, 1.04, 1.02, 1.01, 1.00,
+	1 / 1.01, 1 / 1.02, 1 / 1.04, 1 / 1.08, 1 / 1.16, 1 / 1.32, 1 / 1.64 };
+static const double Differences[RatioCount] = {
+	-0.64, -0.32, -0.16, -0.08, -0.04, -0.02, -0.01, 0.0,
+	 0.01,  0.02,  0.04,  0.08,  0.16,  0.32,  0.64 };
+
+/*
+ * Families of ratio features, each compared to the 15 parameters above :
+ * the feature is numerator / denominator < k (false if the denominator
+ * is 0), in the order of featuresfirststep.all_features().
+ */
+enum Family
+{
+	Ratio2, LogRatio2, DiffOverAvg2, DiffOverMin2, DiffOverMax2,
+	Ratio3, LogRatio3, DiffOverAvg3, DiffOverMin3, DiffOverMax3,
+	Curving, CurvingRatio,
+	FamilyCount
+};
+
+static const char * const FamilyNames[FamilyCount] = {
+	"ratio2", "log_ratio2", "diff_over_avg2", "diff_over_min2",
+	"diff_over_max2", "ratio3", "log_ratio3", "diff_over_avg3",
+	"diff_over_min3", "diff_over_max3", "curving", "curving_ratio" };
+
+// The two-measure families, then downTrend and upTrend, the three-measure
+// families, and the bracket of the lens position.
+static const int TwoMeasureCount = 5 * RatioCount;
+static const int DownTrend = TwoMeasureCount;
+static const int UpTrend = DownTrend + 1;
+static const int ThreeMeasureStart = UpTrend + 1;
+static const int Bracket = ThreeMeasureStart + 7 * RatioCount;
+static const int FirstStepCount = Bracket + 1;
+
+static const int BracketCount = 5;
+static const double Brackets[BracketCount] = { 0.0, 0.08, 0.20, 0.80, 0.92 };
+
+static inline double
+lesserOf( double a, double b )
+{
+	return a < b ? a : b;
+}
+
+static inline double
+greaterOf( double a, double b )
+{
+	return a > b ? a : b;
+}
+
+// The fraction of a family of ratio features.
+static void
+ratioTerms( int family, double first, double second, double third,
+			double &numerator, double &denominator )
+{
+	switch ( family )
+	{
+		case Ratio2:
+			numerator = first;
+			denominator = second;
+			break;
+		case LogRatio2:
+			numerator = log( first + 1.0 );
+			denominator = log( second + 1.0 );
+			break;
+		case DiffOverAvg2:
+			numerator = 2.0 * (second - first);
+			denominator = second + first;
+			break;
+		case DiffOverMin2:
+			numerator = second - first;
+			denominator = lesserOf( second, first );
+			break;
+		case DiffOverMax2:
+			numerator = second - first;
+			denominator = greaterOf( second, first );
+			break;
+		case Ratio3:
+			numerator = first;
+			denominator = third;
+			break;
+		case LogRatio3:
+			numerator = log( first + 1.0 );
+			denominator = log( third + 1.0 );
+			break;
+		case DiffOverAvg3:
+			numerator = 2.0 * (third - first);
+			denominator = third + first;
+			break;
+		case DiffOverMin3:
+			numerator = third - first;
+			denominator = lesserOf( third, first );
+			break;
+		case DiffOverMax3:
+			numerator = third - first;
+			denominator = greaterOf( third, first );
+			break;
+		case Curving:
+			numerator = first + third - 2 * second;
+			denominator = second;
+			break;
+		default:
+			numerator = first - second;
+			denominator = second - third;
+			break;
+	}
+}
+
+// Family and parameter of a ratio feature.
+static void
+ratioFeature( int feature, int &family, double &k )
+{
+	int index;
+	if ( feature < TwoMeasureCount )
+	{
+		family = Ratio2 + feature / RatioCount;
+		index = feature % RatioCount;
+	}
+	else
+	{
+		family = Ratio3 + (feature - ThreeMeasureStart) / RatioCount;
+		index = (feature - ThreeMeasureStart) % RatioCount;
+	}
+	bool ratio = family == Ratio2 || family == LogRatio2 ||
+				 family == Ratio3 || family == LogRatio3;
+	k = ratio ? Ratios[index] : Differences[index];
+}
+
+int
+FirstStepFeatures::count()
+{
+	return FirstStepCount;
+}
+
+// Names of the first step features, made once.
+struct FirstStepNames
+{
+	char text[FirstStepCount][32];
+
+	FirstStepNames()
+	{
+		for (int f = 0; f < FirstStepCount; f++)
+		{
+			if ( f == DownTrend )
+				snprintf( text[f], sizeof( text[f] ), "downTrend" );
+			else if ( f == UpTrend )
+				snprintf( text[f], sizeof( text[f] ), "upTrend" );
+			else if ( f == Bracket )
+				snprintf( text[f], sizeof( text[f] ), "bracket" );
+			else
+			{
+				int family;
+				double k;
+				ratioFeature( f, family, k );
+				int index = f < TwoMeasureCount ? f % RatioCount :
+					(f - ThreeMeasureStart) % RatioCount;
+				snprintf( text[f], sizeof( text[f] ), "%s_%d",
+						  FamilyNames[family], index );
+			}
+		}
+	}
+};
+
+const char *
+FirstStepFeatures::name( int feature )
+{
+	static FirstStepNames names;
+	return names.text[feature];
+}
+
+int
+FirstStepFeatures::find( const char *name )
+{
+	for (int f = 0; f < FirstStepCount; f++)
+		if ( strcmp( FirstStepFeatures::name( f ), name ) == 0 )
+			return f;
+	return -1;
+}
+
+double
+FirstStepFeatures::value( int feature, double first, double second,
+						  double third, double lensPosition )
+{
+	if ( feature == DownTrend )
+		return first >= second && second >= third;
+	if ( feature == UpTrend )
+		return first <= second && second <= third;
+	if ( feature == Bracket )
+	{
+		for (int i = 0; i < BracketCount - 1; i++)
+			if ( lensPosition >= Brackets[i] && lensPosition < Brackets[i + 1] )
+				return i;
+		return BracketCount - 1;
+	}
+
+	int family;
+	double k;
+	ratioFeature( feature, family, k );
+	double numerator, denominator;
+	ratioTerms( family, first, second, third, numerator, denominator );
+	return denominator != 0 && numerator / denominator < k;
+}
+
+void
+FirstStepFeatures::values( double first, double second, double third,
+						   double lensPosition, double *values )
+{
+	values[DownTrend] = value( DownTrend, first, second, third, lensPosition );
+	values[UpTrend] = value( UpTrend, first, second, third, lensPosition );
+	values[Bracket] = value( Bracket, first, second, third, lensPosition );
+
+	// The families of ratios, skipping the trends.
+	for (int f = 0; f < Bracket; f += RatioCount)
+	{
+		if ( f == DownTrend )
+			f = ThreeMeasureStart;
+
+		int family;
+		double k;
+		ratioFeature( f, family, k );
+		double numerator, denominator;
+		ratioTerms( family, first, second, third, numerator, denominator );
+		for (int i = 0; i < RatioCount; i++)
+		{
+			ratioFeature( f + i, family, k );
+			values[f + i] = denominator != 0 && numerator / denominator < k;
+		}
+	}
+}
+
+/*
+ * Sweep features, in the order of featuresturn.all_features().
+ */
+enum SweepFeature
+{
+	DistanceSwept,
+	Monotonicity, AbsMonotonicity, AlternationRatio,
+	RatioToMax, RatioToRange, DistanceToMax, RatioMinToMax,
+	SimpleSlope, RegressionSlope, SimpleSlopeUp, RegressionSlopeUp,
+	CurrentSlope, CurrentSlopeLarge, CurrentSlopeUp, CurrentSlopeLargeUp,
+	DownslopeFirstHalf, DownslopeSecondHalf,
+	SweepFeatureCount
+};
+
+static const char * const SweepNames[SweepFeatureCount] = {
+	"distance_swept",
+	"monotonicity", "abs_monotonicity", "alternation_ratio",
+	"ratio_to_max", "ratio_to_range", "distance_to_max", "ratio_min_to_max",
+	"simple_slope", "regression_slope", "simple_slope_up",
+	"regression_slope_up",
+	"current_slope", "current_slope_large", "current_slope_up",
+	"current_slope_large_up",
+	"downslope_1st_half", "downslope_2nd_half" };
+
+// Coarse step of the sweeps, in lens positions.
+static const int StepSize = 8;
+
+int
+SweepFeatures::count()
+{
+	return SweepFeatureCount;
+}
+
+const char *
+SweepFeatures::name( int feature )
+{
+	return SweepNames[feature];
+}
+
+// Slope between two values steps apart, normalized by the number of lens
+// positions and by the average of the values.
+static double
+slope( int steps, double f1, double f2, int totalPositions )
+{
+	double normalizedDiff = (double)(steps * StepSize) / totalPositions;
+	double average = (f2 + f1) / 2;
+	return (f2 - f1) / normalizedDiff / average;
+}
+
+// Spearman's rank correlation between the values and their order. The rank
+// of a value is the number of smaller values (equal values share it).
+static double
+monotonicity( const double *values, int n )
+{
+	double mean = (n - 1) / 2.0;
+	double meanRank = 0;
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			meanRank += values[j] < values[i];
+	meanRank /= n;
+
+	double covariance = 0, varianceX = 0, varianceY = 0;
+	for (int i = 0; i < n; i++)
+	{
+		int rank = 0;
+		for (int j = 0; j < n; j++)
+			rank += values[j] < values[i];
+		covariance += (i - mean) * (rank - meanRank);
+		varianceX += (i - mean) * (i - mean);
+		varianceY += (rank - meanRank) * (rank - meanRank);
+	}
+
+	// Neither increasing nor decreasing (rare).
+	if ( varianceY == 0 )
+		return 0;
+	return covariance / sqrt( varianceX * varianceY );
+}
+
+// Proportion of the steps of values[begin, end) that went down.
+static double
+downslope( const double *values, int begin, int end )
+{
+	int count = 0;
+	for (int i = begin; i + 1 < end; i++)
+		count += values[i] > values[i + 1];
+	return (double)count / (end - begin - 1);
+}
+
+// A sweep feature, given the extremes of the values.
+static double
+sweepValue( int feature, const double *values, int n, int totalPositions,
+			double highest, double lowest )
+{
+	double latest = values[n - 1];
+
+	switch ( feature )
+	{
+		case DistanceSwept:
+			return (double)(n - 1) / totalPositions;
+
+		case Monotonicity:
+			return monotonicity( values, n );
+
+		case AbsMonotonicity:
+			return fabs( monotonicity( values, n ) );
+
+		case AlternationRatio:
+		{
+			int count = 0;
+			for (int i = 0; i + 2 < n; i++)
+				count += (values[i] < values[i + 1]) !=
+						 (values[i + 1] < values[i + 2]);
+			return (double)count / (n - 2);
+		}
+
+		case RatioToMax:
+			return latest / highest;
+
+		case RatioToRange:
+			// An in-between value when every value is the same.
+			if ( lowest == highest )
+				return 0.5;
+			return (latest - lowest) / (highest - lowest);
+
+		case DistanceToMax:
+		{
+			int closest = n;
+			for (int i = 0; i < n; i++)
+				if ( values[i] == highest )
+					closest = n - i;
+			return (double)closest / totalPositions;
+		}
+
+		case RatioMinToMax:
+			return lowest / highest;
+
+		case SimpleSlope:
+		case SimpleSlopeUp:
+		{
+			double s = slope( n, values[0], latest, totalPositions );
+			return feature == SimpleSlope ? s : (s < 0 ? 0 : 1);
+		}
+
+		case RegressionSlope:
+		case RegressionSlopeUp:
+		{
+			double meanX = 0, meanY = 0;
+			for (int i = 0; i < n; i++)
+			{
+				meanX += (double)(i * StepSize) / totalPositions;
+				meanY += values[i];
+			}
+			meanX /= n;
+			meanY /= n;
+			double covariance = 0, varianceX = 0;
+			for (int i = 0; i < n; i++)
+			{
+				double x = (double)(i * StepSize) / totalPositions;
+				covariance += (x - meanX) * (values[i] - meanY);
+				varianceX += (x - meanX) * (x - meanX);
+			}
+			double s = covariance / varianceX / meanY;
+			return feature == RegressionSlope ? s : (s < 0 ? 0 : 1);
+		}
+
+		case CurrentSlope:
+		case CurrentSlopeUp:
+		{
+			double s = slope( n, values[n - 2], latest, totalPositions );
+			return feature == CurrentSlope ? s : (s < 0 ? 0 : 1);
+		}
+
+		case CurrentSlopeLarge:
+		case CurrentSlopeLargeUp:
+		{
+			double s = slope( n, values[n - 3], latest, totalPositions );
+			return feature == CurrentSlopeLarge ? s : (s < 0 ? 0 : 1);
+		}
+
+		case DownslopeFirstHalf:
+			return downslope( values, 0, (n + 1) / 2 );
+
+		case DownslopeSecondHalf:
+			return downslope( values, n / 2, n );
+
+		default:
+			return 0;
+	}
+}
+
+static void
+extremes( const double *values, int n, double &highest, double &lowest )
+{
+	highest = values[0];
+	lowest = values[0];
+	for (int i = 1; i < n; i++)
+	{
+		highest = values[i] > highest ? values[i] : highest;
+		lowest = values[i] < lowest ? values[i] : lowest;
+	}
+}
+
+double
+SweepFeatures::value( int feature, const double *values, int n,
+					  int totalPositions )
+{
+	double highest, lowest;
+	extremes( values, n, highest, lowest );
+	return sweepValue( feature, values, n, totalPositions, highest, lowest );
+}
+
+void
+SweepFeatures::values( const double *values, int n, int totalPositions,
+					   double *features )
+{
+	double highest, lowest;
+	extremes( values, n, highest, lowest );
+	double rankCorrelation = monotonicity( values, n );
+	for (int f = 0; f < SweepFeatureCount; f++)
+		if ( f == Monotonicity )
+			features[f] = rankCorrelation;
+		else if ( f == AbsMonotonicity )
+			features[f] = fabs( rankCorrelation );
+		else
+			features[f] = sweepValue( f, values, n, totalPositions, highest,
+									  lowest );
+}
@@ -0,0 +1,61 @@
+#ifndef _AfFeatures_H
+#define _AfFeatures_H
+
+/*
+ * The features of the decision trees, as computed by featuresfirststep.py
+ * (left/right tree) and featuresturn.py (action tree), numbered in the
+ * order of their all_features(). Computing one feature allocates nothing,
+ * so that a tree only computes the features on its path.
+ */
+
+/*
+ * Features of the first three focus values, to choose the direction of
+ * the first sweep. Booleans are 0 or 1, as in the ARFF files.
+ */
+class FirstStepFeatures
+{
+public:
+	static int count();
+	static const char * name( int feature );
+	static int find( const char *name );	// -1 if unknown
+
+	/*
+	 * lensPosition is normalized to [0, 1].
+	 */
+	static double value( int feature, double first, double second,
+						 double third, double lensPosition );
+
+	/*
+	 * Every feature at once, into values[0..count()) : each family of
+	 * ratios is divided once for its 15 parameters.
+	 */
+	static void values( double first, double second, double third,
+						double lensPosition, double *values );
+};
+
+/*
+ * Features of the focus values of a sweep (at least three), to choose
+ * between continuing, turning back to the peak and backtracking.
+ */
+class SweepFeatures
+{
+public:
+	static int count();
+	static const char * name( int feature );
+
+	/*
+	 * values of the sweep so far, its start first; totalPositions is the
+	 * number of lens positions of the lens.
+	 */
+	static double value( int feature, const double *values, int n,
+						 int totalPositions );
+
+	/*
+	 * Every feature at once, into features[0..count()), sharing the
+	 * extremes and the rank correlation of the values.
+	 */
+	static void values( const double *values, int n, int totalPositions,
+						double *features );
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include "afSimulator.h"
+#include "curveStore.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdlib.h>
+
+using namespace std;
+
+// Default parameters of the camera model (see cameramodel.py).
+#define NOISE_FACTOR 0.05
+#define MAXIMUM_BACKLASH 3
+
+int
+AfScene::distanceToPeak( int position ) const
+{
+	int distance = values.size();
+	for (size_t i = 0; i < maxima.size(); i++)
+		distance = min( distance, abs( position - maxima[i] ) );
+	return distance;
+}
+
+// Whether a file name ends with an extension.
+static bool
+hasExtension( const string &name, const string &extension )
+{
+	return name.length() > extension.length() &&
+		name.compare( name.length() - extension.length(),
+					  extension.length(), extension ) == 0;
+}
+
+// The focus values of a scene, the second column of each line.
+static bool
+readValues( const string &fileName, vector<double> &values, string &error )
+{
+	ifstream in( fileName.c_str() );
+	if ( !in )
+	{
+		error = "Could not open scene file " + fileName;
+		return false;
+	}
+	string line;
+	while ( getline( in, line ) )
+	{
+		istringstream columns( line );
+		double position, value;
+		string extra;
+		if ( !(columns >> position >> value) || (columns >> extra) )
+		{
+			error = "Lines of " + fileName + " should have two columns";
+			return false;
+		}
+		values.push_back( value );
+	}
+	if ( values.empty() )
+	{
+		error = "No focus values in " + fileName;
+		return false;
+	}
+	return true;
+}
+
+bool
+loadScenes( const string &folder, const string &maximaFile,
+			const vector<string> &excluded, vector<AfScene> &scenes,
+			string &error )
+{
+	DIR *dir = opendir( folder.c_str() );
+	if ( dir == NULL )
+	{
+		error = "Scenes folder " + folder + " not found";
+		return false;
+	}
+	vector<string> names;
+	struct dirent *entry;
+	while ( (entry = readdir( dir )) != NULL )
+	{
+		string name( entry->d_name );
+		if ( hasExtension( name, ".txt" ) &&
+			 find( excluded.begin(), excluded.end(), name ) == excluded.end() )
+			names.push_back( name );
+	}
+	closedir( dir );
+	sort( names.begin(), names.end() );
+
+	scenes.assign( names.size(), AfScene() );
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		AfScene &scene = scenes[i];
+		scene.fileName = names[i];
+		scene.name = names[i].substr( 0, names[i].rfind( '.' ) );
+		if ( !readValues( folder + "/" + names[i], scene.values, error ) )
+			return false;
+	}
+
+	// Pairs of lines : the file name of a scene, then its peaks.
+	ifstream in( maximaFile.c_str() );
+	if ( !in )
+	{
+		error = "Could not open maxima file " + maximaFile;
+		return false;
+	}
+	string fileName, line;
+	while ( getline( in, fileName ) && getline( in, line ) )
+	{
+		istringstream name( fileName );
+		name >> fileName;
+		for (size_t i = 0; i < scenes.size(); i++)
+			if ( scenes[i].fileName == fileName )
+			{
+				istringstream positions( line );
+				int position;
+				while ( positions >> position )
+					scenes[i].maxima.push_back( position );
+			}
+	}
+
+	for (size_t i = 0; i < scenes.size(); i++)
+		if ( scenes[i].maxima.empty() )
+		{
+			error = "No maxima for " + scenes[i].fileName + " in " + maximaFile;
+			return false;
+		}
+	return true;
+}
+
+bool
+loadStoredScenes( const string &storeFile, int measure, bool normalized,
+				  const vector<string> &excluded, vector<AfScene> &scenes,
+				  string &error )
+{
+	CurveStoreReader store;
+	if ( !store.open( storeFile ) )
+	{
+		error = store.error();
+		return false;
+	}
+	if ( measure < 0 && store.curves() > 0 )
+		measure = store.measure( 0 );
+
+	scenes.clear();
+	for (int i = 0; i < store.curves(); i++)
+	{
+		string fileName = string( store.name( i ) ) + ".txt";
+		if ( store.measure( i ) != measure ||
+			 find( excluded.begin(), excluded.end(), fileName ) != excluded.end() )
+			continue;
+
+		AfScene scene;
+		scene.fileName = fileName;
+		scene.name = store.name( i );
+		const double *values = normalized ? store.normalized( i ) :
+			store.raw( i );
+		scene.values.assign( values, values + store.length( i ) );
+		scene.maxima.assign( store.maxima( i ),
+							 store.maxima( i ) + store.maximaCount( i ) );
+		if ( scene.values.empty() )
+		{
+			error = "No focus values for " + fileName + " in " + storeFile;
+			return false;
+		}
+		if ( scene.maxima.empty() )
+		{
+			error = "No maxima for " + fileName + " in " + storeFile;
+			return false;
+		}
+		scenes.push_back( scene );
+	}
+
+	sort( scenes.begin(), scenes.end(), []( const AfScene &a, const AfScene &b )
+		  { return a.fileName < b.fileName; } );
+	return true;
+}
+
+bool
+AfOutcome::truePositive( const AfScene &scene ) const
+{
+	return found && scene.distanceToPeak( position ) <= 1;
+}
+
+bool
+AfOutcome::falsePositive( const AfScene &scene ) const
+{
+	return found && scene.distanceToPeak( position ) > 1;
+}
+
+AfSimulator::AfSimulator( AfDecisions &decisions, bool backlash, bool noise,
+						  int coarseStep, int fineStep )
+	: decisions( decisions ), backlash( backlash ), noise( noise ),
+	  coarseStep( coarseStep ), fineStep( fineStep ),
+	  maximumBacklash( MAXIMUM_BACKLASH ), noiseFactor( NOISE_FACTOR ),
+	  peakFit( NoPeakFit ), fitSamples( 3 ), strategy( HillClimbStrategy )
+{
+}
+
+void
+AfSimulator::setPeakFit( PeakFit fit, int samples )
+{
+	peakFit = fit;
+	fitSamples = samples;
+}
+
+AfOutcome
+AfSimulator::run( const AfScene &scene, int start, unsigned seed ) const
+{
+	AfSearch *search = newSearch( strategy, decisions, coarseStep, fineStep,
+								  peakFit, fitSamples );
+	AfOutcome outcome = run( *search, scene, start, seed );
+	delete search;
+	return outcome;
+}
+
+AfOutcome
+AfSimulator::run( AfSearch &search, const AfScene &scene, int start,
+				  unsigned seed ) const
+{
+	const vector<double> &values = scene.values;
+	int stepCount = values.size();
+	mt19937 random( seed );
+	uniform_real_distribution<double> unit( 0.0, 1.0 );
+	uniform_int_distribution<int> offset( -maximumBacklash, maximumBacklash );
+	double maxNoise = *min_element( values.begin(), values.end() ) * noiseFactor;
+
+	AfOutcome outcome;
+	outcome.backlashCount = 0;
+	outcome.travel = 0;
+
+	search.start( start, stepCount );
+
+	// The camera starts without a direction : its first move counts as a
+	// change of direction.
+	int position = start;
+	int direction = 0;
+	LensCommand command = search.onFocusValue( values[position], position );
+	while ( command.kind == LensCommand::Move )
+	{
+		int size = abs( command.steps );
+		int moveDirection = command.steps > 0 ? +1 : -1;
+		if ( backlash && moveDirection != direction )
+		{
+			outcome.backlashCount++;
+			// Off by the backlash, but still at least one position on.
+			if ( command.coarse )
+				size = max( 1, size + offset( random ) );
+		}
+		direction = moveDirection;
+
+		int previous = position;
+		position += direction * size;
+		position = position < 0 ? 0 :
+			position >= stepCount ? stepCount - 1 : position;
+		outcome.travel += abs( position - previous );
+		double value = values[position];
+		if ( noise )
+			value += unit( random ) * maxNoise;
+		command = search.onFocusValue( value, position );
+	}
+
+	outcome.found = command.kind == LensCommand::Found;
+	outcome.position = position;
+	outcome.steps = search.steps();
+	outcome.nearPeak = false;
+	for (int p = 0; p < stepCount && !outcome.nearPeak; p++)
+		outcome.nearPeak = search.visited( p ) && scene.distanceToPeak( p ) <= 1;
+	return outcome;
+}
@@ -0,0 +1,120 @@
+#ifndef _AfSimulator_H
+#define _AfSimulator_H
+
+#include <string>
+#include <vector>
+
+#include "afStrategies.h"
+
+/*
+ * The focus values of a scene at every lens position (a file of
+ * focusraw/ or of the low-light folders, or a curve of a curve store), and
+ * its peaks from maxima.txt.
+ */
+struct AfScene
+{
+	std::string fileName;		// e.g. "bench.txt"
+	std::string name;			// without the extension
+	std::vector<double> values;
+	std::vector<int> maxima;
+
+	int distanceToPeak( int position ) const;
+};
+
+/*
+ * Every scene of a folder, sorted by file name, as load_scenes() in
+ * scene.py. Returns false if a scene or the maxima can't be read, or if
+ * a scene has no maxima (see error).
+ */
+bool loadScenes( const std::string &folder, const std::string &maximaFile,
+				 const std::vector<std::string> &excluded,
+				 std::vector<AfScene> &scenes, std::string &error );
+
+/*
+ * The same scenes from a curve store (see curveStore.h, made by makestore
+ * or apply --store), mapped at once : the curves of a measure (that of the
+ * first curve if measure is -1), raw or normalized to [0, 1], with the
+ * maxima stored along.
+ */
+bool loadStoredScenes( const std::string &storeFile, int measure,
+					   bool normalized,
+					   const std::vector<std::string> &excluded,
+					   std::vector<AfScene> &scenes, std::string &error );
+
+/*
+ * How one simulated search ended.
+ */
+struct AfOutcome
+{
+	bool found;				// the controller stopped at a peak
+	int position;			// where the lens ended
+	int steps;				// lens positions visited, the start included
+	int travel;				// lens positions moved over
+	int backlashCount;		// changes of direction
+	bool nearPeak;			// a position visited within one step of a peak
+
+	bool truePositive( const AfScene &scene ) const;
+	bool falsePositive( const AfScene &scene ) const;
+	bool trueNegative() const { return !found && !nearPeak; }
+	bool falseNegative() const { return !found && nearPeak; }
+};
+
+/*
+ * Runs AfController (or another search, see setStrategy) on a scene with
+ * the camera of cameramodel.py : every change of direction is a backlash,
+ * and a coarse move (see LensCommand) that changes direction is off by
+ * up to 3 lens positions, though it still moves at least one position the
+ * way it was asked; fine moves are exact. Every focus value but the first
+ * gets a uniform noise of up to 5% of the scene's lowest value. Both
+ * amounts can be changed, to search strategies for other cameras.
+ *
+ * A simulation only depends on its seed, so simulations can run in any
+ * order and on any thread, as long as the decisions keep no state
+ * (TreeDecisions and HillClimbDecisions don't).
+ */
+class AfSimulator
+{
+public:
+	AfSimulator( AfDecisions &decisions, bool backlash, bool noise,
+				 int coarseStep = 8, int fineStep = 1 );
+
+	/*
+	 * Largest error of a move after a backlash, in lens positions, and
+	 * largest noise, as a fraction of the lowest value of the scene.
+	 */
+	void setMaximumBacklash( int positions ) { maximumBacklash = positions; }
+	void setNoiseFactor( double factor ) { noiseFactor = factor; }
+
+	/*
+	 * The peak fit of the controller (see AfController::setPeakFit).
+	 */
+	void setPeakFit( PeakFit fit, int samples = 3 );
+
+	/*
+	 * The search to run instead of the hill climb (see afStrategies.h).
+	 */
+	void setStrategy( AfStrategy strategy ) { this->strategy = strategy; }
+
+	AfOutcome run( const AfScene &scene, int start, unsigned seed ) const;
+
+	/*
+	 * The same with a search of the caller's, started here, instead of a
+	 * new one of the strategy.
+	 */
+	AfOutcome run( AfSearch &search, const AfScene &scene, int start,
+				   unsigned seed ) const;
+
+private:
+	AfDecisions &decisions;
+	bool backlash;
+	bool noise;
+	int coarseStep;
+	int fineStep;
+	int maximumBacklash;
+	double noiseFactor;
+	PeakFit peakFit;
+	int fitSamples;
+	AfStrategy strategy;
+};
+
+#endif
@@ -0,0 +1,349 @@
+#include "afStrategies.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Moves to reach a probe the lens missed (backlash), at most.
+#define MAXIMUM_CORRECTIONS 2
+
+// Predictions of the predictive search, at most.
+#define MAXIMUM_FITS 6
+
+// Values below this ratio of the best one are past a peak.
+#define DROP_RATIO 0.9
+
+#define INVERSE_GOLDEN_RATIO 0.6180339887498949
+
+const char *
+strategyName( AfStrategy strategy )
+{
+	switch ( strategy )
+	{
+		case GoldenSectionStrategy: return "golden-section";
+		case FibonacciStrategy: return "fibonacci";
+		case PredictiveStrategy: return "predictive";
+		case HillClimbStrategy:
+		default: return "hill-climb";
+	}
+}
+
+bool
+strategyFromName( const std::string &name, AfStrategy &strategy )
+{
+	const AfStrategy strategies[] = { HillClimbStrategy, GoldenSectionStrategy,
+									  FibonacciStrategy, PredictiveStrategy };
+	for (int i = 0; i < 4; i++)
+		if ( name == strategyName( strategies[i] ) )
+		{
+			strategy = strategies[i];
+			return true;
+		}
+	return false;
+}
+
+AfSearch *
+newSearch( AfStrategy strategy, AfDecisions &decisions, int coarseStep,
+		   int fineStep, PeakFit peakFit, int fitSamples )
+{
+	switch ( strategy )
+	{
+		case GoldenSectionStrategy:
+			return new GoldenSectionSearch();
+
+		case FibonacciStrategy:
+			return new FibonacciSearch();
+
+		case PredictiveStrategy:
+			return new PredictiveSearch( coarseStep,
+				peakFit == NoPeakFit ? GaussianFit : peakFit, fitSamples );
+
+		case HillClimbStrategy:
+		default:
+		{
+			AfController *controller = new AfController( decisions, coarseStep,
+														 fineStep );
+			controller->setPeakFit( peakFit, fitSamples );
+			return controller;
+		}
+	}
+}
+
+ProbeSearch::ProbeSearch()
+	: stepCount( 0 ), lensPosition( 0 ), stepsTaken( 0 ),
+	  target( -1 ), corrections( 0 ), finishing( false )
+{
+}
+
+void
+ProbeSearch::start( int position, int stepCount )
+{
+	this->stepCount = stepCount;
+	values.assign( stepCount, 0 );
+	probed.assign( stepCount, false );
+	visits.assign( stepCount, false );
+
+	lensPosition = position;
+	stepsTaken = 0;
+	target = -1;
+	finishing = false;
+	reset();
+}
+
+int
+ProbeSearch::best() const
+{
+	int best = -1;
+	for (int p = 0; p < stepCount; p++)
+		if ( probed[p] && (best < 0 || values[p] > values[best]) )
+			best = p;
+	return best;
+}
+
+LensCommand
+ProbeSearch::moveTo( int target )
+{
+	this->target = target;
+	corrections = MAXIMUM_CORRECTIONS;
+	LensCommand command = { LensCommand::Move, target - lensPosition,
+							abs( target - lensPosition ) > 1 };
+	lensPosition = target;
+	return command;
+}
+
+LensCommand
+ProbeSearch::onFocusValue( double value, int position )
+{
+	if ( stepCount <= 0 )
+	{
+		LensCommand failed = { LensCommand::Failed, 0 };
+		return failed;
+	}
+	lensPosition = position < 0 ? 0 :
+		position >= stepCount ? stepCount - 1 : position;
+	values[lensPosition] = value;
+	probed[lensPosition] = true;
+	visits[lensPosition] = true;
+	stepsTaken++;
+
+	// Off target after a backlash : try again, or make do.
+	if ( target >= 0 && lensPosition != target && corrections > 0 )
+	{
+		corrections--;
+		LensCommand command = { LensCommand::Move, target - lensPosition,
+								abs( target - lensPosition ) > 1 };
+		lensPosition = target;
+		return command;
+	}
+	if ( !finishing )
+	{
+		if ( target >= 0 && !probed[target] )
+		{
+			values[target] = value;
+			probed[target] = true;
+		}
+
+		// Probes known already cost nothing; a search never needs more
+		// than one per position.
+		for (int i = 0; i <= stepCount; i++)
+		{
+			int probe = nextProbe();
+			if ( probe < 0 || probe >= stepCount )
+				break;
+			if ( !probed[probe] )
+				return moveTo( probe );
+		}
+
+		finishing = true;
+		int best = this->best();
+		if ( best != lensPosition )
+			return moveTo( best );
+	}
+
+	LensCommand found = { LensCommand::Found, 0 };
+	return found;
+}
+
+void
+GoldenSectionSearch::reset()
+{
+	low = 0;
+	high = stepCount - 1;
+	int offset = (int)floor( (high - low) * INVERSE_GOLDEN_RATIO + 0.5 );
+	left = high - offset;
+	right = low + offset;
+}
+
+int
+GoldenSectionSearch::nextProbe()
+{
+	for (;;)
+	{
+		// A few positions left : measure them all.
+		if ( high - low < 3 )
+		{
+			for (int p = low; p <= high; p++)
+				if ( !known( p ) )
+					return p;
+			return -1;
+		}
+
+		// Both probes inside the range, apart, for it to shrink.
+		if ( left <= low )
+			left = low + 1;
+		if ( right >= high )
+			right = high - 1;
+		if ( right <= left )
+		{
+			if ( left < high - 1 )
+				right = left + 1;
+			else
+			{
+				right = high - 1;
+				left = high - 2;
+			}
+		}
+		if ( !known( left ) )
+			return left;
+		if ( !known( right ) )
+			return right;
+
+		// Drop the part beyond the lower probe; the other probe is one of
+		// the new ones.
+		int offset;
+		if ( value( left ) >= value( right ) )
+		{
+			high = right;
+			right = left;
+			offset = (int)floor( (high - low) * INVERSE_GOLDEN_RATIO + 0.5 );
+			left = high - offset;
+		}
+		else
+		{
+			low = left;
+			left = right;
+			offset = (int)floor( (high - low) * INVERSE_GOLDEN_RATIO + 0.5 );
+			right = low + offset;
+		}
+	}
+}
+
+void
+FibonacciSearch::reset()
+{
+	// Enough numbers for a range covering the lens.
+	fibonacci.assign( 2, 1 );
+	fibonacci[0] = 0;
+	while ( fibonacci.back() - 1 < stepCount )
+		fibonacci.push_back( fibonacci[fibonacci.size() - 1] +
+							 fibonacci[fibonacci.size() - 2] );
+	index = fibonacci.size() - 1;
+	low = -1;
+}
+
+int
+FibonacciSearch::nextProbe()
+{
+	// Down to a single position.
+	while ( index > 3 )
+	{
+		int left = low + fibonacci[index - 2];
+		int right = low + fibonacci[index - 1];
+		if ( left < stepCount && !known( left ) )
+			return left;
+		if ( right < stepCount && !known( right ) )
+			return right;
+
+		double leftValue = left < stepCount ? value( left ) : -HUGE_VAL;
+		double rightValue = right < stepCount ? value( right ) : -HUGE_VAL;
+		if ( leftValue < rightValue )
+			low = left;
+		index--;
+	}
+	int last = low + 1;
+	return last < stepCount && !known( last ) ? last : -1;
+}
+
+PredictiveSearch::PredictiveSearch( int coarseStep, PeakFit model,
+									int samples )
+	: coarseStep( coarseStep ), model( model ), samples( samples ), fits( 0 )
+{
+}
+
+void
+PredictiveSearch::reset()
+{
+	fits = 0;
+	direction = 0;
+	positions.assign( stepCount, 0 );
+	knownValues.assign( stepCount, 0 );
+}
+
+int
+PredictiveSearch::nextProbe()
+{
+	int count = 0, best = 0;
+	for (int p = 0; p < stepCount; p++)
+		if ( known( p ) )
+		{
+			positions[count] = p;
+			knownValues[count] = value( p );
+			if ( knownValues[count] > knownValues[best] )
+				best = count;
+			count++;
+		}
+	if ( count == 0 )
+		return -1;
+
+	// The best value is a peak once values on both sides fell well below
+	// it (as in HillClimbDecisions); bumps of a flat curve are not.
+	bool fallenLeft = false, fallenRight = false;
+	for (int i = 0; i < count; i++)
+		if ( knownValues[i] < DROP_RATIO * knownValues[best] )
+		{
+			if ( i < best )
+				fallenLeft = true;
+			else
+				fallenRight = true;
+		}
+
+	// Where the model puts the peak, unless it is known.
+	double peak;
+	if ( fallenLeft && fallenRight && fits < MAXIMUM_FITS &&
+		 estimatePeak( model, &positions[0], &knownValues[0], count, samples,
+					   peak ) )
+	{
+		fits++;
+		int probe = (int)floor( peak + 0.5 );
+		if ( !known( probe ) )
+			return probe;
+		fits = MAXIMUM_FITS;
+	}
+
+	// No peak yet : coarse steps past the last position on a side where
+	// the values didn't fall, the side of the sweep first.
+	if ( fits == 0 || !(fallenLeft && fallenRight) )
+	{
+		bool canRight = !fallenRight && positions[count - 1] < stepCount - 1;
+		bool canLeft = !fallenLeft && positions[0] > 0;
+		if ( canRight && (direction > 0 || !canLeft) )
+		{
+			direction = +1;
+			int probe = positions[count - 1] + coarseStep;
+			return probe < stepCount ? probe : stepCount - 1;
+		}
+		if ( canLeft )
+		{
+			direction = -1;
+			int probe = positions[0] - coarseStep;
+			return probe >= 0 ? probe : 0;
+		}
+	}
+
+	// The model is done (or the peak is at an end of the lens) : the best
+	// value must be higher than its neighbours, as a fine climb would end.
+	int bestPosition = positions[best];
+	if ( bestPosition > 0 && !known( bestPosition - 1 ) )
+		return bestPosition - 1;
+	if ( bestPosition < stepCount - 1 && !known( bestPosition + 1 ) )
+		return bestPosition + 1;
+	return -1;
+}
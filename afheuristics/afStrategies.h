@@ -0,0 +1,152 @@
+#ifndef _AfStrategies_H
+#define _AfStrategies_H
+
+#include <string>
+#include <vector>
+
+#include "afController.h"
+#include "peakEstimator.h"
+
+/*
+ * Searches for the peak of focus other than the hill climb of
+ * AfController, to compare them with it on the recorded scenes, and the
+ * choice of one of them by name, at run time.
+ */
+enum AfStrategy
+{
+	HillClimbStrategy,		// AfController
+	GoldenSectionStrategy,
+	FibonacciStrategy,
+	PredictiveStrategy
+};
+
+/*
+ * "hill-climb", "golden-section", "fibonacci" or "predictive", and back.
+ * fromName returns false for other names.
+ */
+const char *strategyName( AfStrategy strategy );
+bool strategyFromName( const std::string &name, AfStrategy &strategy );
+
+/*
+ * A new search of a strategy, to delete once done with. decisions are
+ * those of the hill climb, which also takes the peak fit (see
+ * AfController); the predictive search fits its model with the peak fit
+ * (Gaussian by default). coarseStep is the first step of the predictive
+ * search.
+ */
+AfSearch *newSearch( AfStrategy strategy, AfDecisions &decisions,
+					 int coarseStep = 8, int fineStep = 1,
+					 PeakFit peakFit = NoPeakFit, int fitSamples = 3 );
+
+/*
+ * A search that measures the focus at positions of its choice (probes),
+ * anywhere on the lens, then goes to the best position measured. The lens
+ * moves straight to each probe; if it lands elsewhere (backlash), it
+ * moves again, up to twice, then the value where it landed stands for the
+ * probe's. Probes measured already are not measured again.
+ */
+class ProbeSearch : public AfSearch
+{
+public:
+	ProbeSearch();
+
+	virtual void start( int position, int stepCount );
+	virtual LensCommand onFocusValue( double value, int position );
+	virtual int steps() const { return stepsTaken; }
+	virtual bool visited( int position ) const
+		{ return visits[position]; }
+
+protected:
+	/*
+	 * Start a search on a lens of stepCount positions.
+	 */
+	virtual void reset() = 0;
+
+	/*
+	 * The next position to measure, given those known; -1 once the search
+	 * is over. Asked again straight away if the position is known.
+	 */
+	virtual int nextProbe() = 0;
+
+	bool known( int position ) const { return probed[position]; }
+	double value( int position ) const { return values[position]; }
+	int best() const;			// known position of the highest value
+
+	int stepCount;
+
+private:
+	LensCommand moveTo( int target );
+
+	int lensPosition;
+	int stepsTaken;
+	int target;					// the probe, or the best position
+	int corrections;			// moves left to reach it
+	bool finishing;				// going to the best position
+	std::vector<double> values;	// latest value at each probed position
+	std::vector<bool> probed;
+	std::vector<bool> visits;
+};
+
+/*
+ * Golden-section search of the whole lens : two probes divide the range
+ * in the golden ratio, and the part beyond the lower one is dropped, until
+ * three positions are left. Assumes a single peak.
+ */
+class GoldenSectionSearch : public ProbeSearch
+{
+protected:
+	virtual void reset();
+	virtual int nextProbe();
+
+private:
+	int low, high;				// the range left, ends included
+	int left, right;			// its probes
+};
+
+/*
+ * Fibonacci search of the whole lens, the golden-section search for
+ * integer positions : the range is a Fibonacci number of positions
+ * (beyond the end of the lens, values are lowest), and each probe but the
+ * first two reuses one of the previous ones. Assumes a single peak.
+ */
+class FibonacciSearch : public ProbeSearch
+{
+protected:
+	virtual void reset();
+	virtual int nextProbe();
+
+private:
+	std::vector<int> fibonacci;
+	int low;					// the range left is low + 1 to
+	int index;					// low + fibonacci[index] - 1
+};
+
+/*
+ * Predicts the peak with a model of the curve around it : a sweep in
+ * coarse steps (right first, then left) until the values on both sides of
+ * the best one fell below 90% of it, then the model (a Gaussian, see
+ * peakEstimator.h) fitted on the samples around the best one gives the
+ * next position to measure, until it gives a known position. Last, the
+ * neighbours of the best position are measured, if they aren't known.
+ */
+class PredictiveSearch : public ProbeSearch
+{
+public:
+	PredictiveSearch( int coarseStep = 8, PeakFit model = GaussianFit,
+					  int samples = 3 );
+
+protected:
+	virtual void reset();
+	virtual int nextProbe();
+
+private:
+	int coarseStep;
+	PeakFit model;
+	int samples;				// of the fit
+	int fits;					// predictions made
+	int direction;				// of the sweep, 0 before it
+	std::vector<int> positions;	// the known ones, for the fit
+	std::vector<double> knownValues;
+};
+
+#endif
@@ -0,0 +1,369 @@
+#include <iostream>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "afFeatures.h"
+#include "afSimulator.h"
+#include "threadPool.h"
+#include "trainingData.h"
+#include "treeDecisions.h"
+#include "treeTrainer.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: afbenchmark [OPTIONS]" << endl;
+    cerr << "\t Simulates the autofocus from every initial lens position of" << endl;
+    cerr << "\t every scene, and prints the table of benchmark.py (also" << endl;
+    cerr << "\t steps.txt and backlash.txt). Simulations run on every core" << endl;
+    cerr << "\t (FOCUS_THREADS sets the number of threads)." << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --left-right-tree=FILE : Weka output of the left/right tree" << endl;
+    cerr << "\t --action-tree=FILE : Weka output of the action tree" << endl;
+    cerr << "\t --hill-climb : decide without trees (instead of the two above)" << endl;
+    cerr << "\t --leave-one-out : instead of --action-tree, train an action" << endl;
+    cerr << "\t     tree for each scene on the others (as makeactiontree.sh" << endl;
+    cerr << "\t     -lv), all in parallel, and benchmark the scene with it" << endl;
+    cerr << "\t --min-instances=N : of the leaves of these trees (default 512)" << endl;
+    cerr << "\t --lowlight : the scenes of lowlightraw/ (default focusraw/)" << endl;
+    cerr << "\t --lowlightgauss : the scenes of lowlightgaussraw/" << endl;
+    cerr << "\t --store=FILE : the scenes of a curve store (see makestore)," << endl;
+    cerr << "\t     instead of a folder and maxima.txt" << endl;
+    cerr << "\t --use-only=FILE : only this scene (e.g. bench.txt)" << endl;
+    cerr << "\t --backlash : simulate backlash" << endl;
+    cerr << "\t --noise : simulate measurement noise" << endl;
+    cerr << "\t --strategy=NAME : search with hill-climb (default, with the" << endl;
+    cerr << "\t     decisions above), golden-section, fibonacci or predictive" << endl;
+    cerr << "\t --peak-fit=FIT : once a peak was passed, move to the peak" << endl;
+    cerr << "\t     estimated by a fit (parabolic, gaussian or centroid)" << endl;
+    cerr << "\t     instead of climbing to it (default none)" << endl;
+    cerr << "\t --fit-samples=N : values the fit uses, 3 to 5 (default 3)" << endl;
+    cerr << "\t --runs=N : simulations from each position, with different" << endl;
+    cerr << "\t     noise and backlash (default 1); counts are summed" << endl;
+    cerr << "\t --seed=N : first seed of the random numbers (default 1)" << endl;
+    exit(1);
+}
+
+// Print rows such that each column is aligned on the right.
+static void
+print_aligned_rows( const vector< vector<string> > &rows )
+{
+    vector<size_t> widths;
+    for (size_t r = 0; r < rows.size(); r++)
+        for (size_t c = 0; c < rows[r].size(); c++)
+        {
+            if (c >= widths.size())
+                widths.push_back( 0 );
+            widths[c] = max( widths[c], rows[r][c].size() );
+        }
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        string line;
+        for (size_t c = 0; c < rows[r].size(); c++)
+        {
+            if (c > 0)
+                line += "|";
+            line += string( widths[c] - rows[r][c].size(), ' ' ) + rows[r][c];
+        }
+        printf( "%s\n", line.c_str() );
+    }
+}
+
+static string
+format( const char *pattern, double value )
+{
+    char text[64];
+    snprintf( text, sizeof( text ), pattern, value );
+    return text;
+}
+
+// Rows of 20 numbers, for the histograms of benchmark.py.
+static bool
+write_counts( const string &fileName, const vector<int> &counts )
+{
+    FILE *file = fopen( fileName.c_str(), "w" );
+    if (file == NULL)
+        return false;
+    for (size_t i = 0; i < counts.size(); i++)
+        fprintf( file, "%s%d", i == 0 ? "" : i % 20 == 0 ? ",\n" : ",",
+                 counts[i] );
+    fclose( file );
+    return true;
+}
+
+int
+main( int argc, char *argv[] )
+{
+    string leftRightFile, actionFile, useOnly;
+    string folder = "focusraw";
+    string storeFile;
+    bool hillClimb = false, leaveOneOut = false;
+    bool backlash = false, noise = false;
+    int runs = 1;
+    AfStrategy strategy = HillClimbStrategy;
+    PeakFit peakFit = NoPeakFit;
+    int fitSamples = 3;
+    TreeTrainerOptions treeOptions;
+    treeOptions.minInstances = 512;
+    unsigned seed = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option.compare(0, 18, "--left-right-tree=") == 0)
+            leftRightFile = option.substr(18);
+        else if (option.compare(0, 14, "--action-tree=") == 0)
+            actionFile = option.substr(14);
+        else if (option == "--hill-climb")
+            hillClimb = true;
+        else if (option == "--leave-one-out")
+            leaveOneOut = true;
+        else if (option.compare(0, 16, "--min-instances=") == 0)
+            treeOptions.minInstances = atoi(option.substr(16).c_str());
+        else if (option == "--lowlight" || option == "--low-light")
+            folder = "lowlightraw";
+        else if (option == "--lowlightgauss" || option == "--low-light-gauss")
+            folder = "lowlightgaussraw";
+        else if (option.compare(0, 8, "--store=") == 0)
+            storeFile = option.substr(8);
+        else if (option.compare(0, 11, "--use-only=") == 0)
+            useOnly = option.substr(11);
+        else if (option == "--backlash")
+            backlash = true;
+        else if (option == "--noise")
+            noise = true;
+        else if (option.compare(0, 11, "--strategy=") == 0)
+        {
+            if (!strategyFromName( option.substr(11), strategy ))
+                print_usage();
+        }
+        else if (option.compare(0, 11, "--peak-fit=") == 0)
+        {
+            if (!peakFitFromName( option.substr(11), peakFit ))
+                print_usage();
+        }
+        else if (option.compare(0, 14, "--fit-samples=") == 0)
+            fitSamples = atoi(option.substr(14).c_str());
+        else if (option.compare(0, 7, "--runs=") == 0)
+            runs = atoi(option.substr(7).c_str());
+        else if (option.compare(0, 7, "--seed=") == 0)
+            seed = strtoul(option.substr(7).c_str(), NULL, 10);
+        else
+            print_usage();
+    }
+    if (runs < 1 || treeOptions.minInstances < 1 ||
+        fitSamples < 3 || fitSamples > 5 ||
+        (hillClimb && !(leftRightFile.empty() && actionFile.empty())) ||
+        (hillClimb && leaveOneOut) ||
+        (!hillClimb && (leftRightFile.empty() ||
+                        actionFile.empty() != leaveOneOut)))
+        print_usage();
+
+    TreeDecisions trees;
+    HillClimbDecisions hillClimbing;
+    AfDecisions *decisions = &hillClimbing;
+    if (!hillClimb && !leaveOneOut)
+    {
+        if (!trees.load( leftRightFile, actionFile ))
+        {
+            cerr << trees.error() << endl;
+            exit(1);
+        }
+        decisions = &trees;
+    }
+
+    // The scenes benchmark.py (and simulate.py) leave out.
+    vector<string> excluded;
+    excluded.push_back( "cat.txt" );
+    excluded.push_back( "moon.txt" );
+    excluded.push_back( "projector2.txt" );
+    excluded.push_back( "projector3.txt" );
+
+    vector<AfScene> scenes;
+    string error;
+    bool loaded = storeFile.empty() ?
+        loadScenes( folder, "maxima.txt", excluded, scenes, error ) :
+        loadStoredScenes( storeFile, -1, false, excluded, scenes, error );
+    if (!loaded)
+    {
+        cerr << error << endl;
+        exit(1);
+    }
+    if (!useOnly.empty())
+    {
+        vector<AfScene> only;
+        for (size_t s = 0; s < scenes.size(); s++)
+            if (scenes[s].fileName == useOnly)
+                only.push_back( scenes[s] );
+        scenes.swap( only );
+    }
+    if (scenes.empty())
+    {
+        cerr << "No scenes" << endl;
+        exit(1);
+    }
+
+    // The decisions of each scene.
+    vector<TreeDecisions> folds;
+    vector<AfSimulator> simulators;
+    if (leaveOneOut)
+    {
+        vector<string> names;
+        for (int f = 0; f < FirstStepFeatures::count(); f++)
+            names.push_back( FirstStepFeatures::name( f ) );
+        DecisionTree leftRight;
+        if (!leftRight.load( leftRightFile, names ))
+        {
+            cerr << leftRight.error() << endl;
+            exit(1);
+        }
+        names.clear();
+        for (int f = 0; f < SweepFeatures::count(); f++)
+            names.push_back( SweepFeatures::name( f ) );
+
+        // The action trees are always trained on focusraw/.
+        vector<AfScene> training;
+        if (!loadScenes( "focusraw", "maxima.txt", excluded, training, error ))
+        {
+            cerr << error << endl;
+            exit(1);
+        }
+
+        // A fold per scene, each on one thread.
+        folds.resize( scenes.size() );
+        vector<string> errors( scenes.size() );
+        ThreadPool::global().runTasks( scenes.size(), [&]( int s )
+        {
+            vector<AfScene> others;
+            for (size_t t = 0; t < training.size(); t++)
+                if (training[t].fileName != scenes[s].fileName)
+                    others.push_back( training[t] );
+            ActionOptions actionOptions;
+            actionOptions.seed = seed;
+            FeatureSet set;
+            makeActionSet( others, actionOptions, set );
+
+            TreeTrainer trainer( treeOptions );
+            DecisionTree action;
+            if (!trainer.train( set ))
+                errors[s] = trainer.error();
+            else if (!action.parse( trainer.text(), names ))
+                errors[s] = action.error();
+            else if (!folds[s].setTrees( leftRight, action ))
+                errors[s] = folds[s].error();
+        } );
+        for (size_t s = 0; s < scenes.size(); s++)
+            if (!errors[s].empty())
+            {
+                cerr << scenes[s].name << ": " << errors[s] << endl;
+                exit(1);
+            }
+    }
+    for (size_t s = 0; s < scenes.size(); s++)
+    {
+        simulators.push_back( AfSimulator( leaveOneOut ? folds[s] : *decisions,
+                                           backlash, noise ) );
+        simulators.back().setPeakFit( peakFit, fitSamples );
+        simulators.back().setStrategy( strategy );
+    }
+
+    // Every simulation, numbered scene by scene, then by initial position,
+    // then by run. Initial positions leave room for the first two steps.
+    vector<int> firstSimulation( scenes.size() + 1, 0 );
+    for (size_t s = 0; s < scenes.size(); s++)
+    {
+        int starts = max( 0, (int)scenes[s].values.size() - 2 );
+        firstSimulation[s + 1] = firstSimulation[s] + starts * runs;
+    }
+    int simulationCount = firstSimulation.back();
+    vector<AfOutcome> outcomes( simulationCount );
+
+    ThreadPool::global().parallelFor( 0, simulationCount,
+        [&]( int begin, int end )
+        {
+            size_t s = 0;
+            for (int i = begin; i < end; i++)
+            {
+                while (i >= firstSimulation[s + 1])
+                    s++;
+                int start = (i - firstSimulation[s]) / runs;
+                int run = (i - firstSimulation[s]) % runs;
+
+                // Each simulation has its own random numbers, whatever the
+                // thread running it.
+                seed_seq sequence = { seed + run, (unsigned)s, (unsigned)start };
+                unsigned simulationSeed;
+                sequence.generate( &simulationSeed, &simulationSeed + 1 );
+                outcomes[i] = simulators[s].run( scenes[s], start,
+                                                 simulationSeed );
+            }
+        }, 64 );
+
+    vector< vector<string> > rows;
+    if (scenes.size() > 1)
+    {
+        const char *header[] = { "filename", "t-pos", "f-pos", "t-neg",
+                                 "f-neg", "%", "steps", "avgdist" };
+        rows.push_back( vector<string>( header, header + 8 ) );
+    }
+
+    vector<int> stepCounts, backlashCounts;
+    double sums[7] = { 0, 0, 0, 0, 0, 0, 0 };
+    for (size_t s = 0; s < scenes.size(); s++)
+    {
+        const AfScene &scene = scenes[s];
+        int counts[4] = { 0, 0, 0, 0 };
+        double steps = 0, distance = 0;
+        for (int i = firstSimulation[s]; i < firstSimulation[s + 1]; i++)
+        {
+            const AfOutcome &outcome = outcomes[i];
+            counts[0] += outcome.truePositive( scene );
+            counts[1] += outcome.falsePositive( scene );
+            counts[2] += outcome.trueNegative();
+            counts[3] += outcome.falseNegative();
+            steps += outcome.steps;
+            distance += scene.distanceToPeak( (i - firstSimulation[s]) / runs );
+            stepCounts.push_back( outcome.steps );
+            backlashCounts.push_back( outcome.backlashCount );
+        }
+
+        int simulations = firstSimulation[s + 1] - firstSimulation[s];
+        int total = counts[0] + counts[1] + counts[2] + counts[3];
+        double values[7] = { (double)counts[0], (double)counts[1],
+                             (double)counts[2], (double)counts[3],
+                             total > 0 ? 100.0 * counts[0] / total : 0.0,
+                             simulations > 0 ? steps / simulations : 0.0,
+                             simulations > 0 ? distance / simulations : 0.0 };
+        vector<string> row( 1, scene.name );
+        for (int c = 0; c < 7; c++)
+        {
+            row.push_back( format( c < 4 ? "%.0f" : "%.1f", values[c] ) );
+            sums[c] += values[c];
+        }
+        rows.push_back( row );
+    }
+
+    // No need for the average of only one scene.
+    if (scenes.size() > 1)
+    {
+        vector<string> row( 1, "average" );
+        for (int c = 0; c < 7; c++)
+            row.push_back( format( "%.1f", sums[c] / scenes.size() ) );
+        rows.push_back( row );
+    }
+    print_aligned_rows( rows );
+
+    // For the histograms of the number of steps and of backlashes.
+    if (!write_counts( "steps.txt", stepCounts ) ||
+        !write_counts( "backlash.txt", backlashCounts ))
+    {
+        cerr << "Could not write steps.txt or backlash.txt" << endl;
+        exit(1);
+    }
+
+    return( 0 );
+}
@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "afSimulator.h"
+#include "threadPool.h"
+#include "treeDecisions.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: afsearch [OPTIONS]" << endl;
+    cerr << "\t Searches the parameters of the autofocus for few steps and a" << endl;
+    cerr << "\t small focus error, simulating it from every initial lens" << endl;
+    cerr << "\t position of every scene, as afbenchmark (with backlash and" << endl;
+    cerr << "\t noise). For each camera model, prints the Pareto front of the" << endl;
+    cerr << "\t average number of steps against the average focus error (the" << endl;
+    cerr << "\t distance from the final lens position to the nearest peak)." << endl;
+    cerr << "\t Simulations run on every core." << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --coarse-steps=LIST : coarse step sizes (default 4,6,8,10,12,16)" << endl;
+    cerr << "\t --fine-steps=LIST : fine step sizes (default 1,2)" << endl;
+    cerr << "\t --drop-ratios=LIST : the hill climb turns back below this" << endl;
+    cerr << "\t     ratio of the best value of a sweep (default" << endl;
+    cerr << "\t     0.75,0.8,0.85,0.9,0.95)" << endl;
+    cerr << "\t --left-right-tree=FILE, --action-tree=FILE : Weka outputs of" << endl;
+    cerr << "\t     trees to decide with, instead of the hill climb (no drop" << endl;
+    cerr << "\t     ratios)" << endl;
+    cerr << "\t --noise-levels=LIST : camera models with these noises, as" << endl;
+    cerr << "\t     a fraction of the lowest value of a scene (default 0.05," << endl;
+    cerr << "\t     as cameramodel.py)" << endl;
+    cerr << "\t --backlash-levels=LIST : and these largest errors after a" << endl;
+    cerr << "\t     backlash, in lens positions (default 3); -1 for none" << endl;
+    cerr << "\t --peak-fit=FIT, --fit-samples=N : move to the peak fitted" << endl;
+    cerr << "\t     on the values around the best one (as afbenchmark)" << endl;
+    cerr << "\t --halving : successive halving instead of the whole grid :" << endl;
+    cerr << "\t     every setting on a sample of the simulations, then the" << endl;
+    cerr << "\t     best fronts on samples eta times larger, up to all" << endl;
+    cerr << "\t --eta=N : of the halving (default 3)" << endl;
+    cerr << "\t --lowlight : the scenes of lowlightraw/ (default focusraw/)" << endl;
+    cerr << "\t --lowlightgauss : the scenes of lowlightgaussraw/" << endl;
+    cerr << "\t --store=FILE : the scenes of a curve store (see makestore)," << endl;
+    cerr << "\t     instead of a folder and maxima.txt" << endl;
+    cerr << "\t --all : print every setting evaluated on all simulations," << endl;
+    cerr << "\t     not only the front" << endl;
+    cerr << "\t --seed=N : seed of the random numbers (default 1)" << endl;
+    exit(1);
+}
+
+// A comma-separated list of numbers.
+static bool
+parse_list( const string &text, vector<double> &values )
+{
+    values.clear();
+    const char *start = text.c_str();
+    for (;;)
+    {
+        char *end;
+        values.push_back( strtod( start, &end ) );
+        if (end == start || (*end != ',' && *end != 0))
+            return false;
+        if (*end == 0)
+            return true;
+        start = end + 1;
+    }
+}
+
+// Print rows such that each column is aligned on the right.
+static void
+print_aligned_rows( const vector< vector<string> > &rows )
+{
+    vector<size_t> widths;
+    for (size_t r = 0; r < rows.size(); r++)
+        for (size_t c = 0; c < rows[r].size(); c++)
+        {
+            if (c >= widths.size())
+                widths.push_back( 0 );
+            widths[c] = max( widths[c], rows[r][c].size() );
+        }
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        string line;
+        for (size_t c = 0; c < rows[r].size(); c++)
+        {
+            if (c > 0)
+                line += "|";
+            line += string( widths[c] - rows[r][c].size(), ' ' ) + rows[r][c];
+        }
+        printf( "%s\n", line.c_str() );
+    }
+}
+
+static string
+format( const char *pattern, double value )
+{
+    char text[64];
+    snprintf( text, sizeof( text ), pattern, value );
+    return text;
+}
+
+// The parameters of the autofocus being searched.
+struct Setting
+{
+    int coarseStep;
+    int fineStep;
+    double dropRatio;      // of HillClimbDecisions, 0 with trees
+};
+
+// Averages over the simulations a setting was evaluated on.
+struct Score
+{
+    int simulations;
+    double steps;
+    double travel;
+    double error;
+    double found;           // share of searches stopping near a peak
+};
+
+// a is at least as good as b on both counts, and better on one.
+static bool
+dominates( const Score &a, const Score &b )
+{
+    return a.steps <= b.steps && a.error <= b.error &&
+           (a.steps < b.steps || a.error < b.error);
+}
+
+// Indices of the scores, front after front : the first front is dominated
+// by none, the second only by the first, and so on. Each front is sorted
+// by steps.
+static vector< vector<int> >
+pareto_fronts( const vector<Score> &scores, const vector<int> &candidates )
+{
+    vector< vector<int> > fronts;
+    vector<int> left( candidates );
+    while (!left.empty())
+    {
+        vector<int> front, rest;
+        for (size_t i = 0; i < left.size(); i++)
+        {
+            bool dominated = false;
+            for (size_t j = 0; j < left.size() && !dominated; j++)
+                dominated = dominates( scores[left[j]], scores[left[i]] );
+            (dominated ? rest : front).push_back( left[i] );
+        }
+        sort( front.begin(), front.end(), [&]( int a, int b )
+              { return scores[a].steps < scores[b].steps ||
+                       (scores[a].steps == scores[b].steps &&
+                        scores[a].error < scores[b].error); } );
+        fronts.push_back( front );
+        left.swap( rest );
+    }
+    return fronts;
+}
+
+int
+main( int argc, char *argv[] )
+{
+    vector<double> coarseSteps = { 4, 6, 8, 10, 12, 16 };
+    vector<double> fineSteps = { 1, 2 };
+    vector<double> dropRatios = { 0.75, 0.8, 0.85, 0.9, 0.95 };
+    vector<double> noiseLevels = { 0.05 };
+    vector<double> backlashLevels = { 3 };
+    string leftRightFile, actionFile;
+    string folder = "focusraw";
+    string storeFile;
+    bool halving = false, printAll = false;
+    int eta = 3;
+    PeakFit peakFit = NoPeakFit;
+    int fitSamples = 3;
+    unsigned seed = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        bool valid = true;
+        if (option.compare(0, 15, "--coarse-steps=") == 0)
+            valid = parse_list( option.substr(15), coarseSteps );
+        else if (option.compare(0, 13, "--fine-steps=") == 0)
+            valid = parse_list( option.substr(13), fineSteps );
+        else if (option.compare(0, 14, "--drop-ratios=") == 0)
+            valid = parse_list( option.substr(14), dropRatios );
+        else if (option.compare(0, 18, "--left-right-tree=") == 0)
+            leftRightFile = option.substr(18);
+        else if (option.compare(0, 14, "--action-tree=") == 0)
+            actionFile = option.substr(14);
+        else if (option.compare(0, 15, "--noise-levels=") == 0)
+            valid = parse_list( option.substr(15), noiseLevels );
+        else if (option.compare(0, 18, "--backlash-levels=") == 0)
+            valid = parse_list( option.substr(18), backlashLevels );
+        else if (option.compare(0, 11, "--peak-fit=") == 0)
+            valid = peakFitFromName( option.substr(11), peakFit );
+        else if (option.compare(0, 14, "--fit-samples=") == 0)
+            fitSamples = atoi(option.substr(14).c_str());
+        else if (option == "--halving")
+            halving = true;
+        else if (option.compare(0, 6, "--eta=") == 0)
+            eta = atoi(option.substr(6).c_str());
+        else if (option == "--lowlight" || option == "--low-light")
+            folder = "lowlightraw";
+        else if (option == "--lowlightgauss" || option == "--low-light-gauss")
+            folder = "lowlightgaussraw";
+        else if (option.compare(0, 8, "--store=") == 0)
+            storeFile = option.substr(8);
+        else if (option == "--all")
+            printAll = true;
+        else if (option.compare(0, 7, "--seed=") == 0)
+            seed = strtoul(option.substr(7).c_str(), NULL, 10);
+        else
+            valid = false;
+        if (!valid)
+            print_usage();
+    }
+    bool useTrees = !leftRightFile.empty() || !actionFile.empty();
+    if (eta < 2 || fitSamples < 3 || fitSamples > 5 ||
+        (useTrees && (leftRightFile.empty() || actionFile.empty())))
+        print_usage();
+    for (size_t i = 0; i < coarseSteps.size(); i++)
+        if (coarseSteps[i] < 1)
+            print_usage();
+    for (size_t i = 0; i < fineSteps.size(); i++)
+        if (fineSteps[i] < 1)
+            print_usage();
+
+    TreeDecisions trees;
+    if (useTrees && !trees.load( leftRightFile, actionFile ))
+    {
+        cerr << trees.error() << endl;
+        exit(1);
+    }
+
+    // The scenes benchmark.py leaves out.
+    vector<string> excluded;
+    excluded.push_back( "cat.txt" );
+    excluded.push_back( "moon.txt" );
+    excluded.push_back( "projector2.txt" );
+    excluded.push_back( "projector3.txt" );
+
+    vector<AfScene> scenes;
+    string error;
+    bool loaded = storeFile.empty() ?
+        loadScenes( folder, "maxima.txt", excluded, scenes, error ) :
+        loadStoredScenes( storeFile, -1, false, excluded, scenes, error );
+    if (!loaded)
+    {
+        cerr << error << endl;
+        exit(1);
+    }
+
+    // Every setting of the grid, with its own decisions.
+    vector<Setting> settings;
+    for (size_t c = 0; c < coarseSteps.size(); c++)
+        for (size_t f = 0; f < fineSteps.size(); f++)
+        {
+            Setting setting = { (int)coarseSteps[c], (int)fineSteps[f], 0 };
+            if (useTrees)
+                settings.push_back( setting );
+            else
+                for (size_t d = 0; d < dropRatios.size(); d++)
+                {
+                    setting.dropRatio = dropRatios[d];
+                    settings.push_back( setting );
+                }
+        }
+    vector<HillClimbDecisions> hillClimbs;
+    for (size_t s = 0; s < settings.size(); s++)
+        hillClimbs.push_back( HillClimbDecisions( settings[s].dropRatio ) );
+
+    // Every simulation (a scene and an initial position), in a random
+    // order, so that the first ones are a fair sample for the halving.
+    vector< pair<int, int> > simulations;
+    for (size_t s = 0; s < scenes.size(); s++)
+        for (int start = 0; start + 2 < (int)scenes[s].values.size(); start++)
+            simulations.push_back( make_pair( (int)s, start ) );
+    mt19937 random( seed );
+    shuffle( simulations.begin(), simulations.end(), random );
+    int simulationCount = simulations.size();
+
+    for (size_t n = 0; n < noiseLevels.size(); n++)
+        for (size_t b = 0; b < backlashLevels.size(); b++)
+        {
+            double noiseLevel = noiseLevels[n];
+            int backlashLevel = (int)backlashLevels[b];
+            vector<AfSimulator> simulators;
+            for (size_t s = 0; s < settings.size(); s++)
+            {
+                AfDecisions &decisions = useTrees ?
+                    (AfDecisions &)trees : (AfDecisions &)hillClimbs[s];
+                AfSimulator simulator( decisions, backlashLevel >= 0,
+                                       noiseLevel > 0, settings[s].coarseStep,
+                                       settings[s].fineStep );
+                simulator.setMaximumBacklash( max( backlashLevel, 0 ) );
+                simulator.setNoiseFactor( noiseLevel );
+                simulator.setPeakFit( peakFit, fitSamples );
+                simulators.push_back( simulator );
+            }
+
+            // Rounds of the halving : the first has eta times fewer
+            // simulations than the next, the last has all of them.
+            int rounds = 1;
+            if (halving)
+                while (pow( (double)eta, rounds ) < settings.size() &&
+                       simulationCount / pow( (double)eta, rounds ) >= 100)
+                    rounds++;
+
+            vector<Score> scores( settings.size() );
+            vector<int> candidates;
+            for (size_t s = 0; s < settings.size(); s++)
+                candidates.push_back( s );
+            for (int round = 0; round < rounds; round++)
+            {
+                int sample = round == rounds - 1 ? simulationCount :
+                    (int)(simulationCount / pow( (double)eta, rounds - 1 - round ));
+
+                // Every candidate on the sample, all at once.
+                vector<AfOutcome> outcomes( (size_t)candidates.size() * sample );
+                ThreadPool::global().parallelFor( 0, outcomes.size(),
+                    [&]( int begin, int end )
+                    {
+                        for (int i = begin; i < end; i++)
+                        {
+                            int setting = candidates[i / sample];
+                            const pair<int, int> &simulation =
+                                simulations[i % sample];
+                            seed_seq sequence = { seed,
+                                                  (unsigned)simulation.first,
+                                                  (unsigned)simulation.second };
+                            unsigned simulationSeed;
+                            sequence.generate( &simulationSeed,
+                                               &simulationSeed + 1 );
+                            outcomes[i] = simulators[setting].run(
+                                scenes[simulation.first], simulation.second,
+                                simulationSeed );
+                        }
+                    }, 64 );
+
+                for (size_t c = 0; c < candidates.size(); c++)
+                {
+                    Score score = { sample, 0, 0, 0, 0 };
+                    for (int i = 0; i < sample; i++)
+                    {
+                        const AfOutcome &outcome = outcomes[c * sample + i];
+                        const AfScene &scene = scenes[simulations[i].first];
+                        score.steps += outcome.steps;
+                        score.travel += outcome.travel;
+                        score.error += scene.distanceToPeak( outcome.position );
+                        score.found += outcome.truePositive( scene );
+                    }
+                    score.steps /= sample;
+                    score.travel /= sample;
+                    score.error /= sample;
+                    score.found /= sample;
+                    scores[candidates[c]] = score;
+                }
+                if (round == rounds - 1)
+                    break;
+
+                // Keep the best fronts, a share 1 / eta of the candidates.
+                // The front that doesn't fit whole gives members evenly
+                // spread along it.
+                size_t keep = max( (size_t)1,
+                                   (candidates.size() + eta - 1) / eta );
+                vector< vector<int> > fronts = pareto_fronts( scores, candidates );
+                vector<int> kept;
+                for (size_t f = 0; f < fronts.size() && kept.size() < keep; f++)
+                {
+                    const vector<int> &front = fronts[f];
+                    size_t room = keep - kept.size();
+                    if (front.size() <= room)
+                        kept.insert( kept.end(), front.begin(), front.end() );
+                    else
+                        for (size_t k = 0; k < room; k++)
+                            kept.push_back( front[room == 1 ? 0 :
+                                k * (front.size() - 1) / (room - 1)] );
+                }
+                candidates.swap( kept );
+            }
+
+            printf( "noise %g, %s : %d settings", noiseLevel,
+                    backlashLevel < 0 ? "no backlash" :
+                    format( "backlash up to %.0f", backlashLevel ).c_str(),
+                    (int)settings.size() );
+            if (halving)
+                printf( ", %d left after %d rounds of halving",
+                        (int)candidates.size(), rounds - 1 );
+            printf( ", %d simulations each\n", simulationCount );
+
+            vector< vector<int> > fronts = pareto_fronts( scores, candidates );
+            vector< vector<string> > rows;
+            const char *header[] = { "coarse", "fine", "drop", "steps",
+                                     "travel", "error", "found %", "front" };
+            rows.push_back( vector<string>( header, header + 8 ) );
+            for (size_t f = 0; f < (printAll ? fronts.size() : 1); f++)
+                for (size_t i = 0; i < fronts[f].size(); i++)
+                {
+                    const Setting &setting = settings[fronts[f][i]];
+                    const Score &score = scores[fronts[f][i]];
+                    vector<string> row;
+                    row.push_back( format( "%.0f", setting.coarseStep ) );
+                    row.push_back( format( "%.0f", setting.fineStep ) );
+                    row.push_back( useTrees ? "trees" :
+                                   format( "%.2f", setting.dropRatio ) );
+                    row.push_back( format( "%.1f", score.steps ) );
+                    row.push_back( format( "%.1f", score.travel ) );
+                    row.push_back( format( "%.2f", score.error ) );
+                    row.push_back( format( "%.1f", 100 * score.found ) );
+                    row.push_back( format( "%.0f", f + 1 ) );
+                    rows.push_back( row );
+                }
+            print_aligned_rows( rows );
+            printf( "\n" );
+        }
+
+    return( 0 );
+}
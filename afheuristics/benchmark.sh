@@ -3,11 +3,6 @@
 
 JAR="/usr/share/java/weka-3.6.10.jar"
 
-if [ ! -f $JAR ]; then
-    echo "ERROR: Weka not found at "$JAR
-    exit
-fi
-
 PARSER="parsej48.py"
 
 WEKA_LEFTRIGHT="results/nearest3_weka.txt"
@@ -18,6 +13,7 @@ redirect=false
 simulateerrors=false
 lowlight=false
 lowlightgauss=false
+native=false
 leaveout=""
 useonly=""
 plotfile=""
@@ -30,6 +26,7 @@ while [ "$1" != "" ]; do
         -se | --simulateerrors | --simulate-errors ) simulateerrors=true ;;
         -ll | --lowlight | --low-light ) lowlight=true ;;
         -llg | --lowlightgauss | --low-light-gauss ) lowlightgauss=true ;;
+        -n | --native ) native=true ;;
         -lv | --leaveout ) shift
               redirect=true
               leaveout="--leave-out="$1
@@ -43,6 +40,12 @@ while [ "$1" != "" ]; do
     shift
 done
 
+# The trees of --native runs may come from traintree.exe instead.
+if [ "$native" = false ] && [ ! -f $JAR ]; then
+    echo "ERROR: Weka not found at "$JAR
+    exit
+fi
+
 # Parse weka output from txt to json.
 echo "Parsing leftright tree..."
 cat $WEKA_LEFTRIGHT | ./$PARSER > /tmp/tree_leftright.json
@@ -54,15 +57,22 @@ arg1="--left-right-tree=/tmp/tree_leftright.json "
 arg2="--action-tree=/tmp/tree_action.json "
 treeargs=$arg1$arg2
 
+# afbenchmark.exe (make afbenchmark) reads the Weka output directly.
+arg1="--left-right-tree=$WEKA_LEFTRIGHT "
+arg2="--action-tree=$WEKA_ACTION "
+nativeargs=$arg1$arg2
+
 # Optional arguments.
 if [ "$simulateerrors" = true ]; then
     arg=" --backlash --noise"
     treeargs=$treeargs$arg
+    nativeargs=$nativeargs$arg
 fi
 
 if [ "$lowlight" = true ]; then
     arg=" --lowlight"
     treeargs=$treeargs$arg
+    nativeargs=$nativeargs$arg
 fi
 
 if [ "$lowlightgauss" = true ]; then
@@ -73,6 +83,7 @@ if [ "$lowlightgauss" = true ]; then
     fi
     arg=" --lowlightgauss"
     treeargs=$treeargs$arg
+    nativeargs=$nativeargs$arg
 fi
 
 # Evaluate tree effectiveness.
@@ -80,9 +91,15 @@ echo "Evaluating..."
 mkdir -p simulations
 if [ "$redirect" = true ]; then
     # This is for leave-on-out cross validation.
-    ./benchmark.py $treeargs $useonly >> results.txt
+    if [ "$native" = true ]; then
+        ./afbenchmark.exe $nativeargs $useonly >> results.txt
+    else
+        ./benchmark.py $treeargs $useonly >> results.txt
+    fi
     ./benchmark.py $treeargs \
                 --specific-scene=$plotfile > simulations/$plotfile.R
+elif [ "$native" = true ]; then
+    ./afbenchmark.exe $nativeargs
 else
     ./benchmark.py $treeargs
 fi
@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "afSimulator.h"
+#include "threadPool.h"
+#include "treeDecisions.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: comparesearch [OPTIONS]" << endl;
+    cerr << "\t Simulates every search strategy of afStrategies.h from every" << endl;
+    cerr << "\t initial lens position of every scene, as afbenchmark, and" << endl;
+    cerr << "\t prints for each the share of searches ending at a peak, the" << endl;
+    cerr << "\t average and largest numbers of steps, then the fastest safe" << endl;
+    cerr << "\t strategy (for afbenchmark --strategy). Simulations run on" << endl;
+    cerr << "\t every core." << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --left-right-tree=FILE, --action-tree=FILE : Weka outputs of" << endl;
+    cerr << "\t     the trees of the hill climb (default HillClimbDecisions)" << endl;
+    cerr << "\t --lowlight : the scenes of lowlightraw/ (default focusraw/)" << endl;
+    cerr << "\t --lowlightgauss : the scenes of lowlightgaussraw/" << endl;
+    cerr << "\t --store=FILE : the scenes of a curve store (see makestore)," << endl;
+    cerr << "\t     instead of a folder and maxima.txt" << endl;
+    cerr << "\t --backlash : simulate backlash" << endl;
+    cerr << "\t --noise : simulate measurement noise" << endl;
+    cerr << "\t --runs=N : simulations from each position, with different" << endl;
+    cerr << "\t     noise and backlash (default 1)" << endl;
+    cerr << "\t --safe=P : a safe strategy ends within a position of a peak" << endl;
+    cerr << "\t     in P% of the searches at least (default 95)" << endl;
+    cerr << "\t --seed=N : first seed of the random numbers (default 1)" << endl;
+    exit(1);
+}
+
+// Print rows such that each column is aligned on the right.
+static void
+print_aligned_rows( const vector< vector<string> > &rows )
+{
+    vector<size_t> widths;
+    for (size_t r = 0; r < rows.size(); r++)
+        for (size_t c = 0; c < rows[r].size(); c++)
+        {
+            if (c >= widths.size())
+                widths.push_back( 0 );
+            widths[c] = max( widths[c], rows[r][c].size() );
+        }
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        string line;
+        for (size_t c = 0; c < rows[r].size(); c++)
+        {
+            if (c > 0)
+                line += "|";
+            line += string( widths[c] - rows[r][c].size(), ' ' ) + rows[r][c];
+        }
+        printf( "%s\n", line.c_str() );
+    }
+}
+
+static string
+format( const char *pattern, double value )
+{
+    char text[64];
+    snprintf( text, sizeof( text ), pattern, value );
+    return text;
+}
+
+int
+main( int argc, char *argv[] )
+{
+    string leftRightFile, actionFile;
+    string folder = "focusraw";
+    string storeFile;
+    bool backlash = false, noise = false;
+    int runs = 1;
+    double safe = 95;
+    unsigned seed = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option.compare(0, 18, "--left-right-tree=") == 0)
+            leftRightFile = option.substr(18);
+        else if (option.compare(0, 14, "--action-tree=") == 0)
+            actionFile = option.substr(14);
+        else if (option == "--lowlight" || option == "--low-light")
+            folder = "lowlightraw";
+        else if (option == "--lowlightgauss" || option == "--low-light-gauss")
+            folder = "lowlightgaussraw";
+        else if (option.compare(0, 8, "--store=") == 0)
+            storeFile = option.substr(8);
+        else if (option == "--backlash")
+            backlash = true;
+        else if (option == "--noise")
+            noise = true;
+        else if (option.compare(0, 7, "--runs=") == 0)
+            runs = atoi(option.substr(7).c_str());
+        else if (option.compare(0, 7, "--safe=") == 0)
+            safe = atof(option.substr(7).c_str());
+        else if (option.compare(0, 7, "--seed=") == 0)
+            seed = strtoul(option.substr(7).c_str(), NULL, 10);
+        else
+            print_usage();
+    }
+    if (runs < 1 || leftRightFile.empty() != actionFile.empty())
+        print_usage();
+
+    TreeDecisions trees;
+    HillClimbDecisions hillClimbing;
+    AfDecisions *decisions = &hillClimbing;
+    if (!leftRightFile.empty())
+    {
+        if (!trees.load( leftRightFile, actionFile ))
+        {
+            cerr << trees.error() << endl;
+            exit(1);
+        }
+        decisions = &trees;
+    }
+
+    // The scenes benchmark.py leaves out.
+    vector<string> excluded;
+    excluded.push_back( "cat.txt" );
+    excluded.push_back( "moon.txt" );
+    excluded.push_back( "projector2.txt" );
+    excluded.push_back( "projector3.txt" );
+
+    vector<AfScene> scenes;
+    string error;
+    bool loaded = storeFile.empty() ?
+        loadScenes( folder, "maxima.txt", excluded, scenes, error ) :
+        loadStoredScenes( storeFile, -1, false, excluded, scenes, error );
+    if (!loaded)
+    {
+        cerr << error << endl;
+        exit(1);
+    }
+
+    // Every simulation : a scene, an initial position and a run, the
+    // seeds of afbenchmark.
+    struct Simulation
+    {
+        int scene;
+        int start;
+        unsigned seed;
+    };
+    vector<Simulation> simulations;
+    for (size_t s = 0; s < scenes.size(); s++)
+        for (int start = 0; start + 2 < (int)scenes[s].values.size(); start++)
+            for (int run = 0; run < runs; run++)
+            {
+                seed_seq sequence = { seed + run, (unsigned)s, (unsigned)start };
+                Simulation simulation = { (int)s, start, 0 };
+                sequence.generate( &simulation.seed, &simulation.seed + 1 );
+                simulations.push_back( simulation );
+            }
+    int simulationCount = simulations.size();
+
+    const AfStrategy strategies[] = { HillClimbStrategy, GoldenSectionStrategy,
+                                      FibonacciStrategy, PredictiveStrategy };
+    const int strategyCount = 4;
+    vector<AfSimulator> simulators;
+    for (int t = 0; t < strategyCount; t++)
+    {
+        simulators.push_back( AfSimulator( *decisions, backlash, noise ) );
+        simulators.back().setStrategy( strategies[t] );
+    }
+
+    // Every strategy on every simulation, all at once.
+    vector<AfOutcome> outcomes( (size_t)strategyCount * simulationCount );
+    ThreadPool::global().parallelFor( 0, outcomes.size(),
+        [&]( int begin, int end )
+        {
+            for (int i = begin; i < end; i++)
+            {
+                const Simulation &simulation = simulations[i % simulationCount];
+                outcomes[i] = simulators[i / simulationCount].run(
+                    scenes[simulation.scene], simulation.start,
+                    simulation.seed );
+            }
+        }, 64 );
+
+    vector< vector<string> > rows;
+    const char *header[] = { "strategy", "found %", "steps", "worst",
+                             "travel", "backlash" };
+    rows.push_back( vector<string>( header, header + 6 ) );
+    int fastest = -1;
+    double fastestSteps = 0;
+    for (int t = 0; t < strategyCount; t++)
+    {
+        double found = 0, steps = 0, travel = 0, backlashes = 0;
+        int worst = 0;
+        for (int i = 0; i < simulationCount; i++)
+        {
+            const AfOutcome &outcome = outcomes[(size_t)t * simulationCount + i];
+            found += outcome.truePositive( scenes[simulations[i].scene] );
+            steps += outcome.steps;
+            worst = max( worst, outcome.steps );
+            travel += outcome.travel;
+            backlashes += outcome.backlashCount;
+        }
+        found = 100 * found / simulationCount;
+        steps /= simulationCount;
+        if (found >= safe && (fastest < 0 || steps < fastestSteps))
+        {
+            fastest = t;
+            fastestSteps = steps;
+        }
+
+        vector<string> row;
+        row.push_back( strategyName( strategies[t] ) );
+        row.push_back( format( "%.1f", found ) );
+        row.push_back( format( "%.1f", steps ) );
+        row.push_back( format( "%.0f", worst ) );
+        row.push_back( format( "%.1f", travel / simulationCount ) );
+        row.push_back( format( "%.1f", backlashes / simulationCount ) );
+        rows.push_back( row );
+    }
+    print_aligned_rows( rows );
+
+    if (fastest >= 0)
+        printf( "\nFastest safe strategy : %s\n", strategyName( strategies[fastest] ) );
+    else
+        printf( "\nNo strategy ends at a peak %g%% of the time\n", safe );
+
+    return( 0 );
+}
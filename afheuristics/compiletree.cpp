@@ -0,0 +1,150 @@
+#include <chrono>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "afFeatures.h"
+#include "decisionTree.h"
+#include "featureSet.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: compiletree [OPTIONS] WEKA_OUTPUT" << endl;
+    cerr << "\t Reads a J48 tree from Weka's output and prints its size." << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --features=firststep|turn : the features of the tree, those" << endl;
+    cerr << "\t     of featuresfirststep.py (left/right tree) or of" << endl;
+    cerr << "\t     featuresturn.py (action tree, the default)" << endl;
+    cerr << "\t --cpp=NAME : print the tree as a C++ function NAME, taking" << endl;
+    cerr << "\t     the features in the order of afFeatures.h" << endl;
+    cerr << "\t --arff=FILE : classify the instances of an ARFF file (the" << endl;
+    cerr << "\t     one the tree was trained on, or its binary version from" << endl;
+    cerr << "\t     makefeatures), and print the accuracy and the time per" << endl;
+    cerr << "\t     decision" << endl;
+    exit(1);
+}
+
+static void
+evaluate( const DecisionTree &tree, const FeatureSet &set )
+{
+    int count = set.size();
+    int stride = set.features.size();
+    vector<int> classes( count );
+    tree.classifyBatch( &set.values[0], count, stride, &classes[0] );
+
+    double correct = 0, total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (tree.classes()[classes[i]] == set.classes[set.labels[i]])
+            correct += set.weights[i];
+        total += set.weights[i];
+    }
+    printf( "instances  %d\n", count );
+    printf( "correct    %.2f%% (weighted)\n", 100.0 * correct / total );
+
+    // Classify everything again until the time is large enough to measure.
+    typedef chrono::steady_clock Clock;
+    long long decisions = 0;
+    Clock::time_point start = Clock::now();
+    double seconds;
+    do
+    {
+        tree.classifyBatch( &set.values[0], count, stride, &classes[0] );
+        decisions += count;
+        seconds = chrono::duration<double>( Clock::now() - start ).count();
+    } while (seconds < 0.5);
+    printf( "time       %.1f ns per decision\n", seconds * 1e9 / decisions );
+}
+
+int
+main( int argc, char *argv[] )
+{
+    string features = "turn";
+    string cppName;
+    string arffFile;
+
+    int first = 1;
+    for (; first < argc; first++)
+    {
+        string option(argv[first]);
+        if (option.compare(0, 11, "--features=") == 0)
+            features = option.substr(11);
+        else if (option.compare(0, 6, "--cpp=") == 0)
+            cppName = option.substr(6);
+        else if (option.compare(0, 7, "--arff=") == 0)
+            arffFile = option.substr(7);
+        else if (option.compare(0, 2, "--") == 0)
+            // This option isn't recognized.
+            print_usage();
+        else
+            // The tree - we can stop reading options now.
+            break;
+    }
+    if (first + 1 != argc)
+        print_usage();
+    string treeFile(argv[first]);
+
+    vector<string> names;
+    if (features == "firststep")
+    {
+        for (int f = 0; f < FirstStepFeatures::count(); f++)
+            names.push_back( FirstStepFeatures::name( f ) );
+    }
+    else if (features == "turn")
+    {
+        for (int f = 0; f < SweepFeatures::count(); f++)
+            names.push_back( SweepFeatures::name( f ) );
+    }
+    else
+        print_usage();
+
+    DecisionTree tree;
+    if (!tree.load( treeFile, names ))
+    {
+        cerr << tree.error() << endl;
+        exit(1);
+    }
+
+    if (!cppName.empty())
+    {
+        cout << tree.generateCpp( cppName, names );
+        return( 0 );
+    }
+
+    printf( "nodes      %d\n", tree.size() );
+    printf( "depth      %d\n", tree.depth() );
+    printf( "classes   " );
+    for (size_t c = 0; c < tree.classes().size(); c++)
+        printf( " %s", tree.classes()[c].c_str() );
+    printf( "\n" );
+
+    if (!arffFile.empty())
+    {
+        // The instances only have the features kept by the attribute
+        // selection : read the tree again with those.
+        FeatureSet set;
+        if (!set.read( arffFile ))
+        {
+            cerr << set.error() << endl;
+            exit(1);
+        }
+        if (set.size() == 0)
+        {
+            cerr << "No instances in " << arffFile << endl;
+            exit(1);
+        }
+        DecisionTree arffTree;
+        if (!arffTree.load( treeFile, set.features ))
+        {
+            cerr << arffTree.error() << endl;
+            exit(1);
+        }
+        evaluate( arffTree, set );
+    }
+
+    return( 0 );
+}
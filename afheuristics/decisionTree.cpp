@@ -0,0 +1,318 @@
+#include "decisionTree.h"
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+/*
+ * A line of the tree : a branch of the node at its depth, taken by the
+ * values of the node's feature up to high (and above the bounds of the
+ * branches before it), leading to a class or to the lines below it.
+ */
+struct DecisionTree::Line
+{
+	int depth;
+	int feature;
+	double high;
+	int leaf;				// class, or -1 if the branch is a subtree
+	string text;
+};
+
+DecisionTree::DecisionTree()
+	: root( ~0 )
+{
+}
+
+bool
+DecisionTree::fail( const string &message )
+{
+	lastError = message;
+	return false;
+}
+
+int
+DecisionTree::classIndex( const string &name ) const
+{
+	for (size_t c = 0; c < classNames.size(); c++)
+		if ( classNames[c] == name )
+			return c;
+	return -1;
+}
+
+bool
+DecisionTree::load( const string &fileName, const vector<string> &featureNames )
+{
+	ifstream in( fileName.c_str() );
+	if ( !in )
+		return fail( "Could not read file: " + fileName );
+	stringstream text;
+	text << in.rdbuf();
+	if ( !parse( text.str(), featureNames ) )
+		return fail( lastError + " in " + fileName );
+	return true;
+}
+
+// Parse a number, or a range '(low-high]' of Weka's discretization, into
+// the upper bound of the values it stands for.
+static bool
+parseHigh( const string &token, double &high )
+{
+	char *end;
+	high = strtod( token.c_str(), &end );
+	if ( !token.empty() && *end == 0 )
+		return true;
+
+	if ( token.size() < 6 || token.compare( 0, 2, "'(" ) != 0 ||
+		 token[token.size() - 1] != '\'' )
+		return false;
+
+	// The dash separating the bounds is not the sign of the first one.
+	string range = token.substr( 2, token.size() - 4 );
+	size_t dash = range.find( '-', 1 );
+	if ( dash == string::npos )
+		return false;
+	string upper = range.substr( dash + 1 );
+	if ( upper == "inf" )
+	{
+		high = HUGE_VAL;
+		return true;
+	}
+	high = strtod( upper.c_str(), &end );
+	return *end == 0;
+}
+
+bool
+DecisionTree::parse( const string &text, const vector<string> &featureNames )
+{
+	nodes.clear();
+	classNames.clear();
+	root = ~0;
+	lastError.clear();
+
+	// The tree follows "J48 pruned tree", a line of dashes and a blank
+	// line, and ends at the next blank line. A tree that is a single leaf
+	// follows the dashes directly.
+	istringstream in( text );
+	string line;
+	bool found = false;
+	while ( getline( in, line ) )
+		if ( line.find( "J48 pruned tree" ) == 0 ||
+			 line.find( "J48 unpruned tree" ) == 0 )
+		{
+			getline( in, line );
+			found = true;
+			break;
+		}
+	if ( !found )
+		return fail( "No J48 tree" );
+	getline( in, line );
+	bool pending = line.find_first_not_of( " \t\r" ) != string::npos;
+
+	vector<Line> lines;
+	while ( pending || (getline( in, line ) &&
+						line.find_first_not_of( " \t\r" ) != string::npos) )
+	{
+		pending = false;
+		Line parsed;
+		parsed.depth = 0;
+		parsed.text = line;
+
+		// "|   |   feature <= 0.5: class (12.0/3.0)", or ": class (n)" for
+		// a tree that is a single leaf.
+		replace( line.begin(), line.end(), ':', ' ' );
+		istringstream tokens( line );
+		string token;
+		vector<string> parts;
+		while ( tokens >> token )
+			parts.push_back( token );
+		while ( parsed.depth < (int)parts.size() && parts[parsed.depth] == "|" )
+			parsed.depth++;
+		parts.erase( parts.begin(), parts.begin() + parsed.depth );
+
+		if ( parts.size() == 2 && lines.empty() && parts[1][0] == '(' )
+		{
+			classNames.push_back( parts[0] );
+			root = ~0;
+			return true;
+		}
+		if ( parts.size() < 3 )
+			return fail( "Malformed line \"" + parsed.text + "\"" );
+
+		parsed.feature = find( featureNames.begin(), featureNames.end(),
+							   parts[0] ) - featureNames.begin();
+		if ( parsed.feature == (int)featureNames.size() )
+			return fail( "Unknown feature " + parts[0] );
+
+		// Every branch becomes the values up to a bound.
+		double value;
+		if ( !parseHigh( parts[2], value ) )
+			return fail( "Nominal value " + parts[2] + " (only numbers are "
+						 "supported)" );
+		const string &op = parts[1];
+		if ( op == "<=" || op == "=" )
+			parsed.high = value;
+		else if ( op == "<" )
+			parsed.high = nextafter( value, -HUGE_VAL );
+		else if ( op == ">" || op == ">=" )
+			parsed.high = HUGE_VAL;
+		else
+			return fail( "Unknown comparison " + op );
+
+		parsed.leaf = -1;
+		if ( parts.size() > 3 )
+		{
+			parsed.leaf = classIndex( parts[3] );
+			if ( parsed.leaf < 0 )
+			{
+				parsed.leaf = classNames.size();
+				classNames.push_back( parts[3] );
+			}
+		}
+		lines.push_back( parsed );
+	}
+	if ( lines.empty() )
+		return fail( "Empty tree" );
+
+	size_t next = 0;
+	root = build( lines, next, 0 );
+	if ( !lastError.empty() )
+		return false;
+	if ( next != lines.size() )
+		return fail( "Unexpected line \"" + lines[next].text + "\"" );
+	return true;
+}
+
+// Node (or class) of the branches at a depth, starting at lines[next].
+int
+DecisionTree::build( const vector<Line> &lines, size_t &next, int depth )
+{
+	vector< pair<double, int> > branches;
+	int feature = lines[next].feature;
+	while ( next < lines.size() && lines[next].depth == depth )
+	{
+		const Line &line = lines[next++];
+		if ( line.feature != feature )
+		{
+			fail( "Feature mismatch at \"" + line.text + "\"" );
+			return ~0;
+		}
+		int child;
+		if ( line.leaf >= 0 )
+			child = ~line.leaf;
+		else if ( next < lines.size() && lines[next].depth == depth + 1 )
+			child = build( lines, next, depth + 1 );
+		else
+		{
+			fail( "Missing subtree under \"" + line.text + "\"" );
+			return ~0;
+		}
+		branches.push_back( make_pair( line.high, child ) );
+	}
+	if ( next < lines.size() && lines[next].depth > depth )
+	{
+		fail( "Tree jumps two levels at \"" + lines[next].text + "\"" );
+		return ~0;
+	}
+
+	// A chain of nodes, one per bound but the last.
+	stable_sort( branches.begin(), branches.end(),
+				 []( const pair<double, int> &a, const pair<double, int> &b )
+				 { return a.first < b.first; } );
+	int child = branches.back().second;
+	for (int i = (int)branches.size() - 2; i >= 0; i--)
+	{
+		Node node = { feature, branches[i].first, branches[i].second, child };
+		nodes.push_back( node );
+		child = nodes.size() - 1;
+	}
+	return child;
+}
+
+void
+DecisionTree::classifyBatch( const double *values, int count, int stride,
+							 int *classes ) const
+{
+	for (int i = 0; i < count; i++)
+	{
+		const double *row = values + (size_t)i * stride;
+		classes[i] = classify( [row]( int feature ) { return row[feature]; } );
+	}
+}
+
+int
+DecisionTree::depthFrom( int node ) const
+{
+	if ( node < 0 )
+		return 0;
+	return 1 + max( depthFrom( nodes[node].left ),
+					depthFrom( nodes[node].right ) );
+}
+
+int
+DecisionTree::depth() const
+{
+	return depthFrom( root );
+}
+
+void
+DecisionTree::generateNode( int node, int indent, string &out ) const
+{
+	string tabs( indent, '\t' );
+	char line[256];
+	if ( node < 0 )
+	{
+		snprintf( line, sizeof( line ), "%sreturn %d;\t// %s\n", tabs.c_str(),
+				  ~node, classNames[~node].c_str() );
+		out += line;
+		return;
+	}
+
+	const Node &n = nodes[node];
+	snprintf( line, sizeof( line ), "%sif ( features[%d] <= %.17g )\n",
+			  tabs.c_str(), n.feature, n.threshold );
+	out += line;
+	bool braces = n.left >= 0;
+	out += braces ? tabs + "{\n" : "";
+	generateNode( n.left, indent + 1, out );
+	out += braces ? tabs + "}\n" : "";
+	out += tabs + "else\n";
+	braces = n.right >= 0;
+	out += braces ? tabs + "{\n" : "";
+	generateNode( n.right, indent + 1, out );
+	out += braces ? tabs + "}\n" : "";
+}
+
+string
+DecisionTree::generateCpp( const string &name,
+						   const vector<string> &featureNames ) const
+{
+	string out = "/*\n * Generated from a J48 tree.\n * Classes :";
+	for (size_t c = 0; c < classNames.size(); c++)
+	{
+		char text[128];
+		snprintf( text, sizeof( text ), " %d %s", (int)c, classNames[c].c_str() );
+		out += text;
+	}
+	out += "\n * Features :";
+
+	// Only the features the tree uses.
+	vector<bool> used( featureNames.size(), false );
+	for (size_t n = 0; n < nodes.size(); n++)
+		used[nodes[n].feature] = true;
+	for (size_t f = 0; f < featureNames.size(); f++)
+		if ( used[f] )
+		{
+			char text[128];
+			snprintf( text, sizeof( text ), " %d %s", (int)f,
+					  featureNames[f].c_str() );
+			out += text;
+		}
+	out += "\n */\nint\n" + name + "( const double *features )\n{\n";
+	generateNode( root, 1, out );
+	out += "}\n";
+	return out;
+}
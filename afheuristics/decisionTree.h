@@ -0,0 +1,98 @@
+#ifndef _DecisionTree_H
+#define _DecisionTree_H
+
+#include <string>
+#include <vector>
+
+/*
+ * A decision tree trained by Weka (weka.classifiers.trees.J48), read from
+ * Weka's text output (the same input as parsej48.py) and flattened into a
+ * table of binary nodes : each node sends a feature value to its left
+ * child if it is <= the node's threshold, to its right child otherwise.
+ * Multi-way splits (nominal values, or ranges from -ds) become chains of
+ * such nodes. Classifying walks the table without recursion or allocation.
+ */
+class DecisionTree
+{
+public:
+	DecisionTree();
+
+	/*
+	 * Read a tree. featureNames are the features that may appear in the
+	 * tree; the tree refers to them by their index in this list. Returns
+	 * false if the tree can't be read (see error()).
+	 */
+	bool load( const std::string &fileName,
+			   const std::vector<std::string> &featureNames );
+	bool parse( const std::string &text,
+				const std::vector<std::string> &featureNames );
+
+	/*
+	 * Classes of the leaves, in order of appearance in the tree. A class
+	 * is an index into this list.
+	 */
+	const std::vector<std::string> & classes() const { return classNames; }
+	int classIndex( const std::string &name ) const;
+
+	/*
+	 * Class of an instance. features( f ) is the value of feature f, only
+	 * computed for the features on the instance's path.
+	 */
+	template <class Features>
+	int classify( const Features &features ) const
+	{
+		int n = root;
+		while ( n >= 0 )
+		{
+			const Node &node = nodes[n];
+			n = features( node.feature ) <= node.threshold ?
+				node.left : node.right;
+		}
+		return ~n;
+	}
+
+	/*
+	 * Class of each of count instances whose feature values are in rows
+	 * stride values apart (row i starts at values + i * stride).
+	 */
+	void classifyBatch( const double *values, int count, int stride,
+						int *classes ) const;
+
+	/*
+	 * Number of nodes, and length of the longest path.
+	 */
+	int size() const { return nodes.size(); }
+	int depth() const;
+
+	/*
+	 * C++ source of a function "int name( const double *features )"
+	 * returning the class of an instance, as nested ifs.
+	 */
+	std::string generateCpp( const std::string &name,
+							 const std::vector<std::string> &featureNames ) const;
+
+	const std::string & error() const { return lastError; }
+
+private:
+	// Children >= 0 are nodes, children < 0 are classes (~child).
+	struct Node
+	{
+		int feature;
+		double threshold;
+		int left;
+		int right;
+	};
+
+	struct Line;
+	int build( const std::vector<Line> &lines, size_t &next, int depth );
+	int depthFrom( int node ) const;
+	void generateNode( int node, int indent, std::string &out ) const;
+	bool fail( const std::string &message );
+
+	std::vector<Node> nodes;
+	int root;
+	std::vector<std::string> classNames;
+	std::string lastError;
+};
+
+#endif
@@ -0,0 +1,350 @@
+#include "featureSet.h"
+#include <ctype.h>
+#include <fstream>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+static const char Magic[4] = { 'A', 'F', 'F', 'S' };
+static const int32_t Version = 1;
+
+FeatureSet::FeatureSet()
+	: weighted( false )
+{
+}
+
+bool
+FeatureSet::fail( const string &message ) const
+{
+	lastError = message;
+	return false;
+}
+
+void
+FeatureSet::clear()
+{
+	relation.clear();
+	features.clear();
+	types.clear();
+	classAttribute.clear();
+	classes.clear();
+	weighted = false;
+	values.clear();
+	labels.clear();
+	weights.clear();
+	lastError.clear();
+}
+
+void
+FeatureSet::add( const double *row, int label, double weight )
+{
+	values.insert( values.end(), row, row + features.size() );
+	labels.push_back( label );
+	weights.push_back( weight );
+}
+
+void
+FeatureSet::append( const FeatureSet &other )
+{
+	values.insert( values.end(), other.values.begin(), other.values.end() );
+	labels.insert( labels.end(), other.labels.begin(), other.labels.end() );
+	weights.insert( weights.end(), other.weights.begin(), other.weights.end() );
+}
+
+bool
+FeatureSet::read( const string &fileName )
+{
+	FILE *file = fopen( fileName.c_str(), "rb" );
+	if ( file == NULL )
+		return fail( "Could not read file: " + fileName );
+	char start[4] = { 0, 0, 0, 0 };
+	size_t got = fread( start, 1, sizeof( start ), file );
+	fclose( file );
+
+	if ( got == sizeof( start ) && memcmp( start, Magic, sizeof( Magic ) ) == 0 )
+		return readBinary( fileName );
+	return readArff( fileName );
+}
+
+static string
+trim( const string &text )
+{
+	size_t begin = text.find_first_not_of( " \t\r" );
+	if ( begin == string::npos )
+		return "";
+	size_t end = text.find_last_not_of( " \t\r" );
+	return text.substr( begin, end - begin + 1 );
+}
+
+// The first word of a line, and the rest of it.
+static void
+splitWord( const string &line, string &word, string &rest )
+{
+	size_t end = line.find_first_of( " \t" );
+	word = line.substr( 0, end );
+	rest = end == string::npos ? "" : trim( line.substr( end ) );
+}
+
+bool
+FeatureSet::readArff( const string &fileName )
+{
+	clear();
+	ifstream in( fileName.c_str() );
+	if ( !in )
+		return fail( "Could not read file: " + fileName );
+
+	string line;
+	bool data = false;
+	vector<string> attributes;
+	vector<string> attributeTypes;
+	while ( getline( in, line ) )
+	{
+		line = trim( line );
+		if ( line.empty() || line[0] == '%' )
+			continue;
+
+		if ( !data )
+		{
+			string keyword, rest;
+			splitWord( line, keyword, rest );
+			for (size_t i = 0; i < keyword.size(); i++)
+				keyword[i] = toupper( keyword[i] );
+			if ( keyword == "@RELATION" )
+				relation = rest;
+			else if ( keyword == "@ATTRIBUTE" )
+			{
+				string name, type;
+				splitWord( rest, name, type );
+				attributes.push_back( name );
+				attributeTypes.push_back( type );
+			}
+			else if ( keyword == "@DATA" )
+			{
+				// The last attribute is the class, with nominal values.
+				if ( attributes.size() < 2 )
+					return fail( "No features in " + fileName );
+				string classType = attributeTypes.back();
+				if ( classType.size() < 2 || classType[0] != '{' ||
+					 classType[classType.size() - 1] != '}' )
+					return fail( "The class of " + fileName + " isn't nominal" );
+				classAttribute = attributes.back();
+				string list = classType.substr( 1, classType.size() - 2 );
+				size_t begin = 0;
+				while ( begin <= list.size() )
+				{
+					size_t end = list.find( ',', begin );
+					if ( end == string::npos )
+						end = list.size();
+					string value = trim( list.substr( begin, end - begin ) );
+					if ( !value.empty() )
+						classes.push_back( value );
+					begin = end + 1;
+				}
+				features.assign( attributes.begin(), attributes.end() - 1 );
+				types.assign( attributeTypes.begin(), attributeTypes.end() - 1 );
+				data = true;
+			}
+			continue;
+		}
+
+		// "value,...,value,class", maybe followed by ",{weight}".
+		const char *text = line.c_str();
+		for (size_t f = 0; f < features.size(); f++)
+		{
+			char *end;
+			values.push_back( strtod( text, &end ) );
+			while ( *end == ' ' )
+				end++;
+			if ( end == text || *end != ',' )
+				return fail( "Malformed instance \"" + line + "\" in " + fileName );
+			text = end + 1;
+		}
+
+		string rest( text );
+		size_t comma = rest.find( ',' );
+		string label = trim( rest.substr( 0, comma ) );
+		double weight = 1;
+		if ( comma != string::npos )
+		{
+			string last = trim( rest.substr( comma + 1 ) );
+			if ( last.size() < 2 || last[0] != '{' )
+				return fail( "Malformed instance \"" + line + "\" in " + fileName );
+			weight = atof( last.c_str() + 1 );
+			weighted = true;
+		}
+
+		int c = 0;
+		while ( c < (int)classes.size() && classes[c] != label )
+			c++;
+		if ( c == (int)classes.size() )
+			return fail( "Unknown class " + label + " in " + fileName );
+		labels.push_back( c );
+		weights.push_back( weight );
+	}
+	if ( !data )
+		return fail( "No @DATA in " + fileName );
+	return true;
+}
+
+bool
+FeatureSet::writeArff( const string &fileName, const char *format ) const
+{
+	FILE *file = fileName == "-" ? stdout : fopen( fileName.c_str(), "w" );
+	if ( file == NULL )
+		return fail( "Could not write file: " + fileName );
+
+	fprintf( file, "@RELATION %s\n\n", relation.c_str() );
+	for (size_t f = 0; f < features.size(); f++)
+		fprintf( file, "@ATTRIBUTE %s %s\n", features[f].c_str(),
+				 types[f].c_str() );
+	fprintf( file, "@ATTRIBUTE %s {", classAttribute.c_str() );
+	for (size_t c = 0; c < classes.size(); c++)
+		fprintf( file, "%s%s", c == 0 ? "" : ", ", classes[c].c_str() );
+	fprintf( file, "}\n\n@DATA\n" );
+
+	for (int i = 0; i < size(); i++)
+	{
+		const double *r = row( i );
+		for (size_t f = 0; f < features.size(); f++)
+		{
+			fprintf( file, format, r[f] );
+			fputc( ',', file );
+		}
+		fputs( classes[labels[i]].c_str(), file );
+		if ( weighted )
+			fprintf( file, ",{%.3f}", weights[i] );
+		fputc( '\n', file );
+	}
+
+	bool written = !ferror( file );
+	if ( file != stdout )
+		written = fclose( file ) == 0 && written;
+	else
+		written = fflush( file ) == 0 && written;
+	if ( !written )
+		return fail( "Could not write file: " + fileName );
+	return true;
+}
+
+static void
+putInt( FILE *file, int32_t value )
+{
+	fwrite( &value, sizeof( value ), 1, file );
+}
+
+static void
+putString( FILE *file, const string &text )
+{
+	putInt( file, text.size() );
+	fwrite( text.data(), 1, text.size(), file );
+}
+
+bool
+FeatureSet::writeBinary( const string &fileName ) const
+{
+	FILE *file = fopen( fileName.c_str(), "wb" );
+	if ( file == NULL )
+		return fail( "Could not write file: " + fileName );
+
+	fwrite( Magic, 1, sizeof( Magic ), file );
+	putInt( file, Version );
+	putInt( file, features.size() );
+	putInt( file, classes.size() );
+	putInt( file, size() );
+	putString( file, relation );
+	putString( file, classAttribute );
+	for (size_t f = 0; f < features.size(); f++)
+	{
+		putString( file, features[f] );
+		putString( file, types[f] );
+	}
+	for (size_t c = 0; c < classes.size(); c++)
+		putString( file, classes[c] );
+
+	vector<float> floats( values.begin(), values.end() );
+	vector<int32_t> ints( labels.begin(), labels.end() );
+	vector<float> floatWeights( weights.begin(), weights.end() );
+	fwrite( floats.data(), sizeof( float ), floats.size(), file );
+	fwrite( ints.data(), sizeof( int32_t ), ints.size(), file );
+	fwrite( floatWeights.data(), sizeof( float ), floatWeights.size(), file );
+
+	bool written = !ferror( file );
+	written = fclose( file ) == 0 && written;
+	if ( !written )
+		return fail( "Could not write file: " + fileName );
+	return true;
+}
+
+static bool
+getInt( FILE *file, int32_t &value )
+{
+	return fread( &value, sizeof( value ), 1, file ) == 1;
+}
+
+static bool
+getString( FILE *file, string &text )
+{
+	int32_t length;
+	if ( !getInt( file, length ) || length < 0 || length > (1 << 20) )
+		return false;
+	text.resize( length );
+	return length == 0 || fread( &text[0], 1, length, file ) == (size_t)length;
+}
+
+bool
+FeatureSet::readBinary( const string &fileName )
+{
+	clear();
+	FILE *file = fopen( fileName.c_str(), "rb" );
+	if ( file == NULL )
+		return fail( "Could not read file: " + fileName );
+
+	char magic[4];
+	int32_t version, featureCount, classCount, count;
+	bool ok = fread( magic, 1, sizeof( magic ), file ) == sizeof( magic ) &&
+		memcmp( magic, Magic, sizeof( Magic ) ) == 0 &&
+		getInt( file, version ) && version == Version &&
+		getInt( file, featureCount ) && featureCount >= 0 &&
+		getInt( file, classCount ) && classCount >= 0 &&
+		getInt( file, count ) && count >= 0 &&
+		getString( file, relation ) && getString( file, classAttribute );
+
+	features.resize( ok ? featureCount : 0 );
+	types.resize( features.size() );
+	for (size_t f = 0; ok && f < features.size(); f++)
+		ok = getString( file, features[f] ) && getString( file, types[f] );
+	classes.resize( ok ? classCount : 0 );
+	for (size_t c = 0; ok && c < classes.size(); c++)
+		ok = getString( file, classes[c] );
+
+	if ( ok )
+	{
+		size_t n = (size_t)count * featureCount;
+		vector<float> floats( n );
+		vector<int32_t> ints( count );
+		vector<float> floatWeights( count );
+		ok = fread( floats.data(), sizeof( float ), n, file ) == n &&
+			fread( ints.data(), sizeof( int32_t ), count, file ) == (size_t)count &&
+			fread( floatWeights.data(), sizeof( float ), count, file ) ==
+				(size_t)count;
+		values.assign( floats.begin(), floats.end() );
+		labels.assign( ints.begin(), ints.end() );
+		weights.assign( floatWeights.begin(), floatWeights.end() );
+		for (int i = 0; ok && i < count; i++)
+		{
+			ok = labels[i] >= 0 && labels[i] < classCount;
+			weighted = weighted || weights[i] != 1.0f;
+		}
+	}
+	fclose( file );
+
+	if ( !ok )
+	{
+		clear();
+		return fail( "Not a valid feature file: " + fileName );
+	}
+	return true;
+}
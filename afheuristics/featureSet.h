@@ -0,0 +1,77 @@
+#ifndef _FeatureSet_H
+#define _FeatureSet_H
+
+#include <string>
+#include <vector>
+
+/*
+ * Instances to train or test a decision tree on : a row of feature values,
+ * a class and a weight per instance. They are read from and written to
+ * ARFF files (Weka's format, as made by makeleftrightfeatures.py and
+ * simulate.py), or to a binary file that is faster to read and smaller.
+ *
+ * Only numeric features are supported; nominal ones must have numbers as
+ * values, such as the {0,1} features of featuresfirststep.py. The class is
+ * the last attribute. Weights follow the class as "{weight}".
+ *
+ * The binary format, in the byte order of the machine : "AFFS", then the
+ * 32-bit integers version (1), feature count, class count and instance
+ * count, then the strings relation, class attribute, the names and ARFF
+ * types of the features and the class values (each a 32-bit length and its
+ * characters), then the values of every instance as floats, a row after
+ * the other, their classes as 32-bit integers and their weights as floats.
+ */
+class FeatureSet
+{
+public:
+	FeatureSet();
+
+	std::string relation;				// @RELATION
+	std::vector<std::string> features;
+	std::vector<std::string> types;		// of each feature, e.g. "numeric"
+	std::string classAttribute;			// e.g. "action"
+	std::vector<std::string> classes;	// its values
+	bool weighted;						// ARFF lines end with "{weight}"
+
+	std::vector<double> values;			// size() rows of features.size()
+	std::vector<int> labels;			// index into classes
+	std::vector<double> weights;		// 1 unless weighted
+
+	int size() const { return labels.size(); }
+	const double * row( int i ) const
+	{
+		return &values[(size_t)i * features.size()];
+	}
+
+	void add( const double *row, int label, double weight = 1.0 );
+
+	/*
+	 * Append the instances of another set with the same attributes.
+	 */
+	void append( const FeatureSet &other );
+
+	/*
+	 * Read a file, binary or ARFF (told apart by their first bytes).
+	 */
+	bool read( const std::string &fileName );
+	bool readArff( const std::string &fileName );
+	bool readBinary( const std::string &fileName );
+
+	/*
+	 * Write an ARFF file, its values printed with format ("%.3f" like
+	 * simulate.py, "%g" for integers); "-" is stdout.
+	 */
+	bool writeArff( const std::string &fileName,
+					const char *format = "%g" ) const;
+	bool writeBinary( const std::string &fileName ) const;
+
+	const std::string & error() const { return lastError; }
+
+private:
+	bool fail( const std::string &message ) const;
+	void clear();
+
+	mutable std::string lastError;
+};
+
+#endif
@@ -1,76 +1,60 @@
-# Should replace with a Makefile if we ever have more than
-# one file.
-g++ localMax.cpp -o localMax.exe
+# Build localMax.exe with the other tools.
+make localmax
 
 maximaFile=maxima.txt
 
-# Empty what's in the file previously (we need to do that because
-# we will be appending to the file multiple times)
-cat /dev/null > $maximaFile
-
-for file in \
-	backyard.txt \
-	bench.txt \
-	book.txt \
-	bridge.txt \
-	building1.txt \
-	building2.txt \
-	building3.txt \
-	cat.txt \
-	cup1.txt \
-	cup2.txt \
-	cup3.txt \
-	cup4.txt \
-	fabric.txt \
-	flower.txt \
-	interior1.txt \
-	interior2.txt \
-	lamp.txt \
-	landscape1.txt \
-	landscape2.txt \
-	landscape3.txt \
-	moon.txt \
-	screen.txt \
-	snails.txt \
-	stillLife.txt \
-	vase.txt \
-	books1.txt \
-	books2.txt \
-	books3.txt \
-	books4.txt \
-	gorillapod.txt \
-	granola.txt \
-	timbuk.txt \
-	ubuntu.txt
-do
-	echo $file >> $maximaFile
-	./localMax.exe < focusmeasures/$file >> $maximaFile
-done
-
-# For gametree.txt, localmax misses a maxima.
-echo gametree.txt >> $maximaFile
-echo " "`./localMax.exe < focusmeasures/gametree.txt`" 56" >> $maximaFile
+# One run over every curve. localMax misses a maximum of gametree.txt, and
+# two of screws2.txt : they are added by hand.
+./localMax.exe \
+	--add=gametree.txt:56 \
+	--add=screws2.txt:75,97 \
+	focusmeasures/backyard.txt \
+	focusmeasures/bench.txt \
+	focusmeasures/book.txt \
+	focusmeasures/bridge.txt \
+	focusmeasures/building1.txt \
+	focusmeasures/building2.txt \
+	focusmeasures/building3.txt \
+	focusmeasures/cat.txt \
+	focusmeasures/cup1.txt \
+	focusmeasures/cup2.txt \
+	focusmeasures/cup3.txt \
+	focusmeasures/cup4.txt \
+	focusmeasures/fabric.txt \
+	focusmeasures/flower.txt \
+	focusmeasures/interior1.txt \
+	focusmeasures/interior2.txt \
+	focusmeasures/lamp.txt \
+	focusmeasures/landscape1.txt \
+	focusmeasures/landscape2.txt \
+	focusmeasures/landscape3.txt \
+	focusmeasures/moon.txt \
+	focusmeasures/screen.txt \
+	focusmeasures/snails.txt \
+	focusmeasures/stillLife.txt \
+	focusmeasures/vase.txt \
+	focusmeasures/books1.txt \
+	focusmeasures/books2.txt \
+	focusmeasures/books3.txt \
+	focusmeasures/books4.txt \
+	focusmeasures/gorillapod.txt \
+	focusmeasures/granola.txt \
+	focusmeasures/timbuk.txt \
+	focusmeasures/ubuntu.txt \
+	focusmeasures/gametree.txt \
+	lowlightgaussnorm/blackboard1.txt \
+	lowlightgaussnorm/blackboard2.txt \
+	lowlightgaussnorm/pillow1.txt \
+	lowlightgaussnorm/pillow2.txt \
+	lowlightgaussnorm/pillow3.txt \
+	lowlightgaussnorm/projector1.txt \
+	lowlightgaussnorm/projector2.txt \
+	lowlightgaussnorm/projector3.txt \
+	lowlightgaussnorm/screws1.txt \
+	lowlightgaussnorm/whiteboard1.txt \
+	lowlightgaussnorm/whiteboard2.txt \
+	lowlightgaussnorm/whiteboard3.txt \
+	lowlightgaussnorm/screws2.txt \
+	> $maximaFile
 
 ./makestatistics.py > stats.R
-
-for file in \
-	blackboard1.txt \
-	blackboard2.txt \
-	pillow1.txt \
-	pillow2.txt \
-	pillow3.txt \
-	projector1.txt \
-	projector2.txt \
-	projector3.txt \
-	screws1.txt \
-	whiteboard1.txt \
-	whiteboard2.txt \
-	whiteboard3.txt
-do
-	echo $file >> $maximaFile
-	./localMax.exe < lowlightgaussnorm/$file >> $maximaFile
-done
-
-# For screws2.txt, localmax misses two maxima.
-echo screws2.txt >> $maximaFile
-echo " "`./localMax.exe < lowlightgaussnorm/screws2.txt`" 75 97" >> $maximaFile
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "afSimulator.h"
+#include "peakEstimator.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: fitpeaks [OPTIONS]" << endl;
+    cerr << "\t Evaluates the peak fits of the controller on the curves of" << endl;
+    cerr << "\t focusmeasures/ : each peak of maxima.txt is sampled every" << endl;
+    cerr << "\t coarse step, from every offset, and estimated from the" << endl;
+    cerr << "\t samples around the highest one. Prints, for each fit and" << endl;
+    cerr << "\t number of samples, how far the estimates are from the peaks" << endl;
+    cerr << "\t (none is the highest sample). Peaks at an end of the lens or" << endl;
+    cerr << "\t next to a higher one have no fit, the highest sample being" << endl;
+    cerr << "\t the first or the last." << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --coarse-step=N : lens positions between samples (default 8)" << endl;
+    cerr << "\t --raw : the curves of focusraw/, not normalized" << endl;
+    cerr << "\t --store=FILE : the scenes of a curve store (see makestore)," << endl;
+    cerr << "\t     instead of a folder and maxima.txt" << endl;
+    exit(1);
+}
+
+// Print rows such that each column is aligned on the right.
+static void
+print_aligned_rows( const vector< vector<string> > &rows )
+{
+    vector<size_t> widths;
+    for (size_t r = 0; r < rows.size(); r++)
+        for (size_t c = 0; c < rows[r].size(); c++)
+        {
+            if (c >= widths.size())
+                widths.push_back( 0 );
+            widths[c] = max( widths[c], rows[r][c].size() );
+        }
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        string line;
+        for (size_t c = 0; c < rows[r].size(); c++)
+        {
+            if (c > 0)
+                line += "|";
+            line += string( widths[c] - rows[r][c].size(), ' ' ) + rows[r][c];
+        }
+        printf( "%s\n", line.c_str() );
+    }
+}
+
+static string
+format( const char *pattern, double value )
+{
+    char text[64];
+    snprintf( text, sizeof( text ), pattern, value );
+    return text;
+}
+
+int
+main( int argc, char *argv[] )
+{
+    int coarseStep = 8;
+    string folder = "focusmeasures";
+    string storeFile;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option.compare(0, 14, "--coarse-step=") == 0)
+            coarseStep = atoi(option.substr(14).c_str());
+        else if (option == "--raw")
+            folder = "focusraw";
+        else if (option.compare(0, 8, "--store=") == 0)
+            storeFile = option.substr(8);
+        else
+            print_usage();
+    }
+    if (coarseStep < 1)
+        print_usage();
+
+    vector<AfScene> scenes;
+    string error;
+    bool loaded = storeFile.empty() ?
+        loadScenes( folder, "maxima.txt", vector<string>(), scenes, error ) :
+        loadStoredScenes( storeFile, -1, folder == "focusmeasures",
+                          vector<string>(), scenes, error );
+    if (!loaded)
+    {
+        cerr << error << endl;
+        exit(1);
+    }
+
+    vector< vector<string> > rows;
+    const char *header[] = { "fit", "samples", "peaks", "no fit %",
+                             "error", "within 1 %", "within 2 %" };
+    rows.push_back( vector<string>( header, header + 7 ) );
+
+    const PeakFit fits[] = { NoPeakFit, ParabolicFit, GaussianFit, CentroidFit };
+    for (int f = 0; f < 4; f++)
+        for (int samples = 3; samples <= 5; samples++)
+        {
+            if (fits[f] == NoPeakFit && samples > 3)
+                break;
+            int peaks = 0, failed = 0, within1 = 0, within2 = 0;
+            double distance = 0;
+            for (size_t s = 0; s < scenes.size(); s++)
+            {
+                const AfScene &scene = scenes[s];
+                int stepCount = scene.values.size();
+                for (size_t m = 0; m < scene.maxima.size(); m++)
+                    for (int phase = 0; phase < coarseStep; phase++)
+                    {
+                        // The samples of a sweep over the peak, as far as
+                        // a fit could reach, but not much further (other
+                        // peaks).
+                        int peak = scene.maxima[m];
+                        vector<int> positions;
+                        vector<double> values;
+                        for (int p = peak - phase - 2 * coarseStep;
+                             p <= peak + 2 * coarseStep; p += coarseStep)
+                            if (p >= 0 && p < stepCount)
+                            {
+                                positions.push_back( p );
+                                values.push_back( scene.values[p] );
+                            }
+
+                        double estimate = 0;
+                        bool found = true;
+                        if (fits[f] == NoPeakFit)
+                        {
+                            int best = 0;
+                            for (size_t i = 1; i < values.size(); i++)
+                                if (values[i] > values[best])
+                                    best = i;
+                            estimate = positions[best];
+                        }
+                        else
+                            found = estimatePeak( fits[f], &positions[0],
+                                                  &values[0], positions.size(),
+                                                  samples, estimate );
+                        peaks++;
+                        if (!found)
+                        {
+                            failed++;
+                            continue;
+                        }
+                        int miss = abs( (int)floor( estimate + 0.5 ) - peak );
+                        distance += fabs( estimate - peak );
+                        within1 += miss <= 1;
+                        within2 += miss <= 2;
+                    }
+            }
+
+            int estimated = peaks - failed;
+            vector<string> row;
+            row.push_back( peakFitName( fits[f] ) );
+            row.push_back( fits[f] == NoPeakFit ? "-" :
+                           format( "%.0f", samples ) );
+            row.push_back( format( "%.0f", peaks ) );
+            row.push_back( format( "%.1f", 100.0 * failed / max( peaks, 1 ) ) );
+            row.push_back( format( "%.2f", distance / max( estimated, 1 ) ) );
+            row.push_back( format( "%.1f", 100.0 * within1 / max( estimated, 1 ) ) );
+            row.push_back( format( "%.1f", 100.0 * within2 / max( estimated, 1 ) ) );
+            rows.push_back( row );
+        }
+    print_aligned_rows( rows );
+
+    return( 0 );
+}
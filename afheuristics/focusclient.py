@@ -0,0 +1,95 @@
+"""
+Client of focusd, the focus measurement daemon (see
+focusmeasure/focusProtocol.h for the protocol).
+
+    client = FocusClient("/tmp/focusd.sock")
+    names = client.measures()
+    values = client.measure(pixels, width, height, [0, 4, 27])
+
+pixels is a string of width * height bytes. Frames that are already in a
+file (e.g. in /dev/shm) can be measured without sending them with
+measure_shared.
+"""
+
+import socket
+import struct
+
+MEASURE_REQUEST = 1
+MEASURE_SHARED_REQUEST = 2
+LIST_REQUEST = 3
+
+SCALE_HALF = 1
+CROP = 2
+
+class FocusError(Exception):
+    """Error reported by the daemon."""
+    pass
+
+class FocusClient(object):
+    """See file docstring."""
+
+    def __init__(self, socket_path):
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._socket.connect(socket_path)
+        self._next_id = 0
+
+    def close(self):
+        self._socket.close()
+
+    def _read(self, size):
+        data = b""
+        while len(data) < size:
+            chunk = self._socket.recv(size - len(data))
+            if not chunk:
+                raise FocusError("Connection closed by focusd")
+            data += chunk
+        return data
+
+    def _request(self, request_type, body):
+        """Send a request and return the count and body of its reply."""
+        self._next_id += 1
+        message = struct.pack("<II", request_type, self._next_id) + body
+        self._socket.sendall(struct.pack("<I", len(message)) + message)
+
+        length, = struct.unpack("<I", self._read(4))
+        status, request_id, count = struct.unpack("<III", self._read(12))
+        reply = self._read(length - 12)
+        if status != 0:
+            raise FocusError(reply.decode())
+        return count, reply
+
+    def _header(self, width, height, measures, scale_half, crop,
+                pyramid_level):
+        flags = (SCALE_HALF if scale_half else 0) | (CROP if crop else 0)
+        return (struct.pack("<IIIII", width, height, flags, pyramid_level,
+                            len(measures)) +
+                struct.pack("<%dI" % len(measures), *measures))
+
+    def measure(self, pixels, width, height, measures, scale_half=False,
+                crop=False, pyramid_level=0):
+        """Focus values of a frame, one per measure."""
+        body = self._header(width, height, measures, scale_half, crop,
+                            pyramid_level) + pixels
+        count, reply = self._request(MEASURE_REQUEST, body)
+        return list(struct.unpack("<%dd" % count, reply))
+
+    def measure_shared(self, path, offset, width, height, measures,
+                       scale_half=False, crop=False, pyramid_level=0):
+        """Focus values of a frame found at offset in a file."""
+        path = path.encode()
+        body = (self._header(width, height, measures, scale_half, crop,
+                             pyramid_level) +
+                struct.pack("<QI", offset, len(path)) + path)
+        count, reply = self._request(MEASURE_SHARED_REQUEST, body)
+        return list(struct.unpack("<%dd" % count, reply))
+
+    def measures(self):
+        """Names of the measures, in the order of their numbers."""
+        count, reply = self._request(LIST_REQUEST, b"")
+        names = []
+        position = 0
+        for i in range(count):
+            length, = struct.unpack("<I", reply[position:position + 4])
+            names.append(reply[position + 4:position + 4 + length].decode())
+            position += 4 + length
+        return names
@@ -0,0 +1,56 @@
+"""
+Focus measures computed in-process through libfocusmeasure.so (see
+focusmeasure/focusLibrary.h), instead of running apply and parsing its
+output.
+
+    library = FocusLibrary("../focusmeasure/libfocusmeasure.so")
+    values = library.measure_batch([pixels, ...], width, height, [0, 4])
+
+Frames are strings of width * height bytes, read in place.
+"""
+
+import ctypes
+
+SCALE_HALF = 1
+CROP = 2
+
+class FocusLibraryError(Exception):
+    """Error code returned by the library."""
+    pass
+
+class FocusLibrary(object):
+    """See file docstring."""
+
+    def __init__(self, path):
+        lib = ctypes.CDLL(path)
+        lib.focus_error_message.restype = ctypes.c_char_p
+        lib.focus_measure_name.restype = ctypes.c_char_p
+        lib.focus_measure_batch.argtypes = [
+            ctypes.POINTER(ctypes.c_char_p), ctypes.c_int, ctypes.c_int,
+            ctypes.c_int, ctypes.POINTER(ctypes.c_int), ctypes.c_int,
+            ctypes.c_int, ctypes.c_int, ctypes.POINTER(ctypes.c_double)]
+        self._lib = lib
+
+    def _check(self, error):
+        if error != 0:
+            message = self._lib.focus_error_message(error)
+            raise FocusLibraryError(message.decode())
+
+    def measures(self):
+        """Names of the measures, in the order of their numbers."""
+        return [self._lib.focus_measure_name(m).decode()
+                for m in range(self._lib.focus_measure_count())]
+
+    def measure_batch(self, frames, width, height, measures, scale_half=False,
+                      crop=False, pyramid_level=0):
+        """Focus values of each frame, a list of one value per measure for
+        each frame."""
+        flags = (SCALE_HALF if scale_half else 0) | (CROP if crop else 0)
+        frame_array = (ctypes.c_char_p * len(frames))(*frames)
+        measure_array = (ctypes.c_int * len(measures))(*measures)
+        values = (ctypes.c_double * (len(frames) * len(measures)))()
+        self._check(self._lib.focus_measure_batch(
+            frame_array, len(frames), width, height, measure_array,
+            len(measures), flags, pyramid_level, values))
+        return [list(values[i * len(measures):(i + 1) * len(measures)])
+                for i in range(len(frames))]
@@ -1,5 +1,23 @@
 #!/bin/bash
-# Perform leave-one-out benchmarks.
+# Perform leave-one-out benchmarks. Options (e.g. --lowlight) are passed on to
+# benchmark.sh. With -n / --native, afbenchmark.exe trains the action tree of
+# every fold itself and runs all the folds at once (make first).
+
+nativeargs=""
+native=false
+for arg in "$@"; do
+    case $arg in
+        -n | --native ) native=true ;;
+        -ll | --lowlight | --low-light ) nativeargs="$nativeargs --lowlight" ;;
+        -llg | --lowlightgauss | --low-light-gauss )
+              nativeargs="$nativeargs --lowlightgauss" ;;
+    esac
+done
+if [ "$native" = true ]; then
+    ./afbenchmark.exe --left-right-tree=results/nearest3_weka.txt \
+        --leave-one-out --backlash --noise $nativeargs > results.txt
+    exit
+fi
 
 cat /dev/null > results.txt
 
@@ -38,5 +56,5 @@ for file in \
     vase.txt
 do
     ./makeactiontree.sh -lv $file
-    ./benchmark.sh -lv $file --simulate-errors
+    ./benchmark.sh -lv $file --simulate-errors "$@"
 done
\ No newline at end of file
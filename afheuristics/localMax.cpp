@@ -1,124 +1,126 @@
 /*
- *  Print the local maxima.
+ *  Print the local maxima of focus curves (see peakDetector.h).
  *  Assumes that the focus measure data
  *  has been normalized to [0, 1].
  */
 
+#include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 
-void printLocalMax( int n, double phi[] );
+#include "peakDetector.h"
 
-int
-main( int argc, char *argv[] )
+using namespace std;
+
+void print_usage()
 {
-    double fm[256];
+    cerr << "Usage: localMax [OPTIONS] [FILE...]" << endl;
+    cerr << "\t Prints the local maxima of a focus curve read from stdin," << endl;
+    cerr << "\t or of each file in the format of maxima.txt (a line with" << endl;
+    cerr << "\t the name of the file, then a line with its maxima)." << endl;
+    cerr << "\t A curve has a line \"position value\" per lens position." << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --add=NAME:POS[,POS...] : maxima to add to those found in" << endl;
+    cerr << "\t     the file NAME (e.g. gametree.txt:56, for those the" << endl;
+    cerr << "\t     detector misses)" << endl;
+    exit(1);
+}
 
+/*
+ *  Feed a curve to the detector as it is read.
+ */
+static bool
+read_curve( FILE *in, const string &name, PeakDetector &detector )
+{
+    detector.reset();
     int i;
     float f;
-    int n = 0;
-    while( fscanf( stdin, "%d %f\n", &i, &f ) != EOF ) {
-	if( i != n ) {
-	    fprintf( stderr, "trouble on input (%d != %d)\n", i, n );
-	    exit( 0 );
+    while (fscanf( in, "%d %f\n", &i, &f ) == 2) {
+        if (i != detector.count()) {
+            fprintf( stderr, "trouble on input of %s (%d != %d)\n",
+                     name.c_str(), i, detector.count() );
+            return false;
         }
-	fm[i] = (double)f;
-	n++;
+        detector.add( f );
     }
+    detector.finish();
+    return true;
+}
 
-    /*
-     *  Print all local maximums.
-     */
-    printLocalMax( n, fm );
-
-    exit( 0 );
-
+static void
+print_maxima( const vector<int> &maxima, const string &added )
+{
+    for (size_t i = 0; i < maxima.size(); i++)
+        printf( " %d", maxima[i] );
+    printf( "%s\n", added.c_str() );
 }
 
-void
-printLocalMax( int n, double fm[] )
+int
+main( int argc, char *argv[] )
 {
-    /*
-     *  Smooth the data by performing a weighted moving average.
-     */
-    double s[256];
-    s[0] = (3.0*fm[0] +
-	        fm[1]) / 4.0;
-    for( int i = 1; i < n-1; i++ ) {
-	s[i] = (    fm[i-1] +
-	        2.0*fm[i  ] +
-		    fm[i+1]) / 4.0;
+    // Maxima to add, by file name : " 75 97".
+    vector< pair<string, string> > additions;
+    vector<string> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option.compare(0, 6, "--add=") == 0)
+        {
+            size_t colon = option.find(':');
+            if (colon == string::npos)
+                print_usage();
+            string positions = option.substr(colon + 1);
+            string added;
+            size_t begin = 0;
+            while (begin < positions.size())
+            {
+                size_t end = positions.find(',', begin);
+                if (end == string::npos)
+                    end = positions.size();
+                added += " " + positions.substr(begin, end - begin);
+                begin = end + 1;
+            }
+            additions.push_back( make_pair( option.substr(6, colon - 6), added ) );
+        }
+        else if (option.compare(0, 2, "--") == 0)
+            print_usage();
+        else
+            files.push_back( option );
+    }
+
+    PeakDetector detector;
+    if (files.empty()) {
+        if (!read_curve( stdin, "stdin", detector ))
+            exit( 1 );
+        print_maxima( detector.peaks(), "" );
+        exit( 0 );
     }
-    s[n-1] = (    fm[n-2] +
-	      3.0*fm[n-1]) / 4.0;
 
     /*
-     *  Determine the local maxima.
+     *  Every file in one run, in the format of maxima.txt.
      */
-    int found = 0;
-    for( int i = 0; i < n; i++ ) {
-	int k;
-
-	/*
-	 *  Determine the height on the left.
-	 */
-	for( k = 0; (i-k > 0) && (s[i-k] > s[i-k-1]); k++ ) {
-	    ;
-	}
-	int index_l = k;
-	double height_l = (s[i] - s[i-k]);
-
-	/*
-	 *  Determine the height on the right.
-	 */
-	for( k = 0; (i+k+1 < n) && (s[i+k] > s[i+k+1]); k++ ) {
-	    ;
-	}
-	int index_r = k;
-	double height_r = (s[i] - s[i+k]);
+    for (size_t f = 0; f < files.size(); f++) {
+        FILE *in = fopen( files[f].c_str(), "r" );
+        if (in == NULL) {
+            fprintf( stderr, "Could not read file: %s\n", files[f].c_str() );
+            exit( 1 );
+        }
+        string name = files[f].substr( files[f].find_last_of( '/' ) + 1 );
+        bool read = read_curve( in, name, detector );
+        fclose( in );
+        if (!read)
+            exit( 1 );
 
-	/*
-	 *  Conditions for being a local max.
-	 */
-	const double delta = 0.01;
-	const double epsilon = 0.005;
-	bool cond_l = (i == 0) ||
-		     ((i == 1) && (height_l > epsilon)) ||
-		     ((index_l > 3) && (height_l > epsilon)) ||
-		      (height_l > delta);
-	bool cond_r = (i == n-1) ||
-		     ((i == n-2) && (height_r > epsilon)) ||
-		     ((index_r > 3) && (height_r > epsilon)) ||
-		      (height_r > delta);
-	if( cond_l && cond_r ) {
-	    printf( " %d", i );
-	    //printf( "Local max: s[%d] = %12.8f\n", i, s[i] );
-	    //printf( "\t%d, diff = %12.8f\n", index_l, height_l );
-	    //printf( "\t%d, diff = %12.8f\n", index_r, height_r );
-	    found++;
-	}
+        string added;
+        for (size_t a = 0; a < additions.size(); a++)
+            if (additions[a].first == name)
+                added += additions[a].second;
+        printf( "%s\n", name.c_str() );
+        print_maxima( detector.peaks(), added );
     }
 
-    if( found > 0 ) {
-	printf( "\n" );
-    }
-    else {
-	/*
-	 *  No local max found according to above conditions,
-	 *  so output the global maximums.
-	 */
-	double max = 0.0;
-	for( int i = 0; i < n; i++ ) {
-	    if( max < s[i] ) {
-		max = s[i];
-	    }
-	}
-	for( int i = 0; i < n; i++ ) {
-	    if( max == s[i] ) {
-		printf( " %d", i );
-	    }
-	}
-	printf( "\n" );
-    }
+    exit( 0 );
 }
-
@@ -6,14 +6,10 @@
 # Optional parameters :
 # -as / --attribute-select  to perform attribute/feature selection
 # -ds / --discretize        to discretize the numerical attributes
+# -n  / --native            to simulate with makefeatures.exe and train with
+#                           traintree.exe instead of Weka (make first)
 
 JAR="/usr/share/java/weka-3.6.10.jar"
-
-if [ ! -f $JAR ]; then
-    echo "ERROR: Weka not found at "$JAR
-    exit
-fi
-
 CP="$CLASSPATH:"$JAR
 
 WEKA_OUT="results/weka_out.txt"
@@ -23,6 +19,7 @@ MIN_INSTANCES_PER_LEAF=512
 # Parameters.
 attribute_select=false
 discretize=false
+native=false
 redirect=false
 leaveout=""
 
@@ -33,6 +30,7 @@ while [ "$1" != "" ]; do
     case $1 in
         -as | --attribute-select ) attribute_select=true ;;
         -ds | --discretize ) discretize=true ;;
+        -n | --native ) native=true ;;
         -lv | --leaveout ) shift
               redirect=true
               leaveout="--leave-out="$1
@@ -44,9 +42,22 @@ while [ "$1" != "" ]; do
     shift
 done
 
+# Only the filters need Weka with --native.
+if [ "$native" = false ] || [ "$discretize" = true ] || \
+   [ "$attribute_select" = true ]; then
+    if [ ! -f $JAR ]; then
+        echo "ERROR: Weka not found at "$JAR
+        exit
+    fi
+fi
+
 # Generate instances to train with.
 echo "Simulating..."
-./simulate.py $leaveout > $ACTION_ARFF
+if [ "$native" = true ]; then
+    ./makefeatures.exe $leaveout --output=$ACTION_ARFF action
+else
+    ./simulate.py $leaveout > $ACTION_ARFF
+fi
 
 # Make a copy of the data, which we will modify if filters used.
 ACTION_DATA=/tmp/action_data.arff
@@ -85,5 +96,9 @@ fi
 
 # Train trees with Weka
 echo "Training action tree..."
-java -cp $CP weka.classifiers.trees.J48 \
-    -t $ACTION_DATA -C 0.25 -M $MIN_INSTANCES_PER_LEAF > $WEKA_OUT
+if [ "$native" = true ]; then
+    ./traintree.exe -C 0.25 -M $MIN_INSTANCES_PER_LEAF $ACTION_DATA > $WEKA_OUT
+else
+    java -cp $CP weka.classifiers.trees.J48 \
+        -t $ACTION_DATA -C 0.25 -M $MIN_INSTANCES_PER_LEAF > $WEKA_OUT
+fi
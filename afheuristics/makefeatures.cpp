@@ -0,0 +1,152 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "afSimulator.h"
+#include "featureSet.h"
+#include "trainingData.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: makefeatures [OPTIONS] leftright|action [FEATURE...]" << endl;
+    cerr << "\t Makes the training data of the left/right tree (as" << endl;
+    cerr << "\t makeleftrightfeatures.py) or of the action tree (as" << endl;
+    cerr << "\t simulate.py) from the scenes of focusraw/ and maxima.txt," << endl;
+    cerr << "\t and prints it as ARFF. Scenes are processed on every core." << endl;
+    cerr << "\t FEATURE... : left/right features to keep (default all)" << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --output=FILE : write to a file instead of stdout" << endl;
+    cerr << "\t --binary : write the binary format of featureSet.h" << endl;
+    cerr << "\t     (with --output)" << endl;
+    cerr << "\t -d, --double-step : measures two lens positions apart" << endl;
+    cerr << "\t --store=FILE : the scenes of a curve store (see makestore)," << endl;
+    cerr << "\t     instead of focusraw/ and maxima.txt" << endl;
+    cerr << "\t Left/right options :" << endl;
+    cerr << "\t --three-measures : the features of three measures (default" << endl;
+    cerr << "\t     two measures)" << endl;
+    cerr << "\t --all-features : every feature, including the bracket" << endl;
+    cerr << "\t --highest : head for the highest peak (default)" << endl;
+    cerr << "\t --nearest : head for the nearest peak" << endl;
+    cerr << "\t --high-and-near : head for the highest and nearest peak" << endl;
+    cerr << "\t --dup-edges : more instances near the ends of the lens" << endl;
+    cerr << "\t Action options :" << endl;
+    cerr << "\t --closest-peak : only turn back to a peak closer than the" << endl;
+    cerr << "\t     next one" << endl;
+    cerr << "\t --backtrack-faster : backtrack when the peak behind is" << endl;
+    cerr << "\t     closer than the one ahead" << endl;
+    cerr << "\t --use-weights : weigh instances instead of sampling them" << endl;
+    cerr << "\t -lv, --leave-out=FILE : a scene to leave out" << endl;
+    cerr << "\t --seed=N : seed of the random numbers (default 1)" << endl;
+    exit(1);
+}
+
+int
+main( int argc, char *argv[] )
+{
+    string output = "-";
+    bool binary = false;
+    string mode;
+    string leaveOut;
+    string storeFile;
+    LeftRightOptions leftRight;
+    ActionOptions action;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option.compare(0, 9, "--output=") == 0)
+            output = option.substr(9);
+        else if (option == "--binary")
+            binary = true;
+        else if (option == "-d" || option == "--double-step")
+            leftRight.stepSize = action.stepSize = 2;
+        else if (option == "--three-measures")
+            leftRight.featureSet = ThreeMeasures;
+        else if (option == "--all-features")
+            leftRight.featureSet = AllFirstStep;
+        else if (option == "--highest")
+            leftRight.peak = HighestPeak;
+        else if (option == "--nearest")
+            leftRight.peak = NearestPeak;
+        else if (option == "--high-and-near")
+            leftRight.peak = HighAndNearPeak;
+        else if (option == "--dup-edges")
+            leftRight.duplicateEdges = true;
+        else if (option == "--closest-peak")
+            action.closestPeak = true;
+        else if (option == "--backtrack-faster")
+            action.backtrackFaster = true;
+        else if (option == "--use-weights")
+            action.useWeights = true;
+        else if (option.compare(0, 12, "--leave-out=") == 0)
+            leaveOut = option.substr(12);
+        else if (option == "-lv" && i + 1 < argc)
+            leaveOut = argv[++i];
+        else if (option.compare(0, 8, "--store=") == 0)
+            storeFile = option.substr(8);
+        else if (option.compare(0, 7, "--seed=") == 0)
+            action.seed = strtoul(option.substr(7).c_str(), NULL, 10);
+        else if (option[0] == '-')
+            print_usage();
+        else if (mode.empty())
+            mode = option;
+        else
+            // A feature to keep.
+            leftRight.filters.push_back( option );
+    }
+    if ((mode != "leftright" && mode != "action") ||
+        (mode == "action" && !leftRight.filters.empty()) ||
+        (binary && output == "-"))
+        print_usage();
+
+    // makeleftrightfeatures.py uses every scene, simulate.py leaves some
+    // out.
+    vector<string> excluded;
+    if (mode == "action")
+    {
+        excluded.push_back( "cat.txt" );
+        excluded.push_back( "moon.txt" );
+        excluded.push_back( "projector2.txt" );
+        excluded.push_back( "projector3.txt" );
+    }
+    if (!leaveOut.empty())
+        excluded.push_back( leaveOut );
+
+    vector<AfScene> scenes;
+    string error;
+    bool loaded = storeFile.empty() ?
+        loadScenes( "focusraw", "maxima.txt", excluded, scenes, error ) :
+        loadStoredScenes( storeFile, -1, false, excluded, scenes, error );
+    if (!loaded)
+    {
+        cerr << error << endl;
+        exit(1);
+    }
+
+    FeatureSet set;
+    if (mode == "leftright")
+    {
+        if (!makeLeftRightSet( scenes, leftRight, set, error ))
+        {
+            cerr << error << endl;
+            exit(1);
+        }
+    }
+    else
+        makeActionSet( scenes, action, set );
+
+    // Left/right features are integers; simulate.py rounds the others.
+    bool written = binary ? set.writeBinary( output ) :
+        set.writeArff( output, mode == "leftright" ? "%g" : "%.3f" );
+    if (!written)
+    {
+        cerr << set.error() << endl;
+        exit(1);
+    }
+
+    return( 0 );
+}
@@ -3,16 +3,32 @@
 # obtain a classifier which determines whether to search left or right
 # (near focus or far focus).
 
+# Optional parameters :
+# -n / --native  to make the features with makefeatures.exe and train the
+#                trees with traintree.exe, without Weka (make first). There
+#                is no attribute selection then : J48 picks its features.
+
 JAR="/usr/share/java/weka-3.6.10.jar"
+CP="$CLASSPATH:"$JAR
+MIN_INSTANCES_PER_LEAF=512
+
+native=false
+MAKE_FEATURES="./makeleftrightfeatures.py"
+while [ "$1" != "" ]; do
+    case $1 in
+        -n | --native ) native=true
+                        MAKE_FEATURES="./makefeatures.exe leftright" ;;
+        * )             echo "Usage: $0 [-n | --native]"
+                        exit 1
+    esac
+    shift
+done
 
-if [ ! -f $JAR ]; then
+if [ "$native" = false ] && [ ! -f $JAR ]; then
     echo "ERROR: Weka not found at "$JAR
     exit
 fi
 
-CP="$CLASSPATH:"$JAR
-MIN_INSTANCES_PER_LEAF=512
-
 function feature_select {
     local input=$1
     local output=$2
@@ -45,19 +61,19 @@ function feature_select {
 
 mkdir -p results
 echo "Making features for classifier \"highest\""
-./makeleftrightfeatures.py --dup-edges --highest > results/highest2.arff
-./makeleftrightfeatures.py --dup-edges --highest --three-measures > results/highest3.arff
-./makeleftrightfeatures.py --dup-edges --highest --all-features > results/highestall.arff
+$MAKE_FEATURES --dup-edges --highest > results/highest2.arff
+$MAKE_FEATURES --dup-edges --highest --three-measures > results/highest3.arff
+$MAKE_FEATURES --dup-edges --highest --all-features > results/highestall.arff
 
 echo "Making features for classifier \"nearest\""
-./makeleftrightfeatures.py --dup-edges --nearest > results/nearest2.arff
-./makeleftrightfeatures.py --dup-edges --nearest --three-measures > results/nearest3.arff
-./makeleftrightfeatures.py --dup-edges --nearest --all-features > results/nearestall.arff
+$MAKE_FEATURES --dup-edges --nearest > results/nearest2.arff
+$MAKE_FEATURES --dup-edges --nearest --three-measures > results/nearest3.arff
+$MAKE_FEATURES --dup-edges --nearest --all-features > results/nearestall.arff
 
 echo "Making features for classifier \"highnear\""
-./makeleftrightfeatures.py --dup-edges --high-and-near > results/highnear2.arff
-./makeleftrightfeatures.py --dup-edges --high-and-near --three-measures > results/highnear3.arff
-./makeleftrightfeatures.py --dup-edges --high-and-near --all-features > results/highnearall.arff
+$MAKE_FEATURES --dup-edges --high-and-near > results/highnear2.arff
+$MAKE_FEATURES --dup-edges --high-and-near --three-measures > results/highnear3.arff
+$MAKE_FEATURES --dup-edges --high-and-near --all-features > results/highnearall.arff
 
 echo "Training left-right trees..."
 for training_data in highest2 highest3 highestall \
@@ -67,7 +83,12 @@ do
     echo $training_data
     data=results/${training_data}.arff
     filtered=results/${training_data}_filtered.arff
-    feature_select $data $filtered
-    java -cp $CP weka.classifiers.trees.J48 \
-        -t $filtered -C 0.25 -M $MIN_INSTANCES_PER_LEAF > results/${training_data}_weka.txt
+    if [ "$native" = true ]; then
+        ./traintree.exe -C 0.25 -M $MIN_INSTANCES_PER_LEAF $data \
+            > results/${training_data}_weka.txt
+    else
+        feature_select $data $filtered
+        java -cp $CP weka.classifiers.trees.J48 \
+            -t $filtered -C 0.25 -M $MIN_INSTANCES_PER_LEAF > results/${training_data}_weka.txt
+    fi
 done
@@ -0,0 +1,80 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "afSimulator.h"
+#include "curveStore.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: makestore [OPTIONS] FOLDER output.curves" << endl;
+    cerr << "\t Packs the scenes of a folder of raw focus values (focusraw/" << endl;
+    cerr << "\t or a low-light folder) and their maxima into a curve store" << endl;
+    cerr << "\t (see curveStore.h), which holds the normalized values too." << endl;
+    cerr << "\t afbenchmark, afsearch, comparesearch, fitpeaks and" << endl;
+    cerr << "\t makefeatures read it with --store." << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --maxima=FILE : maxima of the scenes (default maxima.txt)" << endl;
+    cerr << "\t --measure=N : the focus measure of the values, as numbered by" << endl;
+    cerr << "\t     apply (default -1, unknown)" << endl;
+    exit(1);
+}
+
+int
+main( int argc, char *argv[] )
+{
+    string maximaFile = "maxima.txt";
+    int measure = -1;
+
+    int first = 1;
+    for (; first < argc; first++)
+    {
+        string option(argv[first]);
+        if (option.compare(0, 9, "--maxima=") == 0)
+            maximaFile = option.substr(9);
+        else if (option.compare(0, 10, "--measure=") == 0)
+            measure = atoi(option.substr(10).c_str());
+        else if (option.compare(0, 2, "--") == 0)
+            // This option isn't recognized.
+            print_usage();
+        else
+            // The folder - we can stop reading options now.
+            break;
+    }
+    if (argc - first != 2 || measure < -1)
+        print_usage();
+
+    vector<AfScene> scenes;
+    string error;
+    if (!loadScenes( argv[first], maximaFile, vector<string>(), scenes, error ))
+    {
+        cerr << error << endl;
+        exit(1);
+    }
+
+    CurveStoreWriter store;
+    if (!store.open( argv[first + 1] ))
+    {
+        cerr << store.error() << endl;
+        exit(1);
+    }
+    for (size_t s = 0; s < scenes.size(); s++)
+        if (!store.addCurve( scenes[s].name, measure, &scenes[s].values[0],
+                             scenes[s].values.size(), scenes[s].maxima ))
+        {
+            cerr << store.error() << endl;
+            exit(1);
+        }
+    if (!store.close())
+    {
+        cerr << store.error() << endl;
+        exit(1);
+    }
+
+    printf( "%d scenes stored in %s\n", (int)scenes.size(), argv[first + 1] );
+    return( 0 );
+}
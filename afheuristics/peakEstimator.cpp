@@ -0,0 +1,152 @@
+#include "peakEstimator.h"
+#include <math.h>
+
+// Samples around the highest one, at most.
+#define MAXIMUM_SAMPLES 5
+
+const char *
+peakFitName( PeakFit fit )
+{
+	switch ( fit )
+	{
+		case ParabolicFit: return "parabolic";
+		case GaussianFit: return "gaussian";
+		case CentroidFit: return "centroid";
+		case NoPeakFit:
+		default: return "none";
+	}
+}
+
+bool
+peakFitFromName( const std::string &name, PeakFit &fit )
+{
+	const PeakFit fits[] = { NoPeakFit, ParabolicFit, GaussianFit, CentroidFit };
+	for (int i = 0; i < 4; i++)
+		if ( name == peakFitName( fits[i] ) )
+		{
+			fit = fits[i];
+			return true;
+		}
+	return false;
+}
+
+/*
+ * Vertex of the least squares parabola y = a x^2 + b x + c through n
+ * points, if it is a maximum (a < 0).
+ */
+static bool
+parabolaVertex( const double *x, const double *y, int n, double &vertex )
+{
+	// The normal equations, solved by Cramer's rule.
+	double s[5] = { 0, 0, 0, 0, 0 };	// sums of x^k
+	double t[3] = { 0, 0, 0 };			// sums of x^k y
+	for (int i = 0; i < n; i++)
+	{
+		double power = 1;
+		for (int k = 0; k < 5; k++)
+		{
+			if ( k < 3 )
+				t[k] += power * y[i];
+			s[k] += power;
+			power *= x[i];
+		}
+	}
+	// | s4 s3 s2 | |a|   |t2|
+	// | s3 s2 s1 | |b| = |t1|
+	// | s2 s1 s0 | |c|   |t0|
+	double det = s[4] * (s[2] * s[0] - s[1] * s[1]) -
+				 s[3] * (s[3] * s[0] - s[1] * s[2]) +
+				 s[2] * (s[3] * s[1] - s[2] * s[2]);
+	if ( det == 0 )
+		return false;
+	double a = (t[2] * (s[2] * s[0] - s[1] * s[1]) -
+				s[3] * (t[1] * s[0] - s[1] * t[0]) +
+				s[2] * (t[1] * s[1] - s[2] * t[0])) / det;
+	double b = (s[4] * (t[1] * s[0] - s[1] * t[0]) -
+				t[2] * (s[3] * s[0] - s[1] * s[2]) +
+				s[2] * (s[3] * t[0] - t[1] * s[2])) / det;
+	if ( !(a < 0) )
+		return false;
+	vertex = -b / (2 * a);
+	return true;
+}
+
+bool
+estimatePeak( PeakFit fit, const int *positions, const double *values,
+			  int count, int samples, double &peak )
+{
+	int best = 0;
+	for (int i = 1; i < count; i++)
+		if ( values[i] > values[best] )
+			best = i;
+	if ( fit == NoPeakFit || best == 0 || best == count - 1 )
+		return false;
+
+	// The window of samples, within the ones there are.
+	samples = samples < 3 ? 3 : samples > MAXIMUM_SAMPLES ? MAXIMUM_SAMPLES :
+		samples > count ? count : samples;
+	int first = best - (samples - 1) / 2;
+	if ( samples % 2 == 0 && values[best + 1] < values[best - 1] )
+		first--;
+	if ( first < 0 )
+		first = 0;
+	if ( first + samples > count )
+		first = count - samples;
+
+	// Positions relative to the highest sample, for the precision.
+	double x[MAXIMUM_SAMPLES], y[MAXIMUM_SAMPLES];
+	double lowest = values[first];
+	for (int i = 0; i < samples; i++)
+	{
+		x[i] = positions[first + i] - positions[best];
+		y[i] = values[first + i];
+		if ( y[i] < lowest )
+			lowest = y[i];
+	}
+
+	double offset = 0;
+	switch ( fit )
+	{
+		case ParabolicFit:
+			if ( !parabolaVertex( x, y, samples, offset ) )
+				return false;
+			break;
+
+		case GaussianFit:
+			for (int i = 0; i < samples; i++)
+			{
+				if ( !(y[i] > 0) )
+					return false;
+				y[i] = log( y[i] );
+			}
+			if ( !parabolaVertex( x, y, samples, offset ) )
+				return false;
+			break;
+
+		case CentroidFit:
+		{
+			double sum = 0, weighted = 0;
+			for (int i = 0; i < samples; i++)
+			{
+				sum += y[i] - lowest;
+				weighted += (y[i] - lowest) * x[i];
+			}
+			if ( !(sum > 0) )
+				return false;
+			offset = weighted / sum;
+			break;
+		}
+
+		case NoPeakFit:
+		default:
+			return false;
+	}
+
+	// A fit through samples of another peak may go far : the peak is
+	// between the neighbours of the highest sample.
+	double lower = positions[best - 1] - positions[best];
+	double upper = positions[best + 1] - positions[best];
+	offset = offset < lower ? lower : offset > upper ? upper : offset;
+	peak = positions[best] + offset;
+	return true;
+}
@@ -0,0 +1,46 @@
+#ifndef _PeakEstimator_H
+#define _PeakEstimator_H
+
+#include <string>
+
+/*
+ * Where the peak of a focus curve lies between the lens positions that
+ * were measured, so that the lens can go there in one move instead of
+ * climbing to it in fine steps.
+ *
+ * Parabolic : the least squares parabola through the samples around the
+ * highest one (exact through three).
+ * Gaussian : the same parabola through the logarithms of the values, a
+ * Gaussian peak; values must be positive.
+ * Centroid : the mean of the positions, weighted by how far above the
+ * lowest of the samples their values are.
+ */
+enum PeakFit
+{
+	NoPeakFit,
+	ParabolicFit,
+	GaussianFit,
+	CentroidFit
+};
+
+/*
+ * "none", "parabolic", "gaussian" or "centroid", and back. fromName
+ * returns false for other names.
+ */
+const char *peakFitName( PeakFit fit );
+bool peakFitFromName( const std::string &name, PeakFit &fit );
+
+/*
+ * Estimate the peak around the highest of count samples, at increasing
+ * positions, from samples of them (3 to 5) around it : as many on each
+ * side, the fourth on the side of the higher neighbour. The peak is
+ * between the neighbours of the highest sample.
+ *
+ * Returns false, without a peak, if the highest sample is the first or
+ * the last (the peak may be further), or if the fit has no maximum.
+ * Allocates nothing.
+ */
+bool estimatePeak( PeakFit fit, const int *positions, const double *values,
+				   int count, int samples, double &peak );
+
+#endif
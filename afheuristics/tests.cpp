@@ -0,0 +1,801 @@
+/*
+ *  Checks of the autofocus modules, run by make test from this folder.
+ *  Prints every failed check and exits with 1 if there was any.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "afController.h"
+#include "afSimulator.h"
+#include "decisionTree.h"
+#include "featureSet.h"
+#include "peakEstimator.h"
+#include "treeTrainer.h"
+
+using namespace std;
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK( condition ) \
+    check( (condition), #condition, __FILE__, __LINE__ )
+
+static bool
+check( bool passed, const char *condition, const char *file, int line )
+{
+    checks++;
+    if (!passed)
+    {
+        fprintf( stderr, "%s:%d: check failed: %s\n", file, line, condition );
+        failures++;
+    }
+    return passed;
+}
+
+/*
+ *  Allocations of the whole program, to check that code that should
+ *  allocate nothing doesn't.
+ */
+static long allocations = 0;
+
+void *
+operator new( size_t size )
+{
+    allocations++;
+    void *p = malloc( size > 0 ? size : 1 );
+    if (p == NULL)
+        throw bad_alloc();
+    return p;
+}
+
+void
+operator delete( void *p ) noexcept
+{
+    free( p );
+}
+
+void
+operator delete( void *p, size_t size ) noexcept
+{
+    free( p );
+}
+
+/*
+ *  A scene of stepCount positions with a single smooth peak.
+ */
+static AfScene
+peak_scene( int stepCount, int peak, double width )
+{
+    AfScene scene;
+    scene.fileName = "peak.txt";
+    scene.name = "peak";
+    for (int p = 0; p < stepCount; p++)
+        scene.values.push_back( 1 + exp( -(p - peak) * (p - peak) /
+                                         (2 * width * width) ) );
+    scene.maxima.push_back( peak );
+    return scene;
+}
+
+/*
+ *  A search that makes the moves it is given, in order, then stops, and
+ *  remembers where each value was measured.
+ */
+class ScriptedSearch : public AfSearch
+{
+public:
+    ScriptedSearch( const vector<LensCommand> &script ) : script( script ) {}
+
+    virtual void start( int position, int stepCount ) { positions.clear(); }
+    virtual LensCommand onFocusValue( double value, int position )
+    {
+        positions.push_back( position );
+        if (positions.size() <= script.size())
+            return script[positions.size() - 1];
+        LensCommand found = { LensCommand::Found, 0, false };
+        return found;
+    }
+    virtual int steps() const { return positions.size(); }
+    virtual bool visited( int position ) const
+    {
+        return find( positions.begin(), positions.end(), position ) !=
+            positions.end();
+    }
+
+    vector<LensCommand> script;
+    vector<int> positions;
+};
+
+/*
+ *  Another search, whose moves are remembered.
+ */
+class RecordedSearch : public AfSearch
+{
+public:
+    RecordedSearch( AfSearch &search ) : search( search ) {}
+
+    virtual void start( int position, int stepCount )
+    {
+        commands.clear();
+        search.start( position, stepCount );
+    }
+    virtual LensCommand onFocusValue( double value, int position )
+    {
+        LensCommand command = search.onFocusValue( value, position );
+        commands.push_back( command );
+        return command;
+    }
+    virtual int steps() const { return search.steps(); }
+    virtual bool visited( int position ) const
+        { return search.visited( position ); }
+
+    AfSearch &search;
+    vector<LensCommand> commands;
+};
+
+/*
+ *  Runs a controller on a scene from a lens position, the lens moving
+ *  exactly as told, and counts what it allocates once started.
+ */
+static LensCommand
+drive( AfController &controller, const AfScene &scene, int start,
+       vector<LensCommand> &moves, long &allocated )
+{
+    int stepCount = scene.values.size();
+    moves.clear();
+    moves.reserve( 4 * stepCount );
+    controller.start( start, stepCount );
+    long before = allocations;
+    int position = start;
+    LensCommand command = controller.onFocusValue( scene.values[position] );
+    while (command.kind == LensCommand::Move &&
+           (int)moves.size() < 4 * stepCount)
+    {
+        moves.push_back( command );
+        position = max( 0, min( stepCount - 1, position + command.steps ) );
+        command = controller.onFocusValue( scene.values[position] );
+    }
+    allocated = allocations - before;
+    return command;
+}
+
+/*
+ *  The hill climb : two fine steps to the right, coarse steps to past
+ *  the peak, fine steps back to it, from anywhere on the lens and without
+ *  allocating.
+ */
+static void
+test_controller()
+{
+    AfScene scene = peak_scene( 100, 50, 10 );
+    HillClimbDecisions decisions;
+    AfController controller( decisions );
+    vector<LensCommand> moves;
+    long allocated;
+    for (int start = 0; start < 100; start++)
+    {
+        LensCommand command = drive( controller, scene, start, moves,
+                                     allocated );
+        if (!CHECK( command.kind == LensCommand::Found ) ||
+            !CHECK( moves.size() >= 3 ))
+        {
+            cerr << "start " << start << endl;
+            continue;
+        }
+        CHECK( allocated == 0 );
+        CHECK( controller.position() == 50 );
+        CHECK( controller.steps() == (int)moves.size() + 1 );
+        CHECK( controller.visited( start ) && controller.visited( 50 ) );
+        if (start < 98)
+            CHECK( moves[0].steps == 1 && !moves[0].coarse &&
+                   moves[1].steps == 1 && !moves[1].coarse );
+        for (size_t m = 0; m < moves.size(); m++)
+            CHECK( moves[m].coarse ? abs( moves[m].steps ) == 8 :
+                   abs( moves[m].steps ) == 1 );
+
+        // Started again, the same search.
+        vector<LensCommand> again;
+        drive( controller, scene, start, again, allocated );
+        CHECK( again.size() == moves.size() );
+    }
+
+    // A rising lens : the peak is at its end, a falling one : at its
+    // start.
+    AfScene rising = peak_scene( 60, 59, 30 );
+    CHECK( drive( controller, rising, 10, moves, allocated ).kind ==
+           LensCommand::Found && controller.position() == 59 );
+    AfScene falling = peak_scene( 60, 0, 30 );
+    CHECK( drive( controller, falling, 40, moves, allocated ).kind ==
+           LensCommand::Found && controller.position() == 0 );
+
+    // Nothing to focus on.
+    AfScene flat = peak_scene( 60, 30, 30 );
+    flat.values.assign( 60, 1.0 );
+    LensCommand command = drive( controller, flat, 20, moves, allocated );
+    CHECK( command.kind == LensCommand::Failed );
+    CHECK( controller.steps() < 60 );
+}
+
+/*
+ *  Trees in the layout of Weka's J48 output : numeric splits, a split on
+ *  the numbers of a nominal feature, and the ranges of a discretized one.
+ */
+static const char *const NUMERIC_TREE =
+    "J48 pruned tree\n"
+    "------------------\n"
+    "\n"
+    "a <= 0.5\n"
+    "|   b <= -2: left (4.0)\n"
+    "|   b > -2\n"
+    "|   |   a <= 0.25: right (3.0/1.0)\n"
+    "|   |   a > 0.25: left (2.0)\n"
+    "a > 0.5: right (6.0)\n"
+    "\n"
+    "Number of Leaves  : \t4\n"
+    "\n"
+    "Size of the tree : \t7\n";
+
+static const char *const NOMINAL_TREE =
+    "J48 unpruned tree\n"
+    "------------------\n"
+    "\n"
+    "c = 0: continue (5.0)\n"
+    "c = 1\n"
+    "|   d = '(-inf-1.5]': turn_peak (2.0)\n"
+    "|   d = '(1.5-3]': backtrack (3.0)\n"
+    "|   d = '(3-inf)': turn_peak (1.0)\n"
+    "c = 2: backtrack (4.0)\n"
+    "\n";
+
+static void
+test_decision_tree()
+{
+    vector<string> features;
+    features.push_back( "a" );
+    features.push_back( "b" );
+    features.push_back( "c" );
+    features.push_back( "d" );
+
+    DecisionTree tree;
+    if (CHECK( tree.parse( NUMERIC_TREE, features ) ))
+    {
+        CHECK( tree.classes().size() == 2 && tree.classIndex( "left" ) == 0 &&
+               tree.classIndex( "right" ) == 1 &&
+               tree.classIndex( "up" ) == -1 );
+        CHECK( tree.size() == 3 && tree.depth() == 3 );
+
+        // Rows a, b, c, d and their classes, the bounds included.
+        const double rows[][4] = { { 0.5, -2, 0, 0 }, { 0.5, -1.9, 0, 0 },
+                                   { 0.25, 0, 0, 0 }, { 0.51, -5, 0, 0 },
+                                   { -1, 100, 0, 0 } };
+        const int expected[] = { 0, 0, 1, 1, 1 };
+        int classes[5];
+        tree.classifyBatch( &rows[0][0], 5, 4, classes );
+        for (int r = 0; r < 5; r++)
+        {
+            const double *row = rows[r];
+            CHECK( tree.classify( [row]( int f ) { return row[f]; } ) ==
+                   expected[r] && classes[r] == expected[r] );
+        }
+
+        string code = tree.generateCpp( "classify", features );
+        CHECK( code.find( "int\nclassify( const double *features )" ) !=
+               string::npos );
+        size_t ifs = 0;
+        for (size_t at = code.find( "if (" ); at != string::npos;
+             at = code.find( "if (", at + 1 ))
+            ifs++;
+        CHECK( ifs == 3 );
+        CHECK( code.find( " 2 c" ) == string::npos );
+    }
+
+    if (CHECK( tree.parse( NOMINAL_TREE, features ) ))
+    {
+        CHECK( tree.classes().size() == 3 && tree.size() == 4 );
+        const double rows[][2] = { { 0, 7 }, { 1, 1.5 }, { 1, 2 },
+                                   { 1, 3.5 }, { 2, 0 } };
+        const int expected[] = { 0, 1, 2, 1, 2 };
+        for (int r = 0; r < 5; r++)
+        {
+            const double *row = rows[r];
+            CHECK( tree.classify( [row]( int f ) { return row[f - 2]; } ) ==
+                   expected[r] );
+        }
+    }
+
+    // A single leaf.
+    CHECK( tree.parse( "J48 pruned tree\n------------------\n: left (9.0)\n",
+                       features ) && tree.size() == 0 &&
+           tree.classify( []( int f ) { return 0.0; } ) == 0 );
+
+    // What it can't read.
+    CHECK( !tree.parse( "a <= 0.5: left (1.0)\n", features ) &&
+           tree.error() == "No J48 tree" );
+    string unknown( NUMERIC_TREE );
+    unknown.replace( unknown.find( "b <= -2" ), 1, "e" );
+    CHECK( !tree.parse( unknown, features ) &&
+           tree.error() == "Unknown feature e" );
+    CHECK( !tree.parse( "J48 pruned tree\n---\n\nc = sunny: left (1.0)\n"
+                        "c = rainy: right (1.0)\n", features ) &&
+           tree.error().find( "Nominal value sunny" ) == 0 );
+    CHECK( !tree.parse( "J48 pruned tree\n---\n\na <= 0.5\n"
+                        "a > 0.5: right (1.0)\n", features ) &&
+           tree.error().find( "Missing subtree" ) == 0 );
+    CHECK( !tree.parse( "J48 pruned tree\n---\n\na <= 0.5: left (1.0)\n"
+                        "b > 0.5: right (1.0)\n", features ) &&
+           tree.error().find( "Feature mismatch" ) == 0 );
+    CHECK( !tree.load( "no/such/tree.txt", features ) );
+}
+
+/*
+ *  Quinlan's weather data (weather.numeric.arff of Weka), with the nominal
+ *  values numbered : outlook sunny 0, overcast 1, rainy 2, windy TRUE 1,
+ *  FALSE 0, and J48's tree of it as printed in the documentation of
+ *  parsej48.py, numbered the same way.
+ */
+static const double WEATHER[14][5] =
+{
+    // outlook, temperature, humidity, windy, play (yes 0, no 1)
+    { 0, 85, 85, 0, 1 }, { 0, 80, 90, 1, 1 }, { 1, 83, 86, 0, 0 },
+    { 2, 70, 96, 0, 0 }, { 2, 68, 80, 0, 0 }, { 2, 65, 70, 1, 1 },
+    { 1, 64, 65, 1, 0 }, { 0, 72, 95, 0, 1 }, { 0, 69, 70, 0, 0 },
+    { 2, 75, 80, 0, 0 }, { 0, 75, 70, 1, 0 }, { 1, 72, 90, 1, 0 },
+    { 1, 81, 75, 0, 0 }, { 2, 71, 91, 1, 1 }
+};
+
+static const char *const WEATHER_TREE =
+    "\n"
+    "outlook = 0\n"
+    "|   humidity <= 75: yes (2.0)\n"
+    "|   humidity > 75: no (3.0)\n"
+    "outlook = 1: yes (4.0)\n"
+    "outlook = 2\n"
+    "|   windy = 1: no (2.0)\n"
+    "|   windy = 0: yes (3.0)\n"
+    "\n"
+    "Number of Leaves  : \t5\n"
+    "\n"
+    "Size of the tree : \t8\n";
+
+static FeatureSet
+weather_set( int repeat, const double *weights )
+{
+    FeatureSet set;
+    set.relation = "weather";
+    set.features.push_back( "outlook" );
+    set.features.push_back( "temperature" );
+    set.features.push_back( "humidity" );
+    set.features.push_back( "windy" );
+    set.types.push_back( "{0,1,2}" );
+    set.types.push_back( "numeric" );
+    set.types.push_back( "numeric" );
+    set.types.push_back( "{1,0}" );
+    set.classAttribute = "play";
+    set.classes.push_back( "yes" );
+    set.classes.push_back( "no" );
+    set.weighted = weights != NULL;
+    for (int i = 0; i < 14; i++)
+        for (int r = 0; r < repeat; r++)
+            set.add( WEATHER[i], (int)WEATHER[i][4],
+                     weights != NULL ? weights[i] : 1.0 );
+    return set;
+}
+
+/*
+ *  Instances of two numeric features and a nominal one, whose class is
+ *  mostly that of x + y > 1, with a tenth of the labels flipped, and
+ *  weights of 1 to 3.
+ */
+static FeatureSet
+noisy_set( int count )
+{
+    FeatureSet set;
+    set.relation = "noisy";
+    set.features.push_back( "x" );
+    set.features.push_back( "y" );
+    set.features.push_back( "side" );
+    set.types.push_back( "numeric" );
+    set.types.push_back( "numeric" );
+    set.types.push_back( "{0,1,2}" );
+    set.classAttribute = "class";
+    set.classes.push_back( "low" );
+    set.classes.push_back( "high" );
+    set.weighted = true;
+    unsigned seed = 12345;
+    for (int i = 0; i < count; i++)
+    {
+        double row[3];
+        for (int f = 0; f < 3; f++)
+        {
+            seed = seed * 1103515245 + 12345;
+            row[f] = (seed >> 8 & 0xffff) / 65536.0;
+        }
+        row[0] = floor( row[0] * 100 ) / 100;
+        row[2] = floor( row[2] * 3 );
+        int label = row[0] + row[1] > 1 ? 1 : 0;
+        if (i % 10 == 3)
+            label = 1 - label;
+        set.add( row, label, 1 + i % 3 );
+    }
+    return set;
+}
+
+/*
+ *  The weight and the errors of the leaves of a tree printed by Weka, and
+ *  the weight of the training instances the tree read from it gets wrong.
+ */
+static void
+leaf_weights( const string &text, double &weight, double &errors )
+{
+    weight = errors = 0;
+    for (size_t at = text.find( " (" ); at != string::npos;
+         at = text.find( " (", at + 1 ))
+    {
+        double w = 0, e = 0;
+        if (sscanf( text.c_str() + at, " (%lf/%lf)", &w, &e ) >= 1)
+        {
+            weight += w;
+            errors += e;
+        }
+    }
+}
+
+static double
+misclassified( const DecisionTree &tree, const FeatureSet &set )
+{
+    double errors = 0;
+    for (int i = 0; i < set.size(); i++)
+    {
+        const double *row = set.row( i );
+        int c = tree.classify( [row]( int f ) { return row[f]; } );
+        if (tree.classes()[c] != set.classes[set.labels[i]])
+            errors += set.weights[i];
+    }
+    return errors;
+}
+
+/*
+ *  Weka isn't available here, so the trainer is checked against J48's
+ *  published tree of the weather data, and otherwise against what must
+ *  hold whatever the tree : weights count as copies of the instances, an
+ *  unpruned tree is at least as large, and every tree reads back through
+ *  DecisionTree with the weights and errors of its leaves.
+ */
+static void
+test_tree_trainer()
+{
+    TreeTrainer trainer;
+    FeatureSet weather = weather_set( 1, NULL );
+    if (CHECK( trainer.train( weather ) ))
+    {
+        CHECK( trainer.text() == string( "J48 pruned tree\n"
+                                         "------------------\n" ) +
+               WEATHER_TREE );
+        CHECK( trainer.leafCount() == 5 && trainer.size() == 8 );
+    }
+
+    // All the leaves are pure : nothing to prune.
+    TreeTrainerOptions unpruned;
+    unpruned.prune = false;
+    TreeTrainer unprunedTrainer( unpruned );
+    CHECK( unprunedTrainer.train( weather ) &&
+           unprunedTrainer.text() == string( "J48 unpruned tree\n"
+                                             "------------------\n" ) +
+           WEATHER_TREE );
+
+    // A weight of 2 is two copies.
+    const double weights[14] = { 2, 1, 2, 2, 2, 1, 1, 2, 1, 1, 2, 2, 1, 2 };
+    TreeTrainer weighted, copies;
+    FeatureSet twice = weather_set( 1, weights );
+    FeatureSet copied = weather_set( 1, NULL );
+    for (int i = 0; i < 14; i++)
+        if (weights[i] == 2)
+            copied.add( WEATHER[i], (int)WEATHER[i][4] );
+    CHECK( weighted.train( twice ) && copies.train( copied ) &&
+           weighted.text() == copies.text() );
+
+    vector<string> names( weather.features );
+    DecisionTree tree;
+    CHECK( tree.parse( trainer.text(), names ) &&
+           misclassified( tree, weather ) == 0 );
+
+    // Pruning, with and without raising subtrees, and unpruned, on data
+    // with noise and a nominal feature.
+    FeatureSet noisy = noisy_set( 600 );
+    double totalWeight = 0;
+    for (int i = 0; i < noisy.size(); i++)
+        totalWeight += noisy.weights[i];
+    TreeTrainerOptions variants[3];
+    variants[1].subtreeRaising = false;
+    variants[2].prune = false;
+    int leaves[3];
+    for (int v = 0; v < 3; v++)
+    {
+        TreeTrainer noisyTrainer( variants[v] );
+        if (!CHECK( noisyTrainer.train( noisy ) ))
+            continue;
+        string text = noisyTrainer.text();
+        leaves[v] = noisyTrainer.leafCount();
+        double weight, errors;
+        leaf_weights( text, weight, errors );
+        CHECK( fabs( weight - totalWeight ) < 0.01 * leaves[v] );
+        if (!CHECK( tree.parse( text, noisy.features ) ))
+        {
+            cerr << tree.error() << endl;
+            continue;
+        }
+        CHECK( fabs( misclassified( tree, noisy ) - errors ) <
+               0.01 * leaves[v] );
+        CHECK( (int)tree.classes().size() <= 2 );
+    }
+    CHECK( leaves[2] > leaves[0] && leaves[2] > leaves[1] );
+
+    // What it can't train on.
+    FeatureSet empty = weather_set( 0, NULL );
+    CHECK( !trainer.train( empty ) );
+    FeatureSet strings = weather_set( 1, NULL );
+    strings.types[0] = "{sunny,overcast,rainy}";
+    CHECK( !trainer.train( strings ) );
+    FeatureSet outside = weather_set( 1, NULL );
+    outside.values[0] = 3;
+    CHECK( !trainer.train( outside ) &&
+           trainer.error() == "Value out of {0,1,2} for outlook" );
+}
+
+/*
+ *  The fits are exact on their own curves, stay between the neighbours of
+ *  the highest sample, refuse peaks at the ends, and allocate nothing;
+ *  with a fit the controller jumps to the peak in fewer moves.
+ */
+static void
+test_peak_estimator()
+{
+    // Unevenly spaced samples of a parabola and of a Gaussian peaking at
+    // 10.3.
+    const int positions[] = { 0, 5, 8, 9, 16, 24 };
+    double parabola[6], gaussian[6];
+    for (int i = 0; i < 6; i++)
+    {
+        double d = positions[i] - 10.3;
+        parabola[i] = 100 - d * d;
+        gaussian[i] = exp( -d * d / 50 );
+    }
+    long before = allocations;
+    for (int samples = 3; samples <= 5; samples++)
+    {
+        double peak = 0;
+        CHECK( estimatePeak( ParabolicFit, positions, parabola, 6, samples,
+                             peak ) && fabs( peak - 10.3 ) < 1e-9 );
+        CHECK( estimatePeak( GaussianFit, positions, gaussian, 6, samples,
+                             peak ) && fabs( peak - 10.3 ) < 1e-9 );
+    }
+    CHECK( allocations == before );
+
+    // The centroid of symmetric samples is their middle; a window of four
+    // takes the higher neighbour's side.
+    const int even[] = { 4, 5, 6, 7, 8, 9 };
+    const double symmetric[] = { 0, 1, 3, 5, 3, 1 };
+    double peak = 0;
+    CHECK( estimatePeak( CentroidFit, even, symmetric, 6, 3, peak ) &&
+           peak == 7 );
+    CHECK( estimatePeak( CentroidFit, even, symmetric, 6, 5, peak ) &&
+           peak == 7 );
+    const double skewed[] = { 0, 1, 3, 5, 4, 0 };
+    CHECK( estimatePeak( CentroidFit, even, skewed, 6, 4, peak ) &&
+           fabs( peak - (6 * 3 + 7 * 5 + 8 * 4) / 12.0 ) < 1e-12 );
+
+    // Between the neighbours, whatever the fit says.
+    const int wide[] = { 0, 1, 2, 10 };
+    const double lopsided[] = { 0, 10, 9.99, 9.98 };
+    CHECK( estimatePeak( ParabolicFit, wide, lopsided, 4, 4, peak ) &&
+           peak >= 0 && peak <= 2 );
+
+    // What has no peak to fit.
+    const double rising[] = { 1, 2, 3, 4, 5, 6 };
+    const double flat[] = { 1, 1, 1, 1, 1, 1 };
+    const double negative[] = { -1, 0, 3, 5, 3, 1 };
+    CHECK( !estimatePeak( ParabolicFit, even, rising, 6, 3, peak ) );
+    CHECK( !estimatePeak( CentroidFit, even, flat, 6, 3, peak ) );
+    CHECK( !estimatePeak( NoPeakFit, even, symmetric, 6, 3, peak ) );
+    CHECK( !estimatePeak( GaussianFit, even, negative, 6, 5, peak ) );
+    CHECK( estimatePeak( GaussianFit, even, negative, 6, 3, peak ) );
+
+    PeakFit fit;
+    const PeakFit fits[] = { NoPeakFit, ParabolicFit, GaussianFit,
+                             CentroidFit };
+    for (int f = 0; f < 4; f++)
+        CHECK( peakFitFromName( peakFitName( fits[f] ), fit ) &&
+               fit == fits[f] );
+    CHECK( !peakFitFromName( "cubic", fit ) );
+
+    // The controller with a fit : at the peak, in fewer moves.
+    AfScene scene = peak_scene( 100, 50, 10 );
+    HillClimbDecisions decisions;
+    AfController climb( decisions );
+    AfController jump( decisions );
+    jump.setPeakFit( GaussianFit );
+    vector<LensCommand> moves;
+    long allocated;
+    int climbSteps = 0, jumpSteps = 0;
+    for (int start = 0; start < 100; start++)
+    {
+        drive( climb, scene, start, moves, allocated );
+        climbSteps += climb.steps();
+        CHECK( drive( jump, scene, start, moves, allocated ).kind ==
+               LensCommand::Found );
+        CHECK( jump.position() == 50 && allocated == 0 );
+        jumpSteps += jump.steps();
+    }
+    CHECK( jumpSteps < climbSteps );
+}
+
+/*
+ *  Every strategy finds the single peak of a scene from anywhere on the
+ *  lens, the probe searches in fewer steps than the hill climb; under
+ *  backlash and noise they all still end, each run as its seed says.
+ */
+static void
+test_strategies()
+{
+    const AfStrategy strategies[] = { HillClimbStrategy,
+                                      GoldenSectionStrategy,
+                                      FibonacciStrategy,
+                                      PredictiveStrategy };
+    AfStrategy strategy;
+    for (int s = 0; s < 4; s++)
+        CHECK( strategyFromName( strategyName( strategies[s] ), strategy ) &&
+               strategy == strategies[s] );
+    CHECK( !strategyFromName( "random", strategy ) );
+
+    AfScene scene = peak_scene( 100, 37, 10 );
+    HillClimbDecisions decisions;
+    int totalSteps[4];
+    for (int s = 0; s < 4; s++)
+    {
+        AfSimulator exact( decisions, false, false );
+        exact.setStrategy( strategies[s] );
+        totalSteps[s] = 0;
+        for (int start = 0; start < 100; start++)
+        {
+            AfOutcome outcome = exact.run( scene, start, 0 );
+            if (!CHECK( outcome.found && outcome.position == 37 ))
+                cerr << strategyName( strategies[s] ) << " from " << start
+                     << ": " << outcome.position << endl;
+            CHECK( outcome.steps < 40 );
+            totalSteps[s] += outcome.steps;
+        }
+    }
+    for (int s = 1; s < 4; s++)
+        CHECK( totalSteps[s] < totalSteps[0] );
+
+    // Probes are measured once, the best position last, and only moves of
+    // more than one position are coarse.
+    for (int s = 1; s < 4; s++)
+    {
+        AfSearch *search = newSearch( strategies[s], decisions );
+        RecordedSearch recorded( *search );
+        AfSimulator exact( decisions, false, false );
+        for (int start = 0; start < 100; start += 9)
+        {
+            AfOutcome outcome = exact.run( recorded, scene, start, 0 );
+            int visited = 0;
+            for (int p = 0; p < 100; p++)
+                visited += recorded.visited( p );
+            CHECK( outcome.steps <= visited + 1 );
+            for (size_t c = 0; c < recorded.commands.size(); c++)
+            {
+                const LensCommand &command = recorded.commands[c];
+                if (command.kind == LensCommand::Move)
+                    CHECK( command.coarse == (abs( command.steps ) > 1) );
+            }
+        }
+        delete search;
+    }
+
+    for (int s = 0; s < 4; s++)
+    {
+        AfSimulator camera( decisions, true, true );
+        camera.setStrategy( strategies[s] );
+        for (int start = 0; start < 100; start += 3)
+            for (unsigned seed = 0; seed < 10; seed++)
+            {
+                AfOutcome outcome = camera.run( scene, start, seed );
+                AfOutcome again = camera.run( scene, start, seed );
+                CHECK( outcome.steps < 100 && outcome.travel < 1000 );
+                CHECK( again.found == outcome.found &&
+                       again.position == outcome.position &&
+                       again.steps == outcome.steps &&
+                       again.travel == outcome.travel &&
+                       again.backlashCount == outcome.backlashCount );
+            }
+    }
+}
+
+/*
+ *  Backlash throws coarse moves off when they turn, though they still
+ *  move at least one position the way asked, and never fine moves (even
+ *  of two positions).
+ */
+static void
+test_simulator_backlash()
+{
+    AfScene scene = peak_scene( 100, 50, 10 );
+    HillClimbDecisions decisions;
+    AfSimulator simulator( decisions, true, false, 8, 2 );
+    simulator.setMaximumBacklash( 10 );
+
+    const LensCommand script[] =
+    {
+        { LensCommand::Move, +8, true },    // the first move turns
+        { LensCommand::Move, -2, false },
+        { LensCommand::Move, +2, false },
+        { LensCommand::Move, +8, true },    // same direction
+        { LensCommand::Move, -1, true },
+        { LensCommand::Move, -2, false }
+    };
+    ScriptedSearch search( vector<LensCommand>( script, script + 6 ) );
+    bool longer = false, shorter = false, leastOne = false;
+    for (unsigned seed = 0; seed < 500; seed++)
+    {
+        AfOutcome outcome = simulator.run( search, scene, 40, seed );
+        const vector<int> &p = search.positions;
+        if (!CHECK( p.size() == 7 ))
+            continue;
+        CHECK( outcome.backlashCount == 4 );
+        CHECK( p[1] > p[0] && p[1] <= p[0] + 18 );
+        CHECK( p[2] == p[1] - 2 );
+        CHECK( p[3] == p[2] + 2 );
+        CHECK( p[4] == p[3] + 8 );
+        CHECK( p[5] < p[4] && p[5] >= p[4] - 11 );
+        CHECK( p[6] == p[5] - 2 );
+        longer |= p[1] > p[0] + 8;
+        shorter |= p[1] < p[0] + 8;
+        leastOne |= p[5] == p[4] - 1;
+    }
+    CHECK( longer && shorter && leastOne );
+
+    // Without backlash every move is exact.
+    AfSimulator exact( decisions, false, false, 8, 2 );
+    AfOutcome outcome = exact.run( search, scene, 40, 0 );
+    const int expected[] = { 40, 48, 46, 48, 56, 55, 53 };
+    CHECK( outcome.backlashCount == 0 &&
+           search.positions == vector<int>( expected, expected + 7 ) );
+
+    // The hill climb marks its coarse steps and nothing of a fine step or
+    // less; with fine steps of two positions it still finds the peak.
+    AfController controller( decisions, 8, 2 );
+    RecordedSearch recorded( controller );
+    for (int start = 0; start < 100; start += 7)
+        for (unsigned seed = 0; seed < 20; seed++)
+        {
+            AfOutcome outcome = simulator.run( recorded, scene, start, seed );
+            for (size_t c = 0; c < recorded.commands.size(); c++)
+            {
+                const LensCommand &command = recorded.commands[c];
+                if (command.kind == LensCommand::Move)
+                    CHECK( command.coarse == (abs( command.steps ) > 2) );
+            }
+            CHECK( outcome.found && scene.distanceToPeak( outcome.position )
+                   <= 2 );
+        }
+}
+
+int
+main( int argc, char *argv[] )
+{
+    test_controller();
+    test_decision_tree();
+    test_tree_trainer();
+    test_peak_estimator();
+    test_strategies();
+    test_simulator_backlash();
+
+    printf( "%d checks, %d failed\n", checks, failures );
+    return( failures > 0 ? 1 : 0 );
+}
@@ -0,0 +1,327 @@
+#include "trainingData.h"
+#include "afFeatures.h"
+#include "threadPool.h"
+#include <algorithm>
+#include <random>
+#include <stdlib.h>
+
+using namespace std;
+
+// Length of a coarse step, in lens positions.
+#define COARSE_STEP 8
+
+// Noise added to the values of a sweep, as a fraction of the lowest value
+// of the scene.
+#define SWEEP_NOISE 0.10
+
+// How much less likely an instance is kept (or how much less it weighs)
+// after each step of a sweep.
+#define CONTINUE_RATIO 0.99
+#define TURN_BACK_RATIO 0.93
+
+// Instances kept, before balancing the classes.
+#define SAMPLING_RATE 0.6
+#define WEIGHTED_SAMPLING_RATE 0.10
+
+// Share of each class after balancing : continue 3, turn_peak 1 and
+// backtrack 1, normalized to an average of 1.
+static const double ClassMultipliers[3] = { 1.8, 0.6, 0.6 };
+
+LeftRightOptions::LeftRightOptions()
+	: featureSet( TwoMeasures ), peak( HighestPeak ), stepSize( 1 ),
+	  duplicateEdges( false )
+{
+}
+
+ActionOptions::ActionOptions()
+	: stepSize( 1 ), closestPeak( false ), backtrackFaster( false ),
+	  useWeights( false ), seed( 1 )
+{
+}
+
+bool
+peakOnLeft( const AfScene &scene, int position, PeakChoice peak )
+{
+	const vector<int> &maxima = scene.maxima;
+	const vector<double> &values = scene.values;
+	int best = maxima[0];
+	for (size_t i = 0; i < maxima.size(); i++)
+	{
+		int m = maxima[i];
+		bool better;
+		if ( peak == HighestPeak )
+			better = values[m] > values[best];
+		else if ( peak == NearestPeak )
+			better = abs( position - m ) < abs( position - best );
+		else
+			// Height over distance (+ 1, for a peak at the position).
+			better = values[m] / (abs( position - m ) + 1) >
+					 values[best] / (abs( position - best ) + 1);
+		if ( better )
+			best = m;
+	}
+	return best < position;
+}
+
+// Lens positions with an instance : every position with two before it,
+// and those near the edges again (twice for the nearest).
+static vector<int>
+leftRightPositions( int stepCount, const LeftRightOptions &options )
+{
+	int first = 2 * options.stepSize;
+	vector<int> positions;
+	for (int p = first; p < stepCount; p++)
+		positions.push_back( p );
+	if ( options.duplicateEdges )
+	{
+		for (int p = first; p < (int)(stepCount * 0.2 + first); p++)
+			positions.push_back( p );
+		for (int p = (int)(stepCount * 0.8); p < stepCount; p++)
+			positions.push_back( p );
+		for (int p = first; p < (int)(stepCount * 0.1 + first); p++)
+			positions.push_back( p );
+		for (int p = (int)(stepCount * 0.9); p < stepCount; p++)
+			positions.push_back( p );
+	}
+	return positions;
+}
+
+bool
+makeLeftRightSet( const vector<AfScene> &scenes,
+				  const LeftRightOptions &options, FeatureSet &set,
+				  string &error )
+{
+	// The features of the chosen set, in the order of all_features().
+	int begin = 0, end = FirstStepFeatures::count();
+	if ( options.featureSet == TwoMeasures )
+		end = FirstStepFeatures::find( "downTrend" );
+	else if ( options.featureSet == ThreeMeasures )
+	{
+		begin = FirstStepFeatures::find( "downTrend" );
+		end = FirstStepFeatures::find( "bracket" );
+	}
+	vector<int> kept;
+	for (int f = begin; f < end; f++)
+	{
+		string name = FirstStepFeatures::name( f );
+		if ( options.filters.empty() ||
+			 find( options.filters.begin(), options.filters.end(), name ) !=
+			 options.filters.end() )
+			kept.push_back( f );
+	}
+	if ( kept.empty() )
+	{
+		error = "No features left after filtering";
+		return false;
+	}
+
+	set = FeatureSet();
+	set.relation = "autofocus_dir";
+	for (size_t k = 0; k < kept.size(); k++)
+	{
+		string name = FirstStepFeatures::name( kept[k] );
+		set.features.push_back( name );
+		set.types.push_back( name == "bracket" ? "{0,1,2,3,4}" : "{0,1}" );
+	}
+	set.classAttribute = "direction";
+	set.classes.push_back( "left" );
+	set.classes.push_back( "right" );
+
+	vector<FeatureSet> parts( scenes.size(), set );
+	ThreadPool::global().runTasks( scenes.size(), [&]( int s )
+	{
+		const AfScene &scene = scenes[s];
+		const vector<double> &values = scene.values;
+		int stepCount = values.size();
+		vector<double> all( FirstStepFeatures::count() );
+		vector<double> row( kept.size() );
+
+		vector<int> positions = leftRightPositions( stepCount, options );
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			int p = positions[i];
+			int step = options.stepSize;
+			FirstStepFeatures::values( values[p - 2 * step], values[p - step],
+									   values[p], (double)p / (stepCount - 1),
+									   &all[0] );
+			for (size_t k = 0; k < kept.size(); k++)
+				row[k] = all[kept[k]];
+			parts[s].add( &row[0], peakOnLeft( scene, p, options.peak ) ? 0 : 1 );
+		}
+	} );
+
+	for (size_t s = 0; s < parts.size(); s++)
+		set.append( parts[s] );
+	return true;
+}
+
+// Largest peak <= position, smallest peak > position; -1 if none.
+static int
+peakBefore( const vector<int> &maxima, int position, int from )
+{
+	int largest = -1;
+	for (size_t i = 0; i < maxima.size(); i++)
+		if ( maxima[i] <= position && maxima[i] >= from && maxima[i] > largest )
+			largest = maxima[i];
+	return largest;
+}
+
+static int
+peakAfter( const vector<int> &maxima, int position )
+{
+	int smallest = -1;
+	for (size_t i = 0; i < maxima.size(); i++)
+		if ( maxima[i] > position && (smallest < 0 || maxima[i] < smallest) )
+			smallest = maxima[i];
+	return smallest;
+}
+
+AfAction
+correctAction( const AfScene &scene, int start, int current, int direction,
+			   const ActionOptions &options )
+{
+	int last = scene.values.size() - 1;
+	vector<int> maxima = scene.maxima;
+	if ( direction < 0 )
+	{
+		start = last - start;
+		current = last - current;
+		for (size_t i = 0; i < maxima.size(); i++)
+			maxima[i] = last - maxima[i];
+	}
+
+	int leftClosest = peakBefore( maxima, current, 0 );
+	int leftVisited = peakBefore( maxima, current, start );
+	int rightClosest = peakAfter( maxima, current );
+
+	if ( leftVisited < 0 )
+	{
+		// Backtrack if the peak behind is closer than the one ahead. (With
+		// no peak behind, simulate.py fails; going on is the only choice.)
+		if ( options.backtrackFaster )
+		{
+			if ( rightClosest < 0 )
+				return AfBacktrack;
+			if ( leftClosest >= 0 &&
+				 rightClosest - current > current - leftClosest )
+				return AfBacktrack;
+		}
+
+		// The peak was just behind the start.
+		int leftOfStart = peakBefore( maxima, start, 0 );
+		if ( leftOfStart >= 0 && start - leftOfStart <= COARSE_STEP &&
+			 current - leftOfStart > COARSE_STEP )
+			return AfTurnPeak;
+	}
+	else
+	{
+		// At the end of the lens : turn back to the peak now.
+		if ( current == last )
+			return AfTurnPeak;
+
+		// Just passed a peak : go on a bit to confirm it.
+		if ( current - leftVisited <= COARSE_STEP )
+			return AfContinue;
+		if ( options.closestPeak && rightClosest >= 0 &&
+			 current - leftVisited - COARSE_STEP >= rightClosest - current )
+			return AfContinue;
+		return AfTurnPeak;
+	}
+
+	// No more peaks ahead.
+	if ( rightClosest < 0 && abs( current - start ) > 4 * COARSE_STEP )
+		return AfBacktrack;
+	return AfContinue;
+}
+
+void
+makeActionSet( const vector<AfScene> &scenes, const ActionOptions &options,
+			   FeatureSet &set )
+{
+	set = FeatureSet();
+	set.relation = "autofocus_action";
+	for (int f = 0; f < SweepFeatures::count(); f++)
+	{
+		set.features.push_back( SweepFeatures::name( f ) );
+		set.types.push_back( "numeric" );
+	}
+	set.classAttribute = "action";
+	set.classes.push_back( "continue" );
+	set.classes.push_back( "turn_peak" );
+	set.classes.push_back( "backtrack" );
+	set.weighted = options.useWeights;
+
+	vector<FeatureSet> parts( scenes.size(), set );
+	ThreadPool::global().runTasks( scenes.size(), [&]( int s )
+	{
+		const AfScene &scene = scenes[s];
+		const vector<double> &values = scene.values;
+		int stepCount = values.size();
+		double smallest = *min_element( values.begin(), values.end() );
+		seed_seq sequence = { options.seed, (unsigned)s };
+		mt19937 random( sequence );
+		uniform_real_distribution<double> unit( 0.0, 1.0 );
+		vector<double> sweep, row( SweepFeatures::count() );
+
+		for (int start = 2 * options.stepSize; start < stepCount; start++)
+			for (int direction = +1; direction >= -1; direction -= 2)
+			{
+				sweep.assign( 1, values[start] );
+				int current = start;
+				double keep = 1.0;
+				while ( current > 0 && current < stepCount - 1 )
+				{
+					current += direction * COARSE_STEP;
+					current = current < 0 ? 0 :
+						current >= stepCount ? stepCount - 1 : current;
+					sweep.push_back( values[current] +
+									 unit( random ) * SWEEP_NOISE * smallest );
+
+					AfAction action = correctAction( scene, start, current,
+													 direction, options );
+					keep *= action == AfContinue ? CONTINUE_RATIO :
+												   TURN_BACK_RATIO;
+					if ( sweep.size() < 3 )
+						continue;
+
+					// Sample the instances less as the sweep goes on, or
+					// weigh them less.
+					bool kept = options.useWeights ?
+						unit( random ) <= WEIGHTED_SAMPLING_RATE :
+						unit( random ) <= keep * SAMPLING_RATE;
+					if ( !kept )
+						continue;
+					SweepFeatures::values( &sweep[0], sweep.size(), stepCount,
+										   &row[0] );
+					parts[s].add( &row[0], action,
+								  options.useWeights ? keep : 1.0 );
+				}
+			}
+	} );
+
+	FeatureSet all = set;
+	for (size_t s = 0; s < parts.size(); s++)
+		all.append( parts[s] );
+
+	// Balance the classes : the same sum of weights in each, or about the
+	// same number of instances, before the multipliers.
+	double sums[3] = { 0, 0, 0 };
+	for (int i = 0; i < all.size(); i++)
+		sums[all.labels[i]] += all.weights[i];
+	double smallestSum = min( sums[0], min( sums[1], sums[2] ) );
+	double factors[3];
+	for (int c = 0; c < 3; c++)
+		factors[c] = sums[c] > 0 ? ClassMultipliers[c] * smallestSum / sums[c] : 0;
+
+	seed_seq sequence = { options.seed, (unsigned)scenes.size() };
+	mt19937 random( sequence );
+	uniform_real_distribution<double> unit( 0.0, 1.0 );
+	for (int i = 0; i < all.size(); i++)
+	{
+		int c = all.labels[i];
+		if ( options.useWeights )
+			set.add( all.row( i ), c, all.weights[i] * factors[c] );
+		else if ( unit( random ) < factors[c] )
+			set.add( all.row( i ), c );
+	}
+}
@@ -0,0 +1,90 @@
+#ifndef _TrainingData_H
+#define _TrainingData_H
+
+#include <vector>
+
+#include "afController.h"
+#include "afSimulator.h"
+#include "featureSet.h"
+
+/*
+ * The instances the decision trees are trained on, made from the scenes
+ * the way makeleftrightfeatures.py (left/right tree) and simulate.py
+ * (action tree) make them. Scenes are processed in parallel; the features
+ * of a scene are computed for all its positions at once.
+ */
+
+/*
+ * Which peak the left/right tree should head for.
+ */
+enum PeakChoice
+{
+	HighestPeak,		// --highest
+	NearestPeak,		// --nearest
+	HighAndNearPeak		// --high-and-near
+};
+
+/*
+ * The features of the left/right tree.
+ */
+enum FirstStepSet
+{
+	TwoMeasures,		// the default of makeleftrightfeatures.py
+	ThreeMeasures,		// --three-measures
+	AllFirstStep		// --all-features
+};
+
+struct LeftRightOptions
+{
+	LeftRightOptions();
+
+	FirstStepSet featureSet;
+	PeakChoice peak;
+	int stepSize;					// 1, or 2 with --double-step
+	bool duplicateEdges;			// --dup-edges
+	std::vector<std::string> filters;	// features to keep, all if empty
+};
+
+/*
+ * An instance per lens position (and more near the edges with
+ * duplicateEdges), from the values at the position and the two before it.
+ */
+bool makeLeftRightSet( const std::vector<AfScene> &scenes,
+					   const LeftRightOptions &options, FeatureSet &set,
+					   std::string &error );
+
+/*
+ * Whether the peak to head for from a lens position is on its left.
+ */
+bool peakOnLeft( const AfScene &scene, int position, PeakChoice peak );
+
+struct ActionOptions
+{
+	ActionOptions();
+
+	int stepSize;				// 1, or 2 with --double-step
+	bool closestPeak;			// --closest-peak
+	bool backtrackFaster;		// --backtrack-faster
+	bool useWeights;			// --use-weights
+	unsigned seed;
+};
+
+/*
+ * Sweeps in coarse steps from every position, both ways, with noise, and
+ * an instance per step from the third value of a sweep on. Instances are
+ * sampled (or weighted) less as the sweep goes on, and the classes are
+ * balanced, as in simulate.py. The random numbers of a scene only depend
+ * on the seed and on the scene.
+ */
+void makeActionSet( const std::vector<AfScene> &scenes,
+					const ActionOptions &options, FeatureSet &set );
+
+/*
+ * What a sweep from start, now at current and moving right, should do
+ * (get_move_right_classification). Moving left is the same on the
+ * reversed scene.
+ */
+AfAction correctAction( const AfScene &scene, int start, int current,
+						int direction, const ActionOptions &options );
+
+#endif
@@ -0,0 +1,110 @@
+#include <chrono>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "decisionTree.h"
+#include "featureSet.h"
+#include "treeTrainer.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: traintree [OPTIONS] DATA" << endl;
+    cerr << "\t Trains a decision tree on the instances of an ARFF file (or" << endl;
+    cerr << "\t of a binary file of makefeatures) the way Weka's J48 does," << endl;
+    cerr << "\t and prints it as Weka does, for parsej48.py, compiletree and" << endl;
+    cerr << "\t afbenchmark. Splits are searched on every core." << endl;
+    cerr << "\t Valid options include (those of J48) :" << endl;
+    cerr << "\t -C X, --confidence=X : confidence of the pruning (default" << endl;
+    cerr << "\t     0.25)" << endl;
+    cerr << "\t -M N, --min-instances=N : instances in two of the branches" << endl;
+    cerr << "\t     of a split, at least (default 2)" << endl;
+    cerr << "\t -U, --unpruned : don't prune the tree" << endl;
+    cerr << "\t -S, --no-raising : don't raise subtrees when pruning" << endl;
+    exit(1);
+}
+
+int
+main( int argc, char *argv[] )
+{
+    TreeTrainerOptions options;
+    string dataFile;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option == "-C" && i + 1 < argc)
+            options.confidence = atof(argv[++i]);
+        else if (option.compare(0, 13, "--confidence=") == 0)
+            options.confidence = atof(option.substr(13).c_str());
+        else if (option == "-M" && i + 1 < argc)
+            options.minInstances = atoi(argv[++i]);
+        else if (option.compare(0, 16, "--min-instances=") == 0)
+            options.minInstances = atoi(option.substr(16).c_str());
+        else if (option == "-U" || option == "--unpruned")
+            options.prune = false;
+        else if (option == "-S" || option == "--no-raising")
+            options.subtreeRaising = false;
+        else if (option[0] == '-' || !dataFile.empty())
+            print_usage();
+        else
+            dataFile = option;
+    }
+    // Weka refuses confidences above 0.5 too.
+    if (dataFile.empty() || options.minInstances < 1 ||
+        options.confidence <= 0 || options.confidence > 0.5)
+        print_usage();
+
+    FeatureSet set;
+    if (!set.read( dataFile ))
+    {
+        cerr << set.error() << endl;
+        exit(1);
+    }
+
+    typedef chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    TreeTrainer trainer( options );
+    if (!trainer.train( set ))
+    {
+        cerr << trainer.error() << endl;
+        exit(1);
+    }
+    double seconds = chrono::duration<double>( Clock::now() - start ).count();
+    string tree = trainer.text();
+
+    printf( "\nOptions: -C %g -M %d %s%s\n\n", options.confidence,
+            options.minInstances, options.prune ? "" : "-U ",
+            options.subtreeRaising ? "" : "-S " );
+    printf( "%s\n\nTime taken to build model: %.2f seconds\n", tree.c_str(),
+            seconds );
+
+    // The tree as it will be read, on the data it was trained on.
+    DecisionTree parsed;
+    if (!parsed.parse( tree, set.features ))
+    {
+        cerr << parsed.error() << endl;
+        exit(1);
+    }
+    vector<int> classes( set.size() );
+    parsed.classifyBatch( &set.values[0], set.size(), set.features.size(),
+                          &classes[0] );
+    double correct = 0, total = 0;
+    for (int i = 0; i < set.size(); i++)
+    {
+        if (parsed.classes()[classes[i]] == set.classes[set.labels[i]])
+            correct += set.weights[i];
+        total += set.weights[i];
+    }
+    printf( "\n=== Error on training data ===\n\n" );
+    printf( "Correctly Classified Instances   %12.0f   %9.4f %%\n", correct,
+            100.0 * correct / total );
+    printf( "Incorrectly Classified Instances %12.0f   %9.4f %%\n",
+            total - correct, 100.0 * (total - correct) / total );
+
+    return( 0 );
+}
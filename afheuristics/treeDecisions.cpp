@@ -0,0 +1,93 @@
+#include "treeDecisions.h"
+#include "afFeatures.h"
+
+using namespace std;
+
+TreeDecisions::TreeDecisions()
+{
+}
+
+bool
+TreeDecisions::load( const string &leftRightFile, const string &actionFile )
+{
+	vector<string> names;
+	for (int f = 0; f < FirstStepFeatures::count(); f++)
+		names.push_back( FirstStepFeatures::name( f ) );
+	DecisionTree leftRightTree;
+	if ( !leftRightTree.load( leftRightFile, names ) )
+	{
+		lastError = leftRightTree.error();
+		return false;
+	}
+
+	names.clear();
+	for (int f = 0; f < SweepFeatures::count(); f++)
+		names.push_back( SweepFeatures::name( f ) );
+	DecisionTree actionTree;
+	if ( !actionTree.load( actionFile, names ) )
+	{
+		lastError = actionTree.error();
+		return false;
+	}
+	return setTrees( leftRightTree, actionTree );
+}
+
+bool
+TreeDecisions::setTrees( const DecisionTree &leftRightTree,
+						 const DecisionTree &actionTree )
+{
+	// Class names to decisions, once.
+	directions.clear();
+	for (size_t c = 0; c < leftRightTree.classes().size(); c++)
+	{
+		const string &name = leftRightTree.classes()[c];
+		if ( name != "left" && name != "right" )
+		{
+			lastError = "Unknown direction " + name + " in the left/right tree";
+			return false;
+		}
+		directions.push_back( name == "left" ? -1 : +1 );
+	}
+
+	actions.clear();
+	for (size_t c = 0; c < actionTree.classes().size(); c++)
+	{
+		const string &name = actionTree.classes()[c];
+		if ( name == "continue" )
+			actions.push_back( AfContinue );
+		else if ( name == "turn_peak" )
+			actions.push_back( AfTurnPeak );
+		else if ( name == "backtrack" )
+			actions.push_back( AfBacktrack );
+		else
+		{
+			lastError = "Unknown action " + name + " in the action tree";
+			return false;
+		}
+	}
+
+	leftRight = leftRightTree;
+	action = actionTree;
+	return true;
+}
+
+int
+TreeDecisions::firstDirection( double first, double second, double third,
+							   double normalizedPosition )
+{
+	int c = leftRight.classify( [&]( int feature ) {
+		return FirstStepFeatures::value( feature, first, second, third,
+										 normalizedPosition );
+	} );
+	return directions[c];
+}
+
+AfAction
+TreeDecisions::sweepAction( const AfSweep &sweep )
+{
+	int c = action.classify( [&]( int feature ) {
+		return SweepFeatures::value( feature, sweep.values, sweep.count,
+									 sweep.stepCount );
+	} );
+	return actions[c];
+}
@@ -0,0 +1,47 @@
+#ifndef _TreeDecisions_H
+#define _TreeDecisions_H
+
+#include "afController.h"
+#include "decisionTree.h"
+#include <string>
+#include <vector>
+
+/*
+ * The decisions of benchmark.py : a left/right tree on the features of
+ * featuresfirststep.py, and an action tree on the features of
+ * featuresturn.py, both read from Weka's output. The features are only
+ * computed along the path of each decision.
+ */
+class TreeDecisions : public AfDecisions
+{
+public:
+	TreeDecisions();
+
+	/*
+	 * Read the trees. The leaves must be left/right and continue,
+	 * turn_peak or backtrack. Returns false if a tree can't be read or
+	 * has other classes (see error()).
+	 */
+	bool load( const std::string &leftRightFile, const std::string &actionFile );
+
+	/*
+	 * Use trees already read, or trained (see TreeTrainer).
+	 */
+	bool setTrees( const DecisionTree &leftRightTree,
+				   const DecisionTree &actionTree );
+
+	virtual int firstDirection( double first, double second, double third,
+								double normalizedPosition );
+	virtual AfAction sweepAction( const AfSweep &sweep );
+
+	const std::string & error() const { return lastError; }
+
+private:
+	DecisionTree leftRight;
+	DecisionTree action;
+	std::vector<int> directions;		// of each class of leftRight
+	std::vector<AfAction> actions;		// of each class of action
+	std::string lastError;
+};
+
+#endif
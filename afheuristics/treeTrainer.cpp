@@ -0,0 +1,743 @@
+#include "treeTrainer.h"
+#include "threadPool.h"
+#include <algorithm>
+#include <ctype.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+// Nodes with at least this many values (instances times features) search
+// their split and sort their columns on every core.
+#define PARALLEL_VALUES 65536
+
+// Weka's comparisons (weka.core.Utils), which tolerate rounding errors.
+#define SMALL 1e-6
+
+static bool gr( double a, double b ) { return a - b > SMALL; }
+static bool sm( double a, double b ) { return a - b < -SMALL; }
+static bool eq( double a, double b ) { return fabs( a - b ) < SMALL; }
+
+// x log x, the term of the entropies of EntropyBasedSplitCrit.
+static double
+lnFunc( double x )
+{
+	return x < 1e-6 ? 0 : x * log( x );
+}
+
+// Entropy of the classes, times their weight, in bits.
+static double
+oldEntropy( const double *classes, int classCount, double total )
+{
+	double sum = 0;
+	for (int c = 0; c < classCount; c++)
+		sum += lnFunc( classes[c] );
+	return (lnFunc( total ) - sum) / log( 2.0 );
+}
+
+// Entropy of the classes within each branch, times their weight, in bits.
+static double
+newEntropy( const double *classes, int classCount, int branchCount )
+{
+	double sum = 0;
+	for (int b = 0; b < branchCount; b++)
+	{
+		double branchTotal = 0;
+		for (int c = 0; c < classCount; c++)
+		{
+			sum += lnFunc( classes[b * classCount + c] );
+			branchTotal += classes[b * classCount + c];
+		}
+		sum -= lnFunc( branchTotal );
+	}
+	return -sum / log( 2.0 );
+}
+
+// Gain ratio of a split whose branches have the given weights, from its
+// information gain (GainRatioSplitCrit).
+static double
+gainRatio( double infoGain, const double *branchTotals, int branchCount,
+		   double total )
+{
+	double splitEntropy = lnFunc( total );
+	for (int b = 0; b < branchCount; b++)
+		splitEntropy -= lnFunc( branchTotals[b] );
+	splitEntropy /= log( 2.0 );
+	if ( eq( splitEntropy, 0 ) )
+		return 0;
+	return infoGain / (splitEntropy / total);
+}
+
+// Index of the first largest weight.
+static int
+largest( const vector<double> &weights )
+{
+	int best = 0;
+	for (size_t i = 1; i < weights.size(); i++)
+		if ( gr( weights[i], weights[best] ) )
+			best = i;
+	return best;
+}
+
+static double
+sum( const vector<double> &weights )
+{
+	double total = 0;
+	for (size_t i = 0; i < weights.size(); i++)
+		total += weights[i];
+	return total;
+}
+
+// The value of the standard normal distribution below which lies the
+// given probability.
+static double
+normalInverse( double probability )
+{
+	double low = -40, high = 40;
+	for (int i = 0; i < 200; i++)
+	{
+		double middle = (low + high) / 2;
+		if ( 0.5 * erfc( -middle / sqrt( 2.0 ) ) < probability )
+			low = middle;
+		else
+			high = middle;
+	}
+	return (low + high) / 2;
+}
+
+// Errors to add to the errors of a leaf of the given weight, at the upper
+// limit of their confidence interval (weka.classifiers.trees.j48.Stats).
+static double
+addErrors( double total, double errors, double confidence, double z )
+{
+	if ( errors < 1 )
+	{
+		double base = total * (1 - pow( confidence, 1 / total ));
+		if ( errors == 0 )
+			return base;
+		return base + errors * (addErrors( total, 1, confidence, z ) - base);
+	}
+	if ( errors + 0.5 >= total )
+		return max( total - errors, 0.0 );
+
+	double f = (errors + 0.5) / total;
+	double r = (f + z * z / (2 * total) +
+				z * sqrt( f / total - f * f / total +
+						  z * z / (4 * total * total) )) /
+			   (1 + z * z / total);
+	return r * total - errors;
+}
+
+// A number as Weka prints it, with at most decimals digits after the
+// point ("0.871", "5"), or with at least one ("3208.0") if keepPoint.
+static string
+wekaNumber( double value, int decimals, bool keepPoint )
+{
+	char text[64];
+	snprintf( text, sizeof( text ), "%.*f", decimals, value );
+	string number( text );
+	size_t point = number.find( '.' );
+	if ( point != string::npos )
+	{
+		size_t last = number.find_last_not_of( '0' );
+		if ( last == point )
+			last = keepPoint ? point + 1 : point - 1;
+		number.erase( last + 1 );
+	}
+	if ( number == "-0" )
+		number = "0";
+	return number;
+}
+
+// A threshold as Weka prints it, unless that would read as a smaller
+// number and send the values equal to the threshold to the other branch :
+// the next values of the data are at least 1e-5 above it.
+static string
+thresholdText( double threshold )
+{
+	string text = wekaNumber( threshold, 6, false );
+	if ( strtod( text.c_str(), NULL ) >= threshold )
+		return text;
+	text = wekaNumber( ceil( threshold * 1e6 ) / 1e6, 6, false );
+	if ( strtod( text.c_str(), NULL ) >= threshold )
+		return text;
+	char exact[64];
+	snprintf( exact, sizeof( exact ), "%.17g", threshold );
+	return exact;
+}
+
+TreeTrainerOptions::TreeTrainerOptions()
+	: minInstances( 2 ), confidence( 0.25 ), prune( true ),
+	  subtreeRaising( true )
+{
+}
+
+TreeTrainer::TreeTrainer( const TreeTrainerOptions &options )
+	: options( options ), set( NULL ), classCount( 0 ),
+	  normalDeviate( normalInverse( 1 - options.confidence ) )
+{
+}
+
+bool
+TreeTrainer::train( const FeatureSet &set )
+{
+	this->set = &set;
+	nodes.clear();
+	lastError.clear();
+	if ( set.size() == 0 || set.classes.empty() )
+	{
+		lastError = "No instances to train on";
+		return false;
+	}
+	int count = set.size();
+	int featureCount = set.features.size();
+	classCount = set.classes.size();
+
+	// The values of nominal features, in the order of their branches.
+	nominalValues.assign( featureCount, vector<double>() );
+	for (int f = 0; f < featureCount; f++)
+	{
+		const string &type = set.types[f];
+		if ( type.empty() || type[0] != '{' )
+		{
+			string lower( type );
+			for (size_t i = 0; i < lower.size(); i++)
+				lower[i] = tolower( lower[i] );
+			if ( lower != "numeric" && lower != "real" && lower != "integer" )
+			{
+				lastError = "Unsupported type " + type + " of " + set.features[f];
+				return false;
+			}
+			continue;
+		}
+
+		const char *text = type.c_str() + 1;
+		while ( *text != '}' && *text != 0 )
+		{
+			char *end;
+			nominalValues[f].push_back( strtod( text, &end ) );
+			while ( *end == ' ' )
+				end++;
+			if ( end == text || (*end != ',' && *end != '}') )
+			{
+				lastError = "The values of " + set.features[f] +
+							" must be numbers";
+				return false;
+			}
+			text = *end == ',' ? end + 1 : end;
+		}
+		for (int i = 0; i < count; i++)
+			if ( find( nominalValues[f].begin(), nominalValues[f].end(),
+					   set.row( i )[f] ) == nominalValues[f].end() )
+			{
+				lastError = "Value out of " + type + " for " + set.features[f];
+				return false;
+			}
+	}
+
+	// Instances sorted by each numeric feature, once, and in their order
+	// in the last column.
+	sortedValues.assign( featureCount, vector<double>() );
+	columns.assign( featureCount + 1, vector<int>() );
+	for (int i = 0; i < count; i++)
+		columns[featureCount].push_back( i );
+	ThreadPool::global().parallelFor( 0, featureCount, [&]( int begin, int end )
+	{
+		for (int f = begin; f < end; f++)
+		{
+			if ( !nominalValues[f].empty() )
+				continue;
+			vector<int> &column = columns[f];
+			column = columns[featureCount];
+			stable_sort( column.begin(), column.end(), [&]( int a, int b )
+						 { return set.row( a )[f] < set.row( b )[f]; } );
+			for (int i = 0; i < count; i++)
+				sortedValues[f].push_back( set.row( column[i] )[f] );
+		}
+	} );
+
+	branches.assign( count, 0 );
+	nodes.push_back( Node() );
+	build( 0, 0, count );
+
+	// Let the columns go : only the nodes are needed from now on.
+	columns.clear();
+	sortedValues.clear();
+
+	collapse( 0 );
+	if ( options.prune )
+		prune( 0 );
+	return true;
+}
+
+void
+TreeTrainer::classWeights( const vector<int> &instances,
+						   vector<double> &classes ) const
+{
+	classes.assign( classCount, 0.0 );
+	for (size_t i = 0; i < instances.size(); i++)
+		classes[set->labels[instances[i]]] += set->weights[instances[i]];
+}
+
+// Grow the tree from a node whose instances are [begin, end) of every
+// column (C45ModelSelection and ClassifierTree.buildTree).
+void
+TreeTrainer::build( int node, int begin, int end )
+{
+	int featureCount = set->features.size();
+	const vector<int> &order = columns[featureCount];
+	{
+		Node &n = nodes[node];
+		n.feature = -1;
+		n.instances.assign( order.begin() + begin, order.begin() + end );
+		classWeights( n.instances, n.classes );
+	}
+	vector<double> classes = nodes[node].classes;
+	double total = sum( classes );
+	if ( sm( total, 2 * options.minInstances ) ||
+		 eq( total, classes[largest( classes )] ) )
+		return;
+
+	vector<Split> splits( featureCount );
+	auto search = [&]( int first, int last )
+	{
+		for (int f = first; f < last; f++)
+			splits[f] = nominalValues[f].empty() ?
+				numericSplit( f, begin, end, classes ) :
+				nominalSplit( f, begin, end, classes );
+	};
+	bool parallel = (double)(end - begin) * featureCount >= PARALLEL_VALUES;
+	if ( parallel )
+		ThreadPool::global().parallelFor( 0, featureCount, search );
+	else
+		search( 0, featureCount );
+
+	// The best gain ratio, among the splits with at least the average
+	// information gain.
+	double averageGain = 0;
+	int validCount = 0;
+	for (int f = 0; f < featureCount; f++)
+		if ( splits[f].valid )
+		{
+			averageGain += splits[f].infoGain;
+			validCount++;
+		}
+	if ( validCount == 0 )
+		return;
+	averageGain /= validCount;
+	int best = -1;
+	double bestRatio = 0;
+	for (int f = 0; f < featureCount; f++)
+		if ( splits[f].valid && splits[f].infoGain >= averageGain - 1e-3 &&
+			 gr( splits[f].gainRatio, bestRatio ) )
+		{
+			best = f;
+			bestRatio = splits[f].gainRatio;
+		}
+	if ( best < 0 || eq( bestRatio, 0 ) )
+		return;
+
+	// Weka moves the threshold down to a value of the training data.
+	double threshold = splits[best].threshold;
+	if ( nominalValues[best].empty() )
+	{
+		const vector<double> &values = sortedValues[best];
+		threshold = *(upper_bound( values.begin(), values.end(), threshold ) - 1);
+	}
+	nodes[node].feature = best;
+	nodes[node].threshold = threshold;
+
+	// Split every column, keeping the order of the instances.
+	int branchCount = nominalValues[best].empty() ? 2 :
+		nominalValues[best].size();
+	vector<int> starts( branchCount + 1, 0 );
+	for (int i = begin; i < end; i++)
+	{
+		branches[order[i]] = branch( nodes[node], order[i] );
+		starts[branches[order[i]] + 1]++;
+	}
+	for (int b = 0; b < branchCount; b++)
+		starts[b + 1] += starts[b];
+	auto partition = [&]( int first, int last )
+	{
+		vector<int> split( end - begin );
+		for (int f = first; f < last; f++)
+		{
+			vector<int> &column = columns[f];
+			if ( column.empty() )
+				continue;
+			vector<int> next( starts.begin(), starts.end() - 1 );
+			for (int i = begin; i < end; i++)
+				split[next[branches[column[i]]]++] = column[i];
+			copy( split.begin(), split.end(), column.begin() + begin );
+		}
+	};
+	if ( parallel )
+		ThreadPool::global().parallelFor( 0, featureCount + 1, partition );
+	else
+		partition( 0, featureCount + 1 );
+
+	for (int b = 0; b < branchCount; b++)
+	{
+		int child = nodes.size();
+		nodes.push_back( Node() );
+		nodes[node].children.push_back( child );
+		build( child, begin + starts[b], begin + starts[b + 1] );
+	}
+}
+
+// The best threshold of a numeric feature, between two consecutive values
+// of the node (C45Split.handleNumericAttribute).
+TreeTrainer::Split
+TreeTrainer::numericSplit( int feature, int begin, int end,
+						   const vector<double> &classes ) const
+{
+	Split split = { false, 0, 0, 0 };
+	const vector<int> &column = columns[feature];
+	double total = sum( classes );
+
+	// Both branches need this weight.
+	double minimum = 0.1 * total / classCount;
+	if ( !gr( minimum, options.minInstances ) )
+		minimum = options.minInstances;
+	else if ( gr( minimum, 25 ) )
+		minimum = 25;
+	if ( sm( end - begin, 2 * minimum ) )
+		return split;
+
+	double entropy = oldEntropy( &classes[0], classCount, total );
+	vector<double> sides( 2 * classCount, 0.0 );	// left, then right
+	copy( classes.begin(), classes.end(), sides.begin() + classCount );
+	double leftTotal = 0;
+	double bestGain = 0;
+	int bestIndex = -1, candidates = 0, last = begin;
+	for (int next = begin + 1; next < end; next++)
+	{
+		double previous = set->row( column[next - 1] )[feature];
+		if ( previous + 1e-5 >= set->row( column[next] )[feature] )
+			continue;
+
+		// Move the instances of the previous value to the left.
+		for (int i = last; i < next; i++)
+		{
+			int c = set->labels[column[i]];
+			double weight = set->weights[column[i]];
+			sides[c] += weight;
+			sides[classCount + c] -= weight;
+			leftTotal += weight;
+		}
+		last = next;
+		if ( sm( leftTotal, minimum ) ||
+			 sm( total - leftTotal, minimum ) )
+			continue;
+
+		double gain = entropy - newEntropy( &sides[0], classCount, 2 );
+		gain = eq( gain, 0 ) ? 0 : gain / total;
+		if ( gr( gain, bestGain ) )
+		{
+			bestGain = gain;
+			bestIndex = next - 1;
+		}
+		candidates++;
+	}
+	if ( candidates == 0 )
+		return split;
+
+	// The MDL correction, for choosing among many thresholds.
+	split.infoGain = bestGain - log( (double)candidates ) / log( 2.0 ) / total;
+	if ( !gr( split.infoGain, 0 ) )
+		return split;
+
+	double low = set->row( column[bestIndex] )[feature];
+	double high = set->row( column[bestIndex + 1] )[feature];
+	split.threshold = (low + high) / 2;
+	if ( split.threshold == high )
+		split.threshold = low;
+
+	double branchTotals[2] = { 0, 0 };
+	for (int i = begin; i < end; i++)
+		branchTotals[i > bestIndex] += set->weights[column[i]];
+	split.gainRatio = gainRatio( split.infoGain, branchTotals, 2, total );
+	split.valid = true;
+	return split;
+}
+
+// A branch per value of a nominal feature, if two of them have enough
+// instances (C45Split.handleEnumeratedAttribute).
+TreeTrainer::Split
+TreeTrainer::nominalSplit( int feature, int begin, int end,
+						   const vector<double> &classes ) const
+{
+	Split split = { false, 0, 0, 0 };
+	const vector<double> &values = nominalValues[feature];
+	const vector<int> &order = columns[set->features.size()];
+	int branchCount = values.size();
+	vector<double> bags( branchCount * classCount, 0.0 );
+	vector<double> branchTotals( branchCount, 0.0 );
+	for (int i = begin; i < end; i++)
+	{
+		int instance = order[i];
+		int b = find( values.begin(), values.end(),
+					  set->row( instance )[feature] ) - values.begin();
+		bags[b * classCount + set->labels[instance]] += set->weights[instance];
+		branchTotals[b] += set->weights[instance];
+	}
+
+	int filled = 0;
+	for (int b = 0; b < branchCount; b++)
+		if ( !sm( branchTotals[b], options.minInstances ) )
+			filled++;
+	if ( filled < 2 )
+		return split;
+
+	double total = sum( classes );
+	double gain = oldEntropy( &classes[0], classCount, total ) -
+				  newEntropy( &bags[0], classCount, branchCount );
+	split.infoGain = eq( gain, 0 ) ? 0 : gain / total;
+	split.gainRatio = gainRatio( split.infoGain, &branchTotals[0],
+								 branchCount, total );
+	split.valid = true;
+	return split;
+}
+
+int
+TreeTrainer::branch( const Node &node, int instance ) const
+{
+	double value = set->row( instance )[node.feature];
+	const vector<double> &values = nominalValues[node.feature];
+	if ( values.empty() )
+		return value <= node.threshold ? 0 : 1;
+	return find( values.begin(), values.end(), value ) - values.begin();
+}
+
+// Give a subtree new training instances (ClassifierTree.newDistribution).
+void
+TreeTrainer::distribute( int node, const vector<int> &instances )
+{
+	nodes[node].instances = instances;
+	classWeights( instances, nodes[node].classes );
+	if ( nodes[node].feature < 0 )
+		return;
+
+	vector< vector<int> > parts( nodes[node].children.size() );
+	for (size_t i = 0; i < instances.size(); i++)
+		parts[branch( nodes[node], instances[i] )].push_back( instances[i] );
+	for (size_t b = 0; b < parts.size(); b++)
+		distribute( nodes[node].children[b], parts[b] );
+}
+
+double
+TreeTrainer::trainingErrors( int node ) const
+{
+	const Node &n = nodes[node];
+	if ( n.feature < 0 )
+		return sum( n.classes ) - n.classes[largest( n.classes )];
+	double errors = 0;
+	for (size_t b = 0; b < n.children.size(); b++)
+		errors += trainingErrors( n.children[b] );
+	return errors;
+}
+
+// Make leaves of the subtrees that don't make fewer errors on the
+// training data.
+void
+TreeTrainer::collapse( int node )
+{
+	Node &n = nodes[node];
+	if ( n.feature < 0 )
+		return;
+	double leafErrors = sum( n.classes ) - n.classes[largest( n.classes )];
+	if ( trainingErrors( node ) >= leafErrors - 1e-3 )
+	{
+		n.feature = -1;
+		n.children.clear();
+		return;
+	}
+	for (size_t b = 0; b < n.children.size(); b++)
+		collapse( n.children[b] );
+}
+
+double
+TreeTrainer::estimatedErrors( const vector<double> &classes ) const
+{
+	double total = sum( classes );
+	if ( eq( total, 0 ) )
+		return 0;
+	double errors = total - classes[largest( classes )];
+	return errors + addErrors( total, errors, options.confidence,
+							   normalDeviate );
+}
+
+double
+TreeTrainer::estimatedErrors( int node ) const
+{
+	const Node &n = nodes[node];
+	if ( n.feature < 0 )
+		return estimatedErrors( n.classes );
+	double errors = 0;
+	for (size_t b = 0; b < n.children.size(); b++)
+		errors += estimatedErrors( n.children[b] );
+	return errors;
+}
+
+double
+TreeTrainer::estimatedErrorsForBranch( int node,
+									   const vector<int> &instances ) const
+{
+	const Node &n = nodes[node];
+	if ( n.feature < 0 )
+	{
+		vector<double> classes;
+		classWeights( instances, classes );
+		return estimatedErrors( classes );
+	}
+
+	vector< vector<int> > parts( n.children.size() );
+	for (size_t i = 0; i < instances.size(); i++)
+		parts[branch( n, instances[i] )].push_back( instances[i] );
+	double errors = 0;
+	for (size_t b = 0; b < parts.size(); b++)
+		errors += estimatedErrorsForBranch( n.children[b], parts[b] );
+	return errors;
+}
+
+// Replace a subtree by a leaf, or by its largest branch, when the errors
+// estimated on its instances aren't larger
+// (C45PruneableClassifierTree.prune).
+void
+TreeTrainer::prune( int node )
+{
+	if ( nodes[node].feature < 0 )
+		return;
+	for (size_t b = 0; b < nodes[node].children.size(); b++)
+		prune( nodes[node].children[b] );
+
+	// The last of the largest branches, as Distribution.maxBag.
+	const Node &n = nodes[node];
+	int largestBranch = 0;
+	double largestWeight = 0;
+	for (size_t b = 0; b < n.children.size(); b++)
+	{
+		double weight = sum( nodes[n.children[b]].classes );
+		if ( !sm( weight, largestWeight ) )
+		{
+			largestBranch = b;
+			largestWeight = weight;
+		}
+	}
+	double branchErrors = options.subtreeRaising ?
+		estimatedErrorsForBranch( n.children[largestBranch], n.instances ) :
+		DBL_MAX;
+	double leafErrors = estimatedErrors( n.classes );
+	double treeErrors = estimatedErrors( node );
+
+	if ( !gr( leafErrors, treeErrors + 0.1 ) &&
+		 !gr( leafErrors, branchErrors + 0.1 ) )
+	{
+		nodes[node].feature = -1;
+		nodes[node].children.clear();
+		return;
+	}
+	if ( !gr( branchErrors, treeErrors + 0.1 ) )
+	{
+		Node raised = nodes[n.children[largestBranch]];
+		nodes[node].feature = raised.feature;
+		nodes[node].threshold = raised.threshold;
+		nodes[node].children = raised.children;
+		vector<int> instances = nodes[node].instances;
+		distribute( node, instances );
+		prune( node );
+	}
+}
+
+// "class (weight/errors)". An empty leaf takes the class of its parent, as
+// J48 classifies with it.
+string
+TreeTrainer::leafLabel( int node, int parent ) const
+{
+	const vector<double> &classes = nodes[node].classes;
+	double total = sum( classes );
+	int c = largest( classes );
+	double errors = total - classes[c];
+	if ( !gr( total, 0 ) )
+	{
+		c = parent >= 0 ? largest( nodes[parent].classes ) : 0;
+		errors = 0;
+	}
+
+	string label = set->classes[c] + " (" + wekaNumber( total, 2, true );
+	if ( gr( errors, 0 ) )
+		label += "/" + wekaNumber( errors, 2, true );
+	return label + ")";
+}
+
+void
+TreeTrainer::print( int node, int depth, string &out ) const
+{
+	const Node &n = nodes[node];
+	const string &name = set->features[n.feature];
+	const vector<double> &values = nominalValues[n.feature];
+	for (size_t b = 0; b < n.children.size(); b++)
+	{
+		out += "\n";
+		for (int d = 0; d < depth; d++)
+			out += "|   ";
+		if ( !values.empty() )
+			out += name + " = " + wekaNumber( values[b], 6, false );
+		else if ( b == 0 )
+			out += name + " <= " + thresholdText( n.threshold );
+		else
+			out += name + " > " + thresholdText( n.threshold );
+
+		int child = n.children[b];
+		if ( nodes[child].feature < 0 )
+			out += ": " + leafLabel( child, node );
+		else
+			print( child, depth + 1, out );
+	}
+}
+
+string
+TreeTrainer::text() const
+{
+	if ( nodes.empty() )
+		return "";
+	string out = options.prune ? "J48 pruned tree\n" : "J48 unpruned tree\n";
+	out += "------------------\n";
+	if ( nodes[0].feature < 0 )
+		out += ": " + leafLabel( 0, -1 );
+	else
+		print( 0, 0, out );
+
+	char counts[128];
+	snprintf( counts, sizeof( counts ),
+			  "\n\nNumber of Leaves  : \t%d\n\nSize of the tree : \t%d\n",
+			  leafCount(), size() );
+	return out + counts;
+}
+
+int
+TreeTrainer::countNodes( int node, bool leaves ) const
+{
+	const Node &n = nodes[node];
+	if ( n.feature < 0 )
+		return 1;
+	int count = leaves ? 0 : 1;
+	for (size_t b = 0; b < n.children.size(); b++)
+		count += countNodes( n.children[b], leaves );
+	return count;
+}
+
+int
+TreeTrainer::leafCount() const
+{
+	return nodes.empty() ? 0 : countNodes( 0, true );
+}
+
+int
+TreeTrainer::size() const
+{
+	return nodes.empty() ? 0 : countNodes( 0, false );
+}
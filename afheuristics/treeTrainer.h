@@ -0,0 +1,107 @@
+#ifndef _TreeTrainer_H
+#define _TreeTrainer_H
+
+#include <string>
+#include <vector>
+
+#include "featureSet.h"
+
+/*
+ * Induces a decision tree from the instances of a FeatureSet the way
+ * Weka's J48 (C4.5 release 8) does : numeric features are split in two on
+ * the best gain ratio (with the MDL correction of the information gain),
+ * nominal features get a branch per value, the tree is collapsed, then
+ * pruned on the error estimated with the given confidence, raising
+ * subtrees. Instance weights count wherever Weka counts them.
+ *
+ * The features are sorted once, at the root; each node keeps its part of
+ * every sorted column, and searches the split of every feature in
+ * parallel. The tree is printed as Weka prints it, the input of
+ * DecisionTree and parsej48.py.
+ */
+struct TreeTrainerOptions
+{
+	TreeTrainerOptions();
+
+	int minInstances;		// -M, of two of the branches of a split
+	double confidence;		// -C, of the pruning
+	bool prune;				// false with -U
+	bool subtreeRaising;	// false with -S
+};
+
+class TreeTrainer
+{
+public:
+	TreeTrainer( const TreeTrainerOptions &options = TreeTrainerOptions() );
+
+	/*
+	 * Train on a set. Nominal features (types "{...}") must have numbers
+	 * as values, such as those of featuresfirststep.py. Returns false if
+	 * the set has no instances or other values (see error()).
+	 */
+	bool train( const FeatureSet &set );
+
+	/*
+	 * "J48 pruned tree", the tree, the number of leaves and the size of
+	 * the tree, as in Weka's output.
+	 */
+	std::string text() const;
+
+	int leafCount() const;
+	int size() const;
+
+	const std::string & error() const { return lastError; }
+
+private:
+	struct Node
+	{
+		int feature;					// -1 for a leaf
+		double threshold;				// numeric features : <= goes left
+		std::vector<int> children;
+		std::vector<int> instances;		// its training instances
+		std::vector<double> classes;	// their weight in each class
+	};
+
+	// The best split of a node on one feature.
+	struct Split
+	{
+		bool valid;
+		double infoGain;
+		double gainRatio;
+		double threshold;
+	};
+
+	void build( int node, int begin, int end );
+	Split numericSplit( int feature, int begin, int end,
+						const std::vector<double> &classes ) const;
+	Split nominalSplit( int feature, int begin, int end,
+						const std::vector<double> &classes ) const;
+	int branch( const Node &node, int instance ) const;
+	void distribute( int node, const std::vector<int> &instances );
+	void collapse( int node );
+	void prune( int node );
+	double trainingErrors( int node ) const;
+	double estimatedErrors( int node ) const;
+	double estimatedErrorsForBranch( int node,
+									 const std::vector<int> &instances ) const;
+	double estimatedErrors( const std::vector<double> &classes ) const;
+	void classWeights( const std::vector<int> &instances,
+					   std::vector<double> &classes ) const;
+	void print( int node, int depth, std::string &out ) const;
+	std::string leafLabel( int node, int parent ) const;
+	int countNodes( int node, bool leaves ) const;
+
+	TreeTrainerOptions options;
+	const FeatureSet *set;
+	int classCount;
+	std::vector< std::vector<double> > nominalValues;	// empty if numeric
+	std::vector< std::vector<double> > sortedValues;	// of all instances
+	std::vector< std::vector<int> > columns;	// instances sorted by feature,
+												// the last in their order
+	std::vector<int> branches;					// of each instance
+	double normalDeviate;						// of the confidence
+	std::vector<Node> nodes;
+	std::string lastError;
+};
+
+#endif
@@ -1,46 +1,250 @@
+#include <algorithm>
 #include <string>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <iostream>
 
-#include "ImageTools.h"
+#include "asyncWriter.h"
+#include "frameReader.h"
+#include "imageTools.h"
+#include "threadPool.h"
 
 using namespace std;
 
-#define DEFAULT_WIDTH 1056
-#define DEFAULT_HEIGHT 704
+void print_usage()
+{
+    fprintf( stderr, "Usage: addlowlight darkenFactor noiseFactor [OPTIONS] [files 0..n]\n" );
+    fprintf( stderr, "       addlowlight --batch --darken=d0,d1,... --noise=n0,n1,... [OPTIONS] [files 0..n]\n" );
+    fprintf( stderr, "\t darkenFactor -- amount of light to remove (0-1) \n" );
+    fprintf( stderr, "\t noiseFactor -- amount of noise to add (0-1)\n" );
+    fprintf( stderr, "\t Valid options include :\n" );
+    fprintf( stderr, "\t --batch : read each file once and output every combination\n" );
+    fprintf( stderr, "\t           of the darken and noise factors, in OUT/d<darken>_n<noise>/\n" );
+    fprintf( stderr, "\t           (e.g. OUT/d0.5_n0.125/)\n" );
+    fprintf( stderr, "\t --size=WxH : size of the .gray files (default 1056x704)\n" );
+    fprintf( stderr, "\t --seed=N : seed of the noise (default 0)\n" );
+    fprintf( stderr, "\t --out=OUT : output folder (default LowLightOut)\n" );
+    fprintf( stderr, "\t --no-png : only save the .gray images\n" );
+    exit( 6 );
+}
+
+// Parse a factor, between 0 and 1.
+float parse_factor( const string &text )
+{
+    char *last;
+    float factor = strtof(text.c_str(), &last);
+    if (text.empty() || *last != '\0' || !(factor >= 0 && factor <= 1))
+    {
+        fprintf( stderr, "Not a factor between 0 and 1: '%s'\n", text.c_str() );
+        exit( 6 );
+    }
+    return factor;
+}
+
+// Parse a comma separated list of factors.
+vector<float> parse_factors( const string &list )
+{
+    vector<float> factors;
+    size_t start = 0;
+    while (start <= list.length())
+    {
+        size_t end = list.find(',', start);
+        if (end == string::npos)
+            end = list.length();
+        factors.push_back(parse_factor(list.substr(start, end - start)));
+        start = end + 1;
+    }
+    return factors;
+}
+
+// The shortest text that reads back as the same factor, so that different
+// factors never share a folder.
+string format_factor( float factor )
+{
+    char text[32];
+    for (int digits = 1; digits <= 9; digits++)
+    {
+        snprintf(text, sizeof(text), "%.*g", digits, factor);
+        if (strtof(text, NULL) == factor)
+            break;
+    }
+    return text;
+}
+
+// Folder of a combination of factors in a batch.
+string combination_folder( float darkenFactor, float noiseFactor )
+{
+    return "d" + format_factor(darkenFactor) + "_n" +
+        format_factor(noiseFactor) + "/";
+}
+
+// Create every folder leading to a file, like mkdir -p.
+void make_parent_dirs( const string &fileName )
+{
+    for (size_t i = fileName.find('/', 1); i != string::npos;
+         i = fileName.find('/', i + 1))
+        mkdir(fileName.substr(0, i).c_str(), 0755);
+}
+
+// Name of the outputs of a frame, without extension: frames of sweep files
+// (file.sweep#step) become file_step.
+string output_name( const string &fileName )
+{
+    string name = fileName;
+    string step;
+    size_t hash = name.rfind('#');
+    if (hash != string::npos)
+    {
+        step = "_" + name.substr(hash + 1);
+        name.erase(hash);
+    }
+
+    size_t dot = name.rfind('.');
+    size_t slash = name.rfind('/');
+    if (dot != string::npos && (slash == string::npos || dot > slash))
+        name.erase(dot);
+    return name + step;
+}
 
 int
 main( int argc, char *argv[] )
 {
-    if( argc <= 3 ) {
-        fprintf( stderr, "Usage: addlowlight darkenFactor noiseFactor [files 0..n]\n" );
-        fprintf( stderr, "\t darkenFactor -- amount of light to remove (0-1) \n" );
-        fprintf( stderr, "\t noiseFactor -- amount of noise to add (0-1)\n" );
-        exit( 6 );
+    if( argc <= 3 )
+        print_usage();
+
+    bool batch = string(argv[1]) == "--batch";
+    vector<float> darkenFactors;
+    vector<float> noiseFactors;
+    uint64_t seed = 0;
+    string outFolder = "LowLightOut";
+    bool outputPng = true;
+    int grayWidth = ImageTools::GrayWidth;
+    int grayHeight = ImageTools::GrayHeight;
+
+    int firstFile = 1;
+    if (!batch)
+    {
+        darkenFactors.push_back(parse_factor(argv[1]));
+        noiseFactors.push_back(parse_factor(argv[2]));
+        firstFile = 3;
+    }
+
+    for (; firstFile < argc; firstFile++)
+    {
+        string option(argv[firstFile]);
+        if (option == "--batch")
+            batch = true;
+        else if (option.compare(0, 9, "--darken=") == 0 && batch)
+            darkenFactors = parse_factors(option.substr(9));
+        else if (option.compare(0, 8, "--noise=") == 0 && batch)
+            noiseFactors = parse_factors(option.substr(8));
+        else if (option.compare(0, 7, "--size=") == 0)
+        {
+            if (!ImageTools::parseSize(option.c_str() + 7, grayWidth,
+                                       grayHeight))
+                print_usage();
+        }
+        else if (option.compare(0, 7, "--seed=") == 0)
+            seed = strtoull(option.c_str() + 7, NULL, 10);
+        else if (option.compare(0, 6, "--out=") == 0)
+            outFolder = option.substr(6);
+        else if (option == "--no-png")
+            outputPng = false;
+        else if (option.compare(0, 2, "--") == 0)
+            // This option isn't recognized.
+            print_usage();
+        else
+            // A file - we can stop reading options now.
+            break;
+    }
+
+    if (darkenFactors.empty() || noiseFactors.empty() || firstFile >= argc)
+        print_usage();
+
+    FrameReader reader;
+    reader.setGraySize(grayWidth, grayHeight);
+    for( int i = firstFile; i < argc; i++ )
+    {
+        if (!reader.addFile(argv[i]))
+        {
+            cerr << reader.error() << endl;
+            exit( 1 );
+        }
+    }
+
+    int combinations = darkenFactors.size() * noiseFactors.size();
+    vector<string> folders;
+    for (int c = 0; c < combinations; c++)
+    {
+        string folder = combination_folder(
+            darkenFactors[c / noiseFactors.size()],
+            noiseFactors[c % noiseFactors.size()]);
+        for (size_t f = 0; f < folders.size(); f++)
+            if (folders[f] == folder)
+            {
+                fprintf( stderr, "Two combinations would be written to %s/%s\n",
+                         outFolder.c_str(), folder.c_str() );
+                exit( 6 );
+            }
+        folders.push_back(folder);
     }
 
-    float darkenFactor = atof(argv[1]);
-    float noiseFactor  = atof(argv[2]);
+    // Images are encoded on every core, as the combinations are made.
+    int threads = ThreadPool::global().size();
+    AsyncWriter writer(2 * max(combinations, threads), threads);
 
-    for( int i = 3; i < argc; i++ ) 
+    for( int i = 0; i < reader.frames(); i++ )
     {
-        vector<uchar> buffer(DEFAULT_WIDTH * DEFAULT_HEIGHT);
-        ImageTools::readGray( argv[i], DEFAULT_WIDTH * DEFAULT_HEIGHT, 
-                              &buffer[0] );
+        ImageView frame;
+        if (!reader.frame(i, frame))
+        {
+            cerr << reader.error() << endl;
+            exit( 1 );
+        }
+        string filename(reader.fileName(i));
+        int w = frame.width;
+        int h = frame.height;
+        int n = w * h;
+        string outputName = output_name(filename);
+
+        // The noise of a frame only depends on the seed and the file name,
+        // so the same dataset is generated every time. It is shared by
+        // every combination of factors.
+        vector<uchar> noise(n);
+        ImageTools::lowLightNoise(w, h,
+                                  ImageTools::frameSeed(seed, filename.c_str()),
+                                  &noise[0]);
+
+        ThreadPool::global().parallelFor(0, combinations, [&](int c0, int c1)
+        {
+            for (int c = c0; c < c1; c++)
+            {
+                float darkenFactor = darkenFactors[c / noiseFactors.size()];
+                float noiseFactor = noiseFactors[c % noiseFactors.size()];
+
+                vector<uchar> out(n);
+                ImageTools::applyLowLight(darkenFactor, noiseFactor,
+                                          w, h, &noise[0], frame.data,
+                                          &out[0]);
+
+                // Save both a .gray and a .png version of the new image.
+                string folder = outFolder + "/";
+                if (batch)
+                    folder += folders[c];
+                string grayOut = folder + outputName + ".gray";
+                string pngOut = folder + outputName + ".png";
 
-        ImageTools::addLowLight(darkenFactor, noiseFactor,
-                                DEFAULT_WIDTH, DEFAULT_HEIGHT, &buffer[0]);
+                if (batch)
+                    make_parent_dirs(grayOut);
 
-        // Save both a .gray and a .png version of the new image.
-        string filename(argv[i]);
-        string grayOut("LowLightOut/");
-        grayOut += filename;
-        string jpegOut("LowLightOut/");
-        pngOut += filename.substr(0, filename.length() - 4) + "png";
+                if (outputPng)
+                    writer.saveGrayAndPng(grayOut, pngOut, move(out), w, h);
+                else
+                    writer.saveGray(grayOut, move(out));
+            }
+        });
 
-        ImageTools::saveGray(grayOut.c_str(), &buffer[0]);
-        ImageTools::saveGrayPng(pngOut.c_str(), &buffer[0], 
-                                DEFAULT_WIDTH, DEFAULT_HEIGHT);
+        reader.release(i);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,56 @@
+#include "asyncWriter.h"
+#include "imageTools.h"
+
+using namespace std;
+
+AsyncWriter::AsyncWriter( int maxPending, int threads )
+	: queue( maxPending )
+{
+	for (int i = 0; i < threads || i == 0; i++)
+		writers.push_back( thread( &AsyncWriter::writerLoop, this ) );
+}
+
+AsyncWriter::~AsyncWriter()
+{
+	queue.close();
+	for (size_t i = 0; i < writers.size(); i++)
+		writers[i].join();
+}
+
+void
+AsyncWriter::saveGray( const string &fileName, vector<uchar> &&buffer )
+{
+	Job job;
+	job.grayName = fileName;
+	job.buffer = move( buffer );
+	job.width = 0;
+	job.height = 0;
+	queue.push( move( job ) );
+}
+
+void
+AsyncWriter::saveGrayAndPng( const string &grayName, const string &pngName,
+							 vector<uchar> &&buffer, int w, int h )
+{
+	Job job;
+	job.grayName = grayName;
+	job.pngName = pngName;
+	job.buffer = move( buffer );
+	job.width = w;
+	job.height = h;
+	queue.push( move( job ) );
+}
+
+void
+AsyncWriter::writerLoop()
+{
+	Job job;
+	while ( queue.pop( job ) )
+	{
+		ImageTools::saveGray( job.grayName.c_str(), job.buffer.size(),
+							  &job.buffer[0] );
+		if ( !job.pngName.empty() )
+			ImageTools::saveGrayPng( job.pngName.c_str(), &job.buffer[0],
+									 job.width, job.height );
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef _AsyncWriter_H
+#define _AsyncWriter_H
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boundedQueue.h"
+
+typedef unsigned char uchar;
+
+/*
+ * Writes images to disk on background threads, so that computing the next
+ * image doesn't wait for the previous one to be saved. Images are encoded
+ * and written by several threads at once, in any order. At most maxPending
+ * images are held in memory; saving more blocks until one is written.
+ */
+class AsyncWriter
+{
+public:
+	AsyncWriter( int maxPending = 16, int threads = 1 );
+
+	/*
+	 * Waits for every pending image to be written.
+	 */
+	~AsyncWriter();
+
+	/*
+	 * Queue the gray values of buffer to be saved in a .gray file.
+	 * The buffer is taken over by the writer.
+	 */
+	void saveGray( const std::string &fileName, std::vector<uchar> &&buffer );
+
+	/*
+	 * Same as saveGray, but also save a .png version of the image.
+	 */
+	void saveGrayAndPng( const std::string &grayName,
+						 const std::string &pngName,
+						 std::vector<uchar> &&buffer, int w, int h );
+
+private:
+	struct Job
+	{
+		std::string grayName;
+		std::string pngName;
+		std::vector<uchar> buffer;
+		int width;
+		int height;
+	};
+
+	void writerLoop();
+
+	BoundedQueue<Job> queue;
+	std::vector<std::thread> writers;
+};
+
+#endif
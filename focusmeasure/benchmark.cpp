@@ -0,0 +1,620 @@
+/*
+ * Times every focus measure and image operation at several resolutions.
+ *
+ * Each kernel is run a few times to warm up (caches, page faults, thread
+ * pool), then timed over several runs. The overhead of reading the clock
+ * is subtracted from every run, and the median is reported along with the
+ * spread of the runs, the time per pixel and the throughput.
+ *
+ * Where the hardware performance counters are available, each run is also
+ * counted (cycles, instructions, cache and branch misses), which tells
+ * whether a kernel is bound by computation (low IPC with few misses) or by
+ * memory bandwidth (many bytes per cycle, many cache misses).
+ *
+ * Results can be saved as JSON and used as the baseline of a later run,
+ * which then reports how much each kernel changed and fails if one got
+ * slower than a threshold.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "focusMeasure.h"
+#include "frameReader.h"
+#include "imagePyramid.h"
+#include "imageTools.h"
+#include "perfCounters.h"
+#include "threadPool.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+/*
+ *  A kernel to time. setup() prepares the input of one run and isn't
+ *  timed; run() is. bytes is the amount of memory the kernel reads and
+ *  writes in one run (not counting temporary buffers).
+ */
+struct Kernel
+{
+    string name;
+    double bytes;
+    function<void()> setup;
+    function<void()> run;
+};
+
+struct Result
+{
+    string name;
+    int width;
+    int height;
+    int runs;
+    double medianNs;
+    double minNs;
+    double meanNs;
+    double stddevNs;
+    double bytes;
+    int64_t counters[PerfCounters::CounterCount];   // median per run, or -1
+};
+
+struct Settings
+{
+    vector<int> widths;
+    vector<int> heights;
+    int warmup;
+    int minRuns;
+    int maxRuns;
+    double minTime;         // seconds spent timing each kernel
+    string filter;
+    string image;
+    string jsonFile;
+    string baselineFile;
+    double threshold;
+    bool counters;
+};
+
+void print_usage()
+{
+    cerr << "Usage: benchmark [OPTIONS]" << endl;
+    cerr << "\t Times every focus measure and image operation." << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --sizes=WxH,... : resolutions (default 1056x704,528x352,264x176)" << endl;
+    cerr << "\t --image=FILE : image to scale to each resolution, or the first" << endl;
+    cerr << "\t     frame of a sweep file (default: a synthetic textured image)" << endl;
+    cerr << "\t --filter=TEXT : only time kernels whose name contains TEXT" << endl;
+    cerr << "\t --warmup=N : untimed runs before timing (default 2)" << endl;
+    cerr << "\t --runs=MIN,MAX : number of timed runs (default 5,50)" << endl;
+    cerr << "\t --min-time=S : time each kernel for at least S seconds," << endl;
+    cerr << "\t     within the number of runs (default 0.5)" << endl;
+    cerr << "\t --json=FILE : save the results as JSON (- for stdout)" << endl;
+    cerr << "\t --baseline=FILE : compare with the JSON of an earlier run" << endl;
+    cerr << "\t --threshold=F : slowdown that counts as a regression" << endl;
+    cerr << "\t     (default 0.1, i.e. 10%)" << endl;
+    cerr << "\t --no-counters : don't read the hardware performance counters" << endl;
+    exit(1);
+}
+
+/*
+ *  A synthetic image with edges, gradients and noise, so that thresholds
+ *  and histograms behave as they do on photographs.
+ */
+vector<uchar> synthetic_image( int w, int h )
+{
+    vector<uint32_t> noise(w * h);
+    ImageTools::randomWords( 1, 0, w * h, &noise[0] );
+
+    vector<uchar> image(w * h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+        {
+            double v = 128 + 60 * sin(x * 0.05) * cos(y * 0.03);
+            if (((x / 32) + (y / 32)) % 2 == 0)
+                v += 40;
+            v += (int)(noise[x + y * w] % 21) - 10;
+            image[x + y * w] = (uchar)std::min(255.0, std::max(0.0, v));
+        }
+    return image;
+}
+
+double elapsed_ns( Clock::time_point start, Clock::time_point end )
+{
+    return chrono::duration<double, nano>(end - start).count();
+}
+
+/*
+ *  Median time of reading the clock twice, subtracted from every run.
+ */
+double timer_overhead()
+{
+    vector<double> samples;
+    for (int i = 0; i < 1000; i++)
+    {
+        Clock::time_point start = Clock::now();
+        Clock::time_point end = Clock::now();
+        samples.push_back(elapsed_ns(start, end));
+    }
+    sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+/*
+ *  Median of the values of a counter over every run.
+ */
+int64_t median_count( vector<int64_t> &values )
+{
+    sort(values.begin(), values.end());
+    return values.empty() || values[0] < 0 ? -1 : values[values.size() / 2];
+}
+
+Result time_kernel( const Kernel &kernel, int w, int h,
+                    const Settings &settings, double overhead,
+                    PerfCounters *counters )
+{
+    for (int i = 0; i < settings.warmup; i++)
+    {
+        kernel.setup();
+        kernel.run();
+    }
+
+    vector<double> samples;
+    vector<int64_t> counts[PerfCounters::CounterCount];
+    double total = 0;
+    while ((int)samples.size() < settings.minRuns ||
+           ((int)samples.size() < settings.maxRuns &&
+            total < settings.minTime * 1e9))
+    {
+        kernel.setup();
+        if (counters != NULL)
+            counters->start();
+        Clock::time_point start = Clock::now();
+        kernel.run();
+        Clock::time_point end = Clock::now();
+        if (counters != NULL)
+        {
+            counters->stop();
+            int64_t values[PerfCounters::CounterCount];
+            counters->read(values);
+            for (int c = 0; c < PerfCounters::CounterCount; c++)
+                counts[c].push_back(values[c]);
+        }
+
+        double ns = std::max(0.0, elapsed_ns(start, end) - overhead);
+        samples.push_back(ns);
+        total += ns;
+    }
+
+    Result result;
+    result.name = kernel.name;
+    result.width = w;
+    result.height = h;
+    result.runs = samples.size();
+    result.bytes = kernel.bytes;
+    for (int c = 0; c < PerfCounters::CounterCount; c++)
+        result.counters[c] = median_count(counts[c]);
+
+    sort(samples.begin(), samples.end());
+    int n = samples.size();
+    result.medianNs = n % 2 ? samples[n / 2] :
+        (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    result.minNs = samples[0];
+    result.meanNs = total / n;
+
+    double squares = 0;
+    for (int i = 0; i < n; i++)
+        squares += (samples[i] - result.meanNs) * (samples[i] - result.meanNs);
+    result.stddevNs = n > 1 ? sqrt(squares / (n - 1)) : 0;
+    return result;
+}
+
+/*
+ *  The kernels, working on an image of size (w, h). The buffers they use
+ *  live as long as the returned kernels.
+ */
+struct KernelSet
+{
+    vector<uchar> image;
+    vector<uchar> work;
+    vector<uchar> out;
+    vector<uchar> noise;
+    uchar *owned;
+    int w;
+    int h;
+    FocusMeasure focus;
+    ImagePyramid pyramid;
+    vector<Kernel> kernels;
+
+    KernelSet( const vector<uchar> &input, int w, int h )
+        : image(input), work(input), out(w * h), noise(w * h), owned(NULL), w(w), h(h)
+    {
+        double pixels = (double)w * h;
+
+        for (int m = 0; m < FocusMeasure::count(); m++)
+        {
+            Kernel kernel;
+            kernel.name = string("measure/") + FocusMeasure::name(m);
+            kernel.bytes = pixels;
+            kernel.setup = [] {};
+            kernel.run = [this, m] { focus.apply(m, &image[0], this->w, this->h); };
+            kernels.push_back(kernel);
+        }
+
+        const char *scaleNames[] = { "NearestNeighbor", "Bilinear", "Bicubic",
+                                     "AreaAverage" };
+        for (int method = 0; method < 4; method++)
+        {
+            Kernel kernel;
+            kernel.name = string("scale/") + scaleNames[method] + "/half";
+            kernel.bytes = pixels * 5 / 4;
+            kernel.setup = [] {};
+            kernel.run = [this, method]
+            {
+                uchar *scaled = ImageTools::scaleCopy(&image[0], this->w,
+                    this->h, this->w / 2, this->h / 2,
+                    (ImageTools::ScalingMethod)method);
+                if (scaled != &image[0])
+                    delete [] scaled;
+            };
+            kernels.push_back(kernel);
+        }
+
+        Kernel crop;
+        crop.name = "crop/center";
+        crop.bytes = pixels / 2;
+        crop.setup = [this]
+        {
+            delete [] owned;
+            owned = new uchar[this->w * this->h];
+            memcpy(owned, &image[0], this->w * this->h);
+        };
+        crop.run = [this]
+        {
+            ImageTools::crop(owned, this->w, this->h, this->w / 4,
+                             this->w * 3 / 4, this->h / 4, this->h * 3 / 4);
+        };
+        kernels.push_back(crop);
+
+        Kernel brightness;
+        brightness.name = "changeBrightness";
+        brightness.bytes = 2 * pixels;
+        brightness.setup = [this] { work = image; };
+        brightness.run = [this]
+        {
+            ImageTools::changeBrightness(-0.3f, this->w, this->h, &work[0]);
+        };
+        kernels.push_back(brightness);
+
+        Kernel blur;
+        blur.name = "gaussianBlur/sigma1";
+        blur.bytes = 2 * pixels;
+        blur.setup = [] {};
+        blur.run = [this]
+        {
+            ImageTools::gaussianBlur(1.0, this->w, this->h, &image[0], &out[0]);
+        };
+        kernels.push_back(blur);
+
+        Kernel median;
+        median.name = "medianFilter/3x3";
+        median.bytes = 2 * pixels;
+        median.setup = [] {};
+        median.run = [this]
+        {
+            ImageTools::medianFilter(this->w, this->h, &image[0], &out[0]);
+        };
+        kernels.push_back(median);
+
+        Kernel lowLightNoise;
+        lowLightNoise.name = "lowLightNoise";
+        lowLightNoise.bytes = pixels;
+        lowLightNoise.setup = [] {};
+        lowLightNoise.run = [this]
+        {
+            ImageTools::lowLightNoise(this->w, this->h, 1, &noise[0]);
+        };
+        kernels.push_back(lowLightNoise);
+
+        Kernel lowLight;
+        lowLight.name = "applyLowLight";
+        lowLight.bytes = 3 * pixels;
+        lowLight.setup = [] {};
+        lowLight.run = [this]
+        {
+            ImageTools::applyLowLight(0.5, 0.3, this->w, this->h, &noise[0],
+                                      &image[0], &out[0]);
+        };
+        kernels.push_back(lowLight);
+
+        Kernel levels;
+        levels.name = "imagePyramid/3";
+        levels.bytes = pixels * (1 + 21.0 / 16);
+        levels.setup = [] {};
+        levels.run = [this] { pyramid.build(&image[0], this->w, this->h); };
+        kernels.push_back(levels);
+    }
+
+    ~KernelSet()
+    {
+        delete [] owned;
+    }
+};
+
+/*
+ *  Read the results of an earlier run, as written by write_json.
+ */
+vector<Result> read_baseline( const string &fileName )
+{
+    vector<Result> results;
+    FILE *fp = fopen(fileName.c_str(), "r");
+    if (fp == NULL)
+    {
+        cerr << "No such file: " << fileName << endl;
+        exit(1);
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        char name[256];
+        Result result;
+        if (sscanf(line, " { \"kernel\": \"%255[^\"]\", \"width\": %d, "
+                   "\"height\": %d, \"runs\": %d, \"medianNs\": %lf",
+                   name, &result.width, &result.height, &result.runs,
+                   &result.medianNs) == 5)
+        {
+            result.name = name;
+            results.push_back(result);
+        }
+    }
+    fclose(fp);
+    return results;
+}
+
+/*
+ *  a / b * scale, as text, or "-" when a counter is missing.
+ */
+string format_ratio( double a, double b, double scale, const char *format )
+{
+    if (a < 0 || b <= 0)
+        return "-";
+    char text[32];
+    snprintf(text, sizeof(text), format, a / b * scale);
+    return text;
+}
+
+void write_json( FILE *out, const vector<Result> &results, double overhead )
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"threads\": %d,\n", ThreadPool::global().size());
+    fprintf(out, "  \"timerOverheadNs\": %.1f,\n", overhead);
+    fprintf(out, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        double pixels = (double)r.width * r.height;
+        fprintf(out, "    { \"kernel\": \"%s\", \"width\": %d, \"height\": %d, "
+                "\"runs\": %d, \"medianNs\": %.1f, \"minNs\": %.1f, "
+                "\"meanNs\": %.1f, \"stddevNs\": %.1f, \"nsPerPixel\": %.4f, "
+                "\"megapixelsPerSecond\": %.2f, \"bytes\": %.0f",
+                r.name.c_str(), r.width, r.height, r.runs, r.medianNs,
+                r.minNs, r.meanNs, r.stddevNs, r.medianNs / pixels,
+                pixels / r.medianNs * 1e3, r.bytes);
+
+        // Missing counters are left out.
+        for (int c = 0; c < PerfCounters::CounterCount; c++)
+            if (r.counters[c] >= 0)
+                fprintf(out, ", \"%s\": %lld",
+                        PerfCounters::name((PerfCounters::Counter)c),
+                        (long long)r.counters[c]);
+        int64_t cycles = r.counters[PerfCounters::Cycles];
+        int64_t instructions = r.counters[PerfCounters::Instructions];
+        if (cycles > 0 && instructions >= 0)
+            fprintf(out, ", \"ipc\": %.3f", (double)instructions / cycles);
+        if (cycles > 0)
+            fprintf(out, ", \"bytesPerCycle\": %.3f", r.bytes / cycles);
+        fprintf(out, " }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int
+main( int argc, char *argv[] )
+{
+    Settings settings;
+    settings.warmup = 2;
+    settings.minRuns = 5;
+    settings.maxRuns = 50;
+    settings.minTime = 0.5;
+    settings.threshold = 0.1;
+    settings.counters = true;
+    string sizes = "1056x704,528x352,264x176";
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option.compare(0, 8, "--sizes=") == 0)
+            sizes = option.substr(8);
+        else if (option.compare(0, 8, "--image=") == 0)
+            settings.image = option.substr(8);
+        else if (option.compare(0, 9, "--filter=") == 0)
+            settings.filter = option.substr(9);
+        else if (option.compare(0, 9, "--warmup=") == 0)
+            settings.warmup = atoi(option.c_str() + 9);
+        else if (option.compare(0, 7, "--runs=") == 0)
+        {
+            if (sscanf(option.c_str() + 7, "%d,%d", &settings.minRuns,
+                       &settings.maxRuns) != 2 || settings.minRuns < 1 ||
+                settings.maxRuns < settings.minRuns)
+                print_usage();
+        }
+        else if (option.compare(0, 11, "--min-time=") == 0)
+            settings.minTime = atof(option.c_str() + 11);
+        else if (option.compare(0, 7, "--json=") == 0)
+            settings.jsonFile = option.substr(7);
+        else if (option.compare(0, 11, "--baseline=") == 0)
+            settings.baselineFile = option.substr(11);
+        else if (option.compare(0, 12, "--threshold=") == 0)
+            settings.threshold = atof(option.c_str() + 12);
+        else if (option == "--no-counters")
+            settings.counters = false;
+        else
+            print_usage();
+    }
+
+    size_t start = 0;
+    while (start < sizes.length())
+    {
+        size_t end = sizes.find(',', start);
+        if (end == string::npos)
+            end = sizes.length();
+        int w, h;
+        if (!ImageTools::parseSize(sizes.substr(start, end - start).c_str(),
+                                   w, h))
+            print_usage();
+        settings.widths.push_back(w);
+        settings.heights.push_back(h);
+        start = end + 1;
+    }
+
+    int sourceW = ImageTools::GrayWidth;
+    int sourceH = ImageTools::GrayHeight;
+    vector<uchar> source;
+    if (settings.image.empty())
+        source = synthetic_image(sourceW, sourceH);
+    else
+    {
+        // The first frame of a sweep file.
+        FrameReader reader;
+        ImageView view;
+        if (!reader.addFile(settings.image) || reader.frames() == 0 ||
+            !reader.frame(0, view))
+        {
+            cerr << (reader.error().empty() ? "No frames in " + settings.image :
+                     reader.error()) << endl;
+            exit(1);
+        }
+        sourceW = view.width;
+        sourceH = view.height;
+        source.assign(view.data, view.data + (size_t)sourceW * sourceH);
+    }
+
+    vector<Result> baseline;
+    if (!settings.baselineFile.empty())
+        baseline = read_baseline(settings.baselineFile);
+
+    // The table goes to stderr when the JSON goes to stdout.
+    FILE *table = settings.jsonFile == "-" ? stderr : stdout;
+    double overhead = timer_overhead();
+    fprintf(table, "%d threads, timer overhead %.0f ns\n",
+            ThreadPool::global().size(), overhead);
+
+    // Opened once the pool's threads run, to count them too.
+    PerfCounters perf;
+    PerfCounters *counters = settings.counters ? &perf : NULL;
+    if (counters != NULL && !perf.available())
+    {
+        fprintf(table, "Hardware counters unavailable: %s\n",
+                perf.error().c_str());
+        counters = NULL;
+    }
+
+    fprintf(table, "%-32s %10s %12s %10s %10s %7s %5s", "kernel", "size",
+            "median ms", "ns/pixel", "Mpixel/s", "cv %", "runs");
+    if (counters != NULL)
+        fprintf(table, " %6s %7s %9s %9s %9s", "IPC", "B/cycle", "L1m/kpx",
+                "LLCm/kpx", "brm/kpx");
+    fprintf(table, " %9s\n", baseline.empty() ? "" : "vs base");
+
+    vector<Result> results;
+    int regressions = 0;
+    for (size_t s = 0; s < settings.widths.size(); s++)
+    {
+        int w = settings.widths[s];
+        int h = settings.heights[s];
+
+        uchar *scaled = ImageTools::scaleCopy(&source[0], sourceW, sourceH,
+                                              w, h, ImageTools::AreaAverage);
+        vector<uchar> image(scaled, scaled + w * h);
+        if (scaled != &source[0])
+            delete [] scaled;
+
+        KernelSet set(image, w, h);
+        for (size_t k = 0; k < set.kernels.size(); k++)
+        {
+            const Kernel &kernel = set.kernels[k];
+            if (kernel.name.find(settings.filter) == string::npos)
+                continue;
+
+            Result r = time_kernel(kernel, w, h, settings, overhead,
+                                   counters);
+            results.push_back(r);
+
+            char size[32];
+            sprintf(size, "%dx%d", w, h);
+            double pixels = (double)w * h;
+            fprintf(table, "%-32s %10s %12.3f %10.3f %10.1f %7.2f %5d",
+                    r.name.c_str(), size, r.medianNs / 1e6,
+                    r.medianNs / pixels, pixels / r.medianNs * 1e3,
+                    r.meanNs > 0 ? 100 * r.stddevNs / r.meanNs : 0.0, r.runs);
+            if (counters != NULL)
+            {
+                // Misses are given per thousand pixels.
+                double cycles = r.counters[PerfCounters::Cycles];
+                fprintf(table, " %6s %7s %9s %9s %9s",
+                        format_ratio(r.counters[PerfCounters::Instructions], cycles,
+                              1, "%.2f").c_str(),
+                        format_ratio(cycles < 0 ? -1 : r.bytes, cycles, 1,
+                              "%.3f").c_str(),
+                        format_ratio(r.counters[PerfCounters::L1Misses], pixels,
+                              1000, "%.1f").c_str(),
+                        format_ratio(r.counters[PerfCounters::LLCMisses], pixels,
+                              1000, "%.1f").c_str(),
+                        format_ratio(r.counters[PerfCounters::BranchMisses], pixels,
+                              1000, "%.1f").c_str());
+            }
+
+            for (size_t b = 0; b < baseline.size(); b++)
+                if (baseline[b].name == r.name && baseline[b].width == w &&
+                    baseline[b].height == h && baseline[b].medianNs > 0)
+                {
+                    double change = r.medianNs / baseline[b].medianNs - 1;
+                    bool regression = change > settings.threshold;
+                    fprintf(table, " %+8.1f%%%s", 100 * change,
+                            regression ? " REGRESSION" : "");
+                    regressions += regression;
+                    break;
+                }
+            fprintf(table, "\n");
+            fflush(table);
+        }
+    }
+
+    if (settings.jsonFile == "-")
+        write_json(stdout, results, overhead);
+    else if (!settings.jsonFile.empty())
+    {
+        FILE *out = fopen(settings.jsonFile.c_str(), "w");
+        if (out == NULL)
+        {
+            cerr << "Could not create file: " << settings.jsonFile << endl;
+            exit(1);
+        }
+        write_json(out, results, overhead);
+        fclose(out);
+    }
+
+    if (regressions > 0)
+    {
+        fprintf(table, "%d kernels are more than %.0f%% slower than the "
+                "baseline\n", regressions, 100 * settings.threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef _BoundedQueue_H
+#define _BoundedQueue_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/*
+ * Queue shared between threads, holding at most capacity items. push blocks
+ * while the queue is full, which keeps producers from running too far ahead
+ * of consumers. Once closed, pop returns false as soon as the queue is empty.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+	BoundedQueue( size_t capacity ) : capacity( capacity ), closed( false ) {}
+
+	void push( T item )
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		notFull.wait( lock, [this] { return items.size() < capacity; } );
+		items.push_back( std::move( item ) );
+		notEmpty.notify_one();
+	}
+
+	bool pop( T &item )
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		notEmpty.wait( lock, [this] { return !items.empty() || closed; } );
+		if ( items.empty() )
+			return false;
+		item = std::move( items.front() );
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	/*
+	 * No more items will be pushed.
+	 */
+	void close()
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		closed = true;
+		notEmpty.notify_all();
+	}
+
+private:
+	size_t capacity;
+	bool closed;
+	std::deque<T> items;
+	std::mutex mutex;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+};
+
+#endif
@@ -29,11 +29,9 @@
 #include <stdlib.h>
 #include <vector>
 
+#include "frameReader.h"
 #include "imageTools.h"
 
-#define DEFAULT_WIDTH 1056
-#define DEFAULT_HEIGHT 704
-
 #define REPETITIONS 20
 #define INT_MULTIPLIER 1 << 5
 
@@ -53,10 +51,10 @@ struct RecursiveCoefficientsSet
     const static float A2[3];
     const static float B1[3];
     const static float B2[3];
-    const static float W1 =  0.6681;
-    const static float W2 =  2.0787;
-    const static float L1 = -1.3932;
-    const static float L2 = -1.3732;
+    constexpr static float W1 =  0.6681;
+    constexpr static float W2 =  2.0787;
+    constexpr static float L1 = -1.3932;
+    constexpr static float L2 = -1.3732;
 
     float N0, N1, N2, N3;
     float M1, M2, M3, M4;
@@ -276,13 +274,13 @@ toFloatVector(vector<int>& ints, int multiplier)
 template<typename T> void
 computeGradient(vector<uchar>& input, vector<T>& output,
                 vector<T>& gradientx, vector<T>& gradienty,
-                int filtersize)
+                int filtersize, int w, int h)
 {
     int pad = filtersize / 2;
 
-    for (int iy = pad; iy < DEFAULT_HEIGHT - pad; iy++)
+    for (int iy = pad; iy < h - pad; iy++)
     {
-        for (int ix = pad; ix < DEFAULT_WIDTH - pad; ix++)
+        for (int ix = pad; ix < w - pad; ix++)
         {
             T dx = 0;
             T dy = 0;
@@ -292,14 +290,14 @@ computeGradient(vector<uchar>& input, vector<T>& output,
                 for (int fx = -pad; fx <= pad; fx++)
                 {
                     int filterIndex = (fx + pad) + (fy + pad) * filtersize;
-                    dx += input[ix + fx + (iy + fy) * DEFAULT_WIDTH]
+                    dx += input[ix + fx + (iy + fy) * w]
                         * gradientx[filterIndex];
-                    dy += input[ix + fx + (iy + fy) * DEFAULT_WIDTH]
+                    dy += input[ix + fx + (iy + fy) * w]
                         * gradienty[filterIndex];
                 }
             }
 
-            output[ix + iy * DEFAULT_WIDTH] = dx * dx + dy * dy;
+            output[ix + iy * w] = dx * dx + dy * dy;
         }
     }
 }
@@ -316,59 +314,60 @@ template<typename T> void
 computeGradientSeparated(vector<uchar>& input, vector<T>& output,
                          vector<T>& gradient1d,
                          vector<T>& gaussian1d,
-                         int filtersize)
+                         int filtersize, int w, int h)
 {
     // Static keyword within a function means that the variable is created 
     // only at the first function call. For temporary calculations.
-    static vector<T> buffer(DEFAULT_WIDTH * DEFAULT_HEIGHT);
+    static vector<T> buffer;
+    buffer.resize(w * h);
 
     int pad = filtersize / 2;
 
     // Caculate x-derivative first.
-    for (int y = pad; y < DEFAULT_HEIGHT - pad; y++)
+    for (int y = pad; y < h - pad; y++)
     {
-        for (int x = 0; x < DEFAULT_WIDTH; x++)
+        for (int x = 0; x < w; x++)
         {
             T val = 0;
             for (int i = 0; i < filtersize; i++)
-                val += input[x + (y + i - pad) * DEFAULT_WIDTH] * 
+                val += input[x + (y + i - pad) * w] * 
                        gaussian1d[i];
-            buffer[x + y * DEFAULT_WIDTH] = val;
+            buffer[x + y * w] = val;
         }
     }
-    for (int y = pad; y < DEFAULT_HEIGHT - pad; y++)
+    for (int y = pad; y < h - pad; y++)
     {
-        for (int x = pad; x < DEFAULT_WIDTH - pad; x++)
+        for (int x = pad; x < w - pad; x++)
         {
             T val = 0;
             for (int i = 0; i < filtersize; i++)
-                val += buffer[(x + i - pad) + y * DEFAULT_WIDTH] * 
+                val += buffer[(x + i - pad) + y * w] * 
                        gradient1d[i];
-            output[x + y * DEFAULT_WIDTH] = val * val;
+            output[x + y * w] = val * val;
         }
     }
 
     // Caculate y-derivative second.
-    for (int y = 0; y < DEFAULT_HEIGHT; y++)
+    for (int y = 0; y < h; y++)
     {
-        for (int x = pad; x < DEFAULT_WIDTH - pad; x++)
+        for (int x = pad; x < w - pad; x++)
         {
             T val = 0;
             for (int i = 0; i < filtersize; i++)
-                val += input[(x + i - pad) + y * DEFAULT_WIDTH] * 
+                val += input[(x + i - pad) + y * w] * 
                        gaussian1d[i];
-            buffer[x + y * DEFAULT_WIDTH] = val;
+            buffer[x + y * w] = val;
         }
     }
-    for (int y = pad; y < DEFAULT_HEIGHT - pad; y++)
+    for (int y = pad; y < h - pad; y++)
     {
-        for (int x = pad; x < DEFAULT_WIDTH - pad; x++)
+        for (int x = pad; x < w - pad; x++)
         {
             T val = 0;
             for (int i = 0; i < filtersize; i++)
-                val += buffer[x + (y + i - pad) * DEFAULT_WIDTH] * 
+                val += buffer[x + (y + i - pad) * w] * 
                        gradient1d[i];
-            output[x + y * DEFAULT_WIDTH] += val * val;
+            output[x + y * w] += val * val;
         }
     }
 }
@@ -376,18 +375,16 @@ computeGradientSeparated(vector<uchar>& input, vector<T>& output,
 // Applies a recursive filter on a column x of the input.
 template<typename T> void
 computeRecursiveVertical(vector<T>& in, vector<float>& out,
-                         RecursiveCoefficientsSet& c, int x)
+                         RecursiveCoefficientsSet& c, int w, int h, int x)
 {
-    static vector<float> buf(DEFAULT_HEIGHT);
-
-    // Save some typing.
-    int h = DEFAULT_HEIGHT;
+    static vector<float> buf;
+    buf.resize(h);
 
     // Initialize borders.
-    float i0 = x + 0 * DEFAULT_WIDTH;
-    float i1 = x + 1 * DEFAULT_WIDTH;
-    float i2 = x + 2 * DEFAULT_WIDTH;
-    float i3 = x + 3 * DEFAULT_WIDTH; 
+    float i0 = x + 0 * w;
+    float i1 = x + 1 * w;
+    float i2 = x + 2 * w;
+    float i3 = x + 3 * w; 
     buf[0]  = c.N0  * in[i0] + c.N1  * in[i0] + c.N2  * in[i0] + c.N3  * in[i0]
             - c.BN1 * in[i0] + c.BN2 * in[i0] + c.BN3 * in[i0] + c.BN4 * in[i0];
     buf[1]  = c.N0 * in[i1] + c.N1  * in[i0] + c.N2  * in[i0] + c.N3  * in[i0]
@@ -399,26 +396,26 @@ computeRecursiveVertical(vector<T>& in, vector<float>& out,
     //buf[0] = buf[1] = buf[2] = buf[3] = 0;
 
     // Forward pass
-    for (int y = 4; y < DEFAULT_HEIGHT; y++)
+    for (int y = 4; y < h; y++)
     {
-        buf[y] =   c.N0 * in[x + y * DEFAULT_WIDTH]
-                 + c.N1 * in[x + (y - 1) * DEFAULT_WIDTH]
-                 + c.N2 * in[x + (y - 2) * DEFAULT_WIDTH]
-                 + c.N3 * in[x + (y - 3) * DEFAULT_WIDTH]
+        buf[y] =   c.N0 * in[x + y * w]
+                 + c.N1 * in[x + (y - 1) * w]
+                 + c.N2 * in[x + (y - 2) * w]
+                 + c.N3 * in[x + (y - 3) * w]
                  - c.D1 * buf[y - 1]
                  - c.D2 * buf[y - 2]
                  - c.D3 * buf[y - 3]
                  - c.D4 * buf[y - 4];
     }
 
-    for (int y = 0; y < DEFAULT_HEIGHT; y++)
-        out[x + y * DEFAULT_WIDTH] = buf[y];
+    for (int y = 0; y < h; y++)
+        out[x + y * w] = buf[y];
 
     // Initialize borders on the other side.
-    float i_n1 = x + (DEFAULT_HEIGHT - 1) * DEFAULT_WIDTH;
-    float i_n2 = x + (DEFAULT_HEIGHT - 2) * DEFAULT_WIDTH;
-    float i_n3 = x + (DEFAULT_HEIGHT - 3) * DEFAULT_WIDTH;
-    //float i_n4 = x + (DEFAULT_HEIGHT - 4) * DEFAULT_WIDTH; 
+    float i_n1 = x + (h - 1) * w;
+    float i_n2 = x + (h - 2) * w;
+    float i_n3 = x + (h - 3) * w;
+    //float i_n4 = x + (h - 4) * w; 
     buf[h - 1]  = c.M1  * in[i_n1] + c.M2  * in[i_n1] + c.M3  * in[i_n1] + c.M4  * in[i_n1]
                 - c.BM1 * in[i_n1] + c.BM2 * in[i_n1] + c.BM3 * in[i_n1] + c.BM4 * in[i_n1];
     buf[h - 2]  = c.M1 * in[i_n1]   + c.M2  * in[i_n1] + c.M3  * in[i_n1] + c.M4  * in[i_n1]
@@ -432,35 +429,33 @@ computeRecursiveVertical(vector<T>& in, vector<float>& out,
     // Backward pass.
     for (int y = h - 5; y >= 0; y--)
     {
-        buf[y] =   c.M1 * in[x + (y + 1) * DEFAULT_WIDTH]
-                 + c.M2 * in[x + (y + 2) * DEFAULT_WIDTH]
-                 + c.M3 * in[x + (y + 3) * DEFAULT_WIDTH]
-                 + c.M4 * in[x + (y + 4) * DEFAULT_WIDTH]
+        buf[y] =   c.M1 * in[x + (y + 1) * w]
+                 + c.M2 * in[x + (y + 2) * w]
+                 + c.M3 * in[x + (y + 3) * w]
+                 + c.M4 * in[x + (y + 4) * w]
                  - c.D1 * buf[y + 1]
                  - c.D2 * buf[y + 2]
                  - c.D3 * buf[y + 3]
                  - c.D4 * buf[y + 4];
     }
 
-    for (int y = 0; y < DEFAULT_HEIGHT; y++)
-        out[x + y * DEFAULT_WIDTH] += buf[y];
+    for (int y = 0; y < h; y++)
+        out[x + y * w] += buf[y];
 }
 
 // Applies a recursive filter on row y of the output.
 template<typename T> void
 computeRecursiveHorizontal(vector<T>& in, vector<float>& out,
-                           RecursiveCoefficientsSet& c, int y)
+                           RecursiveCoefficientsSet& c, int w, int h, int y)
 {
-    static vector<float> buf(DEFAULT_WIDTH);
-
-    // Save some typing.
-    int w = DEFAULT_WIDTH;
+    static vector<float> buf;
+    buf.resize(w);
 
     // Initialize borders.
-    float i0 = 0 + y * DEFAULT_WIDTH;
-    float i1 = 1 + y * DEFAULT_WIDTH;
-    float i2 = 2 + y * DEFAULT_WIDTH;
-    float i3 = 3 + y * DEFAULT_WIDTH; 
+    float i0 = 0 + y * w;
+    float i1 = 1 + y * w;
+    float i2 = 2 + y * w;
+    float i3 = 3 + y * w; 
     buf[0]  = c.N0  * in[i0] + c.N1  * in[i0] + c.N2  * in[i0] + c.N3  * in[i0]
             - c.BN1 * in[i0] + c.BN2 * in[i0] + c.BN3 * in[i0] + c.BN4 * in[i0];
     buf[1]  = c.N0 * in[i1] + c.N1  * in[i0] + c.N2  * in[i0] + c.N3  * in[i0]
@@ -472,26 +467,26 @@ computeRecursiveHorizontal(vector<T>& in, vector<float>& out,
     //buf[0] = buf[1] = buf[2] = buf[3] = 0;
 
     // Forward pass
-    for (int x = 4; x < DEFAULT_WIDTH; x++)
+    for (int x = 4; x < w; x++)
     {
-        buf[x] =   c.N0 * in[x + y * DEFAULT_WIDTH]
-                 + c.N1 * in[x - 1 + y * DEFAULT_WIDTH]
-                 + c.N2 * in[x - 2 + y * DEFAULT_WIDTH]
-                 + c.N3 * in[x - 3 + y * DEFAULT_WIDTH]
+        buf[x] =   c.N0 * in[x + y * w]
+                 + c.N1 * in[x - 1 + y * w]
+                 + c.N2 * in[x - 2 + y * w]
+                 + c.N3 * in[x - 3 + y * w]
                  - c.D1 * buf[x - 1]
                  - c.D2 * buf[x - 2]
                  - c.D3 * buf[x - 3]
                  - c.D4 * buf[x - 4];
     }
 
-    for (int x = 0; x < DEFAULT_WIDTH; x++)
-        out[x + y * DEFAULT_WIDTH] = buf[x];
+    for (int x = 0; x < w; x++)
+        out[x + y * w] = buf[x];
 
     // Initialize borders on the other side.
-    float i_n1 = DEFAULT_WIDTH - 1 + y * DEFAULT_WIDTH;
-    float i_n2 = DEFAULT_WIDTH - 2 + y * DEFAULT_WIDTH;
-    float i_n3 = DEFAULT_WIDTH - 3 + y * DEFAULT_WIDTH;
-    //float i_n4 = DEFAULT_WIDTH - 4 + y * DEFAULT_WIDTH; 
+    float i_n1 = w - 1 + y * w;
+    float i_n2 = w - 2 + y * w;
+    float i_n3 = w - 3 + y * w;
+    //float i_n4 = w - 4 + y * w; 
     buf[w - 1]  = c.M1  * in[i_n1] + c.M2  * in[i_n1] + c.M3  * in[i_n1] + c.M4  * in[i_n1]
                 - c.BM1 * in[i_n1] + c.BM2 * in[i_n1] + c.BM3 * in[i_n1] + c.BM4 * in[i_n1];
     buf[w - 2]  = c.M1 * in[i_n1]   + c.M2  * in[i_n1] + c.M3  * in[i_n1] + c.M4  * in[i_n1]
@@ -505,18 +500,18 @@ computeRecursiveHorizontal(vector<T>& in, vector<float>& out,
     // Backward pass.
     for (int x = w - 5; x >= 0; x--)
     {
-        buf[x] =   c.M1 * in[x + 1 + y * DEFAULT_WIDTH]
-                 + c.M2 * in[x + 2 + y * DEFAULT_WIDTH]
-                 + c.M3 * in[x + 3 + y * DEFAULT_WIDTH]
-                 + c.M4 * in[x + 4 + y * DEFAULT_WIDTH]
+        buf[x] =   c.M1 * in[x + 1 + y * w]
+                 + c.M2 * in[x + 2 + y * w]
+                 + c.M3 * in[x + 3 + y * w]
+                 + c.M4 * in[x + 4 + y * w]
                  - c.D1 * buf[x + 1]
                  - c.D2 * buf[x + 2]
                  - c.D3 * buf[x + 3]
                  - c.D4 * buf[x + 4];
     }
 
-    for (int x = 0; x < DEFAULT_HEIGHT; x++)
-        out[x + y * DEFAULT_WIDTH] += buf[x];
+    for (int x = 0; x < w; x++)
+        out[x + y * w] += buf[x];
 }
 
 // Calculates the first derivative of the gaussian in O(1) using
@@ -525,12 +520,14 @@ void
 computeGradientRecursive(vector<uchar>& in, vector<float>& out,
                          RecursiveCoefficientsSet& gaussSet,
                          RecursiveCoefficientsSet& derivSet,
-                         int filtersize)
+                         int filtersize, int w, int h)
 {
     // Static keyword within a function means that the variable is created 
     // only at the first function call. For temporary calculations.
-    static vector<float> buffer1(DEFAULT_WIDTH * DEFAULT_HEIGHT);
-    static vector<float> buffer2(DEFAULT_WIDTH * DEFAULT_HEIGHT);
+    static vector<float> buffer1;
+    static vector<float> buffer2;
+    buffer1.resize(w * h);
+    buffer2.resize(w * h);
 
     // Save some typing
     int pad = filtersize / 2;
@@ -538,34 +535,35 @@ computeGradientRecursive(vector<uchar>& in, vector<float>& out,
     // Caculate x-derivative first.
     // Vertical gaussian blur.
 
-    for (int x = 0; x < DEFAULT_WIDTH; x++)
-        computeRecursiveVertical(in, buffer1, gaussSet, x);
-    for (int y = 0; y < DEFAULT_HEIGHT; y++)
-        computeRecursiveHorizontal(buffer1, buffer2, derivSet, y);
+    for (int x = 0; x < w; x++)
+        computeRecursiveVertical(in, buffer1, gaussSet, w, h, x);
+    for (int y = 0; y < h; y++)
+        computeRecursiveHorizontal(buffer1, buffer2, derivSet, w, h, y);
 
-    for (int y = pad; y < DEFAULT_HEIGHT - pad; y++)
-        for (int x = pad; x < DEFAULT_WIDTH - pad; x++)
-            out[x + y * DEFAULT_WIDTH] =   buffer2[x + y * DEFAULT_WIDTH]
-                                         * buffer2[x + y * DEFAULT_WIDTH];
+    for (int y = pad; y < h - pad; y++)
+        for (int x = pad; x < w - pad; x++)
+            out[x + y * w] =   buffer2[x + y * w]
+                                         * buffer2[x + y * w];
 
     // Then calculate the y-derivative.
     // Vertical gaussian blur.
-    for (int y = 0; y < DEFAULT_HEIGHT; y++)
-        computeRecursiveHorizontal(in, buffer1, gaussSet, y);
-    for (int x = 0; x < DEFAULT_WIDTH; x++)
-        computeRecursiveVertical(buffer1, buffer2, derivSet, x);
-
-    for (int y = pad; y < DEFAULT_HEIGHT - pad; y++)
-        for (int x = pad; x < DEFAULT_WIDTH - pad; x++)
-            out[x + y * DEFAULT_WIDTH] +=   buffer2[x + y * DEFAULT_WIDTH]
-                                          * buffer2[x + y * DEFAULT_WIDTH];
+    for (int y = 0; y < h; y++)
+        computeRecursiveHorizontal(in, buffer1, gaussSet, w, h, y);
+    for (int x = 0; x < w; x++)
+        computeRecursiveVertical(buffer1, buffer2, derivSet, w, h, x);
+
+    for (int y = pad; y < h - pad; y++)
+        for (int x = pad; x < w - pad; x++)
+            out[x + y * w] +=   buffer2[x + y * w]
+                                          * buffer2[x + y * w];
 }
 
 // Computes the error between two sets of numbers pairwise, and prints
 // a five-number statistics of the errors.
 // i.e., (min, first quartile, median, third quartile, max)
 void
-analyzeError(vector<float>& base, vector<float>& diff, int filtersize)
+analyzeError(vector<float>& base, vector<float>& diff, int filtersize,
+             int w, int h)
 {
     assert(base.size() == diff.size());
 
@@ -579,11 +577,11 @@ analyzeError(vector<float>& base, vector<float>& diff, int filtersize)
 
     vector<float> errors;
 
-    for (int y = pad; y < DEFAULT_HEIGHT - pad; y++)
+    for (int y = pad; y < h - pad; y++)
     {
-        for (int x = pad; x < DEFAULT_WIDTH - pad; x++)
+        for (int x = pad; x < w - pad; x++)
         {
-            int i = x + y * DEFAULT_WIDTH;
+            int i = x + y * w;
 
             if (base[i] < smallNumThreshold && diff[i] < smallNumThreshold)
                 smallNumberPairsCount++;
@@ -621,11 +619,14 @@ main( int argc, char *argv[] )
     if( argc <= 2 )
     {
         cerr << "Usage: convolve [filtersize] "
-                "[sigma] [filename] ..." << endl;
+                "[sigma] [--size=WxH] [filename] ..." << endl;
         cerr << "\tfiltersize -- size of the filter" << endl;
         cerr << "\tsigma -- sigma parameter for gaussian" << endl;
-        cerr << "\tfilename -- image to use as benchmark (random image "
-                  "if none provided)" << endl;
+        cerr << "\tsize -- size of the random image or of the .gray file "
+                "(default 1056x704)" << endl;
+        cerr << "\tfilename -- image to use as benchmark, or the first frame "
+                "of a sweep file" << endl;
+        cerr << "\t    (random image if none provided)" << endl;
         exit( 6 );
     }
 
@@ -638,13 +639,47 @@ main( int argc, char *argv[] )
         exit( 6 );
     }
 
-    vector<uchar> image(DEFAULT_WIDTH * DEFAULT_HEIGHT);
+    int w = ImageTools::GrayWidth;
+    int h = ImageTools::GrayHeight;
+    int fileArg = 3;
+    if (argc > fileArg && string(argv[fileArg]).compare(0, 7, "--size=") == 0)
+    {
+        if (!ImageTools::parseSize(argv[fileArg] + 7, w, h))
+        {
+            cerr << "Invalid size: " << argv[fileArg] + 7 << endl;
+            exit( 6 );
+        }
+        fileArg++;
+    }
+
+    vector<uchar> image(w * h);
 
-    if (argc == 3)
-        getRandomImage(DEFAULT_WIDTH, DEFAULT_HEIGHT, &image[0]);
+    if (argc == fileArg)
+        getRandomImage(w, h, &image[0]);
     else
-        ImageTools::readGray( argv[3], 
-            DEFAULT_WIDTH * DEFAULT_HEIGHT, &image[0] );
+    {
+        // The first frame of a sweep file.
+        FrameReader reader;
+        reader.setGraySize(w, h);
+        ImageView view;
+        if (!reader.addFile(argv[fileArg]) || reader.frames() == 0 ||
+            !reader.frame(0, view))
+        {
+            cerr << (reader.error().empty() ?
+                     string("No frames in ") + argv[fileArg] :
+                     reader.error()) << endl;
+            exit( 6 );
+        }
+        w = view.width;
+        h = view.height;
+        image.assign(view.data, view.data + (size_t)w * h);
+    }
+
+    if (w <= filtersize || h <= filtersize)
+    {
+        cerr << "The image is smaller than the filter." << endl;
+        exit( 6 );
+    }
 
     // Filters
     vector<float> gradientx  = get2DGradientX(filtersize, sigma);
@@ -663,20 +698,20 @@ main( int argc, char *argv[] )
     // Do benchmarks.
     clock_t start;
     double duration;
-    vector<float> normalGradient(DEFAULT_WIDTH * DEFAULT_HEIGHT);
-    vector<float> separatedGradient(DEFAULT_WIDTH * DEFAULT_HEIGHT);
-    vector<float> recursiveGradient(DEFAULT_WIDTH * DEFAULT_HEIGHT);
-    vector<int> iNormalGradient(DEFAULT_WIDTH * DEFAULT_HEIGHT);
-    vector<int> iSeparatedGradient(DEFAULT_WIDTH * DEFAULT_HEIGHT);
-    vector<float> fNormalGradient(DEFAULT_WIDTH * DEFAULT_HEIGHT);
-    vector<float> fSeparatedGradient(DEFAULT_WIDTH * DEFAULT_HEIGHT);
+    vector<float> normalGradient(w * h);
+    vector<float> separatedGradient(w * h);
+    vector<float> recursiveGradient(w * h);
+    vector<int> iNormalGradient(w * h);
+    vector<int> iSeparatedGradient(w * h);
+    vector<float> fNormalGradient(w * h);
+    vector<float> fSeparatedGradient(w * h);
 
     // Benchmark naive gradient calculation.
     start = std::clock();
 
     for (int i = 0; i < REPETITIONS; i++)
         computeGradient(image, normalGradient, gradientx, gradienty,
-                        filtersize);
+                        filtersize, w, h);
     duration = ( std::clock() - start ) / (double) CLOCKS_PER_SEC;
 
     cout << "Naive calculations took " << duration << " s." << endl;
@@ -686,24 +721,24 @@ main( int argc, char *argv[] )
 
     for (int i = 0; i < REPETITIONS; i++)
         computeGradientSeparated(image, separatedGradient, 
-                                 gradient1d, gaussian1d, filtersize);
+                                 gradient1d, gaussian1d, filtersize, w, h);
     duration = ( std::clock() - start ) / (double) CLOCKS_PER_SEC;
 
     cout << "Separated calculations took " << duration << " s." << endl;
 
-    analyzeError(normalGradient, separatedGradient, filtersize);
+    analyzeError(normalGradient, separatedGradient, filtersize, w, h);
 
     // Benchmark recursive gradient calculation.
     start = std::clock();
 
     for (int i = 0; i < REPETITIONS; i++)
         computeGradientRecursive(image, recursiveGradient,
-                                 gaussSet, derivSet, filtersize);
+                                 gaussSet, derivSet, filtersize, w, h);
     duration = ( std::clock() - start ) / (double) CLOCKS_PER_SEC;
 
     cout << "Recursive calculations took " << duration << " s." << endl;
 
-    analyzeError(normalGradient, recursiveGradient, filtersize);
+    analyzeError(normalGradient, recursiveGradient, filtersize, w, h);
 
 
     // Benchmark integer naive gradient calculations.
@@ -711,26 +746,26 @@ main( int argc, char *argv[] )
 
     for (int i = 0; i < REPETITIONS; i++)
         computeGradient(image, iNormalGradient, iGradientx, iGradienty,
-                        filtersize);
+                        filtersize, w, h);
     duration = ( std::clock() - start ) / (double) CLOCKS_PER_SEC;
 
     cout << "Int naive calculations took " << duration << " s." << endl;
 
     fNormalGradient = toFloatVector(iNormalGradient,
         INT_MULTIPLIER * INT_MULTIPLIER);
-    //analyzeError(normalGradient, fNormalGradient, filtersize);
+    //analyzeError(normalGradient, fNormalGradient, filtersize, w, h);
 
     // Benchmark integer separated gradient calculations.
     start = std::clock();
 
     for (int i = 0; i < REPETITIONS; i++)
         computeGradientSeparated(image, iSeparatedGradient, 
-                                 iGradient1d, iGaussian1d, filtersize);
+                                 iGradient1d, iGaussian1d, filtersize, w, h);
     duration = ( std::clock() - start ) / (double) CLOCKS_PER_SEC;
 
     cout << "Int separated calculations took " << duration << " s." << endl;
 
     fSeparatedGradient = toFloatVector(iSeparatedGradient,
         INT_MULTIPLIER * INT_MULTIPLIER);
-    //analyzeError(normalGradient, fSeparatedGradient, filtersize);
+    //analyzeError(normalGradient, fSeparatedGradient, filtersize, w, h);
 }
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "curveQuality.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+
+#include "peakDetector.h"
+
+using namespace std;
+
+void
+CurveQuality::normalize( const double *curve, int n, vector<double> &normalized )
+{
+	normalized.assign( curve, curve + n );
+	if ( n == 0 )
+		return;
+
+	double low = *min_element( curve, curve + n );
+	double high = *max_element( curve, curve + n );
+	for (int i = 0; i < n; i++)
+		normalized[i] = high > low ? (curve[i] - low) / (high - low) : 0;
+}
+
+void
+CurveQuality::localMaxima( const vector<double> &fm, vector<int> &maxima )
+{
+	PeakDetector detector;
+	for (size_t i = 0; i < fm.size(); i++)
+		detector.add( fm[i] );
+	detector.finish();
+	maxima = detector.peaks();
+}
+
+bool
+CurveQuality::readMaxima( const string &fileName,
+						  map<string, vector<int> > &maxima )
+{
+	ifstream in( fileName.c_str() );
+	if ( !in )
+		return false;
+
+	string scene, positions;
+	while ( getline( in, scene ) && getline( in, positions ) )
+	{
+		istringstream values( positions );
+		vector<int> &sceneMaxima = maxima[scene];
+		int position;
+		while ( values >> position )
+			sceneMaxima.push_back( position );
+	}
+	return true;
+}
+
+// Distance from a position to the nearest of some positions.
+static int
+distanceTo( int position, const vector<int> &positions )
+{
+	int nearest = -1;
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		int distance = abs( positions[i] - position );
+		if ( nearest < 0 || distance < nearest )
+			nearest = distance;
+	}
+	return nearest;
+}
+
+CurveScore
+CurveQuality::score( const double *curve, int n, const vector<int> &trueMaxima,
+					 int tolerance )
+{
+	CurveScore score = { 0, 0, 0, 0, 0, 0, 0 };
+	if ( n == 0 )
+		return score;
+
+	vector<double> normalized;
+	normalize( curve, n, normalized );
+	score.peak = max_element( curve, curve + n ) - curve;
+	score.peakError = trueMaxima.empty() ? 0 :
+		distanceTo( score.peak, trueMaxima );
+
+	vector<int> detected;
+	localMaxima( normalized, detected );
+	score.detected = detected.size();
+	for (size_t i = 0; i < detected.size(); i++)
+		if ( !trueMaxima.empty() &&
+			 distanceTo( detected[i], trueMaxima ) > tolerance )
+			score.spurious++;
+	for (size_t i = 0; i < trueMaxima.size(); i++)
+		if ( distanceTo( trueMaxima[i], detected ) > tolerance )
+			score.missed++;
+
+	// A step from i to i + 1 should go up when the nearest true maximum is
+	// ahead, and down when it is behind. Flat steps count for half.
+	double good = 0;
+	int steps = 0;
+	for (int i = 0; i + 1 < n && !trueMaxima.empty(); i++)
+	{
+		int target = trueMaxima[0];
+		for (size_t m = 1; m < trueMaxima.size(); m++)
+			if ( abs( 2 * trueMaxima[m] - (2 * i + 1) ) <
+				 abs( 2 * target - (2 * i + 1) ) )
+				target = trueMaxima[m];
+
+		double change = curve[i + 1] - curve[i];
+		if ( change == 0 )
+			good += 0.5;
+		else if ( (change > 0) == (i + 1 <= target) )
+			good += 1;
+		steps++;
+	}
+	score.monotonicity = steps > 0 ? good / steps : 1;
+
+	for (int i = 0; i < n; i++)
+		if ( normalized[i] >= 0.5 )
+			score.width++;
+	return score;
+}
@@ -0,0 +1,60 @@
+#ifndef _CurveQuality_H
+#define _CurveQuality_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * How well a focus curve (the focus value at each lens position of a sweep)
+ * lends itself to autofocus, compared with the known in-focus positions
+ * of the scene.
+ */
+struct CurveScore
+{
+	int peak;				// position of the highest value
+	int peakError;			// distance from peak to the nearest true maximum
+	int detected;			// local maxima found in the curve
+	int spurious;			// ... that are not near a true maximum
+	int missed;				// true maxima with no local maximum near them
+	double monotonicity;	// fraction of steps going towards the nearest
+							// true maximum
+	int width;				// positions at half the height of the peak or
+							// above (fewer is a sharper peak)
+};
+
+class CurveQuality
+{
+public:
+	/*
+	 * Scale a curve of n values to [0, 1].
+	 */
+	static void normalize( const double *curve, int n,
+						   std::vector<double> &normalized );
+
+	/*
+	 * Local maxima of a curve normalized to [0, 1], found by a
+	 * PeakDetector as afheuristics/localMax.cpp finds them (which produced
+	 * maxima.txt).
+	 */
+	static void localMaxima( const std::vector<double> &normalized,
+							 std::vector<int> &maxima );
+
+	/*
+	 * Read the maxima of every scene from a file written by findmax.sh :
+	 * a line with the name of the scene's file (e.g. "cat.txt") followed by
+	 * a line with its maxima. Returns false if the file can't be read.
+	 */
+	static bool readMaxima( const std::string &fileName,
+							std::map<std::string, std::vector<int> > &maxima );
+
+	/*
+	 * Score a curve of n raw values against the true maxima of its scene.
+	 * A local maximum within tolerance steps of a true maximum matches it.
+	 */
+	static CurveScore score( const double *curve, int n,
+							 const std::vector<int> &trueMaxima,
+							 int tolerance = 2 );
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include "curveStore.h"
+#include "curveQuality.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char CURVE_MAGIC[8] = "FCURVE1";
+static const uint32_t CURVE_VERSION = 1;
+
+// Sections start on this many bytes, for the values to be read in place.
+static const uint64_t CURVE_ALIGNMENT = 8;
+
+static uint64_t
+align( uint64_t offset )
+{
+	return (offset + CURVE_ALIGNMENT - 1) / CURVE_ALIGNMENT * CURVE_ALIGNMENT;
+}
+
+CurveStoreWriter::CurveStoreWriter()
+	: fp( NULL )
+{
+}
+
+CurveStoreWriter::~CurveStoreWriter()
+{
+	if ( fp != NULL )
+		close();
+}
+
+bool
+CurveStoreWriter::fail( const string &message )
+{
+	lastError = message + ": " + fileName;
+	return false;
+}
+
+bool
+CurveStoreWriter::open( const string &name )
+{
+	fileName = name;
+	fp = fopen( fileName.c_str(), "wb" );
+	if ( fp == NULL )
+		return fail( "Could not create file" );
+
+	entries.clear();
+	raw.clear();
+	normalized.clear();
+	maxima.clear();
+	names.clear();
+	return true;
+}
+
+bool
+CurveStoreWriter::addCurve( const string &name, int measure,
+							const double *values, int count,
+							const vector<int> &curveMaxima )
+{
+	for (size_t i = 0; i < entries.size(); i++)
+		if ( entries[i].measure == measure &&
+			 strcmp( names.c_str() + entries[i].nameOffset,
+					 name.c_str() ) == 0 )
+		{
+			lastError = "Two curves of " + name + " for the same measure";
+			return false;
+		}
+
+	CurveEntry entry;
+	memset( &entry, 0, sizeof( entry ) );
+	entry.nameOffset = names.size();
+	entry.measure = measure;
+	entry.firstValue = raw.size();
+	entry.valueCount = count;
+	entry.firstMaximum = maxima.size();
+	entry.maximaCount = curveMaxima.size();
+	entries.push_back( entry );
+
+	names.append( name.c_str(), name.size() + 1 );
+	raw.insert( raw.end(), values, values + count );
+	vector<double> scaled;
+	CurveQuality::normalize( values, count, scaled );
+	normalized.insert( normalized.end(), scaled.begin(), scaled.end() );
+	maxima.insert( maxima.end(), curveMaxima.begin(), curveMaxima.end() );
+	return true;
+}
+
+// Write a section at the next aligned offset, which is returned.
+static bool
+writeSection( FILE *fp, const void *data, size_t bytes, uint64_t &offset )
+{
+	offset = align( ftell( fp ) );
+	if ( fseek( fp, offset, SEEK_SET ) != 0 )
+		return false;
+	return bytes == 0 || fwrite( data, 1, bytes, fp ) == bytes;
+}
+
+bool
+CurveStoreWriter::close()
+{
+	CurveStoreHeader header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, CURVE_MAGIC, sizeof( header.magic ) );
+	header.version = CURVE_VERSION;
+	header.curveCount = entries.size();
+	header.valueCount = raw.size();
+	header.maximaCount = maxima.size();
+	header.namesSize = names.size();
+
+	bool ok = fwrite( &header, sizeof( header ), 1, fp ) == 1 &&
+		writeSection( fp, entries.data(), entries.size() * sizeof( CurveEntry ),
+					  header.curvesOffset ) &&
+		writeSection( fp, raw.data(), raw.size() * sizeof( double ),
+					  header.rawOffset ) &&
+		writeSection( fp, normalized.data(), normalized.size() * sizeof( double ),
+					  header.normalizedOffset ) &&
+		writeSection( fp, maxima.data(), maxima.size() * sizeof( int32_t ),
+					  header.maximaOffset ) &&
+		writeSection( fp, names.data(), names.size(), header.namesOffset );
+
+	// The header again, with the offsets.
+	if ( ok && ( fseek( fp, 0, SEEK_SET ) != 0 ||
+				 fwrite( &header, sizeof( header ), 1, fp ) != 1 ) )
+		ok = false;
+	if ( !ok )
+		fail( "Could not write file" );
+
+	if ( fclose( fp ) != 0 && ok )
+		ok = fail( "Could not write file" );
+	fp = NULL;
+	return ok;
+}
+
+CurveStoreReader::CurveStoreReader()
+	: data( NULL ), size( 0 ), header( NULL ), index( NULL ),
+	  rawValues( NULL ), normalizedValues( NULL ), maximaValues( NULL ),
+	  names( NULL )
+{
+}
+
+CurveStoreReader::~CurveStoreReader()
+{
+	close();
+}
+
+bool
+CurveStoreReader::fail( const string &message )
+{
+	lastError = message + ": " + fileName;
+	close();
+	return false;
+}
+
+bool
+CurveStoreReader::isCurveStore( const string &fileName )
+{
+	FILE *fp = fopen( fileName.c_str(), "rb" );
+	if ( fp == NULL )
+		return false;
+
+	char magic[8];
+	bool isStore = fread( magic, 1, sizeof( magic ), fp ) == sizeof( magic ) &&
+		memcmp( magic, CURVE_MAGIC, sizeof( magic ) ) == 0;
+	fclose( fp );
+	return isStore;
+}
+
+// Whether count items of itemSize bytes at offset are inside the file.
+static bool
+inside( uint64_t offset, uint64_t count, uint64_t itemSize, size_t size )
+{
+	return offset % CURVE_ALIGNMENT == 0 && offset <= size &&
+		count <= (size - offset) / itemSize;
+}
+
+bool
+CurveStoreReader::open( const string &name )
+{
+	close();
+	fileName = name;
+
+	int fd = ::open( fileName.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return fail( "No such file" );
+
+	struct stat info;
+	if ( fstat( fd, &info ) != 0 ||
+		 info.st_size < (off_t)sizeof( CurveStoreHeader ) )
+	{
+		::close( fd );
+		return fail( "Not a curve store" );
+	}
+
+	size = info.st_size;
+	void *mapping = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	::close( fd );
+	if ( mapping == MAP_FAILED )
+	{
+		data = NULL;
+		return fail( string( "Could not map file (" ) + strerror( errno ) + ")" );
+	}
+	data = (char *)mapping;
+
+	header = (const CurveStoreHeader *)data;
+	if ( memcmp( header->magic, CURVE_MAGIC, sizeof( header->magic ) ) != 0 )
+		return fail( "Not a curve store" );
+	if ( header->version != CURVE_VERSION )
+		return fail( "Unsupported curve store version" );
+	if ( !inside( header->curvesOffset, header->curveCount,
+				  sizeof( CurveEntry ), size ) ||
+		 !inside( header->rawOffset, header->valueCount, sizeof( double ),
+				  size ) ||
+		 !inside( header->normalizedOffset, header->valueCount,
+				  sizeof( double ), size ) ||
+		 !inside( header->maximaOffset, header->maximaCount,
+				  sizeof( int32_t ), size ) ||
+		 !inside( header->namesOffset, header->namesSize, 1, size ) )
+		return fail( "Truncated curve store" );
+
+	index = (const CurveEntry *)(data + header->curvesOffset);
+	rawValues = (const double *)(data + header->rawOffset);
+	normalizedValues = (const double *)(data + header->normalizedOffset);
+	maximaValues = (const int32_t *)(data + header->maximaOffset);
+	names = data + header->namesOffset;
+
+	if ( header->namesSize > 0 && names[header->namesSize - 1] != '\0' )
+		return fail( "Corrupted curve store" );
+	for (uint32_t i = 0; i < header->curveCount; i++)
+		if ( index[i].nameOffset >= header->namesSize ||
+			 index[i].firstValue > header->valueCount ||
+			 header->valueCount - index[i].firstValue < index[i].valueCount ||
+			 index[i].firstMaximum > header->maximaCount ||
+			 header->maximaCount - index[i].firstMaximum <
+			 index[i].maximaCount )
+			return fail( "Corrupted curve store" );
+
+	// Whole datasets are read at once.
+	madvise( data, size, MADV_WILLNEED );
+	return true;
+}
+
+void
+CurveStoreReader::close()
+{
+	if ( data != NULL )
+		munmap( data, size );
+	data = NULL;
+	size = 0;
+	header = NULL;
+	index = NULL;
+	rawValues = NULL;
+	normalizedValues = NULL;
+	maximaValues = NULL;
+	names = NULL;
+}
+
+int
+CurveStoreReader::find( const string &name, int measure ) const
+{
+	for (int i = 0; i < curves(); i++)
+		if ( (measure < 0 || index[i].measure == measure) &&
+			 name == this->name( i ) )
+			return i;
+	return -1;
+}
@@ -0,0 +1,149 @@
+#ifndef _CurveStore_H
+#define _CurveStore_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*
+ * Focus curves stored in a single file, in columns : every curve of a
+ * dataset (the focus value at each lens position of a scene, for one
+ * measure), raw and normalized to [0, 1], with the maxima of its scene.
+ * It replaces a folder of text tables (e.g. afheuristics/focusraw/ and
+ * focusmeasures/) and maxima.txt, and is read with a single mapping.
+ *
+ * Layout :
+ *   CurveStoreHeader
+ *   CurveEntry[curveCount]             (at header.curvesOffset)
+ *   double raw[valueCount]             (at header.rawOffset)
+ *   double normalized[valueCount]      (at header.normalizedOffset)
+ *   int32_t maxima[maximaCount]        (at header.maximaOffset)
+ *   char names[namesSize]              (at header.namesOffset)
+ *
+ * The values of a curve follow each other in both value columns, and the
+ * curves follow each other in the order they were added. Every section
+ * starts on 8 bytes. Names are NUL terminated.
+ */
+
+struct CurveStoreHeader
+{
+	char magic[8];			// "FCURVE1"
+	uint32_t version;
+	uint32_t curveCount;
+	uint64_t valueCount;	// in each value column
+	uint64_t maximaCount;
+	uint64_t namesSize;		// bytes
+	uint64_t curvesOffset;
+	uint64_t rawOffset;
+	uint64_t normalizedOffset;
+	uint64_t maximaOffset;
+	uint64_t namesOffset;
+};
+
+struct CurveEntry
+{
+	uint32_t nameOffset;	// in the names
+	int32_t measure;		// FocusMeasure id, -1 if unknown
+	uint64_t firstValue;	// in the value columns
+	uint32_t valueCount;
+	uint32_t firstMaximum;	// in the maxima
+	uint32_t maximaCount;
+	uint32_t reserved;
+};
+
+class CurveStoreWriter
+{
+public:
+	CurveStoreWriter();
+	~CurveStoreWriter();
+
+	bool open( const std::string &fileName );
+
+	/*
+	 * Add the curve of a scene (e.g. "bench") for a measure (-1 if
+	 * unknown) : its count raw values, normalized as
+	 * CurveQuality::normalize does, and the lens positions of its maxima.
+	 * There can only be one curve of a scene for a measure.
+	 */
+	bool addCurve( const std::string &name, int measure, const double *raw,
+				   int count, const std::vector<int> &maxima );
+
+	/*
+	 * Write the store. Curves are kept in memory until then.
+	 */
+	bool close();
+
+	const std::string & error() const { return lastError; }
+
+private:
+	bool fail( const std::string &message );
+
+	FILE *fp;
+	std::string fileName;
+	std::vector<CurveEntry> entries;
+	std::vector<double> raw;
+	std::vector<double> normalized;
+	std::vector<int32_t> maxima;
+	std::string names;
+	std::string lastError;
+};
+
+class CurveStoreReader
+{
+public:
+	CurveStoreReader();
+	~CurveStoreReader();
+
+	/*
+	 * Map a store. Returns false if it can't be read or is not a valid
+	 * store.
+	 */
+	bool open( const std::string &fileName );
+	void close();
+
+	int curves() const { return header->curveCount; }
+	const char *name( int i ) const { return names + index[i].nameOffset; }
+	int measure( int i ) const { return index[i].measure; }
+	int length( int i ) const { return index[i].valueCount; }
+
+	/*
+	 * The values of curve i, in the mapped file.
+	 */
+	const double *raw( int i ) const { return rawValues + index[i].firstValue; }
+	const double *normalized( int i ) const
+		{ return normalizedValues + index[i].firstValue; }
+
+	int maximaCount( int i ) const { return index[i].maximaCount; }
+	const int32_t *maxima( int i ) const
+		{ return maximaValues + index[i].firstMaximum; }
+
+	/*
+	 * The curve of a scene for a measure (any measure if -1), or -1 if
+	 * there is none.
+	 */
+	int find( const std::string &name, int measure = -1 ) const;
+
+	const std::string & error() const { return lastError; }
+
+	/*
+	 * Whether a file starts like a curve store.
+	 */
+	static bool isCurveStore( const std::string &fileName );
+
+private:
+	bool fail( const std::string &message );
+
+	std::string fileName;
+	char *data;
+	size_t size;
+	const CurveStoreHeader *header;
+	const CurveEntry *index;
+	const double *rawValues;
+	const double *normalizedValues;
+	const int32_t *maximaValues;
+	const char *names;
+	std::string lastError;
+};
+
+#endif
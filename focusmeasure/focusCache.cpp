@@ -0,0 +1,387 @@
+#include "focusCache.h"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// A value in a cache file. check holds part of the key, to tell a file
+// that doesn't belong to its key (or garbage) from values.
+struct CacheRecord
+{
+	uint32_t measure;
+	uint32_t check;
+	double value;
+};
+
+static const uint64_t MB = 1024 * 1024;
+
+FocusCache::FocusCache()
+	: hits( 0 ), misses( 0 ), stores( 0 ), evictions( 0 )
+{
+}
+
+bool
+FocusCache::fail( const string &message, const string &fileName )
+{
+	lastError = message + ": " + fileName;
+	return false;
+}
+
+bool
+FocusCache::open( const string &directory )
+{
+	dir = directory;
+	while ( dir.length() > 1 && dir[dir.length() - 1] == '/' )
+		dir.erase( dir.length() - 1 );
+
+	// Create every missing folder of the path.
+	for (size_t slash = dir.find( '/', 1 ); ; slash = dir.find( '/', slash + 1 ))
+	{
+		string path = dir.substr( 0, slash );
+		if ( mkdir( path.c_str(), 0755 ) != 0 && errno != EEXIST )
+		{
+			string failed = dir;
+			dir.clear();
+			return fail( string( "Could not create folder (" ) +
+						 strerror( errno ) + ")", failed );
+		}
+		if ( slash == string::npos )
+			break;
+	}
+
+	hits = misses = stores = evictions = 0;
+	return true;
+}
+
+string
+FocusCache::defaultDirectory()
+{
+	const char *cache = getenv( "FOCUS_CACHE" );
+	if ( cache != NULL && *cache != 0 )
+		return strcmp( cache, "off" ) == 0 ? "" : cache;
+
+	const char *home = getenv( "HOME" );
+	if ( home == NULL || *home == 0 )
+		return "";
+	return string( home ) + "/.cache/focusmeasure";
+}
+
+uint64_t
+FocusCache::defaultSizeLimit()
+{
+	const char *size = getenv( "FOCUS_CACHE_SIZE" );
+	if ( size != NULL && atoll( size ) > 0 )
+		return atoll( size ) * MB;
+	return 1024 * MB;
+}
+
+static inline uint64_t
+rotate( uint64_t x, int bits )
+{
+	return (x << bits) | (x >> (64 - bits));
+}
+
+// Final mix of a lane (from MurmurHash3).
+static inline uint64_t
+finish( uint64_t h )
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+// Two independent 64-bit lanes over the data, eight bytes at a time.
+static void
+hashBytes( const uchar *data, size_t size, uint64_t hash[2] )
+{
+	const uint64_t P1 = 0x9e3779b185ebca87ULL;
+	const uint64_t P2 = 0xc2b2ae3d27d4eb4fULL;
+	const uint64_t P3 = 0x165667b19e3779f9ULL;
+
+	uint64_t a = hash[0];
+	uint64_t b = hash[1];
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy( &word, data + i, 8 );
+		a = rotate( a ^ (word * P1), 31 ) * P2;
+		b = rotate( b + (word * P3), 29 ) * P1;
+	}
+	uint64_t tail = 0;
+	memcpy( &tail, data + i, size - i );
+	a = rotate( a ^ (tail * P1), 31 ) * P2;
+	b = rotate( b + (tail * P3), 29 ) * P1;
+
+	hash[0] = finish( a ^ size );
+	hash[1] = finish( b + a );
+}
+
+FocusCache::Key
+FocusCache::frameKey( const uchar *pixels, int w, int h, const string &options )
+{
+	char header[64];
+	int length = snprintf( header, sizeof( header ), "%d %dx%d ", CodeVersion,
+						   w, h );
+
+	Key key;
+	key.hash[0] = 0x243f6a8885a308d3ULL;
+	key.hash[1] = 0x13198a2e03707344ULL;
+	hashBytes( (const uchar *)header, length, key.hash );
+	hashBytes( (const uchar *)options.data(), options.length(), key.hash );
+	hashBytes( pixels, (size_t)w * h, key.hash );
+	return key;
+}
+
+string
+FocusCache::fileName( const Key &key ) const
+{
+	char name[40];
+	snprintf( name, sizeof( name ), "%016llx%016llx",
+			  (unsigned long long)key.hash[0],
+			  (unsigned long long)key.hash[1] );
+	return dir + "/" + string( name, 2 ) + "/" + name;
+}
+
+int
+FocusCache::lookup( const Key &key, const vector<int> &measures,
+					vector<double> &values, vector<bool> &found )
+{
+	values.assign( measures.size(), 0 );
+	found.assign( measures.size(), false );
+	int count = 0;
+
+	int fd = isOpen() ? ::open( fileName( key ).c_str(), O_RDONLY ) : -1;
+	if ( fd >= 0 )
+	{
+		vector<CacheRecord> records;
+		struct stat info;
+		if ( fstat( fd, &info ) == 0 )
+		{
+			// A record cut short by a crash is ignored.
+			records.resize( info.st_size / sizeof( CacheRecord ) );
+			ssize_t size = records.size() * sizeof( CacheRecord );
+			if ( size > 0 && read( fd, &records[0], size ) != size )
+				records.clear();
+		}
+
+		for (size_t r = 0; r < records.size(); r++)
+		{
+			if ( records[r].check != (uint32_t)key.hash[1] )
+				break;
+			for (size_t m = 0; m < measures.size(); m++)
+				if ( records[r].measure == (uint32_t)measures[m] )
+				{
+					count += !found[m];
+					values[m] = records[r].value;
+					found[m] = true;
+				}
+		}
+
+		// Mark the file as recently used.
+		if ( count > 0 )
+			futimens( fd, NULL );
+		close( fd );
+	}
+
+	hits += count;
+	misses += measures.size() - count;
+	return count;
+}
+
+bool
+FocusCache::store( const Key &key, const vector<pair<int, double> > &values )
+{
+	if ( !isOpen() || values.empty() )
+		return false;
+
+	vector<CacheRecord> records( values.size() );
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		memset( &records[i], 0, sizeof( CacheRecord ) );
+		records[i].measure = values[i].first;
+		records[i].check = (uint32_t)key.hash[1];
+		records[i].value = values[i].second;
+	}
+
+	string name = fileName( key );
+	int fd = ::open( name.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644 );
+	if ( fd < 0 && errno == ENOENT )
+	{
+		mkdir( name.substr( 0, name.rfind( '/' ) ).c_str(), 0755 );
+		fd = ::open( name.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644 );
+	}
+	if ( fd < 0 )
+		return false;
+
+	ssize_t size = records.size() * sizeof( CacheRecord );
+	bool written = write( fd, &records[0], size ) == size;
+	close( fd );
+	if ( written )
+		stores += values.size();
+	return written;
+}
+
+// Every value file with its last use, and the total size.
+void
+FocusCache::listFiles( vector<pair<int64_t, string> > &files, uint64_t &bytes )
+{
+	files.clear();
+	bytes = 0;
+	for (int i = 0; i < 256; i++)
+	{
+		char sub[4];
+		snprintf( sub, sizeof( sub ), "%02x", i );
+		string folder = dir + "/" + sub;
+		DIR *d = opendir( folder.c_str() );
+		if ( d == NULL )
+			continue;
+
+		struct dirent *entry;
+		while ( (entry = readdir( d )) != NULL )
+		{
+			if ( entry->d_name[0] == '.' )
+				continue;
+			string name = folder + "/" + entry->d_name;
+			struct stat info;
+			if ( stat( name.c_str(), &info ) != 0 || !S_ISREG( info.st_mode ) )
+				continue;
+			files.push_back( make_pair( (int64_t)info.st_mtime, name ) );
+			bytes += info.st_size;
+		}
+		closedir( d );
+	}
+}
+
+uint64_t
+FocusCache::evict( uint64_t maxBytes )
+{
+	if ( !isOpen() )
+		return 0;
+
+	vector<pair<int64_t, string> > files;
+	uint64_t bytes;
+	listFiles( files, bytes );
+	if ( bytes <= maxBytes )
+		return 0;
+
+	// Go down to 90% of the limit, so that the next runs don't have to
+	// evict again straight away.
+	sort( files.begin(), files.end() );
+	uint64_t removed = 0;
+	for (size_t i = 0; i < files.size() && bytes > maxBytes / 10 * 9; i++)
+	{
+		struct stat info;
+		if ( stat( files[i].second.c_str(), &info ) == 0 &&
+			 unlink( files[i].second.c_str() ) == 0 )
+		{
+			bytes -= std::min( bytes, (uint64_t)info.st_size );
+			removed++;
+		}
+	}
+	evictions += removed;
+	return removed;
+}
+
+bool
+FocusCache::clear()
+{
+	if ( !isOpen() )
+		return false;
+
+	vector<pair<int64_t, string> > files;
+	uint64_t bytes;
+	listFiles( files, bytes );
+	for (size_t i = 0; i < files.size(); i++)
+		if ( unlink( files[i].second.c_str() ) != 0 )
+			return fail( "Could not remove file", files[i].second );
+	return true;
+}
+
+FocusCache::Stats
+FocusCache::runStats() const
+{
+	Stats run = { hits, misses, stores, evictions, 0, 0 };
+	return run;
+}
+
+// Read the counts saved in the stats file (all zero if there's none).
+static void
+readCounts( FILE *fp, FocusCache::Stats &stats )
+{
+	unsigned long long hits = 0, misses = 0, stores = 0, evictions = 0;
+	rewind( fp );
+	if ( fscanf( fp, "hits %llu misses %llu stores %llu evictions %llu",
+				 &hits, &misses, &stores, &evictions ) != 4 )
+		hits = misses = stores = evictions = 0;
+	stats.hits = hits;
+	stats.misses = misses;
+	stats.stores = stores;
+	stats.evictions = evictions;
+}
+
+bool
+FocusCache::saveStats()
+{
+	if ( !isOpen() )
+		return false;
+
+	string name = dir + "/stats";
+	int fd = ::open( name.c_str(), O_RDWR | O_CREAT, 0644 );
+	if ( fd < 0 )
+		return fail( "Could not create file", name );
+	FILE *fp = fdopen( fd, "r+" );
+	flock( fd, LOCK_EX );
+
+	// Counts of lookups and stores running meanwhile go to the next save.
+	Stats total;
+	readCounts( fp, total );
+	Stats run = { hits.exchange( 0 ), misses.exchange( 0 ),
+				  stores.exchange( 0 ), evictions.exchange( 0 ), 0, 0 };
+
+	rewind( fp );
+	fprintf( fp, "hits %llu\nmisses %llu\nstores %llu\nevictions %llu\n",
+			 (unsigned long long)(total.hits + run.hits),
+			 (unsigned long long)(total.misses + run.misses),
+			 (unsigned long long)(total.stores + run.stores),
+			 (unsigned long long)(total.evictions + run.evictions) );
+	bool ok = fflush( fp ) == 0 && ftruncate( fd, ftell( fp ) ) == 0;
+
+	flock( fd, LOCK_UN );
+	fclose( fp );
+	return ok || fail( "Could not write file", name );
+}
+
+bool
+FocusCache::stats( Stats &total )
+{
+	memset( &total, 0, sizeof( total ) );
+	if ( !isOpen() )
+		return false;
+
+	string name = dir + "/stats";
+	FILE *fp = fopen( name.c_str(), "r" );
+	if ( fp != NULL )
+	{
+		flock( fileno( fp ), LOCK_SH );
+		readCounts( fp, total );
+		flock( fileno( fp ), LOCK_UN );
+		fclose( fp );
+	}
+
+	vector<pair<int64_t, string> > files;
+	listFiles( files, total.bytes );
+	total.files = files.size();
+	return true;
+}
@@ -0,0 +1,138 @@
+#ifndef _FocusCache_H
+#define _FocusCache_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "imageTools.h"
+
+/*
+ * On-disk cache of focus values, so that measuring the same frames again
+ * with the same options only costs reading and hashing them.
+ *
+ * Values are addressed by the key of a frame : a 128-bit hash of its
+ * pixels and size, of the preprocessing options applied before measuring,
+ * and of CodeVersion. Each key has its own file, <dir>/<xx>/<key>, made of
+ * fixed-size (measure, value) records. Records are only ever appended, with
+ * one write per frame, so several processes can share a cache.
+ *
+ * Files are touched when they are read, and eviction removes the least
+ * recently used ones until the cache fits in its size limit.
+ *
+ * Errors are reported by returning false; error() then describes the
+ * problem. A cache that can't be read or written just misses.
+ */
+class FocusCache
+{
+public:
+	/*
+	 * Bump whenever a change to a focus measure or to the preprocessing
+	 * changes the values, so that older values are not used anymore.
+	 */
+	static const int CodeVersion = 1;
+
+	struct Key
+	{
+		uint64_t hash[2];
+	};
+
+	struct Stats
+	{
+		uint64_t hits;			// (frame, measure) values found
+		uint64_t misses;		// values that had to be computed
+		uint64_t stores;		// values added
+		uint64_t evictions;		// files removed
+		uint64_t files;			// files in the cache
+		uint64_t bytes;			// size of those files
+	};
+
+	FocusCache();
+
+	/*
+	 * Use the cache in a directory, creating it if needed.
+	 */
+	bool open( const std::string &directory );
+	bool isOpen() const { return !dir.empty(); }
+	const std::string & directory() const { return dir; }
+
+	/*
+	 * The cache directory given by the environment : $FOCUS_CACHE, or
+	 * $HOME/.cache/focusmeasure if it isn't set. Empty if FOCUS_CACHE is
+	 * "off".
+	 */
+	static std::string defaultDirectory();
+
+	/*
+	 * Size limit given by $FOCUS_CACHE_SIZE, in MB (1024 by default).
+	 */
+	static uint64_t defaultSizeLimit();
+
+	/*
+	 * Key of a frame of size (w, h) measured after the preprocessing
+	 * described by options.
+	 */
+	static Key frameKey( const uchar *pixels, int w, int h,
+						 const std::string &options );
+
+	/*
+	 * Look up the value of each measure for a frame. found[i] tells whether
+	 * values[i] was found. Returns the number of values found.
+	 * lookup() and store() can be called from several threads at once,
+	 * and while evict() or saveStats() runs. Other calls must not overlap.
+	 */
+	int lookup( const Key &key, const std::vector<int> &measures,
+				std::vector<double> &values, std::vector<bool> &found );
+
+	/*
+	 * Add the values of some measures, as (measure, value) pairs.
+	 */
+	bool store( const Key &key,
+				const std::vector<std::pair<int, double> > &values );
+
+	/*
+	 * Remove the least recently used files until the cache holds at most
+	 * maxBytes. Returns the number of files removed.
+	 */
+	uint64_t evict( uint64_t maxBytes );
+
+	/*
+	 * Remove every value.
+	 */
+	bool clear();
+
+	/*
+	 * Counts of this process since open().
+	 */
+	Stats runStats() const;
+
+	/*
+	 * Add the counts of this process to the ones saved in the cache, and
+	 * reset them.
+	 */
+	bool saveStats();
+
+	/*
+	 * Counts saved in the cache, with its current number of files and size.
+	 */
+	bool stats( Stats &total );
+
+	const std::string & error() const { return lastError; }
+
+private:
+	std::string fileName( const Key &key ) const;
+	bool fail( const std::string &message, const std::string &fileName );
+	void listFiles( std::vector<std::pair<int64_t, std::string> > &files,
+					uint64_t &bytes );
+
+	std::string dir;
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> misses;
+	std::atomic<uint64_t> stores;
+	std::atomic<uint64_t> evictions;
+	std::string lastError;
+};
+
+#endif
@@ -0,0 +1,217 @@
+#include "focusLibrary.h"
+#include <atomic>
+#include <limits.h>
+#include <new>
+#include <string.h>
+#include <vector>
+
+#include "focusMeasure.h"
+#include "preprocess.h"
+#include "threadPool.h"
+
+using namespace std;
+
+// Larger frames are taken to be a wrong size rather than a frame.
+static const int64_t MaxPixels = 1 << 28;
+
+// Whether frames of size (width, height) can still be measured once
+// preprocessed.
+static bool
+validSize( const PreprocessOptions &options, int width, int height )
+{
+	if ( width < FocusMeasure::minimumSize ||
+		 height < FocusMeasure::minimumSize ||
+		 (int64_t)width * height > MaxPixels ||
+		 options.pyramidLevel > Preprocess::maxPyramidLevel )
+		return false;
+
+	int w, h;
+	Preprocess::size( options, width, height, w, h );
+	return w >= FocusMeasure::minimumSize && h >= FocusMeasure::minimumSize;
+}
+
+// Error code of an exception thrown by a task.
+static int
+taskError()
+{
+	try
+	{
+		throw;
+	}
+	catch ( const bad_alloc & )
+	{
+		return FOCUS_ERROR_MEMORY;
+	}
+	catch ( ... )
+	{
+		return FOCUS_ERROR_INTERNAL;
+	}
+}
+
+static int
+checkMeasures( const int *measures, int measureCount )
+{
+	if ( measures == NULL || measureCount < 0 )
+		return FOCUS_ERROR_ARGUMENT;
+	for (int m = 0; m < measureCount; m++)
+		if ( measures[m] < 0 || measures[m] >= FocusMeasure::count() )
+			return FOCUS_ERROR_MEASURE;
+	return FOCUS_OK;
+}
+
+int
+focus_abi_version( void )
+{
+	return FOCUS_ABI_VERSION;
+}
+
+const char *
+focus_error_message( int error )
+{
+	switch ( error )
+	{
+		case FOCUS_OK:				return "No error";
+		case FOCUS_ERROR_ARGUMENT:	return "Null pointer or bad count";
+		case FOCUS_ERROR_MEASURE:	return "No such measure";
+		case FOCUS_ERROR_SIZE:		return "Frame too small or too large";
+		case FOCUS_ERROR_MEMORY:	return "Out of memory";
+		case FOCUS_ERROR_INTERNAL:	return "Internal error";
+		default:					return "Unknown error";
+	}
+}
+
+int
+focus_measure_count( void )
+{
+	return FocusMeasure::count();
+}
+
+const char *
+focus_measure_name( int measure )
+{
+	if ( measure < 0 || measure >= FocusMeasure::count() )
+		return NULL;
+	return FocusMeasure::name( measure );
+}
+
+int
+focus_measure_find( const char *name )
+{
+	if ( name == NULL )
+		return -1;
+	for (int m = 0; m < FocusMeasure::count(); m++)
+		if ( strcmp( name, FocusMeasure::name( m ) ) == 0 )
+			return m;
+	return -1;
+}
+
+int
+focus_measure( int measure, const unsigned char *frame, int width,
+			   int height, double *value )
+{
+	return focus_measure_batch( &frame, 1, width, height, &measure, 1, 0, 0,
+								value );
+}
+
+int
+focus_measure_batch( const unsigned char * const *frames, int frameCount,
+					 int width, int height, const int *measures,
+					 int measureCount, int flags, int pyramidLevel,
+					 double *values )
+{
+	if ( frames == NULL || frameCount < 0 || values == NULL ||
+		 pyramidLevel < 0 )
+		return FOCUS_ERROR_ARGUMENT;
+	int error = checkMeasures( measures, measureCount );
+	if ( error != FOCUS_OK )
+		return error;
+	// The tasks and values are numbered with an int.
+	if ( (int64_t)frameCount * measureCount > INT_MAX )
+		return FOCUS_ERROR_ARGUMENT;
+	PreprocessOptions options = { (flags & FOCUS_SCALE_HALF) != 0,
+								  pyramidLevel, (flags & FOCUS_CROP) != 0,
+								  false, 0 };
+	if ( !validSize( options, width, height ) )
+		return FOCUS_ERROR_SIZE;
+	for (int i = 0; i < frameCount; i++)
+		if ( frames[i] == NULL )
+			return FOCUS_ERROR_ARGUMENT;
+
+	// No exception may cross the C interface, nor leave a task of the
+	// pool : the first error of the tasks is returned.
+	atomic<int> taskFailure( FOCUS_OK );
+	try
+	{
+		vector<uchar *> buffers( frameCount, (uchar *)NULL );
+		vector<char> owned( frameCount, 0 );
+		int w, h;
+		Preprocess::size( options, width, height, w, h );
+		ThreadPool::global().runTasks( frameCount, [&]( int i )
+		{
+			try
+			{
+				ImageView view = { frames[i], width, height };
+				int frameW, frameH;
+				bool ownsBuffer;
+				buffers[i] = Preprocess::frame( view, "", options, frameW,
+												frameH, ownsBuffer );
+				owned[i] = ownsBuffer;
+			}
+			catch ( ... )
+			{
+				int none = FOCUS_OK;
+				taskFailure.compare_exchange_strong( none, taskError() );
+			}
+		} );
+
+		// One task per measure of each frame, so that a few frames still
+		// keep every thread busy.
+		if ( taskFailure == FOCUS_OK )
+			ThreadPool::global().runTasks( frameCount * measureCount,
+										   [&]( int task )
+			{
+				try
+				{
+					FocusMeasure focus;
+					int i = task / measureCount;
+					int m = task % measureCount;
+					values[task] = focus.apply( measures[m], buffers[i], w, h );
+				}
+				catch ( ... )
+				{
+					int none = FOCUS_OK;
+					taskFailure.compare_exchange_strong( none, taskError() );
+				}
+			} );
+
+		for (int i = 0; i < frameCount; i++)
+			if ( owned[i] )
+				delete [] buffers[i];
+	}
+	catch ( const bad_alloc & )
+	{
+		return FOCUS_ERROR_MEMORY;
+	}
+	catch ( ... )
+	{
+		return FOCUS_ERROR_INTERNAL;
+	}
+	return taskFailure;
+}
+
+int
+focus_color_to_gray( const unsigned char *color, int width, int height,
+					 int stride, int bytesPerPixel, int order,
+					 unsigned char *gray )
+{
+	if ( color == NULL || gray == NULL ||
+		 (bytesPerPixel != 3 && bytesPerPixel != 4) ||
+		 (order != FOCUS_RGB && order != FOCUS_BGR) )
+		return FOCUS_ERROR_ARGUMENT;
+	if ( width <= 0 || height <= 0 || stride < width * bytesPerPixel )
+		return FOCUS_ERROR_SIZE;
+
+	ImageTools::colorToGray( color, width, height, stride, bytesPerPixel,
+							 order == FOCUS_BGR, gray );
+	return FOCUS_OK;
+}
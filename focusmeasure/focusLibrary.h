@@ -0,0 +1,103 @@
+#ifndef _FocusLibrary_H
+#define _FocusLibrary_H
+
+/*
+ * C interface of libfocusmeasure.so, the focus measures and the frame
+ * preprocessing of apply, for programs that measure frames in-process
+ * (e.g. the camera application, or Python through ctypes).
+ *
+ * Frames are 8-bit gray images of size (width, height), row by row, owned
+ * by the caller; they are read in place. Functions return FOCUS_OK or one
+ * of the error codes below, and write their results to caller-owned
+ * arrays. Measures are numbered as in apply (see focus_measure_name).
+ *
+ * Only plain C types are used, so that the functions can be declared as
+ * they are with ctypes. The measures run on a pool of threads, one per
+ * core unless the environment variable FOCUS_THREADS says otherwise.
+ */
+
+#ifdef _WIN32
+#define FOCUS_API __declspec(dllexport)
+#else
+#define FOCUS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Incremented when a function changes in a way existing callers would
+ * notice. New functions don't change it.
+ */
+#define FOCUS_ABI_VERSION 1
+
+#define FOCUS_OK 0
+#define FOCUS_ERROR_ARGUMENT 1		/* null pointer, negative count, or more
+									   than INT_MAX values in a batch */
+#define FOCUS_ERROR_MEASURE 2		/* measure number out of range */
+#define FOCUS_ERROR_SIZE 3			/* frame too small (once preprocessed) or
+									   too large, or pyramid level above 16 */
+#define FOCUS_ERROR_MEMORY 4		/* out of memory while preprocessing */
+#define FOCUS_ERROR_INTERNAL 5		/* unexpected failure */
+
+/* Preprocessing flags, as the options of apply. */
+#define FOCUS_SCALE_HALF 1			/* halve each dimension */
+#define FOCUS_CROP 2				/* keep only the center of the frame */
+
+/* Orders of the channels of color images. */
+#define FOCUS_RGB 0
+#define FOCUS_BGR 1					/* e.g. Qt's 32-bit images */
+
+FOCUS_API int focus_abi_version( void );
+
+/*
+ * Description of an error code (never null).
+ */
+FOCUS_API const char *focus_error_message( int error );
+
+/*
+ * Number of measures, and their names (null if measure is out of range).
+ */
+FOCUS_API int focus_measure_count( void );
+FOCUS_API const char *focus_measure_name( int measure );
+
+/*
+ * Number of the measure with the given name, or -1.
+ */
+FOCUS_API int focus_measure_find( const char *name );
+
+/*
+ * Focus value of a frame for one measure.
+ */
+FOCUS_API int focus_measure( int measure, const unsigned char *frame,
+							 int width, int height, double *value );
+
+/*
+ * Focus values of frameCount frames of the same size, for measureCount
+ * measures each. frames[i] is the i-th frame; values receives
+ * frameCount * measureCount values, the measures of frame i at
+ * values[i * measureCount]. flags (FOCUS_SCALE_HALF, FOCUS_CROP) and
+ * pyramidLevel (0 for none) preprocess each frame as apply does, in
+ * memory of the library's own.
+ */
+FOCUS_API int focus_measure_batch( const unsigned char * const *frames,
+								   int frameCount, int width, int height,
+								   const int *measures, int measureCount,
+								   int flags, int pyramidLevel,
+								   double *values );
+
+/*
+ * Gray values (as for PNG frames) of a color image whose rows are stride
+ * bytes apart and whose pixels are bytesPerPixel (3 or 4) bytes apart,
+ * in the given channel order. gray receives width * height values.
+ */
+FOCUS_API int focus_color_to_gray( const unsigned char *color, int width,
+								   int height, int stride, int bytesPerPixel,
+								   int order, unsigned char *gray );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
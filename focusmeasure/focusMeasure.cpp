@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include "focusMeasure.h"
+#include "instrument.h"
 
 FocusMeasure::FocusMeasure()
 {
@@ -2996,3 +2997,86 @@ FocusMeasure::curvature( uchar *f, int w, int h )
     return( sum );
 }
 
+/*
+ *  The measures in the order of their numbers.
+ */
+typedef double (*MeasureFunction)( FocusMeasure &m, uchar *f, int w, int h );
+
+#define MEASURE( name ) \
+    { #name, []( FocusMeasure &m, uchar *f, int w, int h ) \
+        { return( m.name( f, w, h ) ); } }
+
+static const struct
+{
+    const char *name;
+    MeasureFunction apply;
+} measures[] = {
+    MEASURE( firstorder3x3 ),       // 0
+    MEASURE( roberts3x3 ),          // 1
+    MEASURE( prewitt3x3 ),          // 2
+    MEASURE( scharr3x3 ),           // 3
+    MEASURE( sobel3x3 ),            // 4
+    MEASURE( sobel5x5 ),            // 5
+    MEASURE( laplacian3x3 ),        // 6
+    MEASURE( laplacian5x5 ),        // 7
+    MEASURE( sobel3x3so ),          // 8
+    MEASURE( sobel5x5so ),          // 9
+    MEASURE( brenner ),             // 10
+    MEASURE( thresholdGradient ),   // 11
+    MEASURE( squaredGradient ),     // 12
+    MEASURE( MMHistogram ),         // 13
+    MEASURE( rangeHistogram ),      // 14
+    MEASURE( MGHistogram ),         // 15
+    MEASURE( entropyHistogram ),    // 16
+    MEASURE( th_cont ),             // 17
+    MEASURE( num_pix ),             // 18
+    MEASURE( power ),               // 19
+    MEASURE( var ),                 // 20
+    MEASURE( nor_var ),             // 21
+    MEASURE( vollath4 ),            // 22
+    MEASURE( vollath5 ),            // 23
+    { "autoCorrelation",            // 24
+      []( FocusMeasure &m, uchar *f, int w, int h )
+          { return( m.autoCorrelation( f, w, h, 2 ) ); } },
+    MEASURE( sobel3x3soCross ),     // 25
+    MEASURE( sobel5x5soCross ),     // 26
+    MEASURE( firstDerivGaussian ),  // 27
+    MEASURE( LoG ),                 // 28
+    MEASURE( curvature ),           // 29
+    MEASURE( firstDerivGaussian2 ), // 30
+    MEASURE( firstDerivGaussian3 ), // 31
+    MEASURE( LoG2 ),                // 32
+    MEASURE( LoG3 ),                // 33
+};
+
+#undef MEASURE
+
+int
+FocusMeasure::count()
+{
+    return( sizeof( measures ) / sizeof( measures[0] ) );
+}
+
+const char *
+FocusMeasure::name( int measure )
+{
+    return( measures[measure].name );
+}
+
+double
+FocusMeasure::apply( int measure, uchar *f, int w, int h )
+{
+#ifdef FOCUS_INSTRUMENT
+    // Each measure is timed as its own stage.
+    static std::vector<Instrument::Stage *> stages = [] {
+        std::vector<Instrument::Stage *> all;
+        for (int i = 0; i < count(); i++)
+            all.push_back( Instrument::stage( std::string( "FocusMeasure::" ) +
+                                              name( i ) ) );
+        return( all );
+    }();
+    Instrument::ScopedTimer timer( stages[measure] );
+#endif
+    FOCUS_COUNT( "FocusMeasure::pixels", (uint64_t)w * h );
+    return( measures[measure].apply( *this, f, w, h ) );
+}
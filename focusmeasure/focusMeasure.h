@@ -47,6 +47,20 @@ class FocusMeasure
 	double LoG3( uchar *f, int w, int h );
 	double curvature( uchar *f, int w, int h );
 
+	/*
+	 *  Measures by number, as given to apply.exe (0 to count()-1).
+	 *  name() is the name used for the result files (out_<name>.txt).
+	 */
+	static int count();
+	static const char *name( int measure );
+	double apply( int measure, uchar *f, int w, int h );
+
+	/*
+	 *  Smallest width and height of the frames given to apply(): some
+	 *  measures read outside of smaller frames.
+	 */
+	static const int minimumSize = 4;
+
     private:
 	double combine( int vx, int vy );
 	double determineMean( uchar *f, int w, int h );
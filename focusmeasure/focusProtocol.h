@@ -0,0 +1,71 @@
+#ifndef _FocusProtocol_H
+#define _FocusProtocol_H
+
+/*
+ * Protocol of focusd, the focus measurement daemon.
+ *
+ * A client sends requests and reads one reply per request, in order, over
+ * a Unix domain socket or the daemon's stdin/stdout. Every integer is
+ * little-endian, and every message starts with its length :
+ *
+ * Request
+ *   uint32 length			bytes that follow this field
+ *   uint32 type			FocusMeasureRequest, FocusMeasureSharedRequest,
+ *							FocusListRequest
+ *   uint32 id				copied into the reply
+ *   then, for the two measure requests :
+ *   uint32 width, height	of the frame, one byte per pixel, row by row
+ *   uint32 flags			FocusScaleHalf | FocusCrop
+ *   uint32 pyramidLevel	0 to measure the frame itself, at most 16
+ *   uint32 measureCount
+ *   uint32 measures[measureCount]
+ *   and either the pixels (FocusMeasureRequest)
+ *   uint8 pixels[width * height]
+ *   or where to find them (FocusMeasureSharedRequest), a file that the
+ *   daemon maps, typically in /dev/shm so that frames don't go through
+ *   the socket (the daemon copies each frame once, out of the mapping) :
+ *   uint64 offset			of the pixels in the file
+ *   uint32 pathLength
+ *   char path[pathLength]
+ *
+ * Reply
+ *   uint32 length			bytes that follow this field
+ *   uint32 status			FocusOk, or an error
+ *   uint32 id				of the request
+ *   uint32 count
+ *   then, if status is FocusOk, for a measure request :
+ *   float64 values[count]	one per requested measure, in order
+ *   for a list request, count names :
+ *   uint32 nameLength, char name[nameLength]
+ *   and if status is an error :
+ *   char message[count]
+ *
+ * The measures are numbered as in apply (see FocusMeasure::name).
+ */
+
+enum FocusRequestType
+{
+	FocusMeasureRequest = 1,
+	FocusMeasureSharedRequest = 2,
+	FocusListRequest = 3
+};
+
+enum FocusRequestFlags
+{
+	FocusScaleHalf = 1,
+	FocusCrop = 2
+};
+
+enum FocusStatus
+{
+	FocusOk = 0,
+	FocusBadRequest = 1,		// malformed or unknown request
+	FocusBadMeasure = 2,		// measure number out of range
+	FocusBadFrame = 3			// shared frame that can't be read, or frame
+								// too small once preprocessed
+};
+
+// Requests longer than this are rejected (and the connection closed).
+#define FOCUS_MAX_REQUEST (256 * 1024 * 1024)
+
+#endif
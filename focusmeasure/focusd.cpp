@@ -0,0 +1,617 @@
+/*
+ * Focus measurement daemon : measures frames sent over a Unix domain
+ * socket (or stdin), so that clients measuring one frame at a time don't
+ * pay for starting apply and parsing its output. The thread pool, the
+ * focus value cache and the mappings of shared frames stay warm between
+ * requests.
+ *
+ * See focusProtocol.h for the protocol. The byte order of the protocol is
+ * little-endian, like the machines this runs on, so values are copied as
+ * they are.
+ */
+
+#include <errno.h>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "focusCache.h"
+#include "focusMeasure.h"
+#include "focusProtocol.h"
+#include "preprocess.h"
+#include "threadPool.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: focusd [OPTIONS]" << endl;
+    cerr << "\t Measures the frames sent by clients (see focusProtocol.h)," << endl;
+    cerr << "\t on stdin/stdout unless --socket is given." << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --socket=PATH : listen on a Unix domain socket" << endl;
+    cerr << "\t --cache=DIR : cache of focus values (default $FOCUS_CACHE, or" << endl;
+    cerr << "\t     ~/.cache/focusmeasure)" << endl;
+    cerr << "\t --no-cache : don't use the cache (hashing a frame costs about" << endl;
+    cerr << "\t     as much as the cheapest measures)" << endl;
+    exit(1);
+}
+
+/*
+ *  The copy of a shared frame that SharedFrames is making on this thread,
+ *  if any. A client may truncate its file while the frame is copied : the
+ *  pages beyond the new end then raise SIGBUS, which bus_error turns into
+ *  a failed copy rather than the end of the daemon.
+ */
+static thread_local sigjmp_buf *volatile copyGuard = NULL;
+
+void bus_error( int signalNumber )
+{
+    if (copyGuard != NULL)
+        siglongjmp( *copyGuard, 1 );
+    signal( SIGBUS, SIG_DFL );
+    raise( SIGBUS );
+}
+
+/*
+ *  Files holding shared frames, kept mapped between requests. A file is
+ *  mapped again when it changes (e.g. it was replaced by a larger one).
+ *  Frames are copied out of the mapping before they are measured, so that
+ *  no other thread ever reads pages the client could take away.
+ */
+class SharedFrames
+{
+public:
+    SharedFrames() : uses( 0 ) {}
+
+    ~SharedFrames()
+    {
+        for (map<string, Mapping>::iterator i = mappings.begin();
+             i != mappings.end(); ++i)
+            unmap( i->second );
+    }
+
+    /*
+     *  Copy of the pixels [offset, offset + size) of a file. It stays
+     *  valid until the next call.
+     */
+    bool get( const string &path, uint64_t offset, size_t size,
+              const uchar *&pixels, string &error )
+    {
+        struct stat info;
+        if (stat( path.c_str(), &info ) != 0)
+        {
+            error = "No such file: " + path;
+            return false;
+        }
+
+        Mapping &mapping = mappings[path];
+        if (mapping.data != NULL &&
+            (mapping.inode != info.st_ino || mapping.size != (size_t)info.st_size))
+            unmap( mapping );
+
+        if (mapping.data == NULL)
+        {
+            if (!map_file( path, info, mapping, error ))
+            {
+                mappings.erase( path );
+                return false;
+            }
+            evict();
+        }
+
+        mapping.lastUse = ++uses;
+        if (offset > mapping.size || mapping.size - offset < size)
+        {
+            error = "Frame beyond the end of " + path;
+            return false;
+        }
+
+        // The file may have shrunk since the mapping was made; it may still
+        // shrink during the copy.
+        copy.resize( size );
+        if (fstat( mapping.fd, &info ) != 0 ||
+            (uint64_t)info.st_size < offset + size ||
+            !guarded_copy( &copy[0], (const uchar *)mapping.data + offset,
+                           size ))
+        {
+            unmap( mapping );
+            mappings.erase( path );
+            error = "File truncated while reading it: " + path;
+            return false;
+        }
+        pixels = &copy[0];
+        return true;
+    }
+
+private:
+    struct Mapping
+    {
+        Mapping() : data( NULL ), size( 0 ), fd( -1 ), inode( 0 ),
+                    lastUse( 0 ) {}
+        void *data;
+        size_t size;
+        int fd;             // kept open to check the size of the file
+        ino_t inode;
+        uint64_t lastUse;
+    };
+
+    static const size_t MaxMappings = 32;
+
+    static bool guarded_copy( uchar *to, const uchar *from, size_t size )
+    {
+        sigjmp_buf guard;
+        if (sigsetjmp( guard, 1 ) != 0)
+        {
+            copyGuard = NULL;
+            return false;
+        }
+        copyGuard = &guard;
+        memcpy( to, from, size );
+        copyGuard = NULL;
+        return true;
+    }
+
+    bool map_file( const string &path, const struct stat &info,
+                   Mapping &mapping, string &error )
+    {
+        int fd = open( path.c_str(), O_RDONLY );
+        if (fd < 0 || info.st_size == 0)
+        {
+            if (fd >= 0)
+                close( fd );
+            error = "Could not read file: " + path;
+            return false;
+        }
+        void *data = mmap( NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        if (data == MAP_FAILED)
+        {
+            error = string( "Could not map file (" ) + strerror( errno ) +
+                "): " + path;
+            close( fd );
+            return false;
+        }
+        mapping.data = data;
+        mapping.size = info.st_size;
+        mapping.fd = fd;
+        mapping.inode = info.st_ino;
+        return true;
+    }
+
+    static void unmap( Mapping &mapping )
+    {
+        munmap( mapping.data, mapping.size );
+        close( mapping.fd );
+        mapping.data = NULL;
+        mapping.fd = -1;
+    }
+
+    // Unmap the least recently used files beyond MaxMappings.
+    void evict()
+    {
+        while (mappings.size() > MaxMappings)
+        {
+            map<string, Mapping>::iterator oldest = mappings.begin();
+            for (map<string, Mapping>::iterator i = mappings.begin();
+                 i != mappings.end(); ++i)
+                if (i->second.lastUse < oldest->second.lastUse)
+                    oldest = i;
+            unmap( oldest->second );
+            mappings.erase( oldest );
+        }
+    }
+
+    map<string, Mapping> mappings;
+    uint64_t uses;
+    vector<uchar> copy;
+};
+
+// Reads the fields of a request, in order.
+struct RequestReader
+{
+    const uchar *data;
+    size_t size;
+    size_t position;
+
+    bool get32( uint32_t &value )
+    {
+        if (size - position < 4)
+            return false;
+        memcpy( &value, data + position, 4 );
+        position += 4;
+        return true;
+    }
+
+    bool get64( uint64_t &value )
+    {
+        if (size - position < 8)
+            return false;
+        memcpy( &value, data + position, 8 );
+        position += 8;
+        return true;
+    }
+
+    bool bytes( size_t count, const uchar *&start )
+    {
+        if (size - position < count)
+            return false;
+        start = data + position;
+        position += count;
+        return true;
+    }
+};
+
+void put32( vector<uchar> &out, uint32_t value )
+{
+    size_t end = out.size();
+    out.resize( end + 4 );
+    memcpy( &out[end], &value, 4 );
+}
+
+void put_double( vector<uchar> &out, double value )
+{
+    size_t end = out.size();
+    out.resize( end + 8 );
+    memcpy( &out[end], &value, 8 );
+}
+
+// Start a reply; its length is filled in by finish_reply.
+void start_reply( vector<uchar> &reply, uint32_t status, uint32_t id,
+                  uint32_t count )
+{
+    reply.clear();
+    put32( reply, 0 );
+    put32( reply, status );
+    put32( reply, id );
+    put32( reply, count );
+}
+
+void finish_reply( vector<uchar> &reply )
+{
+    uint32_t length = reply.size() - 4;
+    memcpy( &reply[0], &length, 4 );
+}
+
+void error_reply( vector<uchar> &reply, uint32_t status, uint32_t id,
+                  const string &message )
+{
+    start_reply( reply, status, id, message.length() );
+    reply.insert( reply.end(), message.begin(), message.end() );
+    finish_reply( reply );
+}
+
+/*
+ *  State shared by every connection.
+ */
+struct Daemon
+{
+    FocusCache cache;
+    // lookup() and store() run on any thread; evict(), saveStats() and the
+    // count of stores since the last save hold maintenanceLock.
+    mutex maintenanceLock;
+    uint64_t storesSinceSave;
+};
+
+void measure_request( Daemon &daemon, SharedFrames &shared, uint32_t type,
+                      uint32_t id, RequestReader &request,
+                      vector<uchar> &reply )
+{
+    uint32_t width, height, flags, pyramidLevel, measureCount;
+    if (!request.get32( width ) || !request.get32( height ) ||
+        !request.get32( flags ) || !request.get32( pyramidLevel ) ||
+        !request.get32( measureCount ) || width == 0 || height == 0 ||
+        (uint64_t)width * height > FOCUS_MAX_REQUEST ||
+        measureCount > (uint32_t)FocusMeasure::count() * 16 ||
+        pyramidLevel > (uint32_t)Preprocess::maxPyramidLevel)
+    {
+        error_reply( reply, FocusBadRequest, id, "Malformed measure request" );
+        return;
+    }
+
+    // The measures need a few pixels, even after preprocessing.
+    PreprocessOptions options = { (flags & FocusScaleHalf) != 0,
+                                  (int)pyramidLevel, (flags & FocusCrop) != 0,
+                                  false, 0 };
+    int w, h;
+    Preprocess::size( options, width, height, w, h );
+    if (w < FocusMeasure::minimumSize || h < FocusMeasure::minimumSize)
+    {
+        error_reply( reply, FocusBadFrame, id,
+                     "Frame too small to measure after preprocessing" );
+        return;
+    }
+
+    vector<int> measures( measureCount );
+    for (uint32_t m = 0; m < measureCount; m++)
+    {
+        uint32_t measure;
+        if (!request.get32( measure ))
+        {
+            error_reply( reply, FocusBadRequest, id, "Missing measures" );
+            return;
+        }
+        if (measure >= (uint32_t)FocusMeasure::count())
+        {
+            error_reply( reply, FocusBadMeasure, id, "No such measure" );
+            return;
+        }
+        measures[m] = measure;
+    }
+
+    size_t size = (size_t)width * height;
+    const uchar *pixels;
+    if (type == FocusMeasureRequest)
+    {
+        if (!request.bytes( size, pixels ))
+        {
+            error_reply( reply, FocusBadRequest, id, "Missing pixels" );
+            return;
+        }
+    }
+    else
+    {
+        uint64_t offset;
+        uint32_t pathLength;
+        const uchar *path;
+        string error;
+        if (!request.get64( offset ) || !request.get32( pathLength ) ||
+            !request.bytes( pathLength, path ))
+        {
+            error_reply( reply, FocusBadRequest, id, "Missing shared frame" );
+            return;
+        }
+        if (!shared.get( string( (const char *)path, pathLength ), offset,
+                         size, pixels, error ))
+        {
+            error_reply( reply, FocusBadFrame, id, error );
+            return;
+        }
+    }
+
+    vector<double> values;
+    vector<bool> found;
+    FocusCache::Key key;
+    int cached = 0;
+    if (daemon.cache.isOpen())
+    {
+        key = FocusCache::frameKey( pixels, width, height,
+                                    Preprocess::describe( options, "" ) );
+        cached = daemon.cache.lookup( key, measures, values, found );
+    }
+    else
+    {
+        values.assign( measureCount, 0 );
+        found.assign( measureCount, false );
+    }
+
+    if (cached < (int)measureCount)
+    {
+        ImageView view;
+        view.data = pixels;
+        view.width = width;
+        view.height = height;
+        bool ownsBuffer;
+        uchar *buffer = Preprocess::frame( view, "", options, w, h,
+                                           ownsBuffer );
+
+        // One task per measure still to compute.
+        vector<int> missing;
+        for (uint32_t m = 0; m < measureCount; m++)
+            if (!found[m])
+                missing.push_back( m );
+        ThreadPool::global().runTasks( missing.size(), [&]( int task )
+        {
+            FocusMeasure focus;
+            int m = missing[task];
+            values[m] = focus.apply( measures[m], buffer, w, h );
+        } );
+        if (ownsBuffer)
+            delete [] buffer;
+
+        if (daemon.cache.isOpen())
+        {
+            vector< pair<int, double> > computed;
+            for (size_t i = 0; i < missing.size(); i++)
+                computed.push_back( make_pair( measures[missing[i]],
+                                               values[missing[i]] ) );
+            daemon.cache.store( key, computed );
+
+            // Keep the cache within its size limit as values come in.
+            lock_guard<mutex> lock( daemon.maintenanceLock );
+            daemon.storesSinceSave += computed.size();
+            if (daemon.storesSinceSave >= 10000)
+            {
+                daemon.cache.evict( FocusCache::defaultSizeLimit() );
+                daemon.cache.saveStats();
+                daemon.storesSinceSave = 0;
+            }
+        }
+    }
+
+    start_reply( reply, FocusOk, id, measureCount );
+    for (uint32_t m = 0; m < measureCount; m++)
+        put_double( reply, values[m] );
+    finish_reply( reply );
+}
+
+void handle_request( Daemon &daemon, SharedFrames &shared,
+                     const vector<uchar> &message, vector<uchar> &reply )
+{
+    RequestReader request = { message.empty() ? NULL : &message[0],
+                              message.size(), 0 };
+    uint32_t type, id = 0;
+    if (!request.get32( type ) || !request.get32( id ))
+    {
+        error_reply( reply, FocusBadRequest, id, "Malformed request" );
+        return;
+    }
+
+    if (type == FocusMeasureRequest || type == FocusMeasureSharedRequest)
+        measure_request( daemon, shared, type, id, request, reply );
+    else if (type == FocusListRequest)
+    {
+        start_reply( reply, FocusOk, id, FocusMeasure::count() );
+        for (int m = 0; m < FocusMeasure::count(); m++)
+        {
+            string name( FocusMeasure::name( m ) );
+            put32( reply, name.length() );
+            reply.insert( reply.end(), name.begin(), name.end() );
+        }
+        finish_reply( reply );
+    }
+    else
+        error_reply( reply, FocusBadRequest, id, "Unknown request type" );
+}
+
+bool read_fully( int fd, void *data, size_t size )
+{
+    uchar *bytes = (uchar *)data;
+    while (size > 0)
+    {
+        ssize_t n = read( fd, bytes, size );
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool write_fully( int fd, const void *data, size_t size )
+{
+    const uchar *bytes = (const uchar *)data;
+    while (size > 0)
+    {
+        ssize_t n = write( fd, bytes, size );
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+/*
+ *  Answer the requests of a client until it goes away.
+ */
+void serve( Daemon &daemon, int in, int out )
+{
+    SharedFrames shared;
+    vector<uchar> message, reply;
+    uint32_t length;
+    while (read_fully( in, &length, 4 ))
+    {
+        if (length > FOCUS_MAX_REQUEST)
+        {
+            // The rest of the stream can't be trusted.
+            error_reply( reply, FocusBadRequest, 0, "Request too long" );
+            write_fully( out, &reply[0], reply.size() );
+            break;
+        }
+
+        message.resize( length );
+        if (length > 0 && !read_fully( in, &message[0], length ))
+            break;
+        handle_request( daemon, shared, message, reply );
+        if (!write_fully( out, &reply[0], reply.size() ))
+            break;
+    }
+}
+
+int
+main( int argc, char *argv[] )
+{
+    string socketPath;
+    string cacheFolder = FocusCache::defaultDirectory();
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+        if (option.compare(0, 9, "--socket=") == 0)
+            socketPath = option.substr(9);
+        else if (option.compare(0, 8, "--cache=") == 0)
+            cacheFolder = option.substr(8);
+        else if (option == "--no-cache")
+            cacheFolder.clear();
+        else
+            print_usage();
+    }
+
+    // A client going away, or truncating its frames, must not kill the
+    // daemon.
+    signal( SIGPIPE, SIG_IGN );
+    signal( SIGBUS, bus_error );
+
+    Daemon daemon;
+    daemon.storesSinceSave = 0;
+    if (!cacheFolder.empty() && !daemon.cache.open( cacheFolder ))
+        cerr << daemon.cache.error() << ", not using the cache" << endl;
+
+    // Start the threads now rather than on the first request.
+    ThreadPool::global();
+
+    if (socketPath.empty())
+    {
+        serve( daemon, 0, 1 );
+        daemon.cache.saveStats();
+        return( 0 );
+    }
+
+    int server = socket( AF_UNIX, SOCK_STREAM, 0 );
+    struct sockaddr_un address;
+    memset( &address, 0, sizeof(address) );
+    address.sun_family = AF_UNIX;
+    if (socketPath.length() >= sizeof(address.sun_path))
+    {
+        cerr << "Socket path too long: " << socketPath << endl;
+        exit(1);
+    }
+    strcpy( address.sun_path, socketPath.c_str() );
+    unlink( socketPath.c_str() );
+    if (server < 0 ||
+        bind( server, (struct sockaddr *)&address, sizeof(address) ) != 0 ||
+        listen( server, 16 ) != 0)
+    {
+        cerr << "Could not listen on " << socketPath << " ("
+             << strerror( errno ) << ")" << endl;
+        exit(1);
+    }
+
+    // Each client gets its own thread; their measures share the pool.
+    for (;;)
+    {
+        int client = accept( server, NULL, NULL );
+        if (client < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            cerr << "Could not accept a client (" << strerror( errno ) << ")"
+                 << endl;
+            exit(1);
+        }
+        thread( [&daemon, client]
+        {
+            serve( daemon, client, client );
+            close( client );
+        } ).detach();
+    }
+}
@@ -0,0 +1,301 @@
+#include "frameReader.h"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+FrameReader::FrameReader( int readahead )
+	: grayWidth( ImageTools::GrayWidth ), grayHeight( ImageTools::GrayHeight ),
+	  readahead( readahead )
+{
+}
+
+FrameReader::~FrameReader()
+{
+	for (int i = 0; i < frames(); i++)
+		release( i );
+	for (size_t i = 0; i < sweeps.size(); i++)
+		delete sweeps[i];
+}
+
+void
+FrameReader::setGraySize( int width, int height )
+{
+	grayWidth = width;
+	grayHeight = height;
+}
+
+bool
+FrameReader::fail( const string &message, const string &fileName )
+{
+	lastError = message + ": " + fileName;
+	return false;
+}
+
+bool
+FrameReader::addFile( const string &fileName )
+{
+	struct stat info;
+	if ( stat( fileName.c_str(), &info ) != 0 )
+		return fail( "No such file", fileName );
+	if ( SweepReader::isSweepFile( fileName ) )
+		return addSweep( fileName );
+
+	MappedFile file;
+	file.name = fileName;
+	file.format = ImageTools::imageInfo( fileName.c_str(), file.width,
+										 file.height, file.offset,
+										 grayWidth, grayHeight );
+	if ( file.format == ImageTools::UnknownFormat )
+		return fail( "Unknown image format", fileName );
+	if ( file.format != ImageTools::PngFormat &&
+		 info.st_size < file.offset + (off_t)file.width * file.height )
+		return fail( "Wrong number of bytes", fileName );
+
+	file.data = NULL;
+	file.sweep = -1;
+	file.sweepFrame = 0;
+	file.pixels = NULL;
+	files.push_back( file );
+	return true;
+}
+
+bool
+FrameReader::addSweep( const string &fileName )
+{
+	SweepReader *sweep = new SweepReader();
+	if ( !sweep->open( fileName ) )
+	{
+		lastError = sweep->error();
+		delete sweep;
+		return false;
+	}
+
+	for (int i = 0; i < sweep->frames(); i++)
+	{
+		char step[16];
+		sprintf( step, "#%d", sweep->info( i ).lensStep );
+
+		MappedFile file;
+		file.name = fileName + step;
+		file.format = ImageTools::GrayFormat;
+		file.width = sweep->width();
+		file.height = sweep->height();
+		file.offset = 0;
+		file.data = NULL;
+		file.sweep = sweeps.size();
+		file.sweepFrame = i;
+		file.pixels = NULL;
+		files.push_back( file );
+	}
+	sweeps.push_back( sweep );
+	return true;
+}
+
+// Whether a file name ends with an extension.
+static bool
+hasExtension( const string &name, const string &extension )
+{
+	return name.length() > extension.length() &&
+		name.compare( name.length() - extension.length(),
+					  extension.length(), extension ) == 0;
+}
+
+bool
+FrameReader::addDirectory( const string &directory )
+{
+	DIR *dir = opendir( directory.c_str() );
+	if ( dir == NULL )
+		return fail( "No such folder", directory );
+
+	vector<string> names;
+	struct dirent *entry;
+	while ( (entry = readdir( dir )) != NULL )
+	{
+		string name( entry->d_name );
+		if ( hasExtension( name, ".gray" ) || hasExtension( name, ".pgm" ) ||
+			 hasExtension( name, ".png" ) )
+			names.push_back( directory + "/" + name );
+	}
+	closedir( dir );
+
+	sort( names.begin(), names.end() );
+	for (size_t i = 0; i < names.size(); i++)
+		if ( !addFile( names[i] ) )
+			return false;
+	return true;
+}
+
+bool
+FrameReader::map( int i )
+{
+	// PNG and sweep frames are read when they are requested.
+	MappedFile &file = files[i];
+	if ( file.data != NULL || file.sweep >= 0 ||
+		 file.format == ImageTools::PngFormat )
+		return true;
+
+	int fd = open( file.name.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return fail( "No such file", file.name );
+
+	size_t size = file.offset + (size_t)file.width * file.height;
+	void *data = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( data == MAP_FAILED )
+		return fail( string( "Could not map file (" ) + strerror( errno ) +
+					 ")", file.name );
+
+	// Start reading the whole frame now rather than page by page as the
+	// focus measure touches it.
+	madvise( data, size, MADV_WILLNEED );
+	file.data = data;
+	file.pixels = (const uchar *)data + file.offset;
+	return true;
+}
+
+bool
+FrameReader::frame( int i, ImageView &view )
+{
+	if ( i < 0 || i >= frames() )
+	{
+		lastError = "Frame index out of range";
+		return false;
+	}
+
+	MappedFile &file = files[i];
+	if ( file.sweep >= 0 )
+	{
+		// The whole sweep file is mapped already, only the readahead is
+		// left to do. It is only advice : the frame is read without it.
+		SweepReader *sweep = sweeps[file.sweep];
+		sweep->prefetch( file.sweepFrame + 1, readahead );
+		if ( file.pixels == NULL )
+		{
+			if ( !sweep->frame( file.sweepFrame, view, file.scratch ) )
+			{
+				lastError = sweep->error();
+				return false;
+			}
+			file.pixels = view.data;
+		}
+	}
+	else if ( file.format == ImageTools::PngFormat )
+	{
+		if ( file.pixels == NULL )
+		{
+			int w, h;
+			if ( !ImageTools::readPng( file.name.c_str(), w, h,
+									   file.scratch ) )
+				return fail( "Could not decode", file.name );
+			file.pixels = &file.scratch[0];
+		}
+	}
+	else
+	{
+		if ( !map( i ) )
+			return false;
+
+		// Prefetching is only a hint, a frame that can't be mapped now
+		// will report its error when it is requested.
+		for (int next = i + 1; next <= i + readahead && next < frames();
+			 next++)
+		{
+			string error = lastError;
+			if ( !map( next ) )
+				lastError = error;
+		}
+	}
+
+	view.data = file.pixels;
+	view.width = file.width;
+	view.height = file.height;
+	return true;
+}
+
+bool
+FrameReader::isMapped( int i ) const
+{
+	return files[i].sweep < 0 && files[i].format != ImageTools::PngFormat;
+}
+
+bool
+FrameReader::decode( int i, vector<uchar> &pixels, ImageView &view,
+					 string &error ) const
+{
+	if ( i < 0 || i >= frames() )
+	{
+		error = "Frame index out of range";
+		return false;
+	}
+	if ( isMapped( i ) )
+	{
+		error = "Mapped frame, not decoded: " + files[i].name;
+		return false;
+	}
+
+	const MappedFile &file = files[i];
+	if ( file.sweep >= 0 )
+	{
+		SweepReader *sweep = sweeps[file.sweep];
+		sweep->prefetch( file.sweepFrame + 1, readahead );
+		if ( !sweep->frame( file.sweepFrame, view, pixels ) )
+		{
+			error = sweep->error();
+			return false;
+		}
+		return true;
+	}
+
+	int w, h;
+	if ( !ImageTools::readPng( file.name.c_str(), w, h, pixels ) )
+	{
+		error = "Could not decode: " + file.name;
+		return false;
+	}
+	view.data = &pixels[0];
+	view.width = w;
+	view.height = h;
+	return true;
+}
+
+bool
+FrameReader::load( int i )
+{
+	ImageView view;
+	if ( !frame( i, view ) )
+		return false;
+	touch( view );
+	return true;
+}
+
+void
+FrameReader::touch( const ImageView &view )
+{
+	// Touching one byte per page is enough to fault the whole frame in.
+	size_t pageSize = sysconf( _SC_PAGESIZE );
+	size_t size = (size_t)view.width * view.height;
+	volatile uchar sum = 0;
+	for (size_t offset = 0; offset < size; offset += pageSize)
+		sum += view.data[offset];
+}
+
+void
+FrameReader::release( int i )
+{
+	MappedFile &file = files[i];
+	if ( file.data != NULL )
+	{
+		munmap( file.data, file.offset + (size_t)file.width * file.height );
+		file.data = NULL;
+	}
+	vector<uchar>().swap( file.scratch );
+	file.pixels = NULL;
+}
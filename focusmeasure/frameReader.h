@@ -0,0 +1,135 @@
+#ifndef _FrameReader_H
+#define _FrameReader_H
+
+#include <string>
+#include <vector>
+
+#include "imageTools.h"
+#include "sweepFile.h"
+
+/*
+ * Reads the frames of a sweep (.gray, PGM or PNG files, or the frames of a
+ * sweep file) by memory-mapping them. Frames are handed out as views on
+ * the mapping, without copying; only PNG and compressed sweep frames are
+ * decoded into memory. Every time a frame is requested, the kernel is
+ * asked to start reading the next few frames so that they are in memory
+ * by the time they are needed.
+ *
+ * Each frame has its own size, taken from its header. .gray files have
+ * none and are read at the size given to setGraySize().
+ *
+ * Errors are reported by returning false; error() then describes the
+ * problem.
+ *
+ * A reader is not thread safe : its calls must not overlap (prefetching
+ * maps frames other than the one requested, and every call may set the
+ * error). Only the pixels of a view can be read from any thread while
+ * other calls are made, until the frame is released, and frames that are
+ * not mapped can be decoded with decode().
+ */
+class FrameReader
+{
+public:
+	/*
+	 * readahead is the number of frames after the current one to prefetch.
+	 */
+	FrameReader( int readahead = 4 );
+	~FrameReader();
+
+	/*
+	 * Size of the .gray files added from now on (by default
+	 * ImageTools::GrayWidth x ImageTools::GrayHeight).
+	 */
+	void setGraySize( int width, int height );
+
+	/*
+	 * Append a frame to the sweep. Sweep files are recognized and all of
+	 * their frames are appended.
+	 */
+	bool addFile( const std::string &fileName );
+
+	/*
+	 * Append every frame of a sweep file. Its frames are named
+	 * fileName#lensStep.
+	 */
+	bool addSweep( const std::string &fileName );
+
+	/*
+	 * Append every .gray, .pgm and .png file of a folder, sorted by name.
+	 */
+	bool addDirectory( const std::string &directory );
+
+	int frames() const { return files.size(); }
+	const std::string & fileName( int i ) const { return files[i].name; }
+	int width( int i ) const { return files[i].width; }
+	int height( int i ) const { return files[i].height; }
+
+	/*
+	 * Get a view on frame i, and prefetch the frames that follow it.
+	 * The view stays valid until the frame is released.
+	 */
+	bool frame( int i, ImageView &view );
+
+	/*
+	 * Whether frame() maps frame i (.gray and PGM files), rather than
+	 * decoding it (PNG files) or taking it from a sweep file.
+	 */
+	bool isMapped( int i ) const;
+
+	/*
+	 * View of a frame that isn't mapped, decoded into pixels if needed
+	 * (uncompressed sweep frames point into the sweep file), and prefetch
+	 * the frames of the sweep that follow it. Unlike frame(), this doesn't
+	 * change the reader : it can run on any thread while other calls are
+	 * made, and errors are described in error rather than by error().
+	 */
+	bool decode( int i, std::vector<uchar> &pixels, ImageView &view,
+				 std::string &error ) const;
+
+	/*
+	 * Bring frame i into memory (reading it from disk, and decoding it if
+	 * needed) so that frame() and the first pass over its pixels don't wait
+	 * on the disk : frame(), then touch().
+	 */
+	bool load( int i );
+
+	/*
+	 * Read the pixels of a view from disk, if they aren't in memory. This
+	 * only reads the view, and can be done without holding the reader.
+	 */
+	static void touch( const ImageView &view );
+
+	/*
+	 * Unmap a frame that is not needed anymore.
+	 */
+	void release( int i );
+
+	const std::string & error() const { return lastError; }
+
+private:
+	struct MappedFile
+	{
+		std::string name;
+		ImageTools::ImageFormat format;
+		int width;
+		int height;
+		long offset;				// of the pixels in the file
+		void *data;					// mapping of the file
+		int sweep;					// index in sweeps, -1 for an image file
+		int sweepFrame;
+		std::vector<uchar> scratch;	// decoded PNG or sweep frame
+		const uchar *pixels;		// once mapped or decoded
+	};
+
+	bool map( int i );
+	bool fail( const std::string &message, const std::string &fileName );
+
+	int grayWidth;
+	int grayHeight;
+	int readahead;
+	std::vector<MappedFile> files;
+	std::vector<SweepReader *> sweeps;
+	std::string lastError;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include "imagePyramid.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+using namespace std;
+
+// Taps of the binomial filter, which sum to 16.
+static const int TAPS[5] = { 1, 4, 6, 4, 1 };
+
+ImagePyramid::ImagePyramid( int levels )
+	: maxLevels( levels ), levelCount( levels )
+{
+	assert( levels >= 1 );
+}
+
+void
+ImagePyramid::setLevels( int levels )
+{
+	assert( levels >= 1 );
+	if ( levels == maxLevels )
+		return;
+	maxLevels = levels;
+	levelCount = levels;
+
+	// Allocated again by the next build.
+	widths.clear();
+	heights.clear();
+}
+
+void
+ImagePyramid::allocate( int w, int h )
+{
+	widths.assign( 1, w );
+	heights.assign( 1, h );
+
+	// Stop halving once a level would become empty.
+	while ( (int)widths.size() < maxLevels &&
+			widths.back() / 2 > 0 && heights.back() / 2 > 0 )
+	{
+		widths.push_back( widths.back() / 2 );
+		heights.push_back( heights.back() / 2 );
+	}
+	levelCount = widths.size();
+
+	offsets.resize( levelCount );
+	size_t total = 0;
+	for (int i = 0; i < levelCount; i++)
+	{
+		offsets[i] = total;
+		total += (size_t)widths[i] * heights[i];
+	}
+	data.resize( total );
+
+	rings.resize( levelCount );
+	for (int i = 1; i < levelCount; i++)
+		rings[i].resize( 5 * widths[i] );
+}
+
+void
+ImagePyramid::build( const uchar *image, int w, int h )
+{
+	if ( widths.empty() || widths[0] != w || heights[0] != h )
+		allocate( w, h );
+
+	rowsIn.assign( levelCount, 0 );
+	rowsOut.assign( levelCount, 0 );
+
+	memcpy( level( 0 ), image, (size_t)w * h );
+
+	// Feeding the rows of the base level cascades through every level.
+	if ( levelCount > 1 )
+		for (int y = 0; y < h; y++)
+			pushRow( 1, level( 0 ) + (size_t)y * w );
+}
+
+void
+ImagePyramid::pushRow( int lvl, const uchar *row )
+{
+	int srcW = widths[lvl - 1];
+	int srcH = heights[lvl - 1];
+	int w = widths[lvl];
+	int *out = &rings[lvl][(rowsIn[lvl] % 5) * w];
+
+	// Horizontal filter, keeping only every other column. Columns outside
+	// of the image are replaced by the closest column on the edge.
+	for (int x = 0; x < w; x++)
+	{
+		int c = 2 * x;
+		if ( c >= 2 && c + 2 < srcW )
+		{
+			out[x] = row[c - 2] + 4 * row[c - 1] + 6 * row[c] +
+					 4 * row[c + 1] + row[c + 2];
+		}
+		else
+		{
+			int sum = 0;
+			for (int k = 0; k < 5; k++)
+				sum += TAPS[k] * row[min( max( 0, c + k - 2 ), srcW - 1 )];
+			out[x] = sum;
+		}
+	}
+	rowsIn[lvl]++;
+
+	// Output row y needs the input rows 2y - 2 to 2y + 2.
+	while ( rowsOut[lvl] < heights[lvl] &&
+			min( 2 * rowsOut[lvl] + 2, srcH - 1 ) < rowsIn[lvl] )
+	{
+		emitRow( lvl, rowsOut[lvl] );
+		rowsOut[lvl]++;
+	}
+}
+
+void
+ImagePyramid::emitRow( int lvl, int y )
+{
+	int srcH = heights[lvl - 1];
+	int w = widths[lvl];
+
+	const int *r[5];
+	for (int k = 0; k < 5; k++)
+	{
+		int row = min( max( 0, 2 * y + k - 2 ), srcH - 1 );
+		r[k] = &rings[lvl][(row % 5) * w];
+	}
+
+	uchar *out = level( lvl ) + (size_t)y * w;
+	for (int x = 0; x < w; x++)
+	{
+		int sum = r[0][x] + 4 * r[1][x] + 6 * r[2][x] +
+				  4 * r[3][x] + r[4][x];
+		// The taps sum to 16 in each direction, so divide by 256.
+		out[x] = (uchar)((sum + 128) >> 8);
+	}
+
+	if ( lvl + 1 < levelCount )
+		pushRow( lvl + 1, out );
+}
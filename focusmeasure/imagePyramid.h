@@ -0,0 +1,67 @@
+#ifndef _ImagePyramid_H
+#define _ImagePyramid_H
+
+#include <stddef.h>
+#include <vector>
+
+typedef unsigned char uchar;
+
+/*
+ * Gaussian image pyramid. Level 0 is the full resolution image and each
+ * following level halves both dimensions after applying the 5-tap
+ * low-pass filter (1 4 6 4 1) / 16 in both directions.
+ *
+ * All the levels are produced in a single pass over the input : every row
+ * of a level is fed to the next level as soon as it is computed. The levels
+ * are kept in one contiguous allocation, which is reused by the next build
+ * of an image of the same size.
+ */
+class ImagePyramid
+{
+public:
+	ImagePyramid( int levels = 3 );
+
+	/*
+	 * Build every level from an image of size (w, h).
+	 */
+	void build( const uchar *image, int w, int h );
+
+	/*
+	 * Change the number of levels of the next builds.
+	 */
+	void setLevels( int levels );
+
+	int levels() const { return levelCount; }
+	int width( int level ) const { return widths[level]; }
+	int height( int level ) const { return heights[level]; }
+
+	/*
+	 * Pixels of a level, of size width(level) x height(level).
+	 */
+	uchar * level( int level ) { return &data[offsets[level]]; }
+
+private:
+	void allocate( int w, int h );
+
+	// Horizontally filter and decimate a row of level - 1, then emit
+	// every row of level that became computable.
+	void pushRow( int level, const uchar *row );
+
+	void emitRow( int level, int y );
+
+	int maxLevels;
+	int levelCount;
+
+	std::vector<int> widths;
+	std::vector<int> heights;
+	std::vector<size_t> offsets;
+	std::vector<uchar> data;
+
+	// For each level > 0, a ring of 5 horizontally filtered rows of the
+	// level above, the number of rows received and rows emitted so far.
+	std::vector< std::vector<int> > rings;
+	std::vector<int> rowsIn;
+	std::vector<int> rowsOut;
+};
+
+#endif
@@ -1,18 +1,28 @@
 #include "imageTools.h"
 #include <cassert>
 #include <cmath>
+#include <ctype.h>
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <string>
 #include <vector>
 
+#include "instrument.h"
 #include "lodepng.h"
+#include "threadPool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
 void
 ImageTools::readGray( const char *fileName, int n, uchar *buffer )
 {
+	FOCUS_TIMER( "ImageTools::readGray" );
 	FILE *fp;
 
 	fp = fopen( fileName, "rb" );
@@ -32,9 +42,155 @@ ImageTools::readGray( const char *fileName, int n, uchar *buffer )
 	fclose( fp );
 }
 
+// Read the next number of a PGM header, skipping whitespace and comments.
+static bool
+readPgmNumber( FILE *fp, int &value )
+{
+	int c = fgetc( fp );
+	while ( c == '#' || isspace( c ) )
+	{
+		if ( c == '#' )
+			while ( c != '\n' && c != EOF )
+				c = fgetc( fp );
+		c = fgetc( fp );
+	}
+
+	if ( !isdigit( c ) )
+		return false;
+	value = 0;
+	while ( isdigit( c ) )
+	{
+		value = value * 10 + c - '0';
+		c = fgetc( fp );
+	}
+	// A single whitespace character ends the number.
+	return isspace( c );
+}
+
+ImageTools::ImageFormat
+ImageTools::imageInfo( const char *fileName, int &w, int &h, long &offset,
+					   int grayWidth, int grayHeight )
+{
+	FILE *fp = fopen( fileName, "rb" );
+	if ( fp == NULL )
+		return UnknownFormat;
+
+	uchar magic[24];
+	size_t length = fread( magic, 1, sizeof( magic ), fp );
+	ImageFormat format = GrayFormat;
+	w = grayWidth;
+	h = grayHeight;
+	offset = 0;
+
+	static const uchar pngMagic[8] =
+		{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if ( length == sizeof( magic ) && memcmp( magic, pngMagic, 8 ) == 0 )
+	{
+		// The IHDR chunk comes first, it starts with the size (big-endian).
+		format = PngFormat;
+		w = (magic[16] << 24) | (magic[17] << 16) | (magic[18] << 8) | magic[19];
+		h = (magic[20] << 24) | (magic[21] << 16) | (magic[22] << 8) | magic[23];
+	}
+	else if ( length >= 2 && magic[0] == 'P' && magic[1] == '5' )
+	{
+		int maxValue;
+		fseek( fp, 2, SEEK_SET );
+		if ( readPgmNumber( fp, w ) && readPgmNumber( fp, h ) &&
+			 readPgmNumber( fp, maxValue ) && maxValue < 256 )
+		{
+			format = PgmFormat;
+			offset = ftell( fp );
+		}
+		else
+			format = UnknownFormat;
+	}
+
+	fclose( fp );
+	if ( w <= 0 || h <= 0 )
+		return UnknownFormat;
+	return format;
+}
+
+void
+ImageTools::readImage( const char *fileName, int &w, int &h,
+					   vector<uchar> &buffer, int grayWidth, int grayHeight )
+{
+	FOCUS_TIMER( "ImageTools::readImage" );
+	long offset;
+	ImageFormat format = imageInfo( fileName, w, h, offset,
+									grayWidth, grayHeight );
+	if ( format == UnknownFormat )
+	{
+		fprintf( stderr, "Could not read image: %s\n", fileName );
+		exit( 1 );
+	}
+
+	if ( format == PngFormat )
+	{
+		if ( !readPng( fileName, w, h, buffer ) )
+		{
+			fprintf( stderr, "Could not decode: %s\n", fileName );
+			exit( 1 );
+		}
+		return;
+	}
+
+	buffer.resize( (size_t)w * h );
+	FILE *fp = fopen( fileName, "rb" );
+	if ( fp == NULL || fseek( fp, offset, SEEK_SET ) != 0 ||
+		 fread( &buffer[0], 1, buffer.size(), fp ) != buffer.size() )
+	{
+		fprintf( stderr, "Wrong number of bytes: %s\n", fileName );
+		exit( 1 );
+	}
+	fclose( fp );
+}
+
+bool
+ImageTools::readPng( const char *fileName, int &w, int &h,
+					 vector<uchar> &buffer )
+{
+	FOCUS_TIMER( "ImageTools::readPng" );
+	vector<uchar> rgba;
+	unsigned pngW, pngH;
+	if ( lodepng::decode( rgba, pngW, pngH, fileName ) != 0 )
+		return false;
+
+	// Luma of the colors, which is the gray value itself for our
+	// (gray) images.
+	w = pngW;
+	h = pngH;
+	buffer.resize( (size_t)w * h );
+	colorToGray( &rgba[0], w, h, 4 * w, 4, false, &buffer[0] );
+	return true;
+}
+
+void
+ImageTools::colorToGray( const uchar *color, int w, int h, int stride,
+						 int bytesPerPixel, bool bgr, uchar *gray )
+{
+	int red = bgr ? 2 : 0;
+	int blue = bgr ? 0 : 2;
+	for (int y = 0; y < h; y++)
+	{
+		const uchar *p = color + (size_t)y * stride;
+		uchar *out = gray + (size_t)y * w;
+		for (int x = 0; x < w; x++, p += bytesPerPixel)
+			out[x] = ( 299 * p[red] + 587 * p[1] + 114 * p[blue] + 500 ) / 1000;
+	}
+}
+
+bool
+ImageTools::parseSize( const char *text, int &w, int &h )
+{
+	char end;
+	return sscanf( text, "%dx%d%c", &w, &h, &end ) == 2 && w > 0 && h > 0;
+}
+
 void
 ImageTools::saveGray( const char *fileName, int n, uchar *buffer )
 {
+	FOCUS_TIMER( "ImageTools::saveGray" );
 	FILE *fp;
     
 	fp = fopen( fileName, "w" );
@@ -58,6 +214,7 @@ void
 ImageTools::saveGrayPng( const char *fileName, uchar *buffer, 
 					     int width, int height )
 {
+	FOCUS_TIMER( "ImageTools::saveGrayPng" );
 	// Need to convert the gray values to RGBA for the jpeg image.
 	vector<uchar> pngImg(width * height * 4);
 	for (int y = 0; y < height; y++)
@@ -83,6 +240,7 @@ ImageTools::saveGrayPng( const char *fileName, uchar *buffer,
 void
 ImageTools::changeBrightness( float factor, int w, int h, uchar * buffer )
 {
+	FOCUS_TIMER( "ImageTools::changeBrightness" );
 	assert (factor >= -1.0f && factor <= 1.0f);
 
 	if ( factor < 0.0f )
@@ -112,8 +270,9 @@ ImageTools::changeBrightness( float factor, int w, int h, uchar * buffer )
 
 void
 ImageTools::addLowLight( float darkenFactor, float noiseFactor, 
-							  int w, int h, uchar * buffer )
+							  int w, int h, uchar * buffer, uint64_t seed )
 {
+	FOCUS_TIMER( "ImageTools::addLowLight" );
 	// I found experimentally (i.e., playing around in photoshop) that
 	// something that looks like low-light noise can be generated by
 	// first creating random noise where each of the 3 color channels (RGB)
@@ -124,40 +283,242 @@ ImageTools::addLowLight( float darkenFactor, float noiseFactor,
 	// parts.
 
 	vector<uchar> noise(w * h);
-	vector<uchar> blurredNoise(w * h);
+	lowLightNoise(w, h, seed, &noise[0]);
+	applyLowLight(darkenFactor, noiseFactor, w, h, &noise[0], buffer, buffer);
+}
+
+void
+ImageTools::lowLightNoise( int w, int h, uint64_t seed, uchar * blurredNoise )
+{
+	FOCUS_TIMER( "ImageTools::lowLightNoise" );
+	vector<uchar> noise(w * h);
 
-	// Generate noise as described above.
-	for (int i = 0; i < w * h; i++)
+	// Generate noise as described above. Pixel i uses three bits of the
+	// random word at index i, so rows can be generated in any order.
+	ThreadPool::global().parallelFor(0, h, [&](int y0, int y1)
 	{
-		noise[i] = 0;
-		if (rand() % 2 == 0) noise[i] += 255 / 3; // R
-		if (rand() % 2 == 0) noise[i] += 255 / 3; // G
-		if (rand() % 2 == 0) noise[i] += 255 / 3; // B
-	}
+		vector<uint32_t> words(w);
+		for (int y = y0; y < y1; y++)
+		{
+			randomWords(seed, (uint64_t)y * w, w, &words[0]);
+			for (int x = 0; x < w; x++)
+			{
+				uint32_t r = words[x];
+				noise[x + y * w] = 255 / 3 * ((r & 1) + ((r >> 1) & 1) +
+											  ((r >> 2) & 1));
+			}
+		}
+	});
 
-	ImageTools::gaussianBlur(1.0, w, h, &noise[0], &blurredNoise[0]);
+	ImageTools::gaussianBlur(1.0, w, h, &noise[0], blurredNoise);
+}
 
-	for (int y = 0; y < h; y++)
+void
+ImageTools::applyLowLight( float darkenFactor, float noiseFactor,
+						   int w, int h, const uchar * blurredNoise,
+						   const uchar * in, uchar * out )
+{
+	FOCUS_TIMER( "ImageTools::applyLowLight" );
+	ThreadPool::global().parallelFor(0, h, [&](int y0, int y1)
 	{
-		for (int x = 0; x < w; x++)
+		for (int y = y0; y < y1; y++)
 		{
-			float pixel = buffer[x + y * w];
-			pixel *= darkenFactor;
+			for (int x = 0; x < w; x++)
+			{
+				float pixel = in[x + y * w];
+				pixel *= darkenFactor;
 
-			// Want relativeNoiseFactor = noiseFactor *  1 when pixel = 0
-			// 	    relativeNoiseFactor = noiseFactor * .5 when pixel = 255
-			float relativeNoiseFactor = noiseFactor * (1.0f - pixel / 512.0f);
+				// Want relativeNoiseFactor = noiseFactor *  1 when pixel = 0
+				// 	    relativeNoiseFactor = noiseFactor * .5 when pixel = 255
+				float relativeNoiseFactor =
+					noiseFactor * (1.0f - pixel / 512.0f);
 
-			pixel = pixel * (1.0f - relativeNoiseFactor) + 
-				    noise[x + y * w] * relativeNoiseFactor;
+				pixel = pixel * (1.0f - relativeNoiseFactor) + 
+						blurredNoise[x + y * w] * relativeNoiseFactor;
+				out[x + y * w] = (uchar)min(255.0f, max(0.0f, pixel));
+			}
 		}
+	});
+}
+
+// Constants of Philox4x32, see "Parallel Random Numbers: As Easy as
+// 1, 2, 3" by Salmon et al.
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9;
+static const uint32_t PHILOX_W1 = 0xBB67AE85;
+static const int PHILOX_ROUNDS = 10;
+
+// Four words of random bits for one counter value.
+static void
+philoxBlock( uint64_t seed, uint64_t counter, uint32_t out[4] )
+{
+	uint32_t c0 = (uint32_t)counter, c1 = (uint32_t)(counter >> 32);
+	uint32_t c2 = 0, c3 = 0;
+	uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+
+	for (int r = 0; r < PHILOX_ROUNDS; r++)
+	{
+		uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+		uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+		c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		c1 = (uint32_t)p1;
+		c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c3 = (uint32_t)p0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+#ifdef __SSE2__
+// Same as philoxBlock for four consecutive counters at once. Each vector
+// holds one of the four words for the four counters.
+static void
+philoxBlocks4( uint64_t seed, uint64_t counter, uint32_t out[16] )
+{
+	__m128i c0 = _mm_set_epi32( (uint32_t)(counter + 3),
+		(uint32_t)(counter + 2), (uint32_t)(counter + 1), (uint32_t)counter );
+	__m128i c1 = _mm_set_epi32( (uint32_t)((counter + 3) >> 32),
+		(uint32_t)((counter + 2) >> 32), (uint32_t)((counter + 1) >> 32),
+		(uint32_t)(counter >> 32) );
+	__m128i c2 = _mm_setzero_si128();
+	__m128i c3 = _mm_setzero_si128();
+	uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+
+	const __m128i m0 = _mm_set1_epi32( PHILOX_M0 );
+	const __m128i m1 = _mm_set1_epi32( PHILOX_M1 );
+	const __m128i low = _mm_set_epi32( 0, -1, 0, -1 );
+	const __m128i high = _mm_set_epi32( -1, 0, -1, 0 );
+
+	for (int r = 0; r < PHILOX_ROUNDS; r++)
+	{
+		// 32x32 -> 64 bit products of the even and odd lanes.
+		__m128i p0even = _mm_mul_epu32( c0, m0 );
+		__m128i p0odd = _mm_mul_epu32( _mm_srli_epi64( c0, 32 ), m0 );
+		__m128i p1even = _mm_mul_epu32( c2, m1 );
+		__m128i p1odd = _mm_mul_epu32( _mm_srli_epi64( c2, 32 ), m1 );
+
+		__m128i lo0 = _mm_or_si128( _mm_and_si128( p0even, low ),
+									_mm_slli_epi64( p0odd, 32 ) );
+		__m128i hi0 = _mm_or_si128( _mm_srli_epi64( p0even, 32 ),
+									_mm_and_si128( p0odd, high ) );
+		__m128i lo1 = _mm_or_si128( _mm_and_si128( p1even, low ),
+									_mm_slli_epi64( p1odd, 32 ) );
+		__m128i hi1 = _mm_or_si128( _mm_srli_epi64( p1even, 32 ),
+									_mm_and_si128( p1odd, high ) );
+
+		c0 = _mm_xor_si128( _mm_xor_si128( hi1, c1 ), _mm_set1_epi32( k0 ) );
+		c1 = lo1;
+		c2 = _mm_xor_si128( _mm_xor_si128( hi0, c3 ), _mm_set1_epi32( k1 ) );
+		c3 = lo0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	// Transpose so that the words of each counter are consecutive.
+	__m128i t0 = _mm_unpacklo_epi32( c0, c1 );
+	__m128i t1 = _mm_unpacklo_epi32( c2, c3 );
+	__m128i t2 = _mm_unpackhi_epi32( c0, c1 );
+	__m128i t3 = _mm_unpackhi_epi32( c2, c3 );
+	_mm_storeu_si128( (__m128i *)(out + 0), _mm_unpacklo_epi64( t0, t1 ) );
+	_mm_storeu_si128( (__m128i *)(out + 4), _mm_unpackhi_epi64( t0, t1 ) );
+	_mm_storeu_si128( (__m128i *)(out + 8), _mm_unpacklo_epi64( t2, t3 ) );
+	_mm_storeu_si128( (__m128i *)(out + 12), _mm_unpackhi_epi64( t2, t3 ) );
+}
+#endif
+
+void
+ImageTools::randomWords( uint64_t seed, uint64_t first, int n, uint32_t *out )
+{
+	uint32_t block[4];
+	uint64_t index = first;
+	uint64_t end = first + n;
+
+	// Words before the first full block.
+	if ( index % 4 != 0 )
+	{
+		philoxBlock( seed, index / 4, block );
+		for (; index % 4 != 0 && index < end; index++)
+			*out++ = block[index % 4];
+	}
+
+#ifdef __SSE2__
+	for (; index + 16 <= end; index += 16, out += 16)
+		philoxBlocks4( seed, index / 4, out );
+#endif
+
+	for (; index + 4 <= end; index += 4, out += 4)
+		philoxBlock( seed, index / 4, out );
+
+	// Words after the last full block.
+	if ( index < end )
+	{
+		philoxBlock( seed, index / 4, block );
+		for (int i = 0; index < end; index++, i++)
+			*out++ = block[i];
+	}
+}
+
+float
+ImageTools::randomUniform( uint64_t seed, uint64_t index )
+{
+	uint32_t word;
+	randomWords( seed, index, 1, &word );
+	// Keep 24 bits so that the result fits exactly in a float.
+	return (word >> 8) * (1.0f / 16777216.0f);
+}
+
+// The name of a frame that its seed depends on : the name of its file and
+// of the folder of the file, whatever path led to it. Frames of a sweep
+// file keep their "#step".
+static string
+frameKey( const char *fileName )
+{
+	string name( fileName ), step;
+	char *path = realpath( name.c_str(), NULL );
+	size_t hash = name.rfind( '#' );
+	if ( path == NULL && hash != string::npos )
+	{
+		step = name.substr( hash );
+		name.erase( hash );
+		path = realpath( name.c_str(), NULL );
+	}
+	if ( path != NULL )
+	{
+		name = path;
+		free( path );
 	}
+
+	size_t slash = name.rfind( '/' );
+	if ( slash != string::npos && slash > 0 )
+		slash = name.rfind( '/', slash - 1 );
+	return (slash == string::npos ? name : name.substr( slash + 1 )) + step;
+}
+
+uint64_t
+ImageTools::frameSeed( uint64_t seed, const char *fileName )
+{
+	// FNV-1a hash of the frame's name, mixed with the base seed.
+	string key = frameKey( fileName );
+	uint64_t hash = 14695981039346656037ULL;
+	for (const char *c = key.c_str(); *c != '\0'; c++)
+	{
+		hash ^= (uchar)*c;
+		hash *= 1099511628211ULL;
+	}
+	return hash ^ (seed * 0x9E3779B97F4A7C15ULL);
 }
 
 void 
 ImageTools::crop( uchar*& image, int w, int h, int left, int right,
 				  int top, int bottom)
 {
+	FOCUS_TIMER( "ImageTools::crop" );
 	assert ( left < right && top < bottom );
 
 	int newW = right - left;
@@ -188,6 +549,7 @@ unsigned char *
 ImageTools::scaleCopy ( uchar *image, int w, int h, 
 	int newW, int newH, ScalingMethod method)
 {
+	FOCUS_TIMER( "ImageTools::scaleCopy" );
 	if ( method == NearestNeighbor )
 		return scaleNearestNeighbor( image, w, h, newW, newH );
 	else if ( method == Bilinear )
@@ -431,6 +793,7 @@ void
 ImageTools::gaussianBlur(float sigma, int w, int h,
 						 uchar * in, uchar * out)
 {
+	FOCUS_TIMER( "ImageTools::gaussianBlur" );
 	int filtersize = sigma * 3.0;
 
 	// The filter size should be odd.
@@ -442,33 +805,106 @@ ImageTools::gaussianBlur(float sigma, int w, int h,
 	int pad = filtersize / 2;
 
 	// Horizontal blur.
-	for (int y = 0; y < h; y++)
+	ThreadPool::global().parallelFor(0, h, [&](int y0, int y1)
 	{
-		for (int x = 0; x < w; x++)
+		for (int y = y0; y < y1; y++)
 		{
-			float sum = 0.0;
-			for (int i = 0; i < filtersize; i++)
+			for (int x = 0; x < w; x++)
 			{
-				int x2 = min(max(0, x + i - pad), w - 1);
-				sum += in[x2 + y * w] * filter[i];
+				float sum = 0.0;
+				for (int i = 0; i < filtersize; i++)
+				{
+					int x2 = min(max(0, x + i - pad), w - 1);
+					sum += in[x2 + y * w] * filter[i];
+				}
+				temp[x + y * w] = sum;
 			}
-			temp[x + y * w] = sum;
 		}
-	}
+	});
 
 	// Vertical blur.
-	for (int y = 0; y < h; y++)
+	ThreadPool::global().parallelFor(0, h, [&](int y0, int y1)
 	{
-		for (int x = 0; x < w; x++)
+		for (int y = y0; y < y1; y++)
 		{
-			float sum = 0.0;
-			for (int i = 0; i < filtersize; i++)
+			for (int x = 0; x < w; x++)
 			{
-
-				int y2 = min(max(0, y + i - pad), h - 1);
-				sum += temp[x + y2 * w] * filter[i];
+				float sum = 0.0;
+				for (int i = 0; i < filtersize; i++)
+				{
+
+					int y2 = min(max(0, y + i - pad), h - 1);
+					sum += temp[x + y2 * w] * filter[i];
+				}
+				out[x + y * w] = sum;
 			}
-			out[x + y * w] = sum;
 		}
+	});
+}
+
+// Exchange two values so that a <= b.
+static inline void
+sortPair( uchar &a, uchar &b )
+{
+	uchar smallest = min( a, b );
+	b = max( a, b );
+	a = smallest;
+}
+
+// Exchange network leaving the median of 9 values in p[4], with 19
+// comparisons instead of a sort.
+static const int medianNetwork[19][2] = {
+	{ 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 1 }, { 3, 4 }, { 6, 7 }, { 1, 2 },
+	{ 4, 5 }, { 7, 8 }, { 0, 3 }, { 5, 8 }, { 4, 7 }, { 3, 6 }, { 1, 4 },
+	{ 2, 5 }, { 4, 7 }, { 4, 2 }, { 6, 4 }, { 4, 2 }
+};
+
+void
+ImageTools::medianFilter( int w, int h, const uchar * in, uchar * out )
+{
+	FOCUS_TIMER( "ImageTools::medianFilter" );
+
+	// Images this small are all border.
+	if ( w < 3 || h < 3 )
+	{
+		if ( w > 0 && h > 0 )
+			memcpy( out, in, (size_t)w * h );
+		return;
 	}
-}
\ No newline at end of file
+
+	for (int x = 0; x < w; x++)
+	{
+		out[x] = in[x];
+		out[x + (h - 1) * w] = in[x + (h - 1) * w];
+	}
+
+	// The network is applied to whole rows at once: p[k] holds the k-th
+	// value of the window of every pixel in the row, so that each step is
+	// a min and a max over the row, which the compiler vectorizes.
+	ThreadPool::global().parallelFor(1, h - 1, [&](int y0, int y1)
+	{
+		int n = w - 2;
+		vector<uchar> rows( 9 * n );
+		uchar *p[9];
+		for (int k = 0; k < 9; k++)
+			p[k] = &rows[k * n];
+
+		for (int y = y0; y < y1; y++)
+		{
+			out[y * w] = in[y * w];
+			out[w - 1 + y * w] = in[w - 1 + y * w];
+			for (int dy = 0; dy < 3; dy++)
+				for (int dx = 0; dx < 3; dx++)
+					memcpy( p[dx + 3 * dy], in + dx + (y + dy - 1) * w, n );
+
+			for (int i = 0; i < 19; i++)
+			{
+				uchar * __restrict a = p[medianNetwork[i][0]];
+				uchar * __restrict b = p[medianNetwork[i][1]];
+				for (int x = 0; x < n; x++)
+					sortPair( a[x], b[x] );
+			}
+			memcpy( out + 1 + y * w, p[4], n );
+		}
+	});
+}
@@ -1,10 +1,22 @@
 #ifndef _ImageTools_H
 #define _ImageTools_H
 
+#include <stdint.h>
 #include <vector>
 
 typedef unsigned char uchar;
 
+/*
+ * Read-only access to an image of size (width, height) owned by someone
+ * else, e.g. a memory-mapped file. Pixel (x, y) is data[x + y * width].
+ */
+struct ImageView
+{
+	const uchar *data;
+	int width;
+	int height;
+};
+
 class ImageTools
 {
 public:
@@ -16,6 +28,62 @@ public:
 		AreaAverage
 	};
 
+	enum ImageFormat
+	{
+		UnknownFormat,
+		GrayFormat,
+		PgmFormat,
+		PngFormat
+	};
+
+	/*
+	 *  Size of the frames of our datasets. .gray files have no header, so
+	 *  they are read at this size unless a tool is told otherwise.
+	 */
+	static const int GrayWidth = 1056;
+	static const int GrayHeight = 704;
+
+	/*
+	 *  Find the format and size (w, h) of an image, and the offset of its
+	 *  pixels in the file. Binary PGM (P5, 8 bits) and PNG files have their
+	 *  size in their header; any other file is taken to be .gray of size
+	 *  (grayWidth, grayHeight). PNG pixels are compressed, so they have
+	 *  to be read with readImage. Returns UnknownFormat if the file can't
+	 *  be read.
+	 */
+	static ImageFormat imageInfo( const char *fileName, int &w, int &h,
+								  long &offset, int grayWidth = GrayWidth,
+								  int grayHeight = GrayHeight );
+
+	/*
+	 *  Read an image in any of the formats above, setting (w, h) and
+	 *  resizing buffer to match. Exits if the file can't be read.
+	 */
+	static void readImage( const char *fileName, int &w, int &h,
+						   std::vector<uchar> &buffer,
+						   int grayWidth = GrayWidth,
+						   int grayHeight = GrayHeight );
+
+	/*
+	 *  Decode a PNG file into gray values, setting (w, h). Returns false
+	 *  if it can't be decoded.
+	 */
+	static bool readPng( const char *fileName, int &w, int &h,
+						 std::vector<uchar> &buffer );
+
+	/*
+	 *  Gray values (luma) of a color image of size (w, h), whose rows
+	 *  are stride bytes apart and whose pixels are bytesPerPixel bytes
+	 *  apart, red first (blue first if bgr, e.g. Qt's 32-bit images).
+	 */
+	static void colorToGray( const uchar *color, int w, int h, int stride,
+							 int bytesPerPixel, bool bgr, uchar *gray );
+
+	/*
+	 *  Parse a size written WxH, e.g. 1056x704.
+	 */
+	static bool parseSize( const char *text, int &w, int &h );
+
 	/*
 	 *  Read the gray values from a file into buffer.
 	 */
@@ -61,9 +129,60 @@ public:
 
 	/*
 	 * Reduces the brightness of an image and add low-light noise.
+	 * The noise only depends on the seed, so the same seed always
+	 * gives the same image.
 	 */
 	static void addLowLight( float darkenFactor, float noiseFactor, 
-							  int w, int h, uchar * buffer );
+							  int w, int h, uchar * buffer,
+							  uint64_t seed = 0 );
+
+	/*
+	 * The two halves of addLowLight, for applying several darken/noise
+	 * factors to a frame without generating its noise again.
+	 * lowLightNoise creates the (blurred) noise of size (w, h) for a seed,
+	 * applyLowLight darkens in and mixes in the noise, storing into out
+	 * (which may be the same buffer as in).
+	 */
+	static void lowLightNoise( int w, int h, uint64_t seed, uchar * noise );
+	static void applyLowLight( float darkenFactor, float noiseFactor,
+							   int w, int h, const uchar * noise,
+							   const uchar * in, uchar * out );
+
+	/*
+	 * Applies gaussian blur on an image.
+	 */
+	static void gaussianBlur( float sigma, int w, int h,
+							  uchar * in, uchar * out );
+
+	/*
+	 * 3x3 median filter of an image of size (w, h). The pixels of the
+	 * border keep their values (all of them, if w or h is below 3).
+	 */
+	static void medianFilter( int w, int h, const uchar * in, uchar * out );
+
+	/*
+	 * Counter-based random numbers (Philox4x32-10). The word at a given
+	 * index only depends on the seed and on the index, so any range can be
+	 * generated on its own (e.g. by different threads) and the results are
+	 * identical from one run to the next.
+	 *
+	 * Fills out with the words at indices [first, first + n).
+	 */
+	static void randomWords( uint64_t seed, uint64_t first, int n,
+							 uint32_t *out );
+
+	/*
+	 * Uniform random value in [0, 1) at a given index.
+	 */
+	static float randomUniform( uint64_t seed, uint64_t index );
+
+	/*
+	 * Seed for a frame, derived from a base seed and the names of the
+	 * frame's file and folder (not the path it was given by), so that a
+	 * frame gets the same noise whatever files come with it and wherever
+	 * it is read from.
+	 */
+	static uint64_t frameSeed( uint64_t seed, const char *fileName );
 
 private:
 
@@ -87,10 +206,6 @@ private:
 
 	// Returns a filter representing the 1D gaussian with parameter sigma.
 	static std::vector<float> get1DGaussian(int filtersize, int sigma);
-
-	// Applies gaussian blur on an image.
-	static void gaussianBlur(float sigma, int w, int h,
-							 uchar * in, uchar * out);
 };
 
 #endif
\ No newline at end of file
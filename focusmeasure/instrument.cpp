@@ -0,0 +1,298 @@
+#include "instrument.h"
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+// Every stage and counter, never freed so that they can still be used
+// while the program exits.
+static mutex registryLock;
+static vector<Instrument::Stage *> *stages = NULL;
+static vector<Instrument::Counter *> *counters = NULL;
+
+// Label of what the current thread works on.
+static thread_local const string *currentLabel = NULL;
+
+// Buckets 0-7 hold 0-7 ns. After that, each power of 2 is split into 8
+// buckets : [8 << k, 9 << k), [9 << k, 10 << k) ... [15 << k, 16 << k).
+static int
+bucketOf( uint64_t ns )
+{
+	if ( ns < 8 )
+		return ns;
+	int octave = 63 - __builtin_clzll( ns );
+	return (octave - 2) * 8 + ((ns >> (octave - 3)) & 7);
+}
+
+static uint64_t
+bucketStart( int bucket )
+{
+	if ( bucket < 8 )
+		return bucket;
+	int octave = bucket / 8 + 2;
+	return (uint64_t)(8 + bucket % 8) << (octave - 3);
+}
+
+Instrument::Stage::Stage( const string &name )
+	: name( name ), count( 0 ), totalNs( 0 ), maxNs( 0 ),
+	  slowestThreshold( 0 )
+{
+	for (int i = 0; i < Buckets; i++)
+		counts[i] = 0;
+	for (int i = 0; i < Slowest; i++)
+		slowestNs[i] = 0;
+}
+
+void
+Instrument::Stage::add( uint64_t ns )
+{
+	counts[bucketOf( ns )].fetch_add( 1, memory_order_relaxed );
+	count.fetch_add( 1, memory_order_relaxed );
+	totalNs.fetch_add( ns, memory_order_relaxed );
+
+	uint64_t largest = maxNs.load( memory_order_relaxed );
+	while ( ns > largest &&
+			!maxNs.compare_exchange_weak( largest, ns,
+										  memory_order_relaxed ) )
+		;
+
+	if ( ns <= slowestThreshold.load( memory_order_relaxed ) )
+		return;
+
+	// Replace the fastest of the slowest runs.
+	lock_guard<mutex> guard( lock );
+	int fastest = min_element( slowestNs, slowestNs + Slowest ) - slowestNs;
+	if ( ns <= slowestNs[fastest] )
+		return;
+	slowestNs[fastest] = ns;
+	slowestLabel[fastest] = currentLabel != NULL ? *currentLabel : "";
+	slowestThreshold = *min_element( slowestNs, slowestNs + Slowest );
+}
+
+uint64_t
+Instrument::Stage::percentile( double p ) const
+{
+	uint64_t total = count.load();
+	if ( total == 0 )
+		return 0;
+
+	// The run of rank ceil(p * total), reported as the middle of its
+	// bucket, but never above the slowest run.
+	uint64_t rank = max( (uint64_t)1, (uint64_t)(p * total + 0.999999) );
+	uint64_t seen = 0;
+	for (int i = 0; i < Buckets; i++)
+	{
+		seen += counts[i].load();
+		if ( seen >= rank )
+		{
+			uint64_t start = bucketStart( i );
+			uint64_t end = i + 1 < Buckets ? bucketStart( i + 1 ) : start;
+			return min( (start + end) / 2, maxNs.load() );
+		}
+	}
+	return maxNs.load();
+}
+
+Instrument::ScopedLabel::ScopedLabel( const string &text )
+	: text( text ), previous( currentLabel )
+{
+	currentLabel = &this->text;
+}
+
+Instrument::ScopedLabel::~ScopedLabel()
+{
+	currentLabel = previous;
+}
+
+Instrument::Stage *
+Instrument::stage( const string &name )
+{
+	lock_guard<mutex> guard( registryLock );
+	registerReport();
+	for (size_t i = 0; i < stages->size(); i++)
+		if ( (*stages)[i]->name == name )
+			return (*stages)[i];
+	stages->push_back( new Stage( name ) );
+	return stages->back();
+}
+
+Instrument::Counter *
+Instrument::counter( const string &name )
+{
+	lock_guard<mutex> guard( registryLock );
+	registerReport();
+	for (size_t i = 0; i < counters->size(); i++)
+		if ( (*counters)[i]->name == name )
+			return (*counters)[i];
+	counters->push_back( new Counter( name ) );
+	return counters->back();
+}
+
+uint64_t
+Instrument::now()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Called with registryLock held.
+void
+Instrument::registerReport()
+{
+	if ( stages != NULL )
+		return;
+	stages = new vector<Stage *>();
+	counters = new vector<Counter *>();
+	atexit( report );
+}
+
+void
+Instrument::report()
+{
+	const char *profile = getenv( "FOCUS_PROFILE" );
+	if ( profile == NULL || *profile == 0 )
+		print( stderr );
+	else if ( strcmp( profile, "off" ) != 0 )
+	{
+		FILE *out = fopen( profile, "w" );
+		if ( out == NULL )
+		{
+			fprintf( stderr, "Could not create file: %s\n", profile );
+			return;
+		}
+		writeJson( out );
+		fclose( out );
+	}
+}
+
+// Stages that ran, by decreasing total time.
+static vector<Instrument::Stage *>
+sortedStages()
+{
+	vector<Instrument::Stage *> sorted;
+	if ( stages == NULL )
+		return sorted;
+	for (size_t i = 0; i < stages->size(); i++)
+		if ( (*stages)[i]->count > 0 )
+			sorted.push_back( (*stages)[i] );
+	sort( sorted.begin(), sorted.end(),
+		  []( Instrument::Stage *a, Instrument::Stage *b )
+		  { return a->totalNs > b->totalNs; } );
+	return sorted;
+}
+
+// The slowest runs of a stage that have a label, slowest first.
+static vector<pair<uint64_t, string> >
+slowestRuns( Instrument::Stage *s )
+{
+	lock_guard<mutex> guard( s->lock );
+	vector<pair<uint64_t, string> > slowest;
+	for (int i = 0; i < Instrument::Slowest; i++)
+		if ( s->slowestNs[i] > 0 && !s->slowestLabel[i].empty() )
+			slowest.push_back( make_pair( s->slowestNs[i],
+										  s->slowestLabel[i] ) );
+	sort( slowest.rbegin(), slowest.rend() );
+	return slowest;
+}
+
+void
+Instrument::print( FILE *out )
+{
+	lock_guard<mutex> guard( registryLock );
+	vector<Stage *> sorted = sortedStages();
+
+	fprintf( out, "%-36s %9s %11s %10s %10s %10s %10s %10s\n", "stage",
+			 "count", "total ms", "mean us", "p50 us", "p95 us", "p99 us",
+			 "max us" );
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		Stage *s = sorted[i];
+		fprintf( out, "%-36s %9llu %11.3f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+				 s->name.c_str(), (unsigned long long)s->count.load(),
+				 s->totalNs / 1e6, (double)s->totalNs / s->count / 1e3,
+				 s->percentile( 0.50 ) / 1e3, s->percentile( 0.95 ) / 1e3,
+				 s->percentile( 0.99 ) / 1e3, s->maxNs / 1e3 );
+	}
+
+	// The slowest labelled runs, which are the frames worth looking at.
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		Stage *s = sorted[i];
+		vector<pair<uint64_t, string> > slowest = slowestRuns( s );
+		if ( slowest.empty() )
+			continue;
+
+		fprintf( out, "slowest %s :", s->name.c_str() );
+		for (size_t j = 0; j < slowest.size(); j++)
+			fprintf( out, " %s (%.1f us)", slowest[j].second.c_str(),
+					 slowest[j].first / 1e3 );
+		fprintf( out, "\n" );
+	}
+
+	if ( counters != NULL )
+		for (size_t i = 0; i < counters->size(); i++)
+			fprintf( out, "%-36s %llu\n", (*counters)[i]->name.c_str(),
+					 (unsigned long long)(*counters)[i]->value.load() );
+}
+
+// JSON string, with the characters that need it escaped.
+static string
+quote( const string &text )
+{
+	string quoted = "\"";
+	for (size_t i = 0; i < text.length(); i++)
+	{
+		unsigned char c = text[i];
+		if ( c == '"' || c == '\\' )
+			quoted += '\\';
+		if ( c < 0x20 )
+		{
+			// Control characters, e.g. newlines in a file name.
+			char escaped[8];
+			snprintf( escaped, sizeof( escaped ), "\\u%04x", c );
+			quoted += escaped;
+		}
+		else
+			quoted += c;
+	}
+	return quoted + "\"";
+}
+
+void
+Instrument::writeJson( FILE *out )
+{
+	lock_guard<mutex> guard( registryLock );
+	vector<Stage *> sorted = sortedStages();
+
+	fprintf( out, "{\n  \"stages\": [\n" );
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		Stage *s = sorted[i];
+		fprintf( out, "    { \"name\": %s, \"count\": %llu, \"totalNs\": %llu, "
+				 "\"p50Ns\": %llu, \"p95Ns\": %llu, \"p99Ns\": %llu, "
+				 "\"maxNs\": %llu, \"slowest\": [", quote( s->name ).c_str(),
+				 (unsigned long long)s->count.load(),
+				 (unsigned long long)s->totalNs.load(),
+				 (unsigned long long)s->percentile( 0.50 ),
+				 (unsigned long long)s->percentile( 0.95 ),
+				 (unsigned long long)s->percentile( 0.99 ),
+				 (unsigned long long)s->maxNs.load() );
+
+		vector<pair<uint64_t, string> > slowest = slowestRuns( s );
+		for (size_t j = 0; j < slowest.size(); j++)
+			fprintf( out, "%s{ \"label\": %s, \"ns\": %llu }",
+					 j == 0 ? " " : ", ", quote( slowest[j].second ).c_str(),
+					 (unsigned long long)slowest[j].first );
+		fprintf( out, " ] }%s\n", i + 1 < sorted.size() ? "," : "" );
+	}
+
+	fprintf( out, "  ],\n  \"counters\": {" );
+	if ( counters != NULL )
+		for (size_t i = 0; i < counters->size(); i++)
+			fprintf( out, "%s\n    %s: %llu", i > 0 ? "," : "",
+					 quote( (*counters)[i]->name ).c_str(),
+					 (unsigned long long)(*counters)[i]->value.load() );
+	fprintf( out, "\n  }\n}\n" );
+}
@@ -0,0 +1,147 @@
+#ifndef _Instrument_H
+#define _Instrument_H
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*
+ * Scoped timers and counters for finding where the time of a run goes,
+ * compiled in only with -DFOCUS_INSTRUMENT (make DEFINEFLAGS=-DFOCUS_INSTRUMENT).
+ * Without it the macros below expand to nothing.
+ *
+ *   FOCUS_TIMER( "stage" )			times the rest of the enclosing scope
+ *   FOCUS_COUNT( "counter", n )	adds n to a counter
+ *   FOCUS_LABEL( text )			names what the current thread works on
+ *									(e.g. a frame) for the rest of the scope
+ *
+ * The durations of each stage go into a histogram with logarithmic buckets
+ * (12.5% wide), from which the p50/p95/p99 latencies are estimated. Each
+ * stage also keeps its slowest runs along with the label that was current
+ * when they ran, to find the frames that make up the tail.
+ *
+ * Timers and counters can be used from any thread. Counting and the
+ * histograms are atomic; only a run slower than the slowest kept so far
+ * takes the stage's lock, to record it with its label.
+ *
+ * The report is printed on stderr when the program exits. The environment
+ * variable FOCUS_PROFILE changes that : "off" disables it, any other value
+ * is the name of a file to write the report to as JSON.
+ */
+
+#ifdef FOCUS_INSTRUMENT
+
+#define FOCUS_CONCAT2( a, b ) a##b
+#define FOCUS_CONCAT( a, b ) FOCUS_CONCAT2( a, b )
+
+#define FOCUS_TIMER( name ) \
+	static Instrument::Stage *FOCUS_CONCAT( focusStage, __LINE__ ) = \
+		Instrument::stage( name ); \
+	Instrument::ScopedTimer FOCUS_CONCAT( focusTimer, __LINE__ )( \
+		FOCUS_CONCAT( focusStage, __LINE__ ) )
+
+#define FOCUS_COUNT( name, amount ) \
+	do { \
+		static Instrument::Counter *focusCounter = \
+			Instrument::counter( name ); \
+		focusCounter->value += (amount); \
+	} while ( 0 )
+
+#define FOCUS_LABEL( text ) \
+	Instrument::ScopedLabel FOCUS_CONCAT( focusLabel, __LINE__ )( text )
+
+#else
+
+#define FOCUS_TIMER( name ) do { } while ( 0 )
+#define FOCUS_COUNT( name, amount ) do { } while ( 0 )
+#define FOCUS_LABEL( text ) do { } while ( 0 )
+
+#endif
+
+class Instrument
+{
+public:
+	static const int Buckets = 496;
+	static const int Slowest = 5;
+
+	struct Stage
+	{
+		std::string name;
+		std::atomic<uint64_t> counts[Buckets];
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> totalNs;
+		std::atomic<uint64_t> maxNs;
+
+		// The slowest runs, updated under lock only when a run is slower
+		// than the fastest of them (slowestThreshold).
+		std::mutex lock;
+		std::atomic<uint64_t> slowestThreshold;
+		uint64_t slowestNs[Slowest];
+		std::string slowestLabel[Slowest];
+
+		Stage( const std::string &name );
+		void add( uint64_t ns );
+
+		/*
+		 * Estimated duration below which a fraction p of the runs fall.
+		 */
+		uint64_t percentile( double p ) const;
+	};
+
+	struct Counter
+	{
+		std::string name;
+		std::atomic<uint64_t> value;
+
+		Counter( const std::string &name ) : name( name ), value( 0 ) {}
+	};
+
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer( Stage *stage ) : stage( stage ), start( now() ) {}
+		~ScopedTimer() { stage->add( now() - start ); }
+
+	private:
+		Stage *stage;
+		uint64_t start;
+	};
+
+	class ScopedLabel
+	{
+	public:
+		ScopedLabel( const std::string &text );
+		~ScopedLabel();
+
+	private:
+		std::string text;
+		const std::string *previous;
+	};
+
+	/*
+	 * The stage or counter of a given name, created the first time.
+	 * They live until the program exits.
+	 */
+	static Stage * stage( const std::string &name );
+	static Counter * counter( const std::string &name );
+
+	/*
+	 * Monotonic time in nanoseconds.
+	 */
+	static uint64_t now();
+
+	/*
+	 * Write the report as a table sorted by total time, or as JSON.
+	 */
+	static void print( FILE *out );
+	static void writeJson( FILE *out );
+
+private:
+	static void registerReport();
+	static void report();
+};
+
+#endif
@@ -3,60 +3,484 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "boundedQueue.h"
+#include "curveQuality.h"
+#include "curveStore.h"
+#include "focusCache.h"
 #include "focusMeasure.h"
+#include "frameReader.h"
 #include "imageTools.h"
-
-#define DEFAULT_WIDTH 1056
-#define DEFAULT_HEIGHT 704
-
-// Leaving only a fifth of the width and a third
-// of the height approximate Canon's AF window.
-#define CROP_FACTOR_X 5
-#define CROP_FACTOR_Y 3
+#include "instrument.h"
+#include "preprocess.h"
+#include "threadPool.h"
 
 using namespace std;
 
 void print_usage()
 {
-    cerr << "Usage: apply measure [OPTIONS] [FILES]" << endl;
-    cerr << "\t measure -- focus measure to apply to image (0-33) " << endl;
+    cerr << "Usage: apply measures [OPTIONS] [FILES or FOLDERS]" << endl;
+    cerr << "\t measures -- focus measure to apply to image (0-33), a comma" << endl;
+    cerr << "\t     separated list of measures, or all" << endl;
+    cerr << "\t FILES can be .gray, .pgm or .png images, or sweep files" << endl;
+    cerr << "\t     (see makesweep)" << endl;
     cerr << "\t Valid options include :" << endl;
+    cerr << "\t --size=WxH : size of the .gray files (default 1056x704)" << endl;
     cerr << "\t --scalehalf : reduce each dimension of the image by 1/2" << endl;
+    cerr << "\t --pyramid-level=N : measure on level N of a gaussian pyramid" << endl;
+    cerr << "\t     (each level halves the dimensions after low-pass filtering)." << endl;
+    cerr << "\t     A comma separated list of levels measures each of them, from" << endl;
+    cerr << "\t     one pyramid per frame, in columns named measure@level." << endl;
     cerr << "\t --crop : keep only a small center portion of the image" << endl;
     cerr << "\t --varylight : randomly uniformly darken/brighten image at each step" << endl;
+    cerr << "\t --seed=N : seed of the random numbers used by --varylight" << endl;
     cerr << "\t --raw : output the raw (non-normalized) the data" << endl;
     cerr << "\t --norm-and-raw : output both raw and normalized data" << endl;
+    cerr << "\t --max-frames=N : number of frames read ahead and held in memory" << endl;
+    cerr << "\t --out=DIR : write one table per sweep to DIR/<sweep>.txt, where" << endl;
+    cerr << "\t     each folder and sweep file is a sweep, and so is each run" << endl;
+    cerr << "\t     of .gray files (named after their folder). Without it," << endl;
+    cerr << "\t     every frame is part of one table, printed on stdout." << endl;
+    cerr << "\t --store=FILE : write the curve of every sweep and measure, raw" << endl;
+    cerr << "\t     and normalized, to a curve store (see curveStore.h) instead" << endl;
+    cerr << "\t     of the tables, which are still written with --out." << endl;
+    cerr << "\t --maxima=FILE : maxima of the sweeps for --store (default those" << endl;
+    cerr << "\t     of --evaluate)" << endl;
+    cerr << "\t --cache=DIR : cache of focus values (default $FOCUS_CACHE, or" << endl;
+    cerr << "\t     ~/.cache/focusmeasure). Frames measured before with the same" << endl;
+    cerr << "\t     options are not measured again." << endl;
+    cerr << "\t --no-cache : don't use the cache" << endl;
+    cerr << "\t --cache-stats : print the cache hits and misses of the run" << endl;
+    cerr << "\t --evaluate=MAXIMA : instead of the tables, print the cost (time" << endl;
+    cerr << "\t     per frame) and curve quality of each measure, scoring the" << endl;
+    cerr << "\t     curve of each sweep against its maxima in MAXIMA (see" << endl;
+    cerr << "\t     afheuristics/maxima.txt). Tables are still written with --out." << endl;
+    cerr << "\t     Doesn't use the cache." << endl;
     exit(1);
 }
 
+// Frames [first, first + count) of the reader, output as one table.
+struct Sweep
+{
+    string name;
+    int first;
+    int count;
+    bool looseFiles;
+};
+
+// A frame once preprocessed, shared by every measure applied to it.
+struct PreparedFrame
+{
+    mutex lock;
+    bool loaded;        // set by the loader, under stateLock
+    ImageView view;
+    vector<uchar> pixels;   // the decoded frame, unless it is mapped
+    bool prepared;
+    int pending;        // columns not measured yet
+    ImagePyramid *pyramid;          // built once for all the levels
+    vector<PreparedLevel> levels;   // one per pyramid level measured
+
+    // Values found in the cache, and the ones computed to add to it : one
+    // key per level.
+    vector<FocusCache::Key> keys;
+    vector<double> cached;
+    vector<bool> found;
+    vector< vector< pair<int, double> > > computed;
+};
+
+vector<int> parse_measures( const string &list )
+{
+    vector<int> measures;
+    if (list == "all")
+    {
+        for (int m = 0; m < FocusMeasure::count(); m++)
+            measures.push_back(m);
+        return measures;
+    }
+
+    size_t start = 0;
+    while (start < list.length())
+    {
+        size_t end = list.find(',', start);
+        if (end == string::npos)
+            end = list.length();
+        string number = list.substr(start, end - start);
+        char *last;
+        int m = strtol(number.c_str(), &last, 10);
+        if (number.empty() || *last != '\0' || m < 0 ||
+            m >= FocusMeasure::count())
+            print_usage();
+        measures.push_back(m);
+        start = end + 1;
+    }
+    if (measures.empty())
+        print_usage();
+    return measures;
+}
+
+// Pyramid levels of --pyramid-level, all different.
+vector<int> parse_levels( const string &list )
+{
+    vector<int> levels;
+    size_t start = 0;
+    while (start <= list.length())
+    {
+        size_t end = list.find(',', start);
+        if (end == string::npos)
+            end = list.length();
+        string number = list.substr(start, end - start);
+        char *last;
+        int level = strtol(number.c_str(), &last, 10);
+        if (number.empty() || *last != '\0' || level < 0 ||
+            find(levels.begin(), levels.end(), level) != levels.end())
+            print_usage();
+        levels.push_back(level);
+        start = end + 1;
+    }
+    return levels;
+}
+
+// Last component of a path, without trailing slashes or extension.
+string base_name( string path, const string &extension )
+{
+    while (path.length() > 1 && path[path.length() - 1] == '/')
+        path.erase(path.length() - 1);
+    size_t slash = path.rfind('/');
+    if (slash != string::npos)
+        path = path.substr(slash + 1);
+    if (path.length() > extension.length() &&
+        path.compare(path.length() - extension.length(),
+                     extension.length(), extension) == 0)
+        path.erase(path.length() - extension.length());
+    return path;
+}
+
+/*
+ *  Print the table of a sweep : one row per frame, with the values of
+ *  each measure (raw, normalized or both).
+ */
+void print_table( FILE *out, const Sweep &sweep, const vector<string> &names,
+                  const vector<double> &values, bool printRaw,
+                  bool printRawAndNorm )
+{
+    int measureCount = names.size();
+    vector<double> min(measureCount, HUGE_VAL);
+    vector<double> max(measureCount, 0);
+    for (int i = sweep.first; i < sweep.first + sweep.count; i++)
+        for (int m = 0; m < measureCount; m++)
+        {
+            double v = values[i * measureCount + m];
+            if( max[m] < v ) {
+                max[m] = v;
+            }
+            if( min[m] > v ) {
+                min[m] = v;
+            }
+        }
+
+    if (measureCount > 1)
+    {
+        fprintf( out, "# frame" );
+        for (int m = 0; m < measureCount; m++)
+            fprintf( out, " %s", names[m].c_str() );
+        fprintf( out, "\n" );
+    }
+
+    for (int i = 0; i < sweep.count; i++)
+    {
+        fprintf( out, "%d", i );
+        for (int m = 0; m < measureCount; m++)
+        {
+            double v = values[(sweep.first + i) * measureCount + m];
+            if (printRaw)
+                /*
+                 *  Raw focus measure.
+                 */
+                fprintf( out, " %0.0f", v );
+            else if (printRawAndNorm)
+                /*
+                 *  Both raw and normalized focus measure.
+                 */
+                fprintf( out, " %0.0f %0.5f", v,
+                    (v - min[m])/(double)(max[m] - min[m]) );
+            else
+                /*
+                 *  Normalized focus measure.
+                 */
+                fprintf( out, " %0.5f", (v - min[m])/(double)(max[m] - min[m]) );
+        }
+        fprintf( out, "\n" );
+    }
+}
+
+/*
+ *  Print the table of a sweep to outFolder/<sweep>.txt, or to stdout if no
+ *  folder is given.
+ */
+void write_sweep( const string &outFolder, const Sweep &sweep,
+                  const vector<string> &names, const vector<double> &values,
+                  bool printRaw, bool printRawAndNorm )
+{
+    FOCUS_TIMER( "apply/write" );
+    if (outFolder.empty())
+    {
+        print_table( stdout, sweep, names, values, printRaw,
+                     printRawAndNorm );
+        return;
+    }
+
+    string fileName = outFolder + "/" + sweep.name + ".txt";
+    FILE *out = fopen( fileName.c_str(), "w" );
+    if (out == NULL)
+    {
+        cerr << "Could not create file: " << fileName << endl;
+        exit(1);
+    }
+    print_table( out, sweep, names, values, printRaw, printRawAndNorm );
+    fclose( out );
+}
+
+/*
+ *  Add the curve of every sweep, for every measure, to a curve store, with
+ *  the maxima of the sweep if they are known.
+ */
+void store_sweeps( CurveStoreWriter &store, const vector<Sweep> &sweeps,
+                   const vector<int> &measures, const vector<double> &values,
+                   const map<string, vector<int> > &maxima )
+{
+    FOCUS_TIMER( "apply/store" );
+    int measureCount = measures.size();
+    vector<int> none;
+    vector<double> curve;
+    for (size_t s = 0; s < sweeps.size(); s++)
+    {
+        const Sweep &sweep = sweeps[s];
+        map<string, vector<int> >::const_iterator found =
+            maxima.find( sweep.name + ".txt" );
+        for (int m = 0; m < measureCount; m++)
+        {
+            curve.resize( sweep.count );
+            for (int i = 0; i < sweep.count; i++)
+                curve[i] = values[(sweep.first + i) * measureCount + m];
+            if (!store.addCurve( sweep.name, measures[m], curve.data(),
+                                 sweep.count, found == maxima.end() ?
+                                 none : found->second ))
+            {
+                cerr << store.error() << endl;
+                exit(1);
+            }
+        }
+    }
+    if (!store.close())
+    {
+        cerr << store.error() << endl;
+        exit(1);
+    }
+}
+
+/*
+ *  Print, for each measure, its time per frame and the quality of its
+ *  curves against the true maxima of each sweep, averaged over the sweeps.
+ *  A measure is on the Pareto front if no other measure is at least as
+ *  fast and at least as good on every quality statistic (and better on
+ *  one of them).
+ */
+void print_evaluation( const vector<Sweep> &sweeps, const vector<int> &measures,
+                       const vector<string> &names,
+                       const vector<double> &values, const vector<double> &times,
+                       const map<string, vector<int> > &maxima )
+{
+    struct Row
+    {
+        int measure;
+        const char *name;
+        double timeUs;
+        int scored;
+        double peakError;
+        double hits;
+        double spurious;
+        double missed;
+        double monotonicity;
+        double width;
+        bool pareto;
+    };
+
+    int measureCount = measures.size();
+    int frameCount = values.size() / std::max( 1, measureCount );
+    vector<Row> rows( measureCount );
+    for (int m = 0; m < measureCount; m++)
+    {
+        Row &row = rows[m];
+        memset( &row, 0, sizeof( row ) );
+        row.measure = measures[m];
+        row.name = names[m].c_str();
+        for (int i = 0; i < frameCount; i++)
+            row.timeUs += times[i * measureCount + m] / 1e3;
+        row.timeUs /= std::max( 1, frameCount );
+    }
+
+    int scoredSweeps = 0;
+    vector<double> curve;
+    for (size_t s = 0; s < sweeps.size(); s++)
+    {
+        const Sweep &sweep = sweeps[s];
+        map<string, vector<int> >::const_iterator found =
+            maxima.find( sweep.name + ".txt" );
+        if (found == maxima.end() || sweep.count == 0)
+        {
+            cerr << "No maxima for " << sweep.name << ", not scored" << endl;
+            continue;
+        }
+        scoredSweeps++;
+
+        for (int m = 0; m < measureCount; m++)
+        {
+            curve.resize( sweep.count );
+            for (int i = 0; i < sweep.count; i++)
+                curve[i] = values[(sweep.first + i) * measureCount + m];
+            CurveScore score = CurveQuality::score( &curve[0], sweep.count,
+                                                    found->second );
+            Row &row = rows[m];
+            row.scored++;
+            row.peakError += score.peakError;
+            row.hits += score.peakError <= 1;
+            row.spurious += score.spurious;
+            row.missed += score.missed;
+            row.monotonicity += score.monotonicity;
+            row.width += score.width;
+        }
+    }
+
+    for (int m = 0; m < measureCount; m++)
+    {
+        Row &row = rows[m];
+        int n = std::max( 1, row.scored );
+        row.peakError /= n;
+        row.hits = 100 * row.hits / n;
+        row.spurious /= n;
+        row.missed /= n;
+        row.monotonicity /= n;
+        row.width /= n;
+    }
+
+    for (int a = 0; a < measureCount; a++)
+    {
+        rows[a].pareto = true;
+        for (int b = 0; b < measureCount && rows[a].pareto; b++)
+        {
+            const Row &x = rows[a];
+            const Row &y = rows[b];
+            bool asGood = y.timeUs <= x.timeUs && y.peakError <= x.peakError &&
+                y.spurious <= x.spurious && y.monotonicity >= x.monotonicity;
+            bool better = y.timeUs < x.timeUs || y.peakError < x.peakError ||
+                y.spurious < x.spurious || y.monotonicity > x.monotonicity;
+            if (b != a && asGood && better)
+                rows[a].pareto = false;
+        }
+    }
+
+    sort( rows.begin(), rows.end(), []( const Row &a, const Row &b )
+          { return a.timeUs < b.timeUs; } );
+
+    printf( "# %d frames, %d of %d sweeps scored against their maxima\n",
+            frameCount, scoredSweeps, (int)sweeps.size() );
+    printf( "# us/frame : mean time of the measure on one frame\n" );
+    printf( "# peak err : distance from the highest value to the nearest"
+            " true maximum\n" );
+    printf( "# hit %% : sweeps where that distance is at most 1\n" );
+    printf( "# spurious : local maxima more than 2 steps from a true maximum\n" );
+    printf( "# missed : true maxima with no local maximum within 2 steps\n" );
+    printf( "# monotonic : fraction of steps going towards the nearest"
+            " true maximum\n" );
+    printf( "# width : positions at half the peak height or above\n" );
+    printf( "# pareto : * if no measure is as fast and as good\n" );
+    printf( "%-3s %-22s %10s %9s %6s %9s %7s %10s %7s %6s\n", "id", "measure",
+            "us/frame", "peak err", "hit %", "spurious", "missed",
+            "monotonic", "width", "pareto" );
+    for (int m = 0; m < measureCount; m++)
+    {
+        const Row &row = rows[m];
+        printf( "%-3d %-22s %10.1f %9.2f %6.1f %9.2f %7.2f %10.3f %7.1f %6s\n",
+                row.measure, row.name, row.timeUs,
+                row.peakError, row.hits, row.spurious, row.missed,
+                row.monotonicity, row.width, row.pareto ? "*" : "" );
+    }
+}
+
 int
 main( int argc, char *argv[] )
 {
-    if ( argc <= 3 )
+    if ( argc <= 2 )
         print_usage();
 
-    int apply = atoi( argv[1] );
+    vector<int> measures = parse_measures( argv[1] );
+    vector<int> levels( 1, 0 );
 
     int optionsCount = 0;
-    bool optionScaleHalf = false;
-    bool optionCrop = false;
-    bool optionVaryLight = false;
+    PreprocessOptions options = { false, 0, false, false, 0 };
     bool printRaw = false;
     bool printRawAndNorm = false;
+    string outFolder;
+    string maximaFile;
+    string storeFile;
+    string storeMaximaFile;
+    string cacheFolder = FocusCache::defaultDirectory();
+    bool cacheStats = false;
+    int maxFrames = 0;
+    int grayWidth = ImageTools::GrayWidth;
+    int grayHeight = ImageTools::GrayHeight;
 
     for (int i = 2; i < argc; i++)
     {
         string option(argv[i]);
-        if (option == "--scalehalf")
-            optionScaleHalf = true;
+        if (option.compare(0, 7, "--size=") == 0)
+        {
+            if (!ImageTools::parseSize(option.c_str() + 7, grayWidth,
+                                       grayHeight))
+                print_usage();
+        }
+        else if (option == "--scalehalf")
+            options.scaleHalf = true;
+        else if (option.compare(0, 16, "--pyramid-level=") == 0)
+            levels = parse_levels(option.substr(16));
         else if (option == "--crop")
-            optionCrop = true;
+            options.crop = true;
         else if (option == "--varylight")
-            optionVaryLight = true;
+            options.varyLight = true;
+        else if (option.compare(0, 7, "--seed=") == 0)
+            options.seed = strtoull(option.c_str() + 7, NULL, 10);
         else if (option == "--raw")
             printRaw = true;
         else if (option == "--norm-and-raw")
             printRawAndNorm = true;
+        else if (option.compare(0, 13, "--max-frames=") == 0)
+        {
+            maxFrames = atoi(option.c_str() + 13);
+            if (maxFrames <= 0)
+                print_usage();
+        }
+        else if (option.compare(0, 6, "--out=") == 0)
+            outFolder = option.substr(6);
+        else if (option.compare(0, 11, "--evaluate=") == 0)
+            maximaFile = option.substr(11);
+        else if (option.compare(0, 8, "--store=") == 0)
+            storeFile = option.substr(8);
+        else if (option.compare(0, 9, "--maxima=") == 0)
+            storeMaximaFile = option.substr(9);
+        else if (option.compare(0, 8, "--cache=") == 0)
+            cacheFolder = option.substr(8);
+        else if (option == "--no-cache")
+            cacheFolder.clear();
+        else if (option == "--cache-stats")
+            cacheStats = true;
         else if (option[0] == '-' && option[1] == '-')
             // This option isn't recognized.
             print_usage();
@@ -67,123 +491,418 @@ main( int argc, char *argv[] )
         optionsCount++;
     }
 
-    double measure[argc];
+    // Folders are replaced by the .gray files they contain, sweep files
+    // by their frames.
+    // Frames are brought into memory by the loader below, not by the reader.
+    // The reader isn't thread safe : every call to it holds readerLock.
+    FrameReader reader( 0 );
+    reader.setGraySize( grayWidth, grayHeight );
+    vector<Sweep> sweeps;
+    for( int i = 2 + optionsCount; i < argc; i++ )
+    {
+        struct stat info;
+        bool isFolder = stat( argv[i], &info ) == 0 && S_ISDIR( info.st_mode );
+        bool isSweep = !isFolder && SweepReader::isSweepFile( argv[i] );
+        int first = reader.frames();
+        bool added = isFolder ?
+            reader.addDirectory( argv[i] ) : reader.addFile( argv[i] );
+        if (!added)
+        {
+            cerr << reader.error() << endl;
+            exit(1);
+        }
+
+        bool looseFile = !isFolder && !isSweep;
+        if (looseFile && !sweeps.empty() && sweeps.back().looseFiles)
+        {
+            sweeps.back().count++;
+            continue;
+        }
 
-    FocusMeasure focus;
+        Sweep sweep;
+        string path( argv[i] );
+        if (isFolder)
+            sweep.name = base_name( path, "" );
+        else if (isSweep)
+            sweep.name = base_name( path, ".sweep" );
+        else
+            sweep.name = path.rfind('/') == string::npos ? "sweep" :
+                base_name( path.substr(0, path.rfind('/')), "" );
+        sweep.first = first;
+        sweep.count = reader.frames() - first;
+        sweep.looseFiles = looseFile;
+        sweeps.push_back( sweep );
+    }
 
-    double v = 0;
-    //double min = INT_MAX;
-    double min = HUGE_VAL;
-    double max = 0;
+    map<string, vector<int> > maxima;
+    if (!maximaFile.empty() &&
+        !CurveQuality::readMaxima( maximaFile, maxima ))
+    {
+        cerr << "No such file: " << maximaFile << endl;
+        exit(1);
+    }
+    map<string, vector<int> > storeMaxima;
+    if (!storeMaximaFile.empty() &&
+        !CurveQuality::readMaxima( storeMaximaFile, storeMaxima ))
+    {
+        cerr << "No such file: " << storeMaximaFile << endl;
+        exit(1);
+    }
+    else if (storeMaximaFile.empty())
+        storeMaxima = maxima;
 
-    for( int i = 2 + optionsCount; i < argc; i++ )
+    // Evaluating measures their time, which the cache would hide. A cache
+    // that can't be created only means that everything is measured.
+    FocusCache cache;
+    if (!cacheFolder.empty() && maximaFile.empty() &&
+        !cache.open( cacheFolder ))
+        cerr << cache.error() << ", not using the cache" << endl;
+
+    // When evaluating or storing, the tables are only written to a folder.
+    bool writeTables = (maximaFile.empty() && storeFile.empty()) ||
+        !outFolder.empty();
+
+    int fileCount = reader.frames();
+    if (outFolder.empty() && maximaFile.empty() && storeFile.empty())
+    {
+        // Everything is one table, as if the frames were one sweep.
+        sweeps.resize(1);
+        sweeps[0].first = 0;
+        sweeps[0].count = fileCount;
+    }
+    else if (!outFolder.empty() || !storeFile.empty())
+        for (size_t s = 0; s < sweeps.size(); s++)
+            for (size_t t = 0; t < s; t++)
+                if (sweeps[s].name == sweeps[t].name)
+                {
+                    if (!outFolder.empty())
+                        cerr << "Two sweeps would be written to " << outFolder
+                             << "/" << sweeps[s].name << ".txt" << endl;
+                    else
+                        cerr << "Two sweeps would be stored as "
+                             << sweeps[s].name << " in " << storeFile << endl;
+                    exit(1);
+                }
+
+    // Curves are stored by sweep and measure, for a single level.
+    if (!storeFile.empty() && levels.size() > 1)
+    {
+        cerr << "--store takes a single pyramid level" << endl;
+        exit(1);
+    }
+
+    // The store is written once every sweep is measured.
+    CurveStoreWriter store;
+    if (!storeFile.empty() && !store.open( storeFile ))
+    {
+        cerr << store.error() << endl;
+        exit(1);
+    }
+
+    /*
+     *  The frames go through a pipeline of three stages :
+     *  - a loader thread reads the frames from disk, keeping at most
+     *    maxFrames of them in memory,
+     *  - the thread pool preprocesses and measures them as they arrive,
+     *  - a writer thread writes each sweep as soon as all its frames are
+     *    measured.
+     */
+    int threads = ThreadPool::global().size();
+    if (maxFrames == 0)
+        maxFrames = 3 * std::max( 8, 2 * threads );
+
+    // A column of values per level and measure, named after both when
+    // there are several levels.
+    int measureCount = measures.size();
+    int levelCount = levels.size();
+    int columnCount = levelCount * measureCount;
+    vector<int> columnMeasures;
+    vector<string> names;
+    for (int k = 0; k < levelCount; k++)
+        for (int m = 0; m < measureCount; m++)
+        {
+            char level[16];
+            snprintf( level, sizeof( level ), "@%d", levels[k] );
+            columnMeasures.push_back( measures[m] );
+            names.push_back( string( FocusMeasure::name( measures[m] ) ) +
+                             (levelCount > 1 ? level : "") );
+        }
+
+    vector<double> values(fileCount * columnCount);
+    vector<double> times(fileCount * columnCount);      // in ns
+    vector<PreparedFrame> frames(fileCount);
+    for (int i = 0; i < fileCount; i++)
+    {
+        frames[i].loaded = false;
+        frames[i].prepared = false;
+        frames[i].pending = columnCount;
+        frames[i].pyramid = NULL;
+    }
+
+    // Frames of each sweep still to measure.
+    vector<int> sweepOf(fileCount);
+    vector<int> unmeasured(sweeps.size());
+    for (size_t s = 0; s < sweeps.size(); s++)
+    {
+        unmeasured[s] = sweeps[s].count;
+        for (int i = sweeps[s].first; i < sweeps[s].first + sweeps[s].count; i++)
+            sweepOf[i] = s;
+    }
+
+    if (!outFolder.empty())
+        mkdir( outFolder.c_str(), 0755 );
+
+    // loaded, framesInMemory, unmeasured, failed and error change under
+    // stateLock, so that threads waiting on them are woken. readerLock
+    // is only held to map and release frames, never while decoding.
+    mutex readerLock;
+    mutex stateLock;
+    condition_variable stateChanged;
+    int framesInMemory = 0;
+    atomic<bool> failed( false );
+    string error;
+    auto fail = [&]( const string &message )
+    {
+        {
+            lock_guard<mutex> lock( stateLock );
+            if (!failed)
+                error = message;
+            failed = true;
+        }
+        stateChanged.notify_all();
+    };
+
+    thread loader( [&]
+    {
+        for (int i = 0; i < fileCount && !failed; i++)
+        {
+            {
+                unique_lock<mutex> lock( stateLock );
+                stateChanged.wait( lock, [&]
+                    { return framesInMemory < maxFrames || failed; } );
+            }
+
+            ImageView view;
+            {
+                FOCUS_LABEL( reader.fileName( i ) );
+                FOCUS_TIMER( "apply/load" );
+
+                // The reader is shared with the workers, which release
+                // frames. Decoding and reading the pixels from disk don't
+                // need it.
+                bool viewed;
+                string message;
+                if (reader.isMapped( i ))
+                {
+                    lock_guard<mutex> lock( readerLock );
+                    viewed = reader.frame( i, view );
+                    if (!viewed)
+                        message = reader.error();
+                }
+                else
+                    viewed = reader.decode( i, frames[i].pixels, view,
+                                            message );
+                if (!viewed)
+                {
+                    fail( message );
+                    break;
+                }
+                FrameReader::touch( view );
+            }
+
+            {
+                lock_guard<mutex> lock( stateLock );
+                frames[i].view = view;
+                frames[i].loaded = true;
+                framesInMemory++;
+            }
+            stateChanged.notify_all();
+        }
+    } );
+
+    // Sweeps measured, in the order they were finished.
+    BoundedQueue<int> measuredSweeps( 4 );
+    thread writer( [&]
+    {
+        int s;
+        while (measuredSweeps.pop( s ))
+            if (!failed)
+                write_sweep( outFolder, sweeps[s], names, values,
+                             printRaw, printRawAndNorm );
+    } );
+    for (size_t s = 0; s < sweeps.size() && writeTables; s++)
+        if (sweeps[s].count == 0)
+            measuredSweeps.push( s );
+
+    /*
+     *  Every (frame, column) pair is a task, and the whole run is a single
+     *  runTasks() call : a thread that runs out of tasks steals from the
+     *  others until the last frame, rather than until the end of a batch.
+     *  Tasks of a frame are next to each other, so that a thread mostly
+     *  works on one frame at a time, preprocesses it once and releases it
+     *  as soon as it is done. Frames are dealt to the threads in turn (the
+     *  tasks thread t starts with are those of frames t, t + threads,
+     *  t + 2 * threads...), so that the threads move through the frames
+     *  together, just behind the loader. The last frames of a block may
+     *  be past the end, their tasks do nothing.
+     */
+    int blockTasks = (fileCount + threads - 1) / threads * columnCount;
+    ThreadPool::global().runTasks( threads * blockTasks, [&]( int blockTask )
+    {
+        int i = blockTask % blockTasks / columnCount * threads +
+            blockTask / blockTasks;
+        int column = blockTask % columnCount;
+        int k = column / measureCount;
+        int m = column % measureCount;
+        int task = i * columnCount + column;
+        if (i >= fileCount)
+            return;
+        PreparedFrame &frame = frames[i];
+        {
+            unique_lock<mutex> lock( stateLock );
+            stateChanged.wait( lock, [&] { return frame.loaded || failed; } );
+        }
+        if (failed)
+            return;
+        FOCUS_LABEL( reader.fileName( i ) );
+
+        {
+            lock_guard<mutex> lock( frame.lock );
+            if (!frame.prepared)
+            {
+                const ImageView &view = frame.view;
+
+                // Levels whose values are all cached are not prepared.
+                frame.keys.resize( levelCount );
+                frame.cached.assign( columnCount, 0 );
+                frame.found.assign( columnCount, false );
+                frame.computed.resize( levelCount );
+                vector<int> needed, neededLevels;
+                for (int l = 0; l < levelCount; l++)
+                {
+                    int cached = 0;
+                    if (cache.isOpen())
+                    {
+                        PreprocessOptions levelOptions = options;
+                        levelOptions.pyramidLevel = levels[l];
+                        frame.keys[l] = FocusCache::frameKey( view.data,
+                            view.width, view.height,
+                            Preprocess::describe( levelOptions,
+                                                  reader.fileName( i ) ) );
+                        vector<double> values;
+                        vector<bool> found;
+                        cached = cache.lookup( frame.keys[l], measures,
+                                               values, found );
+                        copy( values.begin(), values.end(),
+                              frame.cached.begin() + l * measureCount );
+                        copy( found.begin(), found.end(),
+                              frame.found.begin() + l * measureCount );
+                    }
+                    if (cached < measureCount)
+                    {
+                        needed.push_back( l );
+                        neededLevels.push_back( levels[l] );
+                    }
+                }
+
+                PreparedLevel none = { NULL, 0, 0, false };
+                frame.levels.assign( levelCount, none );
+                if (!needed.empty())
+                {
+                    FOCUS_TIMER( "apply/prepare" );
+                    vector<PreparedLevel> prepared;
+                    frame.pyramid = new ImagePyramid( 1 );
+                    Preprocess::levels( view, reader.fileName( i ), options,
+                                        neededLevels, *frame.pyramid,
+                                        prepared );
+                    for (size_t n = 0; n < needed.size(); n++)
+                        frame.levels[needed[n]] = prepared[n];
+                }
+                frame.prepared = true;
+            }
+        }
+
+        if (frame.found[column])
+            values[task] = frame.cached[column];
+        else
+        {
+            FocusMeasure focus;
+            const PreparedLevel &level = frame.levels[k];
+            chrono::steady_clock::time_point start =
+                chrono::steady_clock::now();
+            values[task] = focus.apply( measures[m], level.buffer,
+                                        level.w, level.h );
+            times[task] = chrono::duration<double, nano>(
+                chrono::steady_clock::now() - start ).count();
+        }
+
+        {
+            lock_guard<mutex> lock( frame.lock );
+            if (!frame.found[column] && cache.isOpen())
+                frame.computed[k].push_back( make_pair( measures[m],
+                                                        values[task] ) );
+            if (--frame.pending > 0)
+                return;
+            for (int l = 0; l < levelCount; l++)
+            {
+                if (!frame.computed[l].empty())
+                    cache.store( frame.keys[l], frame.computed[l] );
+                if (frame.levels[l].ownsBuffer)
+                    delete [] frame.levels[l].buffer;
+            }
+            vector< vector< pair<int, double> > >().swap( frame.computed );
+            vector<PreparedLevel>().swap( frame.levels );
+            delete frame.pyramid;
+            frame.pyramid = NULL;
+            vector<uchar>().swap( frame.pixels );
+            if (reader.isMapped( i ))
+            {
+                lock_guard<mutex> readerGuard( readerLock );
+                reader.release( i );
+            }
+        }
+
+        // The last frame of its sweep hands the sweep to the writer.
+        int s = sweepOf[i];
+        bool measured;
+        {
+            lock_guard<mutex> lock( stateLock );
+            framesInMemory--;
+            measured = --unmeasured[s] == 0;
+        }
+        stateChanged.notify_all();
+        if (measured && writeTables)
+            measuredSweeps.push( s );
+    } );
+    loader.join();
+    measuredSweeps.close();
+    writer.join();
+
+    if (failed)
+    {
+        cerr << error << endl;
+        exit(1);
+    }
+
+    if (!storeFile.empty())
+        store_sweeps( store, sweeps, measures, values, storeMaxima );
+
+    if (cache.isOpen())
     {
-        uchar * buffer = new uchar[DEFAULT_WIDTH * DEFAULT_HEIGHT];
-        ImageTools::readGray( argv[i], DEFAULT_WIDTH * DEFAULT_HEIGHT, buffer );
-
-        int w = DEFAULT_WIDTH;
-        int h = DEFAULT_HEIGHT;
-
-        if (optionScaleHalf)
-        {
-            ImageTools::scale( buffer, w, h, w / 2, h / 2,
-                               ImageTools::NearestNeighbor );
-            w /= 2;
-            h /= 2;
-        }
-
-        if (optionCrop)
-        {
-            int left = (w - w / CROP_FACTOR_X) / 2;
-            int right = left + w / CROP_FACTOR_X;
-            int top = (h - h / CROP_FACTOR_Y) / 2;
-            int bottom = left + h / CROP_FACTOR_Y;
-            ImageTools::crop( buffer, w, h, left, right, top, bottom );
-            w = right - left;
-            h = bottom - top;
-        }
-
-        if (optionVaryLight)
-        {
-            // In an experimental setup, we found a case where the average
-            // pixel brightness for an outlier was 30% lower (and the median
-            // was 50% lower). So we use a factor that's between -0.3 and 0.3
-            float factor = (float)rand() / RAND_MAX * 0.6f - 0.3f;
-            ImageTools::changeBrightness( factor, w, h, buffer );
-        }
-        
-        switch( apply )
-        {
-            case  0: v = focus.firstorder3x3( buffer, w, h );   break;
-            case  1: v = focus.roberts3x3( buffer, w, h );      break;
-            case  2: v = focus.prewitt3x3( buffer, w, h );      break;
-            case  3: v = focus.scharr3x3( buffer, w, h );       break;
-            case  4: v = focus.sobel3x3( buffer, w, h );        break;
-            case  5: v = focus.sobel5x5( buffer, w, h );        break;
-            case  6: v = focus.laplacian3x3( buffer, w, h );    break;
-            case  7: v = focus.laplacian5x5( buffer, w, h );    break;
-            case  8: v = focus.sobel3x3so( buffer, w, h );      break;
-            case  9: v = focus.sobel5x5so( buffer, w, h );      break;
-            case 10: v = focus.brenner( buffer, w, h );         break;
-            case 11: v = focus.thresholdGradient( buffer, w, h ); break;
-            case 12: v = focus.squaredGradient( buffer, w, h );   break;
-            case 13: v = focus.MMHistogram( buffer, w, h );       break;
-            case 14: v = focus.rangeHistogram( buffer, w, h );    break;
-            case 15: v = focus.MGHistogram( buffer, w, h );       break;
-            case 16: v = focus.entropyHistogram( buffer, w, h );  break;
-            case 17: v = focus.th_cont( buffer, w, h );           break;
-            case 18: v = focus.num_pix( buffer, w, h );           break;
-            case 19: v = focus.power( buffer, w, h );             break;
-            case 20: v = focus.var( buffer, w, h );               break;
-            case 21: v = focus.nor_var( buffer, w, h );           break;
-            case 22: v = focus.vollath4( buffer, w, h );          break;
-            case 23: v = focus.vollath5( buffer, w, h );          break;
-            case 24: v = focus.autoCorrelation( buffer, w, h, 2 ); break;
-            case 25: v = focus.sobel3x3soCross( buffer, w, h );    break;
-            case 26: v = focus.sobel5x5soCross( buffer, w, h );    break;
-            case 27: v = focus.firstDerivGaussian( buffer, w, h ); break;
-            case 28: v = focus.LoG( buffer, w, h );                break;
-            case 29: v = focus.curvature( buffer, w, h );          break;
-            case 30: v = focus.firstDerivGaussian2( buffer, w, h ); break;
-            case 31: v = focus.firstDerivGaussian3( buffer, w, h ); break;
-            case 32: v = focus.LoG2( buffer, w, h ); break;
-            case 33: v = focus.LoG3( buffer, w, h ); break;
-        }
-
-        if( max < v ) {
-            max = v;
-        }
-        if( min > v ) {
-            min = v;
-        }
-
-        int fileIndex = i - 2 - optionsCount;
-        measure[fileIndex] = (double)v;
-
-        delete [] buffer;
-    }
-
-    int fileCount = argc - 2 - optionsCount;
-
-    if (printRaw)
-        /*
-         *  Raw focus measure.
-         */
-        for (int i = 0; i < fileCount; i++)
-            printf( "%d %0.0f\n", i, measure[i] );
-    else if (printRawAndNorm)
-        /*
-         *  Both raw and normalized focus measure.
-         */
-        for (int i = 0; i < fileCount; i++)
-            printf( "%d %0.0f %0.5f\n", i, measure[i], 
-                (measure[i] - min)/(double)(max - min) );
-    else
-        /*
-         *  Normalized focus measure.
-         */
-        for (int i = 0; i < fileCount; i++)
-            printf( "%d %0.5f\n", i, (measure[i] - min)/(double)(max - min) );
+        FocusCache::Stats run = cache.runStats();
+        if (run.stores > 0)
+            cache.evict( FocusCache::defaultSizeLimit() );
+        if (cacheStats)
+            cerr << "cache " << cache.directory() << " : " << run.hits
+                 << " hits, " << run.misses << " misses, " << run.stores
+                 << " stored, " << cache.runStats().evictions << " evicted"
+                 << endl;
+        cache.saveStats();
+    }
+
+    if (!maximaFile.empty())
+        print_evaluation( sweeps, columnMeasures, names, values, times,
+                          maxima );
 
     return( 0 );
 }
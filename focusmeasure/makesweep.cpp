@@ -0,0 +1,125 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+
+#include "frameReader.h"
+#include "sweepFile.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: makesweep [OPTIONS] output.sweep [FILES or FOLDERS]" << endl;
+    cerr << "\t Packs the frames of a sweep (.gray, .pgm or .png) into a single" << endl;
+    cerr << "\t file, in order. Every frame must have the same size." << endl;
+    cerr << "\t The lens step of each frame is its position in the sweep." << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --size=WxH : size of the .gray files (default 1056x704)" << endl;
+    cerr << "\t --compress : compress the frames (lossless)" << endl;
+    cerr << "\t --exposure=T : exposure time of the frames, in seconds" << endl;
+    cerr << "\t --iso=N : ISO speed of the frames" << endl;
+    exit(1);
+}
+
+int
+main( int argc, char *argv[] )
+{
+    bool compress = false;
+    int grayWidth = ImageTools::GrayWidth;
+    int grayHeight = ImageTools::GrayHeight;
+    SweepFrameInfo info;
+    info.lensStep = 0;
+    info.exposureTime = 0;
+    info.iso = 0;
+
+    int first = 1;
+    for (; first < argc; first++)
+    {
+        string option(argv[first]);
+        if (option.compare(0, 7, "--size=") == 0)
+        {
+            if (!ImageTools::parseSize(option.c_str() + 7, grayWidth,
+                                       grayHeight))
+                print_usage();
+        }
+        else if (option == "--compress")
+            compress = true;
+        else if (option.compare(0, 11, "--exposure=") == 0)
+            info.exposureTime = atof(option.c_str() + 11);
+        else if (option.compare(0, 6, "--iso=") == 0)
+            info.iso = atoi(option.c_str() + 6);
+        else if (option.compare(0, 2, "--") == 0)
+            // This option isn't recognized.
+            print_usage();
+        else
+            // The output file - we can stop reading options now.
+            break;
+    }
+
+    if (argc - first < 2)
+        print_usage();
+
+    FrameReader reader;
+    reader.setGraySize( grayWidth, grayHeight );
+    for (int i = first + 1; i < argc; i++)
+    {
+        struct stat fileInfo;
+        bool added = (stat( argv[i], &fileInfo ) == 0 &&
+                      S_ISDIR( fileInfo.st_mode )) ?
+            reader.addDirectory( argv[i] ) : reader.addFile( argv[i] );
+        if (!added)
+        {
+            cerr << reader.error() << endl;
+            exit(1);
+        }
+    }
+
+    if (reader.frames() == 0)
+    {
+        cerr << "No frames to pack" << endl;
+        exit(1);
+    }
+
+    // The sweep takes the size of its first frame.
+    int width = reader.width( 0 );
+    int height = reader.height( 0 );
+    for (int i = 1; i < reader.frames(); i++)
+        if (reader.width( i ) != width || reader.height( i ) != height)
+        {
+            cerr << "Wrong image size: " << reader.fileName( i ) << endl;
+            exit(1);
+        }
+
+    SweepWriter writer;
+    if (!writer.open( argv[first], width, height, compress ))
+    {
+        cerr << writer.error() << endl;
+        exit(1);
+    }
+
+    for (int i = 0; i < reader.frames(); i++)
+    {
+        ImageView view;
+        if (!reader.frame( i, view ))
+        {
+            cerr << reader.error() << endl;
+            exit(1);
+        }
+
+        info.lensStep = i;
+        if (!writer.addFrame( view.data, info ))
+        {
+            cerr << writer.error() << endl;
+            exit(1);
+        }
+        reader.release( i );
+    }
+
+    if (!writer.close())
+    {
+        cerr << writer.error() << endl;
+        exit(1);
+    }
+}
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "focusCache.h"
+
+using namespace std;
+
+void print_usage()
+{
+    cerr << "Usage: managecache [OPTIONS] command" << endl;
+    cerr << "\t Manages the cache of focus values used by apply." << endl;
+    cerr << "\t Commands :" << endl;
+    cerr << "\t stats : hits, misses and evictions so far, and the size of" << endl;
+    cerr << "\t     the cache" << endl;
+    cerr << "\t evict MB : remove the least recently used values until the" << endl;
+    cerr << "\t     cache is smaller than MB megabytes" << endl;
+    cerr << "\t clear : remove every value" << endl;
+    cerr << "\t Valid options include :" << endl;
+    cerr << "\t --cache=DIR : the cache (default $FOCUS_CACHE, or" << endl;
+    cerr << "\t     ~/.cache/focusmeasure)" << endl;
+    exit(1);
+}
+
+int
+main( int argc, char *argv[] )
+{
+    string folder = FocusCache::defaultDirectory();
+
+    int first = 1;
+    for (; first < argc; first++)
+    {
+        string option(argv[first]);
+        if (option.compare(0, 8, "--cache=") == 0)
+            folder = option.substr(8);
+        else if (option.compare(0, 2, "--") == 0)
+            // This option isn't recognized.
+            print_usage();
+        else
+            // The command - we can stop reading options now.
+            break;
+    }
+    if (first >= argc)
+        print_usage();
+    string command(argv[first]);
+
+    FocusCache cache;
+    if (folder.empty())
+    {
+        cerr << "The cache is off (FOCUS_CACHE=off)" << endl;
+        exit(1);
+    }
+    if (!cache.open( folder ))
+    {
+        cerr << cache.error() << endl;
+        exit(1);
+    }
+
+    if (command == "stats" && first + 1 == argc)
+    {
+        FocusCache::Stats stats;
+        cache.stats( stats );
+        uint64_t lookups = stats.hits + stats.misses;
+        printf( "cache      %s\n", cache.directory().c_str() );
+        printf( "files      %llu\n", (unsigned long long)stats.files );
+        printf( "size       %.1f MB (limit %.0f MB)\n",
+                stats.bytes / 1048576.0,
+                FocusCache::defaultSizeLimit() / 1048576.0 );
+        printf( "hits       %llu (%.1f%%)\n", (unsigned long long)stats.hits,
+                lookups > 0 ? 100.0 * stats.hits / lookups : 0.0 );
+        printf( "misses     %llu\n", (unsigned long long)stats.misses );
+        printf( "stores     %llu\n", (unsigned long long)stats.stores );
+        printf( "evictions  %llu\n", (unsigned long long)stats.evictions );
+    }
+    else if (command == "evict" && first + 2 == argc)
+    {
+        long long megabytes = atoll(argv[first + 1]);
+        if (megabytes < 0)
+            print_usage();
+        uint64_t removed = cache.evict( megabytes * 1048576ULL );
+        cache.saveStats();
+        printf( "%llu files removed\n", (unsigned long long)removed );
+    }
+    else if (command == "clear" && first + 1 == argc)
+    {
+        if (!cache.clear())
+        {
+            cerr << cache.error() << endl;
+            exit(1);
+        }
+    }
+    else
+        print_usage();
+
+    return( 0 );
+}
@@ -7,37 +7,14 @@
 #include <string>
 #include <iostream>
 
+#include "frameReader.h"
 #include "imageTools.h"
 
 using namespace std;
 
-int compute_median(unsigned char* buffer, int x, int y, int window_size)
+int compute_adaptive_median(unsigned char* buffer, int w, int h, int x, int y,
+                            int window_size)
 {
-    const int w = 1056;
-    const int h =  704;
-    const int n = w * h;
-
-    int k = x*w + y;
-    int start_delta = -window_size / 2;
-    int end_delta = window_size / 2;
-    int median_index = window_size * window_size / 2;
-    std::vector <int> window;
-
-    for (int x_delta = start_delta; x_delta <= end_delta; x_delta++) {
-      for (int y_delta = start_delta; y_delta <= end_delta; y_delta++) {
-        window.push_back(buffer[k + x_delta * w + y_delta]);
-      }
-    }
-    std::nth_element(window.begin(), window.begin() + median_index, window.end());
-
-    return window[median_index];
-}
-
-int compute_adaptive_median(unsigned char* buffer, int x, int y, int window_size)
-{
-    const int w = 1056;
-    const int h =  704;
-    const int n = w * h;
     int k = x*w + y;
     int this_val = buffer[k];
     int start_delta = -window_size / 2;
@@ -57,7 +34,7 @@ int compute_adaptive_median(unsigned char* buffer, int x, int y, int window_size
     if (window_med - window_min <= 0 || window_med - window_max >= 0) {
       if (x + start_delta - 1 >= 0 && y + start_delta - 1 >= 0 &&
           x + end_delta + 1 < h && y + end_delta + 1 < w && window_size < 10) {
-        return compute_adaptive_median(buffer, x, y, window_size + 2);
+        return compute_adaptive_median(buffer, w, h, x, y, window_size + 2);
       } else {
         return window_med;
       }
@@ -74,23 +51,23 @@ void print_usage(char* progname)
 {
     cerr << "Usage: " << progname << " [OPTIONS] [FILES]" << endl;
     cerr << "\t Valid options include --output-png --compute-median " << endl;
-    cerr << "\t --compute_adaptive_median" << endl;
+    cerr << "\t --compute_adaptive_median --size=WxH (size of .gray files," << endl;
+    cerr << "\t 1056x704 by default; other formats carry their own size)" << endl;
     exit(1);
 }
 
 int
 main( int argc, char *argv[] )
 {
-    // Default image sizes.
-    const int w = 1056;
-    const int h =  704;
-    const int n = w * h;
+    // Size of .gray files, which have no header.
+    int grayWidth = ImageTools::GrayWidth;
+    int grayHeight = ImageTools::GrayHeight;
 
     // Store input/output images.
-    unsigned char buffer[n], result[n];
+    vector<uchar> buffer, result;
 
-    // Function to process the image with.
-    int (*compute)(unsigned char*, int, int, int) = compute_median;
+    // Use the adaptive median rather than the plain 3x3 median.
+    bool adaptive = false;
 
     // Number of command-line options passed onto this program
     // (things that start with --)
@@ -101,11 +78,17 @@ main( int argc, char *argv[] )
     {
         string option(argv[i]);
         if (option == "--median")
-            compute = compute_median;
+            adaptive = false;
         else if (option == "--adaptive-median")
-            compute = compute_adaptive_median;
+            adaptive = true;
         else if (option == "--output-png")
             outputPNG = true;
+        else if (option.compare(0, 7, "--size=") == 0)
+        {
+            if (!ImageTools::parseSize(option.c_str() + 7, grayWidth,
+                                       grayHeight))
+                print_usage(argv[0]);
+        }
         else if (option[0] == '-' && option[1] == '-')
             // This option isn't recognized.
             print_usage(argv[0]);
@@ -116,28 +99,55 @@ main( int argc, char *argv[] )
         optionsCount++;
     }
 
-    // Process all files passed to this program.
+    // Process every frame of the files passed to this program (images,
+    // or the frames of sweep files); files that can't be read are skipped.
+    FrameReader reader;
+    reader.setGraySize(grayWidth, grayHeight);
+    int failed = 0;
     for (int i = 1 + optionsCount; i < argc; i++)
-    {
-        string inputFile(argv[i]);
-
-        ImageTools::readGray( inputFile.c_str(), n, buffer );
+        if (!reader.addFile(argv[i]))
+        {
+            cerr << reader.error() << endl;
+            failed++;
+        }
 
-        // TODO: Is this loop needed?
-        for (int i = 0; i < n; i++)
-            result[i] = buffer[i];
+    for (int f = 0; f < reader.frames(); f++)
+    {
+        string inputFile(reader.fileName(f));
 
-        for( int i = 1; i < h-1; i++ )
-            for( int j = 1; j < w-1; j++ )
-                result[i*w + j] = compute(buffer, i, j, 3);
+        ImageView view;
+        if (!reader.frame(f, view))
+        {
+            cerr << reader.error() << endl;
+            failed++;
+            continue;
+        }
+        int w = view.width;
+        int h = view.height;
+        int n = w * h;
+        buffer.assign(view.data, view.data + n);
+        reader.release(f);
+
+        // The border keeps its original values.
+        result = buffer;
+
+        if (adaptive)
+            for( int i = 1; i < h-1; i++ )
+                for( int j = 1; j < w-1; j++ )
+                    result[i*w + j] = compute_adaptive_median(&buffer[0], w, h,
+                                                              i, j, 3);
+        else
+            ImageTools::medianFilter( w, h, &buffer[0], &result[0] );
 
         string outputFile = inputFile + ".median";
-        ImageTools::saveGray( outputFile.c_str(), n, result );
+        ImageTools::saveGray( outputFile.c_str(), n, &result[0] );
 
         if (outputPNG)
         {
             string pngOutputFile = inputFile + ".png";
-            ImageTools::saveGrayPng( pngOutputFile.c_str(), result, w, h);
+            ImageTools::saveGrayPng( pngOutputFile.c_str(), &result[0], w, h);
         }
     }
+
+    return( failed > 0 ? 1 : 0 );
 }
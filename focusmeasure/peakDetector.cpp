@@ -0,0 +1,121 @@
+#include "peakDetector.h"
+
+// How much the smoothed curve must rise to a peak and fall after it.
+#define DELTA 0.01
+#define EPSILON 0.005
+
+PeakDetector::PeakDetector()
+{
+	reset();
+}
+
+void
+PeakDetector::reset()
+{
+	added = 0;
+	finished = false;
+	smoothedCount = 0;
+	candidate = -1;
+	highest = 0.0;
+	highestPositions.clear();
+	found.clear();
+}
+
+/*
+ * Whether the smoothed curve rose to a position, or fell after it, steeply
+ * enough : by height over length steps. last is the end of the curve on
+ * that side and next the position before it, -1 while unknown.
+ */
+static bool
+isSteep( int position, double height, int length, int last, int next )
+{
+	return position == last ||
+		(position == next && height > EPSILON) ||
+		(length > 3 && height > EPSILON) ||
+		height > DELTA;
+}
+
+void
+PeakDetector::add( double value )
+{
+	if ( finished )
+		return;
+
+	// A smoothed value needs the values on both sides of its position.
+	if ( added == 1 )
+		addSmoothed( (3.0 * raw[1] + value) / 4.0 );
+	else if ( added > 1 )
+		addSmoothed( (raw[0] + 2.0 * raw[1] + value) / 4.0 );
+	raw[0] = raw[1];
+	raw[1] = value;
+	added++;
+}
+
+void
+PeakDetector::addSmoothed( double s )
+{
+	int i = smoothedCount;
+
+	// A fall after the candidate, steep enough before the curve rises
+	// again. The end of the curve may still make it a peak (finish()).
+	if ( candidate >= 0 )
+	{
+		if ( s < previous )
+		{
+			if ( isSteep( candidate, candidateValue - s, i - candidate, -1, -1 ) )
+			{
+				found.push_back( candidate );
+				candidate = -1;
+			}
+		}
+		else
+			candidate = -1;
+	}
+
+	if ( i == 0 || !(s > previous) )
+	{
+		riseStart = i;
+		riseStartValue = s;
+	}
+	if ( isSteep( i, s - riseStartValue, i - riseStart, 0, 1 ) )
+	{
+		candidate = i;
+		candidateValue = s;
+	}
+
+	if ( highest < s )
+	{
+		highest = s;
+		highestPositions.clear();
+	}
+	if ( highest == s )
+		highestPositions.push_back( i );
+
+	previous = s;
+	smoothedCount++;
+}
+
+void
+PeakDetector::finish()
+{
+	if ( finished )
+		return;
+
+	if ( added == 1 )
+		addSmoothed( raw[1] );
+	else if ( added > 1 )
+		addSmoothed( (raw[0] + 3.0 * raw[1]) / 4.0 );
+	finished = true;
+
+	// The candidate fell until the end of the curve, or is the end.
+	int last = smoothedCount - 1;
+	if ( candidate >= 0 &&
+		 isSteep( candidate, candidateValue - previous, last - candidate,
+				  last, last - 1 ) )
+		found.push_back( candidate );
+	candidate = -1;
+
+	// Without peaks, the highest positions.
+	if ( found.empty() )
+		found = highestPositions;
+}
@@ -0,0 +1,74 @@
+#ifndef _PeakDetector_H
+#define _PeakDetector_H
+
+#include <vector>
+
+/*
+ * The local maxima of a focus curve, found as its values arrive, one lens
+ * position at a time. The peaks are those of afheuristics/localMax.cpp
+ * (and so of maxima.txt) : the values are smoothed by a weighted moving
+ * average, and a position is a peak if the smoothed curve rises to it and
+ * falls after it by more than delta = 0.01, or by more than epsilon =
+ * 0.005 over more than three steps or next to an end. Values are expected
+ * in [0, 1]. CurveQuality::localMaxima feeds it whole curves.
+ *
+ * A peak is known as soon as the curve fell enough after it, two positions
+ * after the fall at the earliest (smoothing looks one position ahead). The
+ * detector keeps a few values, not the curve, so curves can be of any
+ * length.
+ */
+class PeakDetector
+{
+public:
+	PeakDetector();
+
+	/*
+	 * Forget the curve, to start another one.
+	 */
+	void reset();
+
+	/*
+	 * Add the value of the next lens position.
+	 */
+	void add( double value );
+
+	/*
+	 * The curve is complete : decide on the peaks near its end. If the
+	 * curve has no peak, its highest positions (after smoothing) are the
+	 * peaks. No value may be added afterwards, until reset().
+	 */
+	void finish();
+
+	/*
+	 * Peaks found so far, in increasing order of position.
+	 */
+	const std::vector<int> & peaks() const { return found; }
+
+	/*
+	 * Values added since reset().
+	 */
+	int count() const { return added; }
+
+private:
+	void addSmoothed( double s );
+
+	int added;
+	double raw[2];				// the last two values added, latest last
+	bool finished;
+
+	int smoothedCount;
+	double previous;			// the latest smoothed value
+	int riseStart;				// start of the rise ending at the latest
+	double riseStartValue;		// smoothed value
+
+	// Position which rose enough, waiting for the curve to fall after it.
+	int candidate;				// -1 if none
+	double candidateValue;
+
+	double highest;				// highest smoothed value, and where
+	std::vector<int> highestPositions;
+
+	std::vector<int> found;
+};
+
+#endif
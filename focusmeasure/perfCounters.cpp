@@ -0,0 +1,232 @@
+#include "perfCounters.h"
+#include <errno.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+
+// Type and config of each counter, in the order of PerfCounters::Counter.
+static const struct
+{
+	uint32_t type;
+	uint64_t config;
+} counterEvents[PerfCounters::CounterCount] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+// Kernel ids of the threads of the process, the calling thread's first.
+static vector<int>
+processThreads()
+{
+	int self = syscall( SYS_gettid );
+	vector<int> threads( 1, self );
+	DIR *dir = opendir( "/proc/self/task" );
+	if ( dir == NULL )
+		return threads;
+	while ( dirent *entry = readdir( dir ) )
+	{
+		int thread = atoi( entry->d_name );
+		if ( thread > 0 && thread != self )
+			threads.push_back( thread );
+	}
+	closedir( dir );
+	return threads;
+}
+
+// A counter of a thread, in the group of leader (-1 to lead a new group,
+// disabled until started).
+static int
+openCounter( int counter, int thread, int leader )
+{
+	perf_event_attr attr;
+	memset( &attr, 0, sizeof( attr ) );
+	attr.size = sizeof( attr );
+	attr.type = counterEvents[counter].type;
+	attr.config = counterEvents[counter].config;
+	attr.disabled = leader < 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+		PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall( SYS_perf_event_open, &attr, thread, -1, leader, 0 );
+}
+
+PerfCounters::PerfCounters()
+	: opened( 0 )
+{
+	// The other threads get the counters the calling thread has.
+	vector<int> threads = processThreads();
+	for (size_t t = 0; t < threads.size(); t++)
+	{
+		int leader = -1;
+		for (int i = 0; i < CounterCount; i++)
+		{
+			int fd = -1;
+			if ( t == 0 || fds[i] >= 0 )
+				fd = openCounter( i, threads[t], leader );
+			if ( fd >= 0 && leader < 0 )
+				leader = fd;
+			if ( t == 0 && fd >= 0 )
+				opened++;
+			else if ( t == 0 && lastError.empty() )
+				lastError = string( "Could not open " ) + name( (Counter)i ) +
+					" counter (" + strerror( errno ) + ")";
+			fds.push_back( fd );
+		}
+		leaders.push_back( leader );
+	}
+	startTimes.assign( 2 * leaders.size(), 0 );
+}
+
+PerfCounters::~PerfCounters()
+{
+	for (size_t i = 0; i < fds.size(); i++)
+		if ( fds[i] >= 0 )
+			close( fds[i] );
+}
+
+// Read a group : the number of counters, the time enabled, the time
+// running, then the value of each counter.
+static bool
+readGroup( int leader, uint64_t data[3 + PerfCounters::CounterCount] )
+{
+	ssize_t size = read( leader, data,
+						 (3 + PerfCounters::CounterCount) * sizeof( uint64_t ) );
+	return size >= (ssize_t)(3 * sizeof( uint64_t )) &&
+		data[0] <= PerfCounters::CounterCount &&
+		size == (ssize_t)((3 + data[0]) * sizeof( uint64_t ));
+}
+
+void
+PerfCounters::start()
+{
+	// The times of a group add up from its opening, the counts from the
+	// last reset.
+	uint64_t data[3 + CounterCount];
+	for (size_t t = 0; t < leaders.size(); t++)
+		if ( leaders[t] >= 0 )
+		{
+			ioctl( leaders[t], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+			if ( readGroup( leaders[t], data ) )
+			{
+				startTimes[2 * t] = data[1];
+				startTimes[2 * t + 1] = data[2];
+			}
+		}
+	for (size_t t = 0; t < leaders.size(); t++)
+		if ( leaders[t] >= 0 )
+			ioctl( leaders[t], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+}
+
+void
+PerfCounters::stop()
+{
+	for (size_t t = 0; t < leaders.size(); t++)
+		if ( leaders[t] >= 0 )
+			ioctl( leaders[t], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP );
+}
+
+void
+PerfCounters::read( int64_t values[CounterCount] )
+{
+	double sums[CounterCount];
+	bool known[CounterCount];
+	for (int i = 0; i < CounterCount; i++)
+	{
+		sums[i] = 0;
+		known[i] = available( (Counter)i );
+	}
+
+	uint64_t data[3 + CounterCount];
+	for (size_t t = 0; t < leaders.size(); t++)
+	{
+		// A thread gone since the counters were opened counts nothing.
+		if ( leaders[t] < 0 )
+			continue;
+		const int *threadFds = &fds[t * CounterCount];
+		bool valid = readGroup( leaders[t], data );
+		uint64_t enabled = valid ? data[1] - startTimes[2 * t] : 0;
+		uint64_t running = valid ? data[2] - startTimes[2 * t + 1] : 0;
+		if ( !valid || (running == 0 && enabled > 0) )
+		{
+			// The group never got a slot on the PMU.
+			for (int i = 0; i < CounterCount; i++)
+				known[i] = false;
+			continue;
+		}
+		double scale = running < enabled ? (double)enabled / running : 1;
+
+		int member = 0;
+		for (int i = 0; i < CounterCount; i++)
+		{
+			if ( threadFds[i] < 0 )
+			{
+				known[i] = false;
+				continue;
+			}
+			if ( member < (int)data[0] )
+				sums[i] += data[3 + member] * scale;
+			member++;
+		}
+	}
+
+	for (int i = 0; i < CounterCount; i++)
+		values[i] = known[i] ? (int64_t)sums[i] : -1;
+}
+
+#else
+
+PerfCounters::PerfCounters()
+	: opened( 0 ), lastError( "Performance counters need Linux" )
+{
+}
+
+PerfCounters::~PerfCounters()
+{
+}
+
+void
+PerfCounters::start()
+{
+}
+
+void
+PerfCounters::stop()
+{
+}
+
+void
+PerfCounters::read( int64_t values[CounterCount] )
+{
+	for (int i = 0; i < CounterCount; i++)
+		values[i] = -1;
+}
+
+#endif
+
+const char *
+PerfCounters::name( Counter counter )
+{
+	static const char *names[CounterCount] = {
+		"cycles", "instructions", "L1-misses", "LLC-misses", "branch-misses"
+	};
+	return names[counter];
+}
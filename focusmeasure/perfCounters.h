@@ -0,0 +1,72 @@
+#ifndef _PerfCounters_H
+#define _PerfCounters_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Hardware performance counters (Linux perf_event_open) of the threads of
+ * the process : cycles, instructions, L1 data cache and last level cache
+ * read misses, and branch misses, summed over the threads.
+ *
+ * The counters of each thread are opened as one group, so that they all
+ * count over the same time and ratios of them (instructions per cycle)
+ * hold. Only the threads running when the counters are opened are
+ * counted : create them after the thread pool (ThreadPool::global()).
+ *
+ * Counters that can't be opened for the calling thread (no PMU in a
+ * virtual machine, counters forbidden by
+ * /proc/sys/kernel/perf_event_paranoid, another OS) are left out, and
+ * their values are reported as -1. When the kernel has to share the PMU
+ * with other groups, each thread's values are scaled by the fraction of
+ * the time its group was actually running; a thread that ran without its
+ * group ever getting the PMU makes every value -1.
+ */
+class PerfCounters
+{
+public:
+	enum Counter
+	{
+		Cycles,
+		Instructions,
+		L1Misses,
+		LLCMisses,
+		BranchMisses,
+		CounterCount
+	};
+
+	PerfCounters();
+	~PerfCounters();
+
+	/*
+	 * Whether at least one counter could be opened. If not, error()
+	 * tells why.
+	 */
+	bool available() const { return opened > 0; }
+	bool available( Counter counter ) const
+		{ return !fds.empty() && fds[counter] >= 0; }
+
+	static const char * name( Counter counter );
+
+	/*
+	 * Reset and start every counter, then stop them. read() returns the
+	 * counts between the last start() and stop().
+	 */
+	void start();
+	void stop();
+	void read( int64_t values[CounterCount] );
+
+	const std::string & error() const { return lastError; }
+
+private:
+	// CounterCount per thread, the calling thread's first; -1 if not open.
+	// The first open counter of a thread leads its group.
+	std::vector<int> fds;
+	std::vector<int> leaders;
+	std::vector<uint64_t> startTimes;	// enabled, running, per thread
+	int opened;
+	std::string lastError;
+};
+
+#endif
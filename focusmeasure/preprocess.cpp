@@ -0,0 +1,175 @@
+#include "preprocess.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#include "instrument.h"
+
+using namespace std;
+
+// Leaving only a fifth of the width and a third
+// of the height approximate Canon's AF window.
+#define CROP_FACTOR_X 5
+#define CROP_FACTOR_Y 3
+
+uchar *
+Preprocess::frame( const ImageView &view, const string &frameName,
+				   const PreprocessOptions &options, int &w, int &h,
+				   bool &ownsBuffer )
+{
+	ImagePyramid pyramid( 1 );
+	vector<PreparedLevel> prepared;
+	Preprocess::levels( view, frameName, options,
+						vector<int>( 1, options.pyramidLevel ), pyramid,
+						prepared );
+	w = prepared[0].w;
+	h = prepared[0].h;
+	ownsBuffer = prepared[0].ownsBuffer;
+
+	// The pyramid goes away with this call : copy the level out of it.
+	if ( !ownsBuffer && prepared[0].buffer != view.data )
+	{
+		uchar * buffer = new uchar[w * h];
+		memcpy( buffer, prepared[0].buffer, w * h );
+		ownsBuffer = true;
+		return buffer;
+	}
+	return prepared[0].buffer;
+}
+
+void
+Preprocess::levels( const ImageView &view, const string &frameName,
+					const PreprocessOptions &options,
+					const vector<int> &levels, ImagePyramid &pyramid,
+					vector<PreparedLevel> &prepared )
+{
+	FOCUS_TIMER( "Preprocess::frame" );
+	int w = view.width;
+	int h = view.height;
+
+	// Measure the frame directly unless the image gets modified.
+	uchar * buffer = const_cast<uchar *>( view.data );
+	bool ownsBuffer = false;
+
+	if ( options.scaleHalf )
+	{
+		buffer = new uchar[w * h];
+		memcpy( buffer, view.data, w * h );
+		ownsBuffer = true;
+		ImageTools::scale( buffer, w, h, w / 2, h / 2,
+						   ImageTools::NearestNeighbor );
+		w /= 2;
+		h /= 2;
+	}
+
+	// Every level, the frame itself included, comes from the pyramid when
+	// there is one.
+	int highest = 0;
+	for (size_t k = 0; k < levels.size(); k++)
+		highest = max( highest, min( levels[k], maxPyramidLevel ) );
+	if ( highest > 0 )
+	{
+		pyramid.setLevels( highest + 1 );
+		pyramid.build( buffer, w, h );
+		if ( ownsBuffer )
+			delete [] buffer;
+		ownsBuffer = false;
+	}
+
+	prepared.resize( levels.size() );
+	for (size_t k = 0; k < levels.size(); k++)
+	{
+		PreparedLevel &level = prepared[k];
+		level.buffer = buffer;
+		level.w = w;
+		level.h = h;
+		level.ownsBuffer = ownsBuffer;
+		if ( highest > 0 )
+		{
+			// Small images may not have as many levels as requested.
+			int l = min( min( levels[k], maxPyramidLevel ),
+						 pyramid.levels() - 1 );
+			level.buffer = pyramid.level( l );
+			level.w = pyramid.width( l );
+			level.h = pyramid.height( l );
+		}
+
+		if ( (options.crop || options.varyLight) && !level.ownsBuffer )
+		{
+			uchar * copy = new uchar[level.w * level.h];
+			memcpy( copy, level.buffer, level.w * level.h );
+			level.buffer = copy;
+			level.ownsBuffer = true;
+		}
+
+		if ( options.crop )
+		{
+			int left = (level.w - level.w / CROP_FACTOR_X) / 2;
+			int right = left + level.w / CROP_FACTOR_X;
+			int top = (level.h - level.h / CROP_FACTOR_Y) / 2;
+			int bottom = top + level.h / CROP_FACTOR_Y;
+			ImageTools::crop( level.buffer, level.w, level.h, left, right,
+							  top, bottom );
+			level.w = right - left;
+			level.h = bottom - top;
+		}
+
+		if ( options.varyLight )
+		{
+			// In an experimental setup, we found a case where the average
+			// pixel brightness for an outlier was 30% lower (and the median
+			// was 50% lower). So we use a factor that's between -0.3 and 0.3
+			float factor = ImageTools::randomUniform(
+				ImageTools::frameSeed( options.seed, frameName.c_str() ), 0 ) *
+				0.6f - 0.3f;
+			ImageTools::changeBrightness( factor, level.w, level.h,
+										  level.buffer );
+		}
+	}
+}
+
+void
+Preprocess::size( const PreprocessOptions &options, int width, int height,
+				  int &w, int &h )
+{
+	w = width;
+	h = height;
+	if ( options.scaleHalf )
+	{
+		w /= 2;
+		h /= 2;
+	}
+
+	// The pyramid stops before a level would be empty.
+	int level = min( options.pyramidLevel, maxPyramidLevel );
+	for (int i = 0; i < level && w / 2 > 0 && h / 2 > 0; i++)
+	{
+		w /= 2;
+		h /= 2;
+	}
+
+	if ( options.crop )
+	{
+		w /= CROP_FACTOR_X;
+		h /= CROP_FACTOR_Y;
+	}
+}
+
+string
+Preprocess::describe( const PreprocessOptions &options, const string &frameName )
+{
+	char text[128];
+	snprintf( text, sizeof( text ), "scalehalf=%d pyramid=%d crop=%d",
+			  options.scaleHalf, options.pyramidLevel, options.crop );
+	string description( text );
+
+	// The brightness change depends on the name of the frame.
+	if ( options.varyLight )
+	{
+		snprintf( text, sizeof( text ), " varylight=%llu",
+				  (unsigned long long)ImageTools::frameSeed(
+					  options.seed, frameName.c_str() ) );
+		description += text;
+	}
+	return description;
+}
@@ -0,0 +1,81 @@
+#ifndef _Preprocess_H
+#define _Preprocess_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "imagePyramid.h"
+#include "imageTools.h"
+
+/*
+ * What is done to a frame before measuring it (see the options of apply).
+ */
+struct PreprocessOptions
+{
+	bool scaleHalf;			// halve each dimension
+	int pyramidLevel;		// measure on this level of a gaussian pyramid
+	bool crop;				// keep only the center, like Canon's AF window
+	bool varyLight;			// darken or brighten the frame at random
+	uint64_t seed;			// of the random brightness changes
+};
+
+/*
+ * A frame preprocessed for one level of the pyramid (see Preprocess::levels).
+ */
+struct PreparedLevel
+{
+	uchar *buffer;
+	int w;
+	int h;
+	bool ownsBuffer;
+};
+
+class Preprocess
+{
+public:
+	/*
+	 * Apply the options to a frame. frameName (e.g. its file name) picks
+	 * its brightness change, so that a frame always gets the same one.
+	 * The result is either the frame itself or a new buffer, of size
+	 * (w, h); ownsBuffer is set if it is a new buffer.
+	 */
+	static uchar * frame( const ImageView &view, const std::string &frameName,
+						  const PreprocessOptions &options, int &w, int &h,
+						  bool &ownsBuffer );
+
+	/*
+	 * Apply the options to a frame for each of several pyramid levels,
+	 * given in place of options.pyramidLevel : prepared[k] is the frame at
+	 * levels[k], which must all be different. The pyramid of the frame is
+	 * built once, up to the highest level, into pyramid; the buffers that
+	 * aren't owned point into it (or into the frame), so it must be kept
+	 * until they are measured.
+	 */
+	static void levels( const ImageView &view, const std::string &frameName,
+						const PreprocessOptions &options,
+						const std::vector<int> &levels, ImagePyramid &pyramid,
+						std::vector<PreparedLevel> &prepared );
+
+	/*
+	 * Size (w, h) that frame() gives a frame of size (width, height), to
+	 * check that it can still be measured before preprocessing it.
+	 */
+	static void size( const PreprocessOptions &options, int width,
+					  int height, int &w, int &h );
+
+	/*
+	 * Levels above this one are taken as this one. Frames would need more
+	 * than 2^32 pixels to have that many levels.
+	 */
+	static const int maxPyramidLevel = 16;
+
+	/*
+	 * Description of what frame() does to a frame, part of its key in the
+	 * focus value cache.
+	 */
+	static std::string describe( const PreprocessOptions &options,
+								 const std::string &frameName );
+};
+
+#endif
@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 
+#include "frameReader.h"
 #include "imageTools.h"
 
 using namespace std;
@@ -10,40 +12,76 @@ int
 main( int argc, char *argv[] )
 {
     if( argc <= 2 ) {
-        fprintf( stderr, "Usage: resize scale fileName0.gray ...\n" );
+        fprintf( stderr, "Usage: resize scale [--size=WxH] fileName0.gray ...\n" );
         fprintf( stderr, "\tscale -- scaling factor \n" );
+        fprintf( stderr, "\t--size=WxH -- size of the .gray files (default 1056x704)\n" );
         fprintf( stderr, "\tfileName0.gray -- file containing gray levels\n" );
+        fprintf( stderr, "\t    (.pgm and .png files carry their own size, sweep\n" );
+        fprintf( stderr, "\t    files give each of their frames)\n" );
         exit( 6 );
     }
 
-    const int w = 1056;
-    const int h =  704;
-    const int n = w * h;
-
     double scale = atof(argv[1]);
 
-    int newW = (int)(w * scale);
-    int newH = (int)(h * scale);
+    int grayWidth = ImageTools::GrayWidth;
+    int grayHeight = ImageTools::GrayHeight;
+    int first = 2;
+    if (strncmp(argv[first], "--size=", 7) == 0)
+    {
+        if (!ImageTools::parseSize(argv[first] + 7, grayWidth, grayHeight))
+        {
+            fprintf( stderr, "Invalid size: %s\n", argv[first] + 7 );
+            exit( 6 );
+        }
+        first++;
+    }
 
-    for( int i = 2; i < argc; i++ )
+    // Files that can't be read are skipped.
+    FrameReader reader;
+    reader.setGraySize( grayWidth, grayHeight );
+    int failed = 0;
+    for( int i = first; i < argc; i++ )
+        if( !reader.addFile( argv[i] ) )
+        {
+            fprintf( stderr, "%s\n", reader.error().c_str() );
+            failed++;
+        }
+
+    for( int f = 0; f < reader.frames(); f++ )
     {
-        uchar * buffer = new uchar[n];
-        char * inputName = argv[i];
-        ImageTools::readGray( inputName, n, buffer );
+        const string &inputName = reader.fileName( f );
+        ImageView view;
+        if( !reader.frame( f, view ) )
+        {
+            fprintf( stderr, "%s\n", reader.error().c_str() );
+            failed++;
+            continue;
+        }
+        int w = view.width;
+        int h = view.height;
+
+        int newW = (int)(w * scale);
+        int newH = (int)(h * scale);
+        uchar * buffer = new uchar[w * h];
+        memcpy( buffer, view.data, w * h );
+        reader.release( f );
 
         ImageTools::scale( buffer, w, h, newW, newH,
                            ImageTools::AreaAverage );
 
-        // We're assuming that the file name from the input does indeed
-        // finish with .gray.
+        // Replace the extension of the input (.gray, .pgm or .png); the
+        // frames of a sweep, named file.sweep#step, keep their name.
         string outputName( inputName );
-        outputName = outputName.substr(0, outputName.length() - 4);
-        outputName += "png";
+        size_t dot = outputName.rfind('.');
+        if (dot != string::npos &&
+            outputName.find_first_of("/#", dot) == string::npos)
+            outputName.erase(dot);
+        outputName += ".png";
 
         ImageTools::saveGrayPng(outputName.c_str(), buffer, newW, newH);
 
         delete [] buffer;
     }
 
-    return 0;
+    return failed > 0 ? 1 : 0;
 }
\ No newline at end of file
@@ -0,0 +1,346 @@
+#include "sweepFile.h"
+#include "lodepng.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char SWEEP_MAGIC[8] = "FSWEEP1";
+static const uint32_t SWEEP_VERSION = 1;
+
+// Deflate can't shrink data more than this many times.
+static const uint64_t DEFLATE_MAX_RATIO = 1032;
+
+// Payloads and madvise() ranges are aligned on the pages of this system.
+static size_t
+systemPageSize()
+{
+	return sysconf( _SC_PAGESIZE );
+}
+
+// Replace every pixel by its difference with the pixel on its left, which
+// deflate compresses much better on smooth images.
+static void
+deltaEncode( const uchar *in, int width, int height, uchar *out )
+{
+	for (int y = 0; y < height; y++)
+	{
+		const uchar *row = in + (size_t)y * width;
+		uchar *outRow = out + (size_t)y * width;
+		outRow[0] = row[0];
+		for (int x = 1; x < width; x++)
+			outRow[x] = row[x] - row[x - 1];
+	}
+}
+
+static void
+deltaDecode( uchar *pixels, int width, int height )
+{
+	for (int y = 0; y < height; y++)
+	{
+		uchar *row = pixels + (size_t)y * width;
+		for (int x = 1; x < width; x++)
+			row[x] += row[x - 1];
+	}
+}
+
+SweepWriter::SweepWriter()
+	: fp( NULL ), compress( false )
+{
+}
+
+SweepWriter::~SweepWriter()
+{
+	if ( fp != NULL )
+		close();
+}
+
+bool
+SweepWriter::fail( const string &message )
+{
+	lastError = message + ": " + fileName;
+	return false;
+}
+
+bool
+SweepWriter::open( const string &name, int width, int height,
+				   bool compressFrames )
+{
+	fileName = name;
+	fp = fopen( fileName.c_str(), "wb" );
+	if ( fp == NULL )
+		return fail( "Could not create file" );
+
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, SWEEP_MAGIC, sizeof( header.magic ) );
+	header.version = SWEEP_VERSION;
+	header.width = width;
+	header.height = height;
+	header.bitDepth = 8;
+	header.pageSize = systemPageSize();
+	index.clear();
+	compress = compressFrames;
+
+	// The header is written again with the final counts on close().
+	if ( fwrite( &header, sizeof( header ), 1, fp ) != 1 )
+		return fail( "Could not write file" );
+	return true;
+}
+
+bool
+SweepWriter::addFrame( const uchar *pixels, const SweepFrameInfo &info )
+{
+	size_t rawSize = (size_t)header.width * header.height;
+
+	SweepFrameEntry entry;
+	memset( &entry, 0, sizeof( entry ) );
+	entry.lensStep = info.lensStep;
+	entry.exposureTime = info.exposureTime;
+	entry.iso = info.iso;
+	entry.compression = SweepUncompressed;
+	entry.storedSize = rawSize;
+
+	const uchar *payload = pixels;
+	vector<uchar> compressed;
+	if ( compress )
+	{
+		vector<uchar> delta( rawSize );
+		deltaEncode( pixels, header.width, header.height, &delta[0] );
+		if ( lodepng::compress( compressed, &delta[0], rawSize ) == 0 &&
+			 compressed.size() < rawSize )
+		{
+			entry.compression = SweepDeltaDeflate;
+			entry.storedSize = compressed.size();
+			payload = &compressed[0];
+		}
+	}
+
+	// Payloads start on a page boundary so that uncompressed frames can
+	// be mapped and prefetched on their own.
+	long position = ftell( fp );
+	long aligned = (position + header.pageSize - 1) / header.pageSize *
+		header.pageSize;
+	if ( fseek( fp, aligned, SEEK_SET ) != 0 )
+		return fail( "Could not write file" );
+
+	entry.offset = aligned;
+	if ( fwrite( payload, 1, entry.storedSize, fp ) != entry.storedSize )
+		return fail( "Could not write file" );
+
+	index.push_back( entry );
+	return true;
+}
+
+bool
+SweepWriter::close()
+{
+	bool ok = true;
+	header.frameCount = index.size();
+
+	// The index is read in place from the mapped file.
+	long position = ftell( fp );
+	header.indexOffset = (position + 7) / 8 * 8;
+	if ( fseek( fp, header.indexOffset, SEEK_SET ) != 0 )
+		ok = fail( "Could not write file" );
+
+	if ( ok && !index.empty() &&
+		 fwrite( &index[0], sizeof( SweepFrameEntry ), index.size(), fp ) !=
+		 index.size() )
+		ok = fail( "Could not write file" );
+	if ( ok && ( fseek( fp, 0, SEEK_SET ) != 0 ||
+				 fwrite( &header, sizeof( header ), 1, fp ) != 1 ) )
+		ok = fail( "Could not write file" );
+
+	if ( fclose( fp ) != 0 && ok )
+		ok = fail( "Could not write file" );
+	fp = NULL;
+	return ok;
+}
+
+SweepReader::SweepReader()
+	: data( NULL ), size( 0 ), header( NULL ), index( NULL )
+{
+}
+
+SweepReader::~SweepReader()
+{
+	close();
+}
+
+bool
+SweepReader::fail( const string &message )
+{
+	lastError = message + ": " + fileName;
+	close();
+	return false;
+}
+
+bool
+SweepReader::isSweepFile( const string &fileName )
+{
+	FILE *fp = fopen( fileName.c_str(), "rb" );
+	if ( fp == NULL )
+		return false;
+
+	char magic[8];
+	bool isSweep = fread( magic, 1, sizeof( magic ), fp ) == sizeof( magic ) &&
+		memcmp( magic, SWEEP_MAGIC, sizeof( magic ) ) == 0;
+	fclose( fp );
+	return isSweep;
+}
+
+bool
+SweepReader::open( const string &name )
+{
+	close();
+	fileName = name;
+
+	int fd = ::open( fileName.c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return fail( "No such file" );
+
+	struct stat info;
+	if ( fstat( fd, &info ) != 0 || info.st_size < (off_t)sizeof( SweepHeader ) )
+	{
+		::close( fd );
+		return fail( "Not a sweep file" );
+	}
+
+	size = info.st_size;
+	void *mapping = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	::close( fd );
+	if ( mapping == MAP_FAILED )
+	{
+		data = NULL;
+		return fail( string( "Could not map file (" ) + strerror( errno ) + ")" );
+	}
+	data = (uchar *)mapping;
+
+	header = (const SweepHeader *)data;
+	if ( memcmp( header->magic, SWEEP_MAGIC, sizeof( header->magic ) ) != 0 )
+		return fail( "Not a sweep file" );
+	if ( header->version != SWEEP_VERSION || header->bitDepth != 8 ||
+		 header->pageSize == 0 )
+		return fail( "Unsupported sweep version" );
+	if ( header->width == 0 || header->height == 0 )
+		return fail( "Corrupted sweep file" );
+	if ( header->indexOffset % alignof( SweepFrameEntry ) != 0 )
+		return fail( "Corrupted sweep file" );
+	if ( header->indexOffset > size ||
+		 (size - header->indexOffset) / sizeof( SweepFrameEntry ) <
+		 header->frameCount )
+		return fail( "Truncated sweep file" );
+
+	index = (const SweepFrameEntry *)(data + header->indexOffset);
+
+	// Every frame must fit in the file, and decode to the frame size.
+	uint64_t rawSize = (uint64_t)header->width * header->height;
+	for (uint32_t i = 0; i < header->frameCount; i++)
+	{
+		const SweepFrameEntry &entry = index[i];
+		if ( entry.offset > size || size - entry.offset < entry.storedSize )
+			return fail( "Truncated sweep file" );
+		if ( entry.compression == SweepUncompressed ?
+			 entry.storedSize != rawSize :
+			 entry.storedSize * DEFLATE_MAX_RATIO < rawSize )
+			return fail( "Corrupted sweep file" );
+	}
+
+	// The index is read once per frame, keep it in memory.
+	size_t pageSize = systemPageSize();
+	size_t indexBegin = header->indexOffset / pageSize * pageSize;
+	madvise( data + indexBegin, header->indexOffset +
+			 header->frameCount * sizeof( SweepFrameEntry ) - indexBegin,
+			 MADV_WILLNEED );
+	return true;
+}
+
+void
+SweepReader::close()
+{
+	if ( data != NULL )
+		munmap( data, size );
+	data = NULL;
+	size = 0;
+	header = NULL;
+	index = NULL;
+}
+
+SweepFrameInfo
+SweepReader::info( int i ) const
+{
+	SweepFrameInfo frameInfo;
+	frameInfo.lensStep = index[i].lensStep;
+	frameInfo.exposureTime = index[i].exposureTime;
+	frameInfo.iso = index[i].iso;
+	return frameInfo;
+}
+
+bool
+SweepReader::frame( int i, ImageView &view, vector<uchar> &scratch )
+{
+	if ( i < 0 || i >= frames() )
+	{
+		lastError = "Frame index out of range";
+		return false;
+	}
+
+	const SweepFrameEntry &entry = index[i];
+	size_t rawSize = (size_t)header->width * header->height;
+	view.width = header->width;
+	view.height = header->height;
+
+	if ( entry.compression == SweepUncompressed )
+	{
+		if ( entry.storedSize != rawSize )
+		{
+			lastError = "Wrong number of bytes: " + fileName;
+			return false;
+		}
+		view.data = data + entry.offset;
+		return true;
+	}
+
+	if ( entry.compression != SweepDeltaDeflate )
+	{
+		lastError = "Unknown compression: " + fileName;
+		return false;
+	}
+
+	scratch.clear();
+	if ( lodepng::decompress( scratch, data + entry.offset,
+							  entry.storedSize ) != 0 ||
+		 scratch.size() != rawSize )
+	{
+		lastError = "Corrupted frame: " + fileName;
+		return false;
+	}
+	deltaDecode( &scratch[0], header->width, header->height );
+	view.data = &scratch[0];
+	return true;
+}
+
+bool
+SweepReader::prefetch( int first, int count )
+{
+	// Files written with larger pages than ours are aligned on ours too.
+	size_t pageSize = systemPageSize();
+	for (int i = max( first, 0 ); i < first + count && i < frames(); i++)
+	{
+		size_t begin = index[i].offset / pageSize * pageSize;
+		if ( madvise( data + begin,
+					  index[i].offset + index[i].storedSize - begin,
+					  MADV_WILLNEED ) != 0 )
+		{
+			lastError = string( "Could not prefetch frames (" ) +
+				strerror( errno ) + "): " + fileName;
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,152 @@
+#ifndef _SweepFile_H
+#define _SweepFile_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "imageTools.h"
+
+/*
+ * A focus sweep stored in a single file : every frame of a scene, one per
+ * lens position, with the metadata of each frame.
+ *
+ * Layout :
+ *   SweepHeader
+ *   frame payloads, each starting on a multiple of header.pageSize
+ *   SweepFrameEntry[frameCount] (the index, at header.indexOffset, which
+ *   is a multiple of 8)
+ *
+ * Frames are stored row by row, one byte per pixel. A frame may be
+ * compressed losslessly (difference with the pixel on its left, then
+ * deflate), in which case it has to be decoded before use; uncompressed
+ * frames can be used directly from the mapped file.
+ *
+ * The lens step of a frame is the lens position it was taken at, when it
+ * is known. makesweep, which packs image files that don't record it,
+ * stores the position of each frame in the sweep (0, 1, 2...) instead.
+ */
+
+struct SweepHeader
+{
+	char magic[8];			// "FSWEEP1"
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bitDepth;
+	uint32_t frameCount;
+	uint32_t pageSize;		// of the system that wrote the file
+	uint64_t indexOffset;
+};
+
+enum SweepCompression
+{
+	SweepUncompressed = 0,
+	SweepDeltaDeflate = 1
+};
+
+struct SweepFrameEntry
+{
+	uint64_t offset;		// from the start of the file
+	uint64_t storedSize;	// bytes in the file
+	uint32_t compression;	// SweepCompression
+	int32_t lensStep;
+	float exposureTime;		// in seconds, 0 if unknown
+	int32_t iso;			// 0 if unknown
+};
+
+/*
+ * Metadata of a frame.
+ */
+struct SweepFrameInfo
+{
+	int lensStep;
+	float exposureTime;
+	int iso;
+};
+
+class SweepWriter
+{
+public:
+	SweepWriter();
+	~SweepWriter();
+
+	/*
+	 * Start a sweep of frames of size (width, height). If compress is set,
+	 * frames are compressed when that makes them smaller.
+	 */
+	bool open( const std::string &fileName, int width, int height,
+			   bool compress = false );
+
+	bool addFrame( const uchar *pixels, const SweepFrameInfo &info );
+
+	/*
+	 * Write the index and the final header.
+	 */
+	bool close();
+
+	const std::string & error() const { return lastError; }
+
+private:
+	bool fail( const std::string &message );
+
+	FILE *fp;
+	std::string fileName;
+	SweepHeader header;
+	std::vector<SweepFrameEntry> index;
+	bool compress;
+	std::string lastError;
+};
+
+class SweepReader
+{
+public:
+	SweepReader();
+	~SweepReader();
+
+	/*
+	 * Map a sweep file. Returns false if it can't be read or is not a
+	 * valid sweep.
+	 */
+	bool open( const std::string &fileName );
+	void close();
+
+	int width() const { return header->width; }
+	int height() const { return header->height; }
+	int bitDepth() const { return header->bitDepth; }
+	int frames() const { return header->frameCount; }
+	SweepFrameInfo info( int i ) const;
+
+	/*
+	 * View of frame i. Uncompressed frames point into the mapped file;
+	 * compressed frames are decoded into scratch, which the view then
+	 * points to.
+	 */
+	bool frame( int i, ImageView &view, std::vector<uchar> &scratch );
+
+	/*
+	 * Ask the kernel to start reading frames [first, first + count).
+	 * Returns false if it refused.
+	 */
+	bool prefetch( int first, int count );
+
+	const std::string & error() const { return lastError; }
+
+	/*
+	 * Whether a file starts like a sweep file.
+	 */
+	static bool isSweepFile( const std::string &fileName );
+
+private:
+	bool fail( const std::string &message );
+
+	std::string fileName;
+	uchar *data;
+	size_t size;
+	const SweepHeader *header;
+	const SweepFrameEntry *index;
+	std::string lastError;
+};
+
+#endif
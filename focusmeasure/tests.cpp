@@ -0,0 +1,1066 @@
+/*
+ *  Checks of the focus measure modules and tools, run by make test from
+ *  this folder (it also reads the curves of ../afheuristics). Prints
+ *  every failed check and exits with 1 if there was any.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits.h>
+#include <mutex>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "curveStore.h"
+#include "focusCache.h"
+#include "focusLibrary.h"
+#include "focusProtocol.h"
+#include "imageTools.h"
+#include "peakDetector.h"
+#include "preprocess.h"
+#include "sweepFile.h"
+#include "threadPool.h"
+
+using namespace std;
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK( condition ) \
+    check( (condition), #condition, __FILE__, __LINE__ )
+
+static bool
+check( bool passed, const char *condition, const char *file, int line )
+{
+    checks++;
+    if (!passed)
+    {
+        fprintf( stderr, "%s:%d: check failed: %s\n", file, line, condition );
+        failures++;
+    }
+    return passed;
+}
+
+/*
+ *  The synthetic scene of the sweep tests : a textured checkerboard, box
+ *  blurred by |k - 3| pixels in each direction in frame k, so that frame 3
+ *  is in focus.
+ */
+static const int SCENE_WIDTH = 1056;
+static const int SCENE_HEIGHT = 704;
+static const int SCENE_FRAMES = 9;
+
+static void
+scene_frame( int k, vector<uchar> &frame )
+{
+    int w = SCENE_WIDTH, h = SCENE_HEIGHT;
+    int r = k > 3 ? k - 3 : 3 - k;
+    vector<int> sharp( w * h ), rows( w * h );
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+        {
+            unsigned hash = (unsigned)x * 73856093u ^ (unsigned)y * 19349663u;
+            sharp[x + y * w] = ((x / 16 + y / 16) % 2 ? 200 : 40) +
+                (int)(hash >> 27);
+        }
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+        {
+            int sum = 0, count = 0;
+            for (int d = -r; d <= r; d++)
+                if (x + d >= 0 && x + d < w)
+                {
+                    sum += sharp[x + d + y * w];
+                    count++;
+                }
+            rows[x + y * w] = sum / count;
+        }
+    frame.resize( w * h );
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+        {
+            int sum = 0, count = 0;
+            for (int d = -r; d <= r; d++)
+                if (y + d >= 0 && y + d < h)
+                {
+                    sum += rows[x + (y + d) * w];
+                    count++;
+                }
+            frame[x + y * w] = sum / count;
+        }
+}
+
+/*
+ *  Raw values of the scene printed by apply before the sweep files, the
+ *  cache and the pyramid existed (apply M --raw frame0.gray ...).
+ */
+struct ApplyBaseline
+{
+    const char *options;
+    double values[SCENE_FRAMES];
+};
+
+static const ApplyBaseline APPLY_BASELINE[] =
+{
+    { "0 --raw", { 895914864, 1356146302, 2318904188, 4687062202,
+                   2318904188, 1356146302, 895914864, 626788944,
+                   450857751 } },
+    { "12 --raw", { 122394578, 190861437, 351906788, 1183969824, 351906788,
+                    190861437, 122394578, 84303379, 60140229 } },
+    { "15 --raw", { 18941223, 22011874, 25071759, 29916552, 25071759,
+                    22011874, 18941223, 16169563, 13635023 } },
+    { "20 --raw", { 3380, 4203, 5155, 6484, 5155, 4203, 3380, 2652,
+                    2016 } },
+    { "27 --raw", { 939964699084, 1385953544788, 2211985663498,
+                    3568178624675, 2211985663498, 1385953544788,
+                    939964699084, 666056617728, 482162816945 } },
+    { "28 --raw", { 1656004579060, 3230531426273, 7368141999053,
+                    14165355006723, 7368141999053, 3230531426273,
+                    1656004579060, 972719727783, 621856787967 } },
+    { "12 --raw --scalehalf", { 113493506, 171628639, 293276739, 591662744,
+                                293276739, 171628639, 113493506, 79501121,
+                                57323235 } },
+    { "12", { 0.05539, 0.11632, 0.25962, 1.00000, 0.25962, 0.11632,
+              0.05539, 0.02150, 0.00000 } }
+};
+
+static bool
+write_file( const string &fileName, const void *data, size_t size )
+{
+    FILE *fp = fopen( fileName.c_str(), "wb" );
+    if (fp == NULL)
+        return false;
+    bool written = fwrite( data, 1, size, fp ) == size;
+    return fclose( fp ) == 0 && written;
+}
+
+static bool
+read_file( const string &fileName, vector<uchar> &data )
+{
+    FILE *fp = fopen( fileName.c_str(), "rb" );
+    if (fp == NULL)
+        return false;
+    data.clear();
+    uchar buffer[65536];
+    size_t n;
+    while ((n = fread( buffer, 1, sizeof( buffer ), fp )) > 0)
+        data.insert( data.end(), buffer, buffer + n );
+    fclose( fp );
+    return true;
+}
+
+/*
+ *  The table printed by a command, one "frame value" line per frame.
+ */
+static bool
+run_table( const string &command, vector<double> &values )
+{
+    values.clear();
+    FILE *out = popen( command.c_str(), "r" );
+    if (out == NULL)
+        return false;
+    char line[256];
+    while (fgets( line, sizeof( line ), out ) != NULL)
+    {
+        int frame;
+        double value;
+        if (sscanf( line, "%d %lf", &frame, &value ) == 2 &&
+            frame == (int)values.size())
+            values.push_back( value );
+    }
+    return pclose( out ) == 0;
+}
+
+/*
+ *  The table printed by a command with a column per measure, one "frame
+ *  value value ..." line per frame.
+ */
+static bool
+run_columns( const string &command, vector< vector<double> > &rows )
+{
+    rows.clear();
+    FILE *out = popen( command.c_str(), "r" );
+    if (out == NULL)
+        return false;
+    char line[1024];
+    while (fgets( line, sizeof( line ), out ) != NULL)
+    {
+        char *next;
+        long frame = strtol( line, &next, 10 );
+        if (next == line || frame != (long)rows.size())
+            continue;
+        vector<double> row;
+        for (char *start = next; ; start = next)
+        {
+            double value = strtod( start, &next );
+            if (next == start)
+                break;
+            row.push_back( value );
+        }
+        rows.push_back( row );
+    }
+    return pclose( out ) == 0;
+}
+
+/*
+ *  Philox4x32-10 known answers (Salmon et al., Random123), for key 0 and
+ *  counter 0, through the vector and the scalar code.
+ */
+static void
+test_philox()
+{
+    const uint32_t expected[4] = { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c,
+                                   0x9b00dbd8 };
+    uint32_t words[64];
+    ImageTools::randomWords( 0, 0, 64, words );
+    CHECK( memcmp( words, expected, sizeof( expected ) ) == 0 );
+
+    uint32_t block[4];
+    ImageTools::randomWords( 0, 0, 4, block );
+    CHECK( memcmp( block, expected, sizeof( expected ) ) == 0 );
+
+    // Any range gives the words at its indices, whatever the alignment.
+    for (int first = 0; first < 20; first++)
+        for (int n = 0; first + n <= 64; n += 7)
+        {
+            uint32_t range[64];
+            ImageTools::randomWords( 0, first, n, range );
+            CHECK( memcmp( range, words + first, n * 4 ) == 0 );
+        }
+
+    // The seed is the key.
+    ImageTools::randomWords( 1, 0, 4, block );
+    CHECK( memcmp( block, expected, sizeof( expected ) ) != 0 );
+}
+
+/*
+ *  runTasks runs every task once, and threads that are done steal the
+ *  tasks of a slow one, from the end of its block.
+ */
+static void
+test_thread_pool()
+{
+    const int threads = 4, count = 400, block = count / threads;
+    ThreadPool pool( threads );
+    vector< atomic<int> > runs( count );
+    vector<thread::id> runBy( count );
+    for (int i = 0; i < count; i++)
+        runs[i] = 0;
+    pool.runTasks( count, [&]( int task )
+    {
+        // The first block is much slower than the others.
+        if (task < block)
+            usleep( 2000 );
+        runs[task]++;
+        runBy[task] = this_thread::get_id();
+    } );
+
+    int once = 0;
+    for (int i = 0; i < count; i++)
+        once += runs[i] == 1;
+    CHECK( once == count );
+
+    // The first task of a block is run by the thread that owns it, and
+    // tasks from the end of the slow block by others.
+    int stolen = 0;
+    for (int i = 0; i < block; i++)
+        stolen += runBy[i] != runBy[0];
+    CHECK( stolen > block / 2 );
+    CHECK( runBy[block - 1] != runBy[0] );
+
+    // A block of tasks per thread when the count is a multiple of it, as
+    // apply expects, and tasks within a block start in order.
+    vector<int> order;
+    mutex orderLock;
+    pool.runTasks( threads * 3, [&]( int task )
+    {
+        usleep( 1000 );
+        lock_guard<mutex> lock( orderLock );
+        order.push_back( task );
+    } );
+    vector<int> firstSeen( threads, -1 );
+    for (size_t k = 0; k < order.size(); k++)
+        if (firstSeen[order[k] / 3] < 0)
+            firstSeen[order[k] / 3] = order[k];
+    for (int t = 0; t < threads; t++)
+        CHECK( firstSeen[t] == 3 * t );
+
+    // Tasks started from a task run serially, on its thread.
+    vector<int> inner( 8, 0 );
+    pool.runTasks( 2, [&]( int task )
+    {
+        thread::id self = this_thread::get_id();
+        bool same = true;
+        pool.runTasks( 4, [&]( int i )
+        {
+            same = same && this_thread::get_id() == self;
+            inner[task * 4 + i]++;
+        } );
+        if (!same)
+            inner[task * 4] = -1;
+    } );
+    CHECK( count_if( inner.begin(), inner.end(),
+                     []( int n ) { return n == 1; } ) == 8 );
+}
+
+static void
+test_sweep_round_trip( const string &dir, const vector< vector<uchar> > &frames,
+                       bool compress )
+{
+    string fileName = dir + (compress ? "/compressed.sweep" : "/scene.sweep");
+    SweepWriter writer;
+    CHECK( writer.open( fileName, SCENE_WIDTH, SCENE_HEIGHT, compress ) );
+    for (int k = 0; k < SCENE_FRAMES; k++)
+    {
+        SweepFrameInfo info = { 10 * k, 0.01f * k, 100 + k };
+        CHECK( writer.addFrame( &frames[k][0], info ) );
+    }
+    CHECK( writer.close() );
+
+    SweepReader reader;
+    if (!CHECK( reader.open( fileName ) ))
+    {
+        cerr << reader.error() << endl;
+        return;
+    }
+    CHECK( reader.width() == SCENE_WIDTH );
+    CHECK( reader.height() == SCENE_HEIGHT );
+    CHECK( reader.bitDepth() == 8 );
+    CHECK( reader.frames() == SCENE_FRAMES );
+    CHECK( reader.prefetch( 0, SCENE_FRAMES ) );
+    vector<uchar> scratch;
+    for (int k = 0; k < reader.frames(); k++)
+    {
+        ImageView view;
+        CHECK( reader.frame( k, view, scratch ) );
+        CHECK( view.width == SCENE_WIDTH && view.height == SCENE_HEIGHT );
+        CHECK( memcmp( view.data, &frames[k][0], frames[k].size() ) == 0 );
+        SweepFrameInfo info = reader.info( k );
+        CHECK( info.lensStep == 10 * k );
+        CHECK( info.exposureTime == 0.01f * k );
+        CHECK( info.iso == 100 + k );
+    }
+    reader.close();
+
+    // The blurred frames compress well.
+    vector<uchar> file;
+    CHECK( read_file( fileName, file ) );
+    if (compress)
+        CHECK( file.size() < (size_t)SCENE_WIDTH * SCENE_HEIGHT * SCENE_FRAMES / 2 );
+
+    // A truncated file is refused.
+    string truncated = dir + "/truncated.sweep";
+    CHECK( write_file( truncated, &file[0], file.size() - 1 ) );
+    CHECK( !reader.open( truncated ) );
+
+    // So is an index that isn't aligned, 4 bytes further.
+    SweepHeader header;
+    memcpy( &header, &file[0], sizeof( header ) );
+    vector<uchar> moved( file.begin(), file.begin() + header.indexOffset );
+    moved.insert( moved.end(), 4, 0 );
+    moved.insert( moved.end(), file.begin() + header.indexOffset, file.end() );
+    header.indexOffset += 4;
+    memcpy( &moved[0], &header, sizeof( header ) );
+    string misaligned = dir + "/misaligned.sweep";
+    CHECK( write_file( misaligned, &moved[0], moved.size() ) );
+    CHECK( !reader.open( misaligned ) );
+}
+
+static void
+test_apply( const string &dir, const vector< vector<uchar> > &scene )
+{
+    // The frames as .gray files, in sweep files and as PNG files, which
+    // are decoded rather than mapped.
+    string frames;
+    mkdir( (dir + "/png").c_str(), 0755 );
+    mkdir( (dir + "/empty").c_str(), 0755 );
+    for (int k = 0; k < SCENE_FRAMES; k++)
+    {
+        char name[32];
+        snprintf( name, sizeof( name ), "/frame%d.gray", k );
+        frames += " " + dir + name;
+        snprintf( name, sizeof( name ), "/png/frame%d.png", k );
+        vector<uchar> pixels( scene[k] );
+        ImageTools::saveGrayPng( (dir + name).c_str(), &pixels[0],
+                                 SCENE_WIDTH, SCENE_HEIGHT );
+    }
+    const int inputCount = 4;
+    const string inputs[inputCount] = { frames, " " + dir + "/scene.sweep",
+                                        " " + dir + "/compressed.sweep",
+                                        " " + dir + "/png" };
+
+    int cases = sizeof( APPLY_BASELINE ) / sizeof( APPLY_BASELINE[0] );
+    for (int c = 0; c < cases; c++)
+        for (int i = 0; i < inputCount; i++)
+        {
+            vector<double> values;
+            string command = string( "./apply.exe " ) +
+                APPLY_BASELINE[c].options + " --no-cache" + inputs[i];
+            if (!CHECK( run_table( command, values ) ) ||
+                !CHECK( values.size() == SCENE_FRAMES ))
+                continue;
+            for (int k = 0; k < SCENE_FRAMES; k++)
+                if (!CHECK( values[k] == APPLY_BASELINE[c].values[k] ))
+                    cerr << command << ": frame " << k << endl;
+        }
+
+    // The same values whatever the number of threads, of frames in memory
+    // and of measures.
+    const char *schedules[] = { "FOCUS_THREADS=1 ./apply.exe 12",
+                                "FOCUS_THREADS=3 ./apply.exe 12",
+                                "FOCUS_THREADS=8 ./apply.exe 12",
+                                "FOCUS_THREADS=3 ./apply.exe 12,0,28",
+                                "FOCUS_THREADS=16 ./apply.exe 12,0,28" };
+    const char *memory[] = { "", " --max-frames=1", " --max-frames=2" };
+    for (int s = 0; s < 5; s++)
+        for (int f = 0; f < 3; f++)
+            for (int i = 0; i < inputCount; i++)
+            {
+                vector<double> values;
+                string command = string( schedules[s] ) + " --raw --no-cache" +
+                    memory[f] + inputs[i];
+                if (!CHECK( run_table( command, values ) ) ||
+                    !CHECK( values.size() == SCENE_FRAMES ))
+                    continue;
+                for (int k = 0; k < SCENE_FRAMES; k++)
+                    if (!CHECK( values[k] == APPLY_BASELINE[1].values[k] ))
+                        cerr << command << ": frame " << k << endl;
+            }
+
+    // One table per sweep, written as the sweeps are done, including a
+    // sweep without frames.
+    string tables = dir + "/tables";
+    string command = "FOCUS_THREADS=3 ./apply.exe 12 --raw --no-cache "
+        "--max-frames=4 --out=" + tables + inputs[1] + inputs[2] + inputs[3] +
+        " " + dir + "/empty";
+    CHECK( system( command.c_str() ) == 0 );
+    const char *names[] = { "scene", "compressed", "png" };
+    for (int n = 0; n < 3; n++)
+    {
+        vector<double> values;
+        string table = tables + "/" + names[n] + ".txt";
+        if (!CHECK( run_table( "cat " + table, values ) ) ||
+            !CHECK( values.size() == SCENE_FRAMES ))
+            continue;
+        for (int k = 0; k < SCENE_FRAMES; k++)
+            if (!CHECK( values[k] == APPLY_BASELINE[1].values[k] ))
+                cerr << table << ": frame " << k << endl;
+    }
+    vector<uchar> empty;
+    CHECK( read_file( tables + "/empty.txt", empty ) && empty.empty() );
+
+    // Several pyramid levels from one pyramid per frame, each column the
+    // values of the level alone, also when they come from the cache.
+    const char *levels[] = { "0", "1", "2" };
+    vector< vector<double> > single[3];
+    for (int l = 0; l < 3; l++)
+        CHECK( run_columns( string( "./apply.exe 12,28 --raw --no-cache "
+                                    "--pyramid-level=" ) + levels[l] +
+                            inputs[1], single[l] ) &&
+               single[l].size() == SCENE_FRAMES );
+    for (int k = 0; k < SCENE_FRAMES && single[0].size() == SCENE_FRAMES; k++)
+        CHECK( single[0][k][0] == APPLY_BASELINE[1].values[k] &&
+               single[0][k][1] == APPLY_BASELINE[5].values[k] );
+    CHECK( single[1] != single[0] && single[2] != single[1] );
+    for (int r = 0; r < 3; r++)
+        for (int i = 0; i < inputCount; i++)
+        {
+            // Without the cache, filling it, then from it.
+            vector< vector<double> > rows;
+            string command = "FOCUS_THREADS=3 ./apply.exe 12,28 --raw "
+                "--pyramid-level=2,0,1 --max-frames=2" +
+                (r == 0 ? string( " --no-cache" ) :
+                          " --cache=" + dir + "/levelcache") + inputs[i];
+            if (!CHECK( run_columns( command, rows ) ) ||
+                !CHECK( rows.size() == SCENE_FRAMES ) ||
+                single[2].size() != SCENE_FRAMES)
+                continue;
+            for (int k = 0; k < SCENE_FRAMES; k++)
+            {
+                vector<double> expected( single[2][k] );
+                expected.insert( expected.end(), single[0][k].begin(),
+                                 single[0][k].end() );
+                expected.insert( expected.end(), single[1][k].begin(),
+                                 single[1][k].end() );
+                if (!CHECK( rows[k] == expected ))
+                    cerr << command << ": frame " << k << endl;
+            }
+        }
+    CHECK( system( "./apply.exe 12 --raw --no-cache --pyramid-level=0,0 "
+                   "2>/dev/null" ) != 0 );
+    CHECK( system( ( "./apply.exe 12 --pyramid-level=0,1 --store=" + dir +
+                     "/levels.curves" + inputs[1] + " 2>/dev/null" ).c_str() )
+           != 0 );
+}
+
+static void
+test_curve_store( const string &dir )
+{
+    const double bench[5] = { 2, 4, 10, 6, 2 };
+    const double flat[3] = { 7, 7, 7 };
+    vector<int> benchMaxima( 1, 2 ), flatMaxima;
+
+    string fileName = dir + "/curves.curves";
+    CurveStoreWriter writer;
+    CHECK( writer.open( fileName ) );
+    CHECK( writer.addCurve( "bench", 12, bench, 5, benchMaxima ) );
+    CHECK( writer.addCurve( "flat", 12, flat, 3, flatMaxima ) );
+    CHECK( writer.addCurve( "bench", 27, bench, 5, benchMaxima ) );
+    CHECK( !writer.addCurve( "bench", 12, bench, 5, benchMaxima ) );
+    CHECK( writer.close() );
+
+    CurveStoreReader reader;
+    CHECK( CurveStoreReader::isCurveStore( fileName ) );
+    if (!CHECK( reader.open( fileName ) ))
+        return;
+    CHECK( reader.curves() == 3 );
+    CHECK( reader.find( "bench", 27 ) == 2 );
+    CHECK( reader.find( "flat" ) == 1 );
+    CHECK( reader.find( "flat", 27 ) == -1 );
+    CHECK( strcmp( reader.name( 0 ), "bench" ) == 0 );
+    CHECK( reader.measure( 0 ) == 12 && reader.length( 0 ) == 5 );
+    CHECK( memcmp( reader.raw( 0 ), bench, sizeof( bench ) ) == 0 );
+    CHECK( reader.normalized( 0 )[0] == 0 && reader.normalized( 0 )[2] == 1 &&
+           reader.normalized( 0 )[3] == 0.5 );
+    CHECK( reader.normalized( 1 )[0] == 0 );
+    CHECK( reader.maximaCount( 0 ) == 1 && reader.maxima( 0 )[0] == 2 );
+    CHECK( reader.maximaCount( 1 ) == 0 );
+    reader.close();
+
+    vector<uchar> file;
+    CHECK( read_file( fileName, file ) );
+    string truncated = dir + "/truncated.curves";
+    CHECK( write_file( truncated, &file[0], file.size() - 8 ) );
+    CHECK( !reader.open( truncated ) );
+}
+
+/*
+ *  The peaks of the curves of ../afheuristics, against maxima.txt, which
+ *  the first localMax found (but for the maxima findmax.sh adds by hand).
+ */
+static void
+test_peak_detector()
+{
+    const string folder = "../afheuristics/";
+    FILE *maxima = fopen( (folder + "maxima.txt").c_str(), "r" );
+    if (!CHECK( maxima != NULL ))
+        return;
+
+    int scenes = 0;
+    char name[256], line[1024];
+    while (fgets( name, sizeof( name ), maxima ) != NULL &&
+           fgets( line, sizeof( line ), maxima ) != NULL)
+    {
+        name[strcspn( name, "\n" )] = '\0';
+        vector<int> expected;
+        for (char *p = strtok( line, " \n" ); p != NULL; p = strtok( NULL, " \n" ))
+            expected.push_back( atoi( p ) );
+        string scene( name );
+        if (scene == "gametree.txt")
+            expected.erase( expected.end() - 1 );
+        else if (scene == "screws2.txt")
+            expected.erase( expected.end() - 2, expected.end() );
+
+        FILE *curve = fopen( (folder + "focusmeasures/" + scene).c_str(), "r" );
+        if (curve == NULL)
+            curve = fopen( (folder + "lowlightgaussnorm/" + scene).c_str(), "r" );
+        if (!CHECK( curve != NULL ))
+            continue;
+
+        PeakDetector detector;
+        int position;
+        float value;
+        bool prefix = true;
+        while (fscanf( curve, "%d %f\n", &position, &value ) == 2)
+        {
+            detector.add( value );
+
+            // Peaks are final as soon as they are found.
+            const vector<int> &peaks = detector.peaks();
+            prefix = prefix && peaks.size() <= expected.size() &&
+                equal( peaks.begin(), peaks.end(), expected.begin() );
+        }
+        fclose( curve );
+        detector.finish();
+        if (!CHECK( detector.peaks() == expected ) || !CHECK( prefix ))
+            cerr << "peaks of " << scene << endl;
+        scenes++;
+    }
+    fclose( maxima );
+    CHECK( scenes == 47 );
+}
+
+/*
+ *  Preprocess::size() against the frames Preprocess::frame() makes.
+ */
+static void
+test_preprocess_size()
+{
+    vector<uchar> pixels( 140 * 90, 128 );
+    for (int width = 20; width <= 140; width += 7)
+        for (int height = 12; height <= 90; height += 5)
+            for (int flags = 0; flags < 4; flags++)
+                for (int level = 0; level < 9; level++)
+                {
+                    PreprocessOptions options = { (flags & 1) != 0, level,
+                                                  (flags & 2) != 0, false, 0 };
+                    int w, h;
+                    Preprocess::size( options, width, height, w, h );
+                    if (w < 1 || h < 1)
+                        continue;
+                    ImageView view = { &pixels[0], width, height };
+                    int frameW, frameH;
+                    bool ownsBuffer;
+                    uchar *buffer = Preprocess::frame( view, "", options,
+                                                       frameW, frameH,
+                                                       ownsBuffer );
+                    if (ownsBuffer)
+                        delete [] buffer;
+                    CHECK( w == frameW && h == frameH );
+                }
+}
+
+// Frames of the size checks, and the status the library returns for them.
+struct SizeCase
+{
+    int width;
+    int height;
+    int flags;
+    int pyramidLevel;
+    int libraryError;
+};
+
+static const SizeCase SIZE_CASES[] =
+{
+    { 2, 2, 0, 0, FOCUS_ERROR_SIZE },
+    { 3, 3, 0, 0, FOCUS_ERROR_SIZE },
+    { 4, 4, 0, 0, FOCUS_OK },
+    { 4, 4, FOCUS_SCALE_HALF, 0, FOCUS_ERROR_SIZE },
+    { 4, 4, FOCUS_CROP, 0, FOCUS_ERROR_SIZE },
+    { 20, 12, FOCUS_CROP, 0, FOCUS_OK },
+    { 64, 64, 0, 4, FOCUS_OK },
+    { 64, 64, 0, 5, FOCUS_ERROR_SIZE },
+    { 64, 64, 0, 6, FOCUS_ERROR_SIZE },
+    { 64, 64, 0, 0x7fffffff, FOCUS_ERROR_SIZE },
+    { 100, 60, FOCUS_CROP, 0, FOCUS_OK }
+};
+
+static vector<uchar>
+test_frame( int w, int h )
+{
+    vector<uchar> frame( w * h );
+    for (int i = 0; i < w * h; i++)
+        frame[i] = (i * 37) & 255;
+    return frame;
+}
+
+static void
+test_library_sizes( vector<double> &values )
+{
+    const int measures[3] = { 0, 15, 27 };
+    int cases = sizeof( SIZE_CASES ) / sizeof( SIZE_CASES[0] );
+    values.clear();
+    for (int c = 0; c < cases; c++)
+    {
+        const SizeCase &s = SIZE_CASES[c];
+        vector<uchar> frame = test_frame( s.width, s.height );
+        const uchar *frames[1] = { &frame[0] };
+        double result[3] = { 0, 0, 0 };
+        int error = focus_measure_batch( frames, 1, s.width, s.height,
+                                         measures, 3, s.flags,
+                                         s.pyramidLevel, result );
+        if (!CHECK( error == s.libraryError ))
+            cerr << "library, case " << c << ": " << error << endl;
+        values.insert( values.end(), result, result + 3 );
+    }
+
+    const uchar *frames[1] = { NULL };
+    double result[3];
+    CHECK( focus_measure_batch( frames, 1, 8, 8, measures, 3, 0, 0,
+                                result ) == FOCUS_ERROR_ARGUMENT );
+    CHECK( focus_measure_batch( frames, 1, 8, 8, measures, 3, 0, -1,
+                                result ) == FOCUS_ERROR_ARGUMENT );
+
+    // More values than an int numbers are refused before any is measured.
+    vector<uchar> frame = test_frame( 8, 8 );
+    vector<const uchar *> many( 1 << 16, &frame[0] );
+    vector<int> manyMeasures( 1 << 15, 0 );
+    CHECK( (int64_t)many.size() * manyMeasures.size() > INT_MAX );
+    CHECK( focus_measure_batch( &many[0], many.size(), 8, 8, &manyMeasures[0],
+                                manyMeasures.size(), 0, 0,
+                                result ) == FOCUS_ERROR_ARGUMENT );
+}
+
+/*
+ *  Values stored in the cache are found again, by several threads at
+ *  once, and the counts, eviction and clearing agree with them.
+ */
+static void
+test_focus_cache( const string &dir )
+{
+    FocusCache cache;
+    CHECK( !cache.isOpen() );
+    if (!CHECK( cache.open( dir + "/cache/values/" ) ))
+        return;
+    CHECK( cache.directory() == dir + "/cache/values" );
+
+    // Keys depend on the pixels, the size and the options.
+    vector<uchar> frame = test_frame( 64, 48 );
+    FocusCache::Key key = FocusCache::frameKey( &frame[0], 64, 48, "" );
+    FocusCache::Key same = FocusCache::frameKey( &frame[0], 64, 48, "" );
+    FocusCache::Key resized = FocusCache::frameKey( &frame[0], 48, 64, "" );
+    FocusCache::Key cropped = FocusCache::frameKey( &frame[0], 64, 48,
+                                                    "crop" );
+    frame[100]++;
+    FocusCache::Key changed = FocusCache::frameKey( &frame[0], 64, 48, "" );
+    CHECK( memcmp( &key, &same, sizeof( key ) ) == 0 );
+    CHECK( memcmp( &key, &resized, sizeof( key ) ) != 0 );
+    CHECK( memcmp( &key, &cropped, sizeof( key ) ) != 0 );
+    CHECK( memcmp( &key, &changed, sizeof( key ) ) != 0 );
+
+    vector<int> measures;
+    measures.push_back( 3 );
+    measures.push_back( 7 );
+    measures.push_back( 9 );
+    vector<double> values;
+    vector<bool> found;
+    CHECK( cache.lookup( key, measures, values, found ) == 0 );
+
+    vector< pair<int, double> > stored;
+    stored.push_back( make_pair( 3, 0.25 ) );
+    stored.push_back( make_pair( 7, -1e300 ) );
+    CHECK( cache.store( key, stored ) );
+    CHECK( cache.lookup( key, measures, values, found ) == 2 );
+    CHECK( found[0] && found[1] && !found[2] );
+    CHECK( values[0] == 0.25 && values[1] == -1e300 );
+    CHECK( cache.lookup( changed, measures, values, found ) == 0 );
+
+    // A record cut short (by a crash) is ignored, the others still found.
+    char name[40];
+    snprintf( name, sizeof( name ), "%016llx%016llx",
+              (unsigned long long)key.hash[0],
+              (unsigned long long)key.hash[1] );
+    string fileName = cache.directory() + "/" + string( name, 2 ) + "/" + name;
+    FILE *fp = fopen( fileName.c_str(), "ab" );
+    if (CHECK( fp != NULL ))
+    {
+        fwrite( "cut", 1, 3, fp );
+        fclose( fp );
+    }
+    CHECK( cache.lookup( key, measures, values, found ) == 2 );
+
+    // Threads storing and looking up the values of their own frames and
+    // of a frame they all share.
+    const int threads = 8, frames = 40;
+    atomic<int> wrong( 0 );
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.push_back( thread( [&, t]
+        {
+            for (int f = 0; f < frames; f++)
+            {
+                vector<uchar> pixels = test_frame( 16 + t, 16 + f );
+                FocusCache::Key own = FocusCache::frameKey( &pixels[0],
+                                                            16 + t, 16 + f,
+                                                            "" );
+                vector< pair<int, double> > one( 1, make_pair( t, t + f ) );
+                vector<int> which( 1, t );
+                vector<double> got;
+                vector<bool> there;
+                if (!cache.store( own, one ) ||
+                    cache.lookup( own, which, got, there ) != 1 ||
+                    got[0] != t + f)
+                    wrong++;
+                if (!cache.store( changed, one ) ||
+                    cache.lookup( changed, which, got, there ) != 1 ||
+                    got[0] != t + f)
+                    wrong++;
+            }
+        } ) );
+    for (int t = 0; t < threads; t++)
+        workers[t].join();
+    CHECK( wrong == 0 );
+    measures.clear();
+    for (int t = 0; t < threads; t++)
+        measures.push_back( t );
+    // The last value stored for a measure is the one found.
+    CHECK( cache.lookup( changed, measures, values, found ) == threads );
+    for (int t = 0; t < threads; t++)
+        CHECK( values[t] == t + frames - 1 );
+
+    // 4 lookups of 3 measures, 2 per frame of each thread, 1 of them all.
+    FocusCache::Stats run = cache.runStats();
+    CHECK( run.hits == 2 + 2 + 2 * threads * frames + threads );
+    CHECK( run.misses == 3 + 1 + 3 + 1 );
+    CHECK( run.stores == 2 + 2 * threads * frames );
+    CHECK( cache.saveStats() );
+    CHECK( cache.runStats().hits == 0 );
+
+    FocusCache::Stats total;
+    CHECK( cache.stats( total ) );
+    CHECK( total.hits == run.hits && total.stores == run.stores );
+    CHECK( total.files == 2 + (uint64_t)threads * frames );
+    CHECK( total.bytes > 0 );
+
+    // Eviction leaves a cache within its limit alone, and empties a cache
+    // over a limit of nothing.
+    CHECK( cache.evict( total.bytes ) == 0 );
+    CHECK( cache.evict( 0 ) == total.files );
+    CHECK( cache.stats( total ) && total.files == 0 && total.bytes == 0 );
+    CHECK( cache.runStats().evictions == 2 + (uint64_t)threads * frames );
+    CHECK( cache.lookup( key, measures, values, found ) == 0 );
+
+    CHECK( cache.store( key, stored ) );
+    CHECK( cache.clear() );
+    CHECK( cache.lookup( key, measures, values, found ) == 0 );
+}
+
+static void
+put32( vector<uchar> &message, uint32_t value )
+{
+    for (int i = 0; i < 4; i++)
+        message.push_back( value >> (8 * i) );
+}
+
+static uint32_t
+get32( const vector<uchar> &message, size_t offset )
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--)
+        value = (value << 8) | message[offset + i];
+    return value;
+}
+
+/*
+ *  The same frames sent to focusd : it answers each of them (the frames
+ *  too small for the library are bad frames, the pyramid levels above
+ *  16 bad requests) with the values of the library.
+ */
+static void
+test_daemon_sizes( const string &dir, const vector<double> &libraryValues )
+{
+    int cases = sizeof( SIZE_CASES ) / sizeof( SIZE_CASES[0] );
+    vector<uchar> requests;
+    for (int c = 0; c < cases; c++)
+    {
+        const SizeCase &s = SIZE_CASES[c];
+        vector<uchar> frame = test_frame( s.width, s.height );
+        vector<uchar> request;
+        put32( request, FocusMeasureRequest );
+        put32( request, c );
+        put32( request, s.width );
+        put32( request, s.height );
+        put32( request, (s.flags & FOCUS_SCALE_HALF ? FocusScaleHalf : 0) |
+                        (s.flags & FOCUS_CROP ? FocusCrop : 0) );
+        put32( request, s.pyramidLevel );
+        put32( request, 3 );
+        put32( request, 0 );
+        put32( request, 15 );
+        put32( request, 27 );
+        request.insert( request.end(), frame.begin(), frame.end() );
+        put32( requests, request.size() );
+        requests.insert( requests.end(), request.begin(), request.end() );
+    }
+
+    string in = dir + "/requests", out = dir + "/replies";
+    CHECK( write_file( in, &requests[0], requests.size() ) );
+    string command = "./focusd.exe --no-cache < " + in + " > " + out;
+    CHECK( system( command.c_str() ) == 0 );
+
+    vector<uchar> replies;
+    CHECK( read_file( out, replies ) );
+    size_t offset = 0;
+    int c = 0;
+    for (; offset + 16 <= replies.size() && c < cases; c++)
+    {
+        const SizeCase &s = SIZE_CASES[c];
+        uint32_t length = get32( replies, offset );
+        uint32_t status = get32( replies, offset + 4 );
+        CHECK( get32( replies, offset + 8 ) == (uint32_t)c );
+        uint32_t expected = s.libraryError == FOCUS_OK ? FocusOk :
+            s.pyramidLevel > Preprocess::maxPyramidLevel ? FocusBadRequest :
+            FocusBadFrame;
+        if (!CHECK( status == expected ))
+            cerr << "focusd, case " << c << ": " << status << endl;
+        if (status == FocusOk && CHECK( length == 12 + 3 * 8 ))
+            CHECK( memcmp( &replies[offset + 16], &libraryValues[3 * c],
+                           3 * 8 ) == 0 );
+        offset += 4 + length;
+    }
+    CHECK( c == cases && offset == replies.size() );
+}
+
+static bool
+send_fully( int fd, const vector<uchar> &data )
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = write( fd, &data[sent], data.size() - sent );
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+static bool
+receive_fully( int fd, vector<uchar> &data, size_t size )
+{
+    data.resize( size );
+    size_t received = 0;
+    while (received < size)
+    {
+        ssize_t n = read( fd, &data[received], size - received );
+        if (n <= 0)
+            return false;
+        received += n;
+    }
+    return true;
+}
+
+/*
+ *  Shared frames truncated by their client while focusd reads them : every
+ *  request gets an answer (the frame or a bad frame), and the daemon
+ *  still answers afterwards.
+ */
+static void
+test_daemon_truncation( const string &dir )
+{
+    const int width = 2048, height = 2048, requests = 200;
+    string fileName = dir + "/shared.gray";
+    vector<uchar> frame = test_frame( width, height );
+    CHECK( write_file( fileName, &frame[0], frame.size() ) );
+
+    // A daemon that died fails the checks, rather than the tests.
+    signal( SIGPIPE, SIG_IGN );
+    int toDaemon[2], fromDaemon[2];
+    if (!CHECK( pipe( toDaemon ) == 0 && pipe( fromDaemon ) == 0 ))
+        return;
+    pid_t daemon = fork();
+    if (daemon == 0)
+    {
+        dup2( toDaemon[0], 0 );
+        dup2( fromDaemon[1], 1 );
+        close( toDaemon[1] );
+        close( fromDaemon[0] );
+        execl( "./focusd.exe", "focusd.exe", "--no-cache", (char *)NULL );
+        _exit( 127 );
+    }
+    close( toDaemon[0] );
+    close( fromDaemon[1] );
+
+    atomic<bool> done( false ), truncated( true );
+    thread truncator( [&]
+    {
+        while (!done)
+        {
+            if (truncate( fileName.c_str(), frame.size() / 4 ) != 0 ||
+                truncate( fileName.c_str(), frame.size() ) != 0)
+                truncated = false;
+            usleep( 1000 );
+        }
+    } );
+
+    vector<uchar> request, reply;
+    int answered = 0;
+    for (int r = 0; r < requests; r++)
+    {
+        request.clear();
+        put32( request, 0 );
+        put32( request, FocusMeasureSharedRequest );
+        put32( request, r );
+        put32( request, width );
+        put32( request, height );
+        put32( request, 0 );
+        put32( request, 0 );
+        put32( request, 1 );
+        put32( request, 0 );
+        request.insert( request.end(), 8, 0 );
+        put32( request, fileName.length() );
+        request.insert( request.end(), fileName.begin(), fileName.end() );
+        uint32_t length = request.size() - 4;
+        memcpy( &request[0], &length, 4 );
+        if (!send_fully( toDaemon[1], request ) ||
+            !receive_fully( fromDaemon[0], reply, 16 ))
+            break;
+        uint32_t status = get32( reply, 4 );
+        CHECK( status == FocusOk || status == FocusBadFrame );
+        CHECK( get32( reply, 8 ) == (uint32_t)r );
+        if (!receive_fully( fromDaemon[0], reply, get32( reply, 0 ) - 12 ))
+            break;
+        answered++;
+    }
+    done = true;
+    truncator.join();
+    CHECK( truncated );
+    CHECK( answered == requests );
+
+    request.clear();
+    put32( request, 8 );
+    put32( request, FocusListRequest );
+    put32( request, requests );
+    CHECK( send_fully( toDaemon[1], request ) &&
+           receive_fully( fromDaemon[0], reply, 16 ) &&
+           get32( reply, 4 ) == FocusOk );
+
+    close( toDaemon[1] );
+    close( fromDaemon[0] );
+    int status;
+    CHECK( waitpid( daemon, &status, 0 ) == daemon && WIFEXITED( status ) &&
+           WEXITSTATUS( status ) == 0 );
+}
+
+int
+main( int argc, char *argv[] )
+{
+    char dirName[] = "/tmp/focustests.XXXXXX";
+    if (mkdtemp( dirName ) == NULL)
+    {
+        perror( "mkdtemp" );
+        exit( 1 );
+    }
+    string dir( dirName );
+
+    test_philox();
+    test_thread_pool();
+
+    vector< vector<uchar> > frames( SCENE_FRAMES );
+    for (int k = 0; k < SCENE_FRAMES; k++)
+    {
+        scene_frame( k, frames[k] );
+        char name[32];
+        snprintf( name, sizeof( name ), "/frame%d.gray", k );
+        CHECK( write_file( dir + name, &frames[k][0], frames[k].size() ) );
+    }
+    test_sweep_round_trip( dir, frames, false );
+    test_sweep_round_trip( dir, frames, true );
+    test_apply( dir, frames );
+
+    test_curve_store( dir );
+    test_peak_detector();
+    test_focus_cache( dir );
+    test_preprocess_size();
+
+    vector<double> libraryValues;
+    test_library_sizes( libraryValues );
+    test_daemon_sizes( dir, libraryValues );
+    test_daemon_truncation( dir );
+
+    string command = "rm -rf " + dir;
+    if (system( command.c_str() ) != 0)
+        cerr << "Could not remove " << dir << endl;
+
+    printf( "%d checks, %d failed\n", checks, failures );
+    return( failures > 0 ? 1 : 0 );
+}
@@ -0,0 +1,183 @@
+#include "threadPool.h"
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+
+using namespace std;
+
+// Set in threads running chunks of a loop (workers, and the calling thread
+// while it helps), so that nested loops don't wait on themselves.
+static thread_local bool insideLoop = false;
+
+int
+ThreadPool::defaultSize()
+{
+	const char *env = getenv( "FOCUS_THREADS" );
+	if ( env != NULL && atoi( env ) > 0 )
+		return atoi( env );
+
+	int cores = thread::hardware_concurrency();
+	return cores > 0 ? cores : 1;
+}
+
+ThreadPool::ThreadPool( int threads )
+	: stopping( false ), body( NULL ), loopEnd( 0 ), chunkSize( 1 ),
+	  nextChunk( 0 ), busyWorkers( 0 ), generation( 0 )
+{
+	if ( threads <= 0 )
+		threads = defaultSize();
+
+	for (int i = 1; i < threads; i++)
+		workers.push_back( thread( &ThreadPool::workerLoop, this ) );
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		unique_lock<std::mutex> lock( mutex );
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+ThreadPool &
+ThreadPool::global()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void
+ThreadPool::parallelFor( int begin, int end,
+						 const function<void(int, int)> &loopBody,
+						 int grain )
+{
+	if ( end <= begin )
+		return;
+
+	int threads = size();
+	if ( threads == 1 || insideLoop || end - begin <= grain )
+	{
+		loopBody( begin, end );
+		return;
+	}
+
+	lock_guard<std::mutex> loopLock( loopMutex );
+
+	// A few chunks per thread so that uneven rows still balance out.
+	int chunk = max( grain, (end - begin + 4 * threads - 1) / (4 * threads) );
+
+	{
+		unique_lock<std::mutex> lock( mutex );
+		body = &loopBody;
+		nextChunk = begin;
+		loopEnd = end;
+		chunkSize = chunk;
+		busyWorkers = workers.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	insideLoop = true;
+	runChunks();
+	insideLoop = false;
+
+	unique_lock<std::mutex> lock( mutex );
+	done.wait( lock, [this] { return busyWorkers == 0; } );
+	body = NULL;
+}
+
+void
+ThreadPool::runTasks( int count, const function<void(int)> &task )
+{
+	if ( count <= 0 )
+		return;
+
+	int threads = min( size(), count );
+	vector<TaskRange> ranges( threads );
+	for (int t = 0; t < threads; t++)
+	{
+		ranges[t].front = (int64_t)count * t / threads;
+		ranges[t].back = (int64_t)count * (t + 1) / threads;
+	}
+
+	// One chunk per range; whichever thread picks up a range owns it.
+	parallelFor( 0, threads, [&]( int first, int last )
+	{
+		for (int t = first; t < last; t++)
+			runTaskRanges( ranges, t, task );
+	} );
+}
+
+void
+ThreadPool::runTaskRanges( vector<TaskRange> &ranges, int own,
+						   const function<void(int)> &task )
+{
+	int threads = ranges.size();
+	for (;;)
+	{
+		// Own tasks are taken from the front, in order, stolen tasks from
+		// the back of their range.
+		int next = -1;
+		{
+			lock_guard<std::mutex> lock( ranges[own].lock );
+			if ( ranges[own].front < ranges[own].back )
+				next = ranges[own].front++;
+		}
+
+		for (int i = 1; next < 0 && i < threads; i++)
+		{
+			TaskRange &victim = ranges[(own + i) % threads];
+			lock_guard<std::mutex> lock( victim.lock );
+			if ( victim.front < victim.back )
+				next = --victim.back;
+		}
+
+		if ( next < 0 )
+			return;
+		task( next );
+	}
+}
+
+void
+ThreadPool::runChunks()
+{
+	for (;;)
+	{
+		int chunkBegin;
+		{
+			unique_lock<std::mutex> lock( mutex );
+			if ( nextChunk >= loopEnd )
+				return;
+			chunkBegin = nextChunk;
+			nextChunk = min( loopEnd, nextChunk + chunkSize );
+		}
+		(*body)( chunkBegin, min( loopEnd, chunkBegin + chunkSize ) );
+	}
+}
+
+void
+ThreadPool::workerLoop()
+{
+	insideLoop = true;
+	unsigned seen = 0;
+
+	for (;;)
+	{
+		{
+			unique_lock<std::mutex> lock( mutex );
+			wake.wait( lock, [&] { return stopping || generation != seen; } );
+			if ( stopping )
+				return;
+			seen = generation;
+		}
+
+		runChunks();
+
+		unique_lock<std::mutex> lock( mutex );
+		if ( --busyWorkers == 0 )
+			done.notify_one();
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef _ThreadPool_H
+#define _ThreadPool_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A fixed set of worker threads used to split loops over rows, pixels or
+ * files. The thread calling parallelFor also takes part in the work.
+ */
+class ThreadPool
+{
+public:
+	/*
+	 * Create a pool with the given number of threads (including the calling
+	 * thread). 0 means one thread per core, unless the environment variable
+	 * FOCUS_THREADS says otherwise.
+	 */
+	ThreadPool( int threads = 0 );
+	~ThreadPool();
+
+	int size() const { return workers.size() + 1; }
+
+	/*
+	 * Split [begin, end) into chunks of at least grain elements and call
+	 * body(chunkBegin, chunkEnd) on each of them. Returns once every chunk
+	 * has been processed. Calls made from inside a worker run serially.
+	 */
+	void parallelFor( int begin, int end,
+					  const std::function<void(int, int)> &body,
+					  int grain = 1 );
+
+	/*
+	 * Call task(i) for every i in [0, count). With n the smaller of size()
+	 * and count, thread t starts with the tasks [count * t / n,
+	 * count * (t + 1) / n), in order; a thread that runs out of tasks
+	 * steals from the end of another thread's block, so tasks whose costs
+	 * differ widely still keep every thread busy. Calls made from inside a
+	 * worker run serially.
+	 */
+	void runTasks( int count, const std::function<void(int)> &task );
+
+	/*
+	 * Pool shared by the image operations.
+	 */
+	static ThreadPool & global();
+
+	/*
+	 * Number of threads to use when none was specified.
+	 */
+	static int defaultSize();
+
+private:
+	// Tasks [front, back) not started yet by one thread of runTasks().
+	struct TaskRange
+	{
+		std::mutex lock;
+		int front;
+		int back;
+	};
+
+	void workerLoop();
+	void runChunks();
+	static void runTaskRanges( std::vector<TaskRange> &ranges, int own,
+							   const std::function<void(int)> &task );
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool stopping;
+
+	// The loop being executed. Only one loop runs at a time.
+	std::mutex loopMutex;
+	const std::function<void(int, int)> *body;
+	int loopEnd;
+	int chunkSize;
+	int nextChunk;
+	int busyWorkers;
+	unsigned generation;
+};
+
+#endif